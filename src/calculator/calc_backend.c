@@ -2,6 +2,7 @@
 
 #include "../util/allocator.h"
 #include "../util/prettify_c.h"
+#include "calc_frame.h"
 #include "func_const_ctx.h"
 #include "native_functions.h"
 
@@ -10,93 +11,164 @@
 #define VECTOR_ITEM_CLONE calc_backend_clone
 #include "../util/vector.h"
 
-typedef struct XyValuesContext {
-  double x;
-  double y;
-  ExprContext parent;
-} XyValuesContext;
+#define VECTOR_C CalcExprMemo
+#define VECTOR_ITEM_DESTRUCTOR calc_expr_memo_free
+#include "../util/vector.h"
 
-ExprValueResult xy_get_variable_val(XyValuesContext* this, StrSlice name);
-ExprValueResult xy_call_function(XyValuesContext* this, StrSlice name,
-                                 vec_ExprValue* args);
-/*
-  // Parsing
-  bool (*is_variable)(void* this, StrSlice var_name);
-  bool (*is_function)(void* this, StrSlice fun_name);
+// =====
+// =
+// BASICS
+// =
+// =====
+static void calc_backend_index_expr(CalcBackend* this, int index);
+static void calc_backend_index_value(CalcBackend* this, int index);
+static void calc_backend_unindex_exprs(CalcBackend* this);
+static void calc_backend_reset_memo(CalcBackend* this);
+static int calc_backend_find_expr(const CalcBackend* this,
+                                  const SymbolMap* index, Symbol name);
+
+static int calc_backend_find_native(Symbol name);
+static CalcBackend* calc_backend_find_function(CalcBackend* this,
+                                               Symbol name, int* index);
+static CalcBackend* calc_backend_find_variable(CalcBackend* this,
+                                               Symbol name, int* index);
+static bool calc_backend_memo_is_const(CalcBackend* this, int index);
+static int calc_backend_memo_call_id(CalcBackend* this, int index);
+static ExprValueResult calc_backend_memo_value(CalcBackend* this, int index);
+static const Expr* calc_backend_memo_body(CalcBackend* this, int index);
+static ExprType calc_backend_memo_type(CalcBackend* this, int index);
+static const CalcScalarCode* calc_backend_memo_scalar(CalcBackend* this,
+                                                      int index);
+static bool calc_backend_number_args(const ExprValue* argument, int count,
+                                     double* into);
 
-  // Computation
-  ExprValueResult (*get_variable_val)(void*, StrSlice);
-  ExprValueResult (*call_function)(void*, StrSlice, vec_ExprValue*);
+void calc_backend_free(CalcBackend this) {
+  vec_CalcExpr_free(this.expressions);
+  vec_CalcValue_free(this.values);
+  vec_CalcExprMemo_free(this.memo);
+  symbol_map_free(this.values_index);
+  symbol_map_free(this.variables_index);
+  symbol_map_free(this.functions_index);
+  calc_call_cache_free(this.call_cache);
+}
 
-  // Anasysis and compilation
-  bool (*is_expr_const)(void* this, const Expr* expr);
-  int (*get_expr_type)(void* this, const Expr* expr);
+CalcBackend calc_backend_clone(const CalcBackend* this) {
+  CalcBackend result = {
+      .parent = this->parent,
+      .expressions = vec_CalcExpr_clone(&this->expressions),
+      .values = vec_CalcValue_clone(&this->values),
+      .memo = vec_CalcExprMemo_with_capacity(this->expressions.length),
+      .values_index = symbol_map_create(),
+      .variables_index = symbol_map_create(),
+      .functions_index = symbol_map_create(),
+      .visible_count = -1,
+      .call_cache = calc_call_cache_create(this->call_cache.capacity),
+      .last_call_id = 0,
+  };
 
-  ExprVariableInfo (*get_variable_info)(void* this, StrSlice var_name);
-  ExprFunctionInfo (*get_function_info)(void* this, StrSlice fun_name);
-*/
+  // Maps are not shared, so clone builds its own index
+  for (int i = 0; i < result.values.length; i++)
+    calc_backend_index_value(&result, i);
+  for (int i = 0; i < result.expressions.length; i++) {
+    calc_backend_index_expr(&result, i);
+    vec_CalcExprMemo_push(&result.memo, (CalcExprMemo){0});
+  }
 
-ExprValueResult calc_calculate_expr(const char* text, double x, double y) {
-  static const ExprContextVtable XY_CTX_VTABLE = {
-      .get_expr_type = null,
-      .get_variable_info = null,
-      .get_function_info = null,
-      .is_variable = null,
-      .is_function = null,
+  return result;
+}
 
-      .get_variable_val = (ExprValueResult (*)(void*, StrSlice))xy_get_variable_val,
-      .call_function = (ExprValueResult (*)(void*,StrSlice,vec_ExprValue*))xy_call_function,
-  };
+// New names may change the meaning of already added expressions, so every
+// addition drops all cached results
+void calc_backend_push_expr(CalcBackend* this, CalcExpr expr) {
+  calc_backend_reset_memo(this);
 
-  CalcBackend backend = calc_backend_create();
-  ExprContext ctx = calc_backend_get_context(&backend);
+  vec_CalcExpr_push(&this->expressions, expr);
+  vec_CalcExprMemo_push(&this->memo, (CalcExprMemo){0});
+  calc_backend_index_expr(this, this->expressions.length - 1);
+}
 
-  ExprResult expr = expr_parse_string(text, ctx);
-  ExprValueResult result;
-  if (not expr.is_ok) {
-    result = ExprValueErr(expr.err_pos, expr.err_text);
-  } else {
-    XyValuesContext xy_ctx = {.x = x, .y = y, .parent = ctx};
-    ExprContext local_ctx = {.data = &xy_ctx, .vtable = &XY_CTX_VTABLE};
+void calc_backend_push_value(CalcBackend* this, CalcValue value) {
+  calc_backend_reset_memo(this);
 
-    result = expr_calculate(&expr.ok, local_ctx);
-    expr_free(expr.ok);
-  }
+  vec_CalcValue_push(&this->values, value);
+  calc_backend_index_value(this, this->values.length - 1);
+}
 
-  calc_backend_free(backend);
-  return result;
+void calc_backend_insert_expr(CalcBackend* this, int index, CalcExpr expr) {
+  assert_m(index >= 0 and index <= this->expressions.length);
+
+  calc_backend_unindex_exprs(this);
+  vec_CalcExpr_insert(&this->expressions, expr, index);
+  vec_CalcExprMemo_insert(&this->memo, (CalcExprMemo){0}, index);
+
+  for (int i = 0; i < this->expressions.length; i++)
+    calc_backend_index_expr(this, i);
 }
 
-ExprValueResult xy_get_variable_val(XyValuesContext* this, StrSlice name) {
-  if (str_slice_eq_ccp(name, "x")) {
-    ExprValue val = {.type = EXPR_VALUE_NUMBER, .number = this->x};
-    return ExprValueOk(val);
-  } else if (str_slice_eq_ccp(name, "y")) {
-    ExprValue val = {.type = EXPR_VALUE_NUMBER, .number = this->y};
-    return ExprValueOk(val);
-  } else
-    return this->parent.vtable->get_variable_val(this->parent.data, name);
+void calc_backend_remove_expr(CalcBackend* this, int index) {
+  assert_m(index >= 0 and index < this->expressions.length);
+
+  calc_backend_unindex_exprs(this);
+  vec_CalcExpr_delete_order(&this->expressions, index);
+  vec_CalcExprMemo_delete_order(&this->memo, index);
+
+  for (int i = 0; i < this->expressions.length; i++)
+    calc_backend_index_expr(this, i);
 }
 
-ExprValueResult xy_call_function(XyValuesContext* this, StrSlice name,
-                                 vec_ExprValue* args) {
-  return this->parent.vtable->call_function(this->parent.data, name, args);
+// Its results in the call cache are not found again, since the memo gets a
+// new `call_id`
+void calc_backend_reset_expr_memo(CalcBackend* this, int index) {
+  assert_m(index >= 0 and index < this->memo.length);
+
+  calc_expr_memo_free(this->memo.data[index]);
+  this->memo.data[index] = (CalcExprMemo){0};
 }
 
-// =====
-// =
-// BASICS
-// =
-// =====
-void calc_backend_free(CalcBackend this) {
-  vec_CalcExpr_free(this.expressions);
-  vec_CalcValue_free(this.values);
+void calc_expr_memo_free(CalcExprMemo this) {
+  if (this.has_body) expr_free(this.body);
+  if (this.is_scalar) calc_scalar_free(this.scalar);
+  if (not this.has_value) return;
+
+  if (this.value.is_ok)
+    expr_value_free(this.value.ok);
+  else
+    str_free(this.value.err_text);
 }
 
-CalcBackend calc_backend_clone(const CalcBackend* this) {
-  return (CalcBackend){.parent = this->parent,
-                       .expressions = vec_CalcExpr_clone(&this->expressions),
-                       .values = vec_CalcValue_clone(&this->values)};
+static void calc_backend_reset_memo(CalcBackend* this) {
+  calc_call_cache_clear(&this->call_cache);
+  for (int i = 0; i < this->memo.length; i++) {
+    calc_expr_memo_free(this->memo.data[i]);
+    this->memo.data[i] = (CalcExprMemo){0};
+  }
+}
+
+static void calc_backend_index_expr(CalcBackend* this, int index) {
+  CalcExpr* item = &this->expressions.data[index];
+
+  if (item->type is CALC_EXPR_VARIABLE)
+    symbol_map_insert(&this->variables_index, item->variable_name, index);
+  else if (item->type is CALC_EXPR_FUNCTION)
+    symbol_map_insert(&this->functions_index, item->function.name, index);
+}
+
+static void calc_backend_index_value(CalcBackend* this, int index) {
+  CalcValue* item = &this->values.data[index];
+  symbol_map_insert(&this->values_index, item->name, index);
+}
+
+// Insertion or removal shifts the indices after it, and another definition
+// of the same name may win then, so all the expressions are indexed again
+static void calc_backend_unindex_exprs(CalcBackend* this) {
+  for (int i = 0; i < this->expressions.length; i++) {
+    CalcExpr* item = &this->expressions.data[i];
+
+    if (item->type is CALC_EXPR_VARIABLE)
+      symbol_map_remove(&this->variables_index, item->variable_name);
+    else if (item->type is CALC_EXPR_FUNCTION)
+      symbol_map_remove(&this->functions_index, item->function.name);
+  }
 }
 
 // =====
@@ -116,13 +188,20 @@ CalcBackend calc_backend_create() {
       .parent = null,
       .expressions = vec_CalcExpr_create(),
       .values = vec_CalcValue_with_capacity(LEN(values)),
+      .memo = vec_CalcExprMemo_create(),
+      .values_index = symbol_map_create(),
+      .variables_index = symbol_map_create(),
+      .functions_index = symbol_map_create(),
+      .visible_count = -1,
+      .call_cache = calc_call_cache_create(CALC_CALL_CACHE_SIZE),
+      .last_call_id = 0,
   };
 
   assert_m(LEN(names) == LEN(values));
   for (int i = 0; i < (int)LEN(values); i++)
-    vec_CalcValue_push(
-        &result.values,
-        (CalcValue){.name = str_literal(names[i]),
+    calc_backend_push_value(
+        &result,
+        (CalcValue){.name = symbol_intern(str_slice_from_string(names[i])),
                     .value = {.type = EXPR_VALUE_NUMBER, .number = values[i]}});
 
   return result;
@@ -134,66 +213,47 @@ CalcBackend calc_backend_create() {
 // =
 // =====
 
+// Every variable and function in the tree has to be const
 bool calc_backend_is_expr_const(const CalcBackend* this, const Expr* expr) {
-  bool result = false;
-
-  if (expr->type is EXPR_VARIABLE) {
-    result = calc_backend_is_var_const(this, expr->variable.name.string);
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = expr});
 
-  } else if (expr->type is EXPR_NUMBER) {
-    result = true;
+  bool result = true;
+  while (result and stack.length > 0) {
+    const Expr* node = vec_ExprStep_popget(&stack).expr;
 
-  } else if (expr->type is EXPR_VECTOR) {
-    result = true;
-    for (int i = 0; i < expr->vector.arguments.length; i++)
-      result = result and calc_backend_is_expr_const(
-                              this, &expr->vector.arguments.data[i]);
+    if (node->type is EXPR_VARIABLE)
+      result = calc_backend_is_var_const_symbol(this, node->variable.name);
+    else if (node->type is EXPR_FUNCTION)
+      result = calc_backend_is_func_const_symbol(this, node->function.name);
 
-  } else if (expr->type is EXPR_BINARY_OP) {
-    result = calc_backend_is_expr_const(this, expr->binary_operator.lhs) and
-             calc_backend_is_expr_const(this, expr->binary_operator.rhs);
-
-  } else if (expr->type is EXPR_FUNCTION) {
-    result = calc_backend_is_func_const(this, expr->function.name.string) and
-             calc_backend_is_expr_const(this, expr->function.argument);
-
-  } else {
-    panic("Unknown expr type");
+    const Expr* child;
+    for (int i = 0; result and (child = expr_child(node, i)); i++)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
   }
 
+  vec_ExprStep_free(stack);
   return result;
 }
 
 bool calc_backend_is_func_const(const CalcBackend* this, const char* name) {
-  StrSlice slice = str_slice_from_string(name);
-  return calc_backend_is_func_const_sslice(this, slice);
+  Symbol symbol = symbol_find(str_slice_from_string(name));
+  return calc_backend_is_func_const_symbol(this, symbol);
 }
 
 bool calc_backend_is_var_const(const CalcBackend* this, const char* name) {
-  StrSlice slice = str_slice_from_string(name);
-  return calc_backend_is_var_const_sslice(this, slice);
+  Symbol symbol = symbol_find(str_slice_from_string(name));
+  return calc_backend_is_var_const_symbol(this, symbol);
 }
 
-bool calc_backend_is_func_const_sslice(const CalcBackend* this, StrSlice name) {
-  if (calculator_get_native_function(name)) return true;
-
-  CalcExpr* expr = calc_backend_get_function_sslice((CalcBackend*)this, name);
-  if (expr) {
-    ExprContext ctx =
-        calc_backend_get_fun_context_sslice((CalcBackend*)this, name);
-    assert_m(ctx.data);
-    FuncConstCtx func_ctx = {
-        .parent = ctx,
-        .used_args = &expr->function.args,
-        .are_const = true,
-    };
+bool calc_backend_is_func_const_symbol(const CalcBackend* this, Symbol name) {
+  if (calc_backend_find_native(name) >= 0) return true;
 
-    ExprContext total_ctx = func_const_ctx_context(&func_ctx);
+  int index;
+  CalcBackend* owner =
+      calc_backend_find_function((CalcBackend*)this, name, &index);
 
-    return total_ctx.vtable->is_expr_const(total_ctx.data, &expr->expression);
-  } else {
-    return false;
-  }
+  return owner and calc_backend_memo_is_const(owner, index);
 }
 
 bool calc_backend_is_func_const_ptr(const CalcBackend* this, CalcExpr* expr) {
@@ -222,20 +282,14 @@ bool calc_backend_is_func_const_ptr(const CalcBackend* this, CalcExpr* expr) {
   }
 }
 
-bool calc_backend_is_var_const_sslice(const CalcBackend* this, StrSlice name) {
-  if (calc_backend_get_value_sslice((CalcBackend*)this, name)) {
-    return true;
-  } else {
-    CalcExpr* expr = calc_backend_get_variable_sslice((CalcBackend*)this, name);
-    if (expr) {
-      ExprContext ctx =
-          calc_backend_get_var_context_sslice((CalcBackend*)this, name);
-      assert_m(ctx.data);
-      return ctx.vtable->is_expr_const(ctx.data, &expr->expression);
-    } else {
-      return false;
-    }
-  }
+bool calc_backend_is_var_const_symbol(const CalcBackend* this, Symbol name) {
+  if (calc_backend_get_value_symbol((CalcBackend*)this, name)) return true;
+
+  int index;
+  CalcBackend* owner =
+      calc_backend_find_variable((CalcBackend*)this, name, &index);
+
+  return owner and calc_backend_memo_is_const(owner, index);
 }
 
 bool calc_backend_is_var_const_ptr(const CalcBackend* this, CalcExpr* expr) {
@@ -250,55 +304,71 @@ bool calc_backend_is_var_const_ptr(const CalcBackend* this, CalcExpr* expr) {
 }
 
 CalcValue* calc_backend_get_value(CalcBackend* this, const char* name) {
-  return calc_backend_get_value_sslice(this, str_slice_from_string(name));
+  Symbol symbol = symbol_find(str_slice_from_string(name));
+  return calc_backend_get_value_symbol(this, symbol);
 }
 CalcExpr* calc_backend_get_function(CalcBackend* this, const char* name) {
-  return calc_backend_get_function_sslice(this, str_slice_from_string(name));
+  Symbol symbol = symbol_find(str_slice_from_string(name));
+  return calc_backend_get_function_symbol(this, symbol);
 }
 CalcExpr* calc_backend_get_variable(CalcBackend* this, const char* name) {
-  return calc_backend_get_variable_sslice(this, str_slice_from_string(name));
+  Symbol symbol = symbol_find(str_slice_from_string(name));
+  return calc_backend_get_variable_symbol(this, symbol);
 }
 
-CalcValue* calc_backend_get_value_sslice(CalcBackend* this, StrSlice name) {
-  for (int i = 0; i < this->values.length; i++)
-    if (str_slice_eq_ccp(name, this->values.data[i].name.string))
-      return &this->values.data[i];
+CalcValue* calc_backend_get_value_symbol(CalcBackend* this, Symbol name) {
+  int index = symbol_map_get(&this->values_index, name);
+  if (index >= 0) return &this->values.data[index];
 
   if (this->parent)
-    return calc_backend_get_value_sslice(this->parent, name);
+    return calc_backend_get_value_symbol(this->parent, name);
   else
     return null;
 }
 
-CalcExpr* calc_backend_get_function_sslice(CalcBackend* this, StrSlice name) {
-  for (int i = 0; i < this->values.length; i++)
-    if (str_slice_eq_ccp(name, this->values.data[i].name.string)) return null;
+CalcExpr* calc_backend_get_function_symbol(CalcBackend* this, Symbol name) {
+  int index;
+  CalcBackend* owner = calc_backend_find_function(this, name, &index);
+  return owner ? &owner->expressions.data[index] : null;
+}
+CalcExpr* calc_backend_get_variable_symbol(CalcBackend* this, Symbol name) {
+  int index;
+  CalcBackend* owner = calc_backend_find_variable(this, name, &index);
+  return owner ? &owner->expressions.data[index] : null;
+}
 
-  for (int i = 0; i < this->expressions.length; i++) {
-    CalcExpr* item = &this->expressions.data[i];
+// Names that were never interned are no natives either
+static int calc_backend_find_native(Symbol name) {
+  if (name is SYMBOL_NONE) return -1;
+  return calculator_find_native(symbol_slice(name));
+}
 
-    if (item->type is CALC_EXPR_FUNCTION and
-        str_slice_eq_ccp(name, item->function.name.string))
-      return item;
-  }
+static CalcBackend* calc_backend_find_function(CalcBackend* this,
+                                               Symbol name, int* index) {
+  for (CalcBackend* level = this; level; level = level->parent) {
+    if (symbol_map_get(&level->values_index, name) >= 0) return null;
 
-  if (this->parent)
-    return calc_backend_get_function_sslice(this->parent, name);
-  else
-    return null;
+    *index = calc_backend_find_expr(level, &level->functions_index, name);
+    if (*index >= 0) return level;
+  }
+  return null;
 }
-CalcExpr* calc_backend_get_variable_sslice(CalcBackend* this, StrSlice name) {
-  for (int i = 0; i < this->expressions.length; i++) {
-    CalcExpr* item = &this->expressions.data[i];
 
-    if (item->type is CALC_EXPR_VARIABLE and
-        str_slice_eq_ccp(name, item->variable_name.string))
-      return item;
+static CalcBackend* calc_backend_find_variable(CalcBackend* this,
+                                               Symbol name, int* index) {
+  for (CalcBackend* level = this; level; level = level->parent) {
+    *index = calc_backend_find_expr(level, &level->variables_index, name);
+    if (*index >= 0) return level;
   }
-  if (this->parent)
-    return calc_backend_get_variable_sslice(this->parent, name);
-  else
-    return null;
+  return null;
+}
+
+// Index holds the first definition, so if that one is hidden, all are
+static int calc_backend_find_expr(const CalcBackend* this,
+                                  const SymbolMap* index, Symbol name) {
+  int result = symbol_map_get(index, name);
+  if (this->visible_count >= 0 and result >= this->visible_count) return -1;
+  return result;
 }
 
 CalcExpr* calc_backend_last_expr(CalcBackend* this) {
@@ -314,88 +384,261 @@ CalcExpr* calc_backend_last_expr(CalcBackend* this) {
 
 ExprContext calc_backend_get_var_context(CalcBackend* this,
                                          const char* var_name) {
-  StrSlice slice = str_slice_from_string(var_name);
-  return calc_backend_get_var_context_sslice(this, slice);
+  Symbol symbol = symbol_find(str_slice_from_string(var_name));
+  return calc_backend_get_var_context_symbol(this, symbol);
 }
 
-ExprContext calc_backend_get_var_context_sslice(CalcBackend* this,
-                                                StrSlice var_name) {
-  for (int i = 0; i < this->values.length; i++)
-    if (str_slice_eq_ccp(var_name, this->values.data[i].name.string))
-      return calc_backend_get_context(this);
-
-  for (int i = 0; i < this->expressions.length; i++) {
-    CalcExpr* item = &this->expressions.data[i];
-    if (item->type is CALC_EXPR_VARIABLE and
-        str_slice_eq_ccp(var_name, item->variable_name.string))
-      return calc_backend_get_context(this);
-  }
+ExprContext calc_backend_get_var_context_symbol(CalcBackend* this,
+                                                Symbol var_name) {
+  if (symbol_map_get(&this->values_index, var_name) >= 0 or
+      calc_backend_find_expr(this, &this->variables_index, var_name) >= 0)
+    return calc_backend_get_context(this);
 
   if (this->parent)
-    return calc_backend_get_var_context_sslice(this->parent, var_name);
+    return calc_backend_get_var_context_symbol(this->parent, var_name);
   else
     return calc_backend_get_context(null);
 }
 
 ExprContext calc_backend_get_fun_context(CalcBackend* this,
                                          const char* fun_name) {
-  StrSlice slice = str_slice_from_string(fun_name);
-  return calc_backend_get_fun_context_sslice(this, slice);
+  Symbol symbol = symbol_find(str_slice_from_string(fun_name));
+  return calc_backend_get_fun_context_symbol(this, symbol);
 }
-ExprContext calc_backend_get_fun_context_sslice(CalcBackend* this,
-                                                StrSlice fun_name) {
-  for (int i = 0; i < this->expressions.length; i++) {
-    CalcExpr* item = &this->expressions.data[i];
-    if (item->type is CALC_EXPR_FUNCTION and
-        str_slice_eq_ccp(fun_name, item->function.name.string))
-      return calc_backend_get_context(this);
-  }
+ExprContext calc_backend_get_fun_context_symbol(CalcBackend* this,
+                                                Symbol fun_name) {
+  if (calc_backend_find_expr(this, &this->functions_index, fun_name) >= 0)
+    return calc_backend_get_context(this);
 
   if (this->parent)
-    return calc_backend_get_fun_context_sslice(this->parent, fun_name);
+    return calc_backend_get_fun_context_symbol(this->parent, fun_name);
   else
     return calc_backend_get_context(null);
 }
 
+// =====
+// =
+// = MEMO
+// =
+// =====
+static bool calc_backend_memo_is_const(CalcBackend* this, int index) {
+  int state = this->memo.data[index].const_state;
+
+  if (state is CALC_CONST_YES) return true;
+  if (state is CALC_CONST_NO) return false;
+  // Expression depends on itself, it can never be calculated
+  if (state is CALC_CONST_CHECKING) return false;
+
+  this->memo.data[index].const_state = CALC_CONST_CHECKING;
+  CalcExpr* expr = &this->expressions.data[index];
+  bool result;
+
+  if (expr->type is CALC_EXPR_FUNCTION) {
+    FuncConstCtx func_ctx = {
+        .parent = calc_backend_get_context(this),
+        .used_args = &expr->function.args,
+        .are_const = true,
+    };
+    ExprContext total_ctx = func_const_ctx_context(&func_ctx);
+    result = total_ctx.vtable->is_expr_const(total_ctx.data, &expr->expression);
+
+  } else {
+    result = calc_backend_is_expr_const(this, &expr->expression);
+  }
+
+  this->memo.data[index].const_state = result ? CALC_CONST_YES : CALC_CONST_NO;
+  return result;
+}
+
+// Given on the first use, so a reset memo gets a new one
+static int calc_backend_memo_call_id(CalcBackend* this, int index) {
+  CalcExprMemo* memo = &this->memo.data[index];
+  if (memo->call_id is 0) memo->call_id = ++this->last_call_id;
+  return memo->call_id;
+}
+
+// Variable has to be const
+static ExprValueResult calc_backend_memo_value(CalcBackend* this, int index) {
+  if (not this->memo.data[index].has_value) {
+    ExprValueResult value =
+        expr_calculate(&this->expressions.data[index].expression,
+                       calc_backend_get_context(this));
+    this->memo.data[index].value = value;
+    this->memo.data[index].has_value = true;
+  }
+
+  const ExprValueResult* value = &this->memo.data[index].value;
+  if (value->is_ok)
+    return ExprValueOk(expr_value_clone(&value->ok));
+  else
+    return ExprValueErr(value->err_pos, str_clone(&value->err_text));
+}
+
+// Function body is simplified once, and then used for every call. Expression
+// itself is kept as parsed, since its names are still needed.
+static const Expr* calc_backend_memo_body(CalcBackend* this, int index) {
+  CalcExprMemo* memo = &this->memo.data[index];
+  CalcExpr* expr = &this->expressions.data[index];
+  assert_m(expr->type is CALC_EXPR_FUNCTION);
+
+  if (not memo->has_body) {
+    FuncConstCtx func_ctx = {
+        .parent = calc_backend_get_context(this),
+        .used_args = &expr->function.args,
+        .are_const = false,
+    };
+    memo->body = expr_simplify(expr_clone(&expr->expression),
+                               func_const_ctx_context(&func_ctx));
+    memo->has_body = true;
+  }
+
+  return &memo->body;
+}
+
+// Number-only form of the function body, or null if it may give anything
+// but a number for number arguments
+static const CalcScalarCode* calc_backend_memo_scalar(CalcBackend* this,
+                                                      int index) {
+  CalcExprMemo* memo = &this->memo.data[index];
+  CalcExpr* expr = &this->expressions.data[index];
+  assert_m(expr->type is CALC_EXPR_FUNCTION);
+
+  if (not memo->has_scalar) {
+    const vec_Symbol* args_names = &expr->function.args;
+    ExprType* args_types =
+        (ExprType*)MALLOC(sizeof(ExprType) * (args_names->length + 1));
+    assert_alloc(args_types);
+    for (int i = 0; i < args_names->length; i++)
+      args_types[i] = ExprTypeOf(EXPR_VALUE_NUMBER, -1);
+
+    ExprType type = calc_backend_call_type(
+        this, expr->function.name, args_types, args_names->length, 0);
+    FREE(args_types);
+
+    memo->is_scalar = false;
+    if (type.type is EXPR_VALUE_NUMBER) {
+      ExprBytecode code =
+          expr_bytecode_compile(calc_backend_memo_body(this, index));
+      memo->is_scalar = calc_scalar_lower(&code, calc_backend_get_context(this),
+                                          args_names, &memo->scalar);
+      expr_bytecode_free(code);
+    }
+    memo->has_scalar = true;
+  }
+
+  return memo->is_scalar ? &memo->scalar : null;
+}
+
+// Argument spread the same way as for a call frame, if it gives exactly
+// `count` numbers
+static bool calc_backend_number_args(const ExprValue* argument, int count,
+                                     double* into) {
+  if (argument->type is EXPR_VALUE_NONE) return count is 0;
+
+  if (argument->type is EXPR_VALUE_NUMBER) {
+    if (count is_not 1) return false;
+    into[0] = argument->number;
+    return true;
+  }
+
+  if (not expr_value_is_vector(argument) or
+      expr_value_vector_length(argument) is_not count)
+    return false;
+
+  for (int i = 0; i < count; i++) {
+    ExprValue item = expr_value_vector_item(argument, i);
+    if (item.type is_not EXPR_VALUE_NUMBER) return false;
+    into[i] = item.number;
+  }
+  return true;
+}
+
 // =====
 // =
 // = CALL_FUNCTION
 // =
 // =====
 
-ExprValueResult calc_backend_call_function(CalcBackend* this, StrSlice fun_name,
-                                           vec_ExprValue* args_values) {
+ExprValueResult calc_backend_call_function(CalcBackend* this, Symbol fun_name,
+                                           ExprValue argument) {
   // 1. NATIVE
-  const NativeFnPtr native_fn = calculator_get_native_function(fun_name);
-  if (native_fn) return native_fn(vec_ExprValue_clone(args_values));
+  int native = calc_backend_find_native(fun_name);
+  if (native >= 0) return calculator_call_native(native, argument);
 
-  CalcExpr* fn_calc_expr = calc_backend_get_function_sslice(this, fun_name);
+  int fn_index;
+  CalcBackend* owner = calc_backend_find_function(this, fun_name, &fn_index);
   ExprValueResult result;
 
-  if (fn_calc_expr) {
-    // 2. Build local backend for function
-    CalcBackend nested_backend = calc_backend_create();
-    nested_backend.parent = this;
-
-    for (int i = 0; i < fn_calc_expr->function.args.length; i++) {
-      CalcValue arg = {
-          .name = str_borrow(&fn_calc_expr->function.args.data[i]),
-          .value = i < args_values->length
-                       ? expr_value_clone(&args_values->data[i])
-                       : (ExprValue){.type = EXPR_VALUE_NONE},
-      };
-      vec_CalcValue_push(&nested_backend.values, arg);
+  if (owner) {
+    CalcExpr* fn_calc_expr = &owner->expressions.data[fn_index];
+
+    // 2. Number arguments go straight to the number-only body. It is cheaper
+    // to run than to look up in the cache. Long argument lists are rare, they
+    // just take the usual way.
+    const CalcScalarCode* scalar = calc_backend_memo_scalar(owner, fn_index);
+    double numbers[8];
+    if (scalar and scalar->args_count <= (int)LEN(numbers) and
+        calc_backend_number_args(&argument, scalar->args_count, numbers)) {
+      expr_value_free(argument);
+      ExprValue val = {.type = EXPR_VALUE_NUMBER,
+                       .number = calc_scalar_run(scalar, numbers)};
+      return ExprValueOk(val);
+    }
+
+    // Arguments are spread, so a range has to be short enough for that
+    result = expr_value_check_expand(&argument);
+    if (not result.is_ok) {
+      expr_value_free(argument);
+      return result;
     }
 
-    result = expr_calculate(&fn_calc_expr->expression,
-                            calc_backend_get_context(&nested_backend));
+    // 3. Const function gives the same result for the same arguments
+    CalcCallKey key;
+    bool is_cached =
+        calc_backend_memo_is_const(owner, fn_index) and
+        calc_call_key_make(calc_backend_memo_call_id(owner, fn_index),
+                           &argument, &key);
+
+    ExprValue cached;
+    if (is_cached and calc_call_cache_get(&owner->call_cache, &key, &cached)) {
+      expr_value_free(argument);
+      return ExprValueOk(cached);
+    }
+
+    // 4. Call frame just borrows the arguments. A single value needs no
+    // vector for that.
+    CalcFrame frame = {
+        .backend = this,
+        .args_names = &fn_calc_expr->function.args,
+    };
+    bool is_spread = expr_value_is_vector(&argument);
+    vec_ExprValue args_values;
+
+    if (is_spread) {
+      args_values = expr_value_to_args(argument);
+      frame.args = args_values.data;
+      frame.args_count = args_values.length;
+    } else if (argument.type is_not EXPR_VALUE_NONE) {
+      frame.args = &argument;
+      frame.args_count = 1;
+    }
+
+    result = expr_calculate(calc_backend_memo_body(owner, fn_index),
+                            calc_frame_context(&frame));
+
+    if (is_spread)
+      vec_ExprValue_free(args_values);
+    else
+      expr_value_free(argument);
 
-    calc_backend_free(nested_backend);
+    if (is_cached and result.is_ok)
+      calc_call_cache_put(&owner->call_cache, &key, &result.ok);
   } else {
+    expr_value_free(argument);
     result = ExprValueErr(
         null,
-        str_owned("Function '%$slice' is not found (this shoudn't happen btw)",
-                  fun_name));
+        str_owned("Function '%s' is not found (this shoudn't happen btw)",
+                  symbol_name(fun_name)));
   }
 
   return result;
@@ -406,110 +649,195 @@ ExprValueResult calc_backend_call_function(CalcBackend* this, StrSlice fun_name,
 // = GET TYPE
 // =
 // =====
-int calc_backend_get_expr_type(const CalcBackend* this, const Expr* expr) {
-  int result = VALUE_TYPE_UNKNOWN;
-
-  if (calc_backend_is_expr_const(this, expr)) {
-    ExprContext ctx = calc_backend_get_context((CalcBackend*)this);
-    ExprValueResult res = expr_calculate(expr, ctx);
-    if (res.is_ok) {
-      result = res.ok.type;
-      expr_value_free(res.ok);
-    } else {
-      str_free(res.err_text);
-    }
+ExprType calc_backend_get_expr_type(const CalcBackend* this, const Expr* expr) {
+  ExprContext ctx = calc_backend_get_context((CalcBackend*)this);
+  if (not calc_backend_is_expr_const(this, expr))
+    return expr_infer_type(expr, ctx);
+
+  // Value gives the exact type
+  ExprType result = ExprTypeUnknown();
+  ExprValueResult res = expr_calculate(expr, ctx);
+  if (res.is_ok) {
+    result = expr_type_of_value(&res.ok);
+    expr_value_free(res.ok);
   } else {
-    debugln("Not yet implemented! Expression: '%$expr'", *expr);
+    str_free(res.err_text);
   }
 
   return result;
 }
+
+ExprType calc_backend_call_type(CalcBackend* this, Symbol fun_name,
+                                const ExprType* args, int args_count,
+                                int depth) {
+  // Natives take precedence, same as in `calc_backend_call_function`
+  if (calc_backend_find_native(fun_name) >= 0)
+    return calculator_get_native_type(symbol_slice(fun_name), args,
+                                      args_count);
+
+  int fn_index;
+  CalcBackend* owner = calc_backend_find_function(this, fun_name, &fn_index);
+  if (not owner) return ExprTypeUnknown();
+
+  // Function may call itself
+  if (depth >= CALC_TYPE_MAX_DEPTH) return ExprTypeUnknown();
+
+  CalcExpr* fn_calc_expr = &owner->expressions.data[fn_index];
+  CalcFrame frame = {
+      .backend = this,
+      .args_names = &fn_calc_expr->function.args,
+      .args_types = args,
+      .args_count = args_count,
+      .depth = depth + 1,
+  };
+  return expr_infer_type(&fn_calc_expr->expression,
+                         calc_frame_context(&frame));
+}
+
+// Const variables are calculated anyway, so their value gives the exact type
+static ExprType calc_backend_memo_type(CalcBackend* this, int index) {
+  if (this->memo.data[index].has_type) return this->memo.data[index].type;
+
+  // Met again while inferring means a cycle
+  this->memo.data[index].has_type = true;
+  this->memo.data[index].type = ExprTypeUnknown();
+
+  CalcExpr* expr = &this->expressions.data[index];
+  ExprType type;
+
+  if (expr->type is CALC_EXPR_FUNCTION) {
+    // Arguments are just names here, with no type
+    FuncConstCtx func_ctx = {
+        .parent = calc_backend_get_context(this),
+        .used_args = &expr->function.args,
+        .are_const = false,
+    };
+    type = expr_infer_type(&expr->expression,
+                           func_const_ctx_context(&func_ctx));
+
+  } else if (calc_backend_memo_is_const(this, index)) {
+    ExprValueResult value = calc_backend_memo_value(this, index);
+    type = value.is_ok ? expr_type_of_value(&value.ok) : ExprTypeUnknown();
+
+    if (value.is_ok)
+      expr_value_free(value.ok);
+    else
+      str_free(value.err_text);
+
+  } else {
+    type = expr_infer_type(&expr->expression, calc_backend_get_context(this));
+  }
+
+  this->memo.data[index].type = type;
+  return type;
+}
 /*
   // Parsing
-  bool (*is_variable)(void* this, StrSlice var_name);
-  bool (*is_function)(void* this, StrSlice fun_name);
+  bool (*is_variable)(void* this, Symbol var_name);
+  bool (*is_function)(void* this, Symbol fun_name);
+  int (*find_native)(void* this, Symbol fun_name);
 
   // Computation
-  ExprValueResult (*get_variable_val)(void*, StrSlice);
-  ExprValueResult (*call_function)(void*, StrSlice, vec_ExprValue*);
+  ExprValueResult (*get_variable_val)(void*, Symbol);
+  ExprValueResult (*call_function)(void*, Symbol, ExprValue argument);
+  ExprValueResult (*call_native)(void*, int index, ExprValue argument);
 
   // Anasysis and compilation
   bool (*is_expr_const)(void* this, const Expr* expr);
-  int (*get_expr_type)(void* this, const Expr* expr);
+  ExprType (*get_expr_type)(void* this, const Expr* expr);
 
-  ExprVariableInfo (*get_variable_info)(void* this, StrSlice var_name);
-  ExprFunctionInfo (*get_function_info)(void* this, StrSlice fun_name);
+  ExprVariableInfo (*get_variable_info)(void* this, Symbol var_name);
+  ExprFunctionInfo (*get_function_info)(void* this, Symbol fun_name);
 */
 
-static bool cb_is_variable(CalcBackend* this, StrSlice var_name);
-static bool cb_is_function(CalcBackend* this, StrSlice fun_name);
+static bool cb_is_variable(CalcBackend* this, Symbol var_name);
+static bool cb_is_function(CalcBackend* this, Symbol fun_name);
+static int cb_find_native(CalcBackend* this, Symbol fun_name);
 
-static ExprValueResult cb_get_variable_val(CalcBackend*, StrSlice);
+static ExprValueResult cb_get_variable_val(CalcBackend*, Symbol);
 // calc_backend_call_function
+static ExprValueResult cb_call_native(CalcBackend* this, int index,
+                                      ExprValue argument);
 
-static int cb_get_expr_type(CalcBackend* this, const Expr* expr);
+static ExprType cb_get_expr_type(CalcBackend* this, const Expr* expr);
+static ExprType cb_get_call_type(CalcBackend* this, Symbol fun_name,
+                                 const ExprType* args, int args_count);
 
-ExprVariableInfo cb_get_variable_info(CalcBackend* this, StrSlice var_name);
-ExprFunctionInfo cb_get_function_info(CalcBackend* this, StrSlice fun_name);
+ExprVariableInfo cb_get_variable_info(CalcBackend* this, Symbol var_name);
+ExprFunctionInfo cb_get_function_info(CalcBackend* this, Symbol fun_name);
 
-static bool cb_is_variable(CalcBackend* this, StrSlice var_name) {
-  if (calculator_get_native_function(var_name)) return false;
+static bool cb_is_variable(CalcBackend* this, Symbol var_name) {
+  if (calc_backend_find_native(var_name) >= 0) return false;
 
-  return calc_backend_get_value_sslice(this, var_name) or
-         calc_backend_get_variable_sslice(this, var_name);
+  return calc_backend_get_value_symbol(this, var_name) or
+         calc_backend_get_variable_symbol(this, var_name);
 }
-static bool cb_is_function(CalcBackend* this, StrSlice fun_name) {
-  if (calculator_get_native_function(fun_name)) return true;
+static bool cb_is_function(CalcBackend* this, Symbol fun_name) {
+  if (calc_backend_find_native(fun_name) >= 0) return true;
 
-  return calc_backend_get_function_sslice(this, fun_name);
+  return calc_backend_get_function_symbol(this, fun_name);
+}
+static int cb_find_native(CalcBackend* this, Symbol fun_name) {
+  unused(this);
+  return calc_backend_find_native(fun_name);
 }
 
 static ExprValueResult cb_get_variable_val(CalcBackend* this,
-                                           StrSlice var_name) {
+                                           Symbol var_name) {
   ExprValueResult result;
-  CalcValue* val = calc_backend_get_value_sslice(this, var_name);
+  CalcValue* val = calc_backend_get_value_symbol(this, var_name);
 
   if (val) {
     result = ExprValueOk(expr_value_clone(&val->value));
   } else {
-    CalcExpr* expr = calc_backend_get_variable_sslice(this, var_name);
-
-    if (expr) {
-      // calculate
-      if (calc_backend_is_var_const_sslice(this, var_name)) {
-        ExprContext ctx = calc_backend_get_var_context_sslice(this, var_name);
-        assert_m(ctx.data);
-        result = expr_calculate(&expr->expression, ctx);
+    int index;
+    CalcBackend* owner = calc_backend_find_variable(this, var_name, &index);
+
+    if (owner) {
+      if (calc_backend_memo_is_const(owner, index)) {
+        result = calc_backend_memo_value(owner, index);
       } else {
         result = ExprValueErr(
-            null,
-            str_owned(
-                "Variable '%$slice' is not const and cannot be calculated"));
+            null, str_owned("Variable '%s' is not const and cannot be "
+                            "calculated",
+                            symbol_name(var_name)));
       }
     } else {
       result = ExprValueErr(
-          null, str_owned("Variable '%$slice' not found", var_name));
+          null, str_owned("Variable '%s' not found", symbol_name(var_name)));
     }
   }
 
   return result;
 }
 // calc_backend_call_function
+static ExprValueResult cb_call_native(CalcBackend* this, int index,
+                                      ExprValue argument) {
+  unused(this);
+  return calculator_call_native(index, argument);
+}
 
-static int cb_get_expr_type(CalcBackend* this, const Expr* expr) {
+static ExprType cb_get_expr_type(CalcBackend* this, const Expr* expr) {
   return calc_backend_get_expr_type(this, expr);
 }
+static ExprType cb_get_call_type(CalcBackend* this, Symbol fun_name,
+                                 const ExprType* args, int args_count) {
+  return calc_backend_call_type(this, fun_name, args, args_count, 0);
+}
 
 ExprContext calc_backend_get_context(CalcBackend* this) {
   static const ExprContextVtable table = {
       .is_variable = (void*)cb_is_variable,
       .is_function = (void*)cb_is_function,
+      .find_native = (void*)cb_find_native,
 
       .get_variable_val = (void*)cb_get_variable_val,
       .call_function = (void*)calc_backend_call_function,
+      .call_native = (void*)cb_call_native,
 
       .is_expr_const = (void*)calc_backend_is_expr_const,
       .get_expr_type = (void*)cb_get_expr_type,
+      .get_call_type = (void*)cb_get_call_type,
 
       .get_variable_info = (void*)cb_get_variable_info,
       .get_function_info = (void*)cb_get_function_info,
@@ -517,28 +845,45 @@ ExprContext calc_backend_get_context(CalcBackend* this) {
   return (ExprContext){.data = this, .vtable = &table};
 }
 
-ExprVariableInfo cb_get_variable_info(CalcBackend* this, StrSlice var_name) {
-  debugln("Smone asks for variable '%$slice' info", var_name);
-  CalcExpr* expr = calc_backend_get_variable_sslice(this, var_name);
-  debugln("Got expr: %p", expr);
-  CalcValue* val = calc_backend_get_value_sslice(this, var_name);
-  debugln("Got val: %p", val);
-  ExprContext ctx = calc_backend_get_var_context_sslice(this, var_name);
-  debugln("Got ctx: data %p + vtable %p", ctx.data, ctx.vtable);
+ExprVariableInfo cb_get_variable_info(CalcBackend* this, Symbol var_name) {
+  CalcExpr* expr = calc_backend_get_variable_symbol(this, var_name);
+  CalcValue* val = calc_backend_get_value_symbol(this, var_name);
+  ExprContext ctx = calc_backend_get_var_context_symbol(this, var_name);
 
-  if (not expr and not val) return cb_get_variable_info(this->parent, var_name);
+  if (not expr and not val) {
+    if (this->parent) {
+      return cb_get_variable_info(this->parent, var_name);
+    } else {
+      ExprVariableInfo result = {
+          .expression = null,
+          .value = null,
+          .is_const = false,
+          .value_type = ExprTypeUnknown(),
+          .correct_context = {.data = null, .vtable = null},
+      };
+      return result;
+    }
+  }
 
   ExprVariableInfo result = {
       .expression = expr ? &expr->expression : null,
       .value = val ? &val->value : null,
-      .is_const = val or calc_backend_is_var_const_sslice(this, var_name),
-      .value_type = VALUE_TYPE_UNKNOWN,
+      .is_const = val or calc_backend_is_var_const_symbol(this, var_name),
+      .value_type = ExprTypeUnknown(),
       .correct_context = ctx,
   };
+
+  int index;
+  CalcBackend* owner = calc_backend_find_variable(this, var_name, &index);
+  if (val)
+    result.value_type = expr_type_of_value(&val->value);
+  else if (owner)
+    result.value_type = calc_backend_memo_type(owner, index);
+
   return result;
 }
-ExprFunctionInfo cb_get_function_info(CalcBackend* this, StrSlice fun_name) {
-  CalcExpr* expr = calc_backend_get_function_sslice(this, fun_name);
+ExprFunctionInfo cb_get_function_info(CalcBackend* this, Symbol fun_name) {
+  CalcExpr* expr = calc_backend_get_function_symbol(this, fun_name);
 
   if (not expr) {
     if (this->parent) {
@@ -547,7 +892,7 @@ ExprFunctionInfo cb_get_function_info(CalcBackend* this, StrSlice fun_name) {
       ExprFunctionInfo result = {
           .is_const = false,
           .correct_context = {.data = null, .vtable = null},
-          .value_type = VALUE_TYPE_UNKNOWN,
+          .value_type = ExprTypeUnknown(),
           .expression = null,
           .args_names = null,
       };
@@ -556,11 +901,16 @@ ExprFunctionInfo cb_get_function_info(CalcBackend* this, StrSlice fun_name) {
   }
 
   ExprFunctionInfo result = {
-      .is_const = calc_backend_is_func_const_sslice(this, fun_name),
-      .correct_context = calc_backend_get_fun_context_sslice(this, fun_name),
+      .is_const = calc_backend_is_func_const_symbol(this, fun_name),
+      .correct_context = calc_backend_get_fun_context_symbol(this, fun_name),
       .expression = expr ? &expr->expression : null,
-      .value_type = VALUE_TYPE_UNKNOWN,
+      .value_type = ExprTypeUnknown(),
       .args_names = expr ? &expr->function.args : null,
   };
+
+  int index;
+  CalcBackend* owner = calc_backend_find_function(this, fun_name, &index);
+  if (owner) result.value_type = calc_backend_memo_type(owner, index);
+
   return result;
 }
\ No newline at end of file
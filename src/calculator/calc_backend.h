@@ -2,15 +2,61 @@
 #define SRC_CALCULATOR_CALC_BACKEND_H_
 
 #include "../util/better_io.h"
+#include "../util/symbol.h"
+#include "calc_call_cache.h"
 #include "calc_expr.h"
+#include "calc_scalar.h"
 #include "calc_value.h"
 
-ExprValueResult calc_calculate_expr(const char* text, double x, double y);
+#define CALC_CONST_UNKNOWN 0
+#define CALC_CONST_CHECKING 1  // Met again while checking means a cycle
+#define CALC_CONST_YES 2
+#define CALC_CONST_NO 3
+
+#define CALC_CALL_CACHE_SIZE 256  // Default, see `CalcBackend.call_cache`
+#define CALC_TYPE_MAX_DEPTH 64    // Of nested calls while inferring types
+
+// Cached analysis of one item of `CalcBackend.expressions`
+typedef struct CalcExprMemo {
+  int const_state;
+  bool has_value;
+  ExprValueResult value;  // Only for const variables
+  bool has_body;
+  Expr body;  // Only for functions: simplified copy of the expression
+  bool has_type;
+  ExprType type;  // For functions, whatever the arguments are
+  bool has_scalar;
+  bool is_scalar;
+  CalcScalarCode scalar;  // Only for functions: body for number arguments
+  int call_id;  // Key of its results in `CalcBackend.call_cache`, 0 if none
+} CalcExprMemo;
+
+void calc_expr_memo_free(CalcExprMemo this);
+
+#define VECTOR_H CalcExprMemo
+#include "../util/vector.h"
 
 typedef struct CalcBackend {
   struct CalcBackend* parent;
   vec_CalcExpr expressions;
   vec_CalcValue values;
+  vec_CalcExprMemo memo;  // Same indices as `expressions`
+
+  // Name -> index in `values`/`expressions`. First definition of a name wins.
+  // Always add through `calc_backend_push_*`/`calc_backend_insert_expr` to
+  // keep these in sync.
+  SymbolMap values_index;
+  SymbolMap variables_index;
+  SymbolMap functions_index;
+
+  // Expressions from this index on are not found by name, -1 if all are. Lets
+  // a text be parsed as if only the expressions above it were added.
+  int visible_count;
+
+  // Results of const user functions. Dropped with the memo. Replace it with
+  // `calc_call_cache_create(0)` to turn it off.
+  CalcCallCache call_cache;
+  int last_call_id;
 } CalcBackend;
 
 void calc_backend_free(CalcBackend);
@@ -20,13 +66,27 @@ CalcBackend calc_backend_create();
 ExprContext calc_backend_get_context(CalcBackend*);
 
 str_t calc_backend_add_expr(CalcBackend* this, const char* text);
+// What `calc_backend_add_expr` says about the expression: value if it is
+// const, or else its kind
+str_t calc_backend_expr_message(CalcBackend* this, CalcExpr* expr);
+// Same for a text that failed to parse. Takes the error text.
+str_t calc_backend_parse_error_message(CalcExprResult error);
+
+void calc_backend_push_expr(CalcBackend* this, CalcExpr expr);
+void calc_backend_push_value(CalcBackend* this, CalcValue value);
+
+// Other expressions keep their cached results, so the caller has to know none
+// of them depends on the inserted or removed name
+void calc_backend_insert_expr(CalcBackend* this, int index, CalcExpr expr);
+void calc_backend_remove_expr(CalcBackend* this, int index);
+void calc_backend_reset_expr_memo(CalcBackend* this, int index);
 
 bool calc_backend_is_expr_const(const CalcBackend* this, const Expr* expr);
 
 bool calc_backend_is_func_const(const CalcBackend* this, const char* name);
 bool calc_backend_is_var_const(const CalcBackend* this, const char* name);
-bool calc_backend_is_func_const_sslice(const CalcBackend* this, StrSlice name);
-bool calc_backend_is_var_const_sslice(const CalcBackend* this, StrSlice name);
+bool calc_backend_is_func_const_symbol(const CalcBackend* this, Symbol name);
+bool calc_backend_is_var_const_symbol(const CalcBackend* this, Symbol name);
 bool calc_backend_is_func_const_ptr(const CalcBackend* this, CalcExpr* func);
 bool calc_backend_is_var_const_ptr(const CalcBackend* this, CalcExpr* var);
 
@@ -34,25 +94,30 @@ CalcValue* calc_backend_get_value(CalcBackend* this, const char* name);
 CalcExpr* calc_backend_get_function(CalcBackend* this, const char* name);
 CalcExpr* calc_backend_get_variable(CalcBackend* this, const char* name);
 
-CalcValue* calc_backend_get_value_sslice(CalcBackend* this, StrSlice name);
-CalcExpr* calc_backend_get_function_sslice(CalcBackend* this, StrSlice name);
-CalcExpr* calc_backend_get_variable_sslice(CalcBackend* this, StrSlice name);
+CalcValue* calc_backend_get_value_symbol(CalcBackend* this, Symbol name);
+CalcExpr* calc_backend_get_function_symbol(CalcBackend* this, Symbol name);
+CalcExpr* calc_backend_get_variable_symbol(CalcBackend* this, Symbol name);
 
 ExprContext calc_backend_get_var_context(CalcBackend* this,
                                          const char* var_name);
-ExprContext calc_backend_get_var_context_sslice(CalcBackend* this,
-                                                StrSlice var_name);
+ExprContext calc_backend_get_var_context_symbol(CalcBackend* this,
+                                                Symbol var_name);
 
 ExprContext calc_backend_get_fun_context(CalcBackend* this,
                                          const char* fun_name);
-ExprContext calc_backend_get_fun_context_sslice(CalcBackend* this,
-                                                StrSlice fun_name);
+ExprContext calc_backend_get_fun_context_symbol(CalcBackend* this,
+                                                Symbol fun_name);
 
 CalcExpr* calc_backend_last_expr(CalcBackend* this);
-int calc_backend_get_expr_type(const CalcBackend* this, const Expr* expr);
-
-ExprValueResult calc_backend_call_function(CalcBackend* this, StrSlice fun_name,
-                                           vec_ExprValue* args_values);
+ExprType calc_backend_get_expr_type(const CalcBackend* this, const Expr* expr);
+// Result type of a call with (spread) arguments of these types. `depth` is
+// how many calls are being inferred already.
+ExprType calc_backend_call_type(CalcBackend* this, Symbol fun_name,
+                                const ExprType* args, int args_count,
+                                int depth);
+
+ExprValueResult calc_backend_call_function(CalcBackend* this, Symbol fun_name,
+                                           ExprValue argument);
 
 #define VECTOR_H CalcBackend
 #include "../util/vector.h"
@@ -0,0 +1,218 @@
+#include "calc_call_cache.h"
+
+#include <string.h>
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+
+static uint32_t calc_call_key_hash(const CalcCallKey* key);
+static bool calc_call_key_eq(const CalcCallKey* a, const CalcCallKey* b);
+static void lru_unlink(CalcCallCache* this, int index);
+static void lru_push_first(CalcCallCache* this, int index);
+static void bucket_unlink(CalcCallCache* this, int index);
+
+// =====
+// =
+// = BASICS
+// =
+// =====
+CalcCallCache calc_call_cache_create(int capacity) {
+  assert_m(capacity >= 0);
+  return (CalcCallCache){
+      .entries = null,
+      .buckets = null,
+      .capacity = capacity,
+      .length = 0,
+      .lru_first = -1,
+      .lru_last = -1,
+      .hits = 0,
+      .misses = 0,
+  };
+}
+
+void calc_call_cache_free(CalcCallCache this) {
+  calc_call_cache_clear(&this);
+  FREE(this.entries);
+  FREE(this.buckets);
+}
+
+void calc_call_cache_clear(CalcCallCache* this) {
+  for (int i = 0; i < this->length; i++)
+    expr_value_free(this->entries[i].result);
+
+  if (this->buckets)
+    for (int i = 0; i < this->capacity; i++) this->buckets[i] = -1;
+
+  this->length = 0;
+  this->lru_first = -1;
+  this->lru_last = -1;
+}
+
+// =====
+// =
+// = KEYS
+// =
+// =====
+bool calc_call_key_make(int function_id, const ExprValue* argument,
+                        CalcCallKey* key) {
+  key->function_id = function_id;
+
+  // Same as `expr_value_to_args` would spread it
+  if (argument->type is EXPR_VALUE_NUMBER) {
+    key->length = 1;
+    key->args[0] = argument->number;
+
+  } else if (argument->type is EXPR_VALUE_NONE) {
+    key->length = 0;
+
+  } else if (expr_value_is_vector(argument)) {
+    key->length = expr_value_vector_length(argument);
+    if (key->length > CALC_CALL_CACHE_MAX_ARGS) return false;
+
+    for (int i = 0; i < key->length; i++) {
+      ExprValue item = expr_value_vector_item(argument, i);
+      if (item.type is_not EXPR_VALUE_NUMBER) return false;
+      key->args[i] = item.number;
+    }
+
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// FNV-1a over the used bytes
+static uint32_t calc_call_key_hash(const CalcCallKey* key) {
+  uint32_t hash = 2166136261u;
+  const unsigned char* bytes = (const unsigned char*)key->args;
+  int bytes_count = (int)sizeof(double) * key->length;
+
+  hash = (hash ^ (uint32_t)key->function_id) * 16777619u;
+  for (int i = 0; i < bytes_count; i++) hash = (hash ^ bytes[i]) * 16777619u;
+
+  return hash;
+}
+
+// Bitwise, so that 0 and -0 are different arguments, and NaN is the same
+static bool calc_call_key_eq(const CalcCallKey* a, const CalcCallKey* b) {
+  return a->function_id is b->function_id and
+         a->length is b->length and
+         memcmp(a->args, b->args, sizeof(double) * a->length) is 0;
+}
+
+// =====
+// =
+// = GET, PUT
+// =
+// =====
+bool calc_call_cache_get(CalcCallCache* this, const CalcCallKey* key,
+                         ExprValue* result) {
+  if (this->capacity is 0) return false;
+  if (this->length is 0) {
+    this->misses++;
+    return false;
+  }
+
+  uint32_t hash = calc_call_key_hash(key);
+  int index = this->buckets[hash % (uint32_t)this->capacity];
+
+  while (index >= 0) {
+    CalcCallEntry* entry = &this->entries[index];
+
+    if (entry->hash is hash and calc_call_key_eq(&entry->key, key)) {
+      lru_unlink(this, index);
+      lru_push_first(this, index);
+
+      this->hits++;
+      *result = expr_value_clone(&entry->result);
+      return true;
+    }
+
+    index = entry->bucket_next;
+  }
+
+  this->misses++;
+  return false;
+}
+
+void calc_call_cache_put(CalcCallCache* this, const CalcCallKey* key,
+                         const ExprValue* result) {
+  if (this->capacity is 0) return;
+
+  if (not this->entries) {
+    this->entries =
+        (CalcCallEntry*)MALLOC(sizeof(CalcCallEntry) * this->capacity);
+    this->buckets = (int*)MALLOC(sizeof(int) * this->capacity);
+    assert_alloc(this->entries);
+    assert_alloc(this->buckets);
+
+    for (int i = 0; i < this->capacity; i++) this->buckets[i] = -1;
+  }
+
+  // Full cache reuses the least recently used entry
+  int index;
+  if (this->length < this->capacity) {
+    index = this->length++;
+  } else {
+    index = this->lru_last;
+    lru_unlink(this, index);
+    bucket_unlink(this, index);
+    expr_value_free(this->entries[index].result);
+  }
+
+  uint32_t hash = calc_call_key_hash(key);
+  uint32_t bucket = hash % (uint32_t)this->capacity;
+
+  this->entries[index] = (CalcCallEntry){
+      .key = *key,
+      .hash = hash,
+      .result = expr_value_clone(result),
+      .bucket_next = this->buckets[bucket],
+  };
+  this->buckets[bucket] = index;
+  lru_push_first(this, index);
+}
+
+// =====
+// =
+// = LISTS
+// =
+// =====
+static void lru_unlink(CalcCallCache* this, int index) {
+  CalcCallEntry* entry = &this->entries[index];
+
+  if (entry->lru_prev >= 0)
+    this->entries[entry->lru_prev].lru_next = entry->lru_next;
+  else
+    this->lru_first = entry->lru_next;
+
+  if (entry->lru_next >= 0)
+    this->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  else
+    this->lru_last = entry->lru_prev;
+}
+
+static void lru_push_first(CalcCallCache* this, int index) {
+  CalcCallEntry* entry = &this->entries[index];
+  entry->lru_prev = -1;
+  entry->lru_next = this->lru_first;
+
+  if (this->lru_first >= 0)
+    this->entries[this->lru_first].lru_prev = index;
+  else
+    this->lru_last = index;
+
+  this->lru_first = index;
+}
+
+static void bucket_unlink(CalcCallCache* this, int index) {
+  uint32_t bucket = this->entries[index].hash % (uint32_t)this->capacity;
+  int* link = &this->buckets[bucket];
+
+  while (*link is_not index) {
+    assert_m(*link >= 0);
+    link = &this->entries[*link].bucket_next;
+  }
+  *link = this->entries[index].bucket_next;
+}
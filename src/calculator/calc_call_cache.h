@@ -0,0 +1,64 @@
+#ifndef SRC_CALCULATOR_CALC_CALL_CACHE_H_
+#define SRC_CALCULATOR_CALC_CALL_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../parser/expr_value.h"
+
+// Bounded cache of user function results. Only for const functions, which
+// depend on nothing but their arguments. When it is full, the least recently
+// used result is replaced.
+// Key is the list of arguments after spreading, so `f(1, 2)` and `f([1, 2])`
+// share a result. Only short lists of numbers are cached.
+// Function is keyed by its memo, not by its position, so the results of a
+// replaced function are never found again and just age out.
+
+#define CALC_CALL_CACHE_MAX_ARGS 16
+
+typedef struct CalcCallKey {
+  int function_id;  // See `CalcExprMemo.call_id`
+  int length;
+  double args[CALC_CALL_CACHE_MAX_ARGS];  // Compared bitwise
+} CalcCallKey;
+
+typedef struct CalcCallEntry {
+  CalcCallKey key;
+  uint32_t hash;
+  ExprValue result;
+
+  int bucket_next;  // Next entry of the same bucket, -1 if none
+  int lru_prev;     // Entry used more recently, -1 if none
+  int lru_next;     // Entry used less recently, -1 if none
+} CalcCallEntry;
+
+typedef struct CalcCallCache {
+  CalcCallEntry* entries;  // Allocated on the first put
+  int* buckets;            // First entry of every bucket, -1 if none
+  int capacity;            // 0 turns the cache off
+  int length;
+  int lru_first;
+  int lru_last;
+
+  long long hits;
+  long long misses;
+} CalcCallCache;
+
+CalcCallCache calc_call_cache_create(int capacity);
+void calc_call_cache_free(CalcCallCache this);
+// Drops the results, but keeps the counters
+void calc_call_cache_clear(CalcCallCache* this);
+
+// Returns false if calls with such argument are not cached
+bool calc_call_key_make(int function_id, const ExprValue* argument,
+                        CalcCallKey* key);
+
+// Counts a hit or a miss (if turned on). On a hit `result` gets a clone of
+// the value.
+bool calc_call_cache_get(CalcCallCache* this, const CalcCallKey* key,
+                         ExprValue* result);
+// Key must not be in the cache already
+void calc_call_cache_put(CalcCallCache* this, const CalcCallKey* key,
+                         const ExprValue* result);
+
+#endif  // SRC_CALCULATOR_CALC_CALL_CACHE_H_
@@ -0,0 +1,229 @@
+#include "calc_compiled.h"
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+
+typedef struct XyValuesContext {
+  double x;
+  double y;
+  Symbol x_name;
+  Symbol y_name;
+  ExprContext parent;
+} XyValuesContext;
+
+static XyValuesContext xy_values(double x, double y, ExprContext parent);
+
+static ExprValueResult xy_get_variable_val(XyValuesContext* this,
+                                           Symbol name);
+static ExprValueResult xy_call_function(XyValuesContext* this, Symbol name,
+                                        ExprValue argument);
+static ExprValueResult xy_call_native(XyValuesContext* this, int index,
+                                      ExprValue argument);
+static bool xy_is_variable(XyValuesContext* this, Symbol name);
+static bool xy_is_function(XyValuesContext* this, Symbol name);
+static ExprType xy_get_call_type(XyValuesContext* this, Symbol name,
+                                 const ExprType* args, int args_count);
+static ExprVariableInfo xy_get_variable_info(XyValuesContext* this,
+                                             Symbol name);
+static ExprFunctionInfo xy_get_function_info(XyValuesContext* this,
+                                             Symbol name);
+
+static ExprContext xy_context(XyValuesContext* this);
+
+// =====
+// =
+// = calc_compile
+// =
+// =====
+CalcCompiled* calc_compile(const char* text) {
+  assert_m(text);
+  CalcCompiled* this = (CalcCompiled*)MALLOC(sizeof(CalcCompiled));
+  assert_alloc(this);
+
+  // Backend is stored by pointer in contexts, so it must not move anymore
+  this->text = str_owned("%s", text);
+  this->backend = calc_backend_create();
+
+  ExprContext ctx = calc_backend_get_context(&this->backend);
+
+  // Token tree, expression and bytecode all go into a few arena blocks
+  this->arena = arena_create();
+  Arena* prev_arena = my_allocator_bind_arena(&this->arena);
+
+  this->expr = expr_parse_string(this->text.string, ctx);
+  if (this->expr.is_ok) {
+    this->expr.ok = expr_simplify(this->expr.ok, ctx);
+    this->code = expr_bytecode_compile(&this->expr.ok);
+  }
+
+  my_allocator_bind_arena(prev_arena);
+
+  // Lowered code is freed on its own, so it is made outside of the arena.
+  // Plot coordinates are its two arguments.
+  this->is_scalar = false;
+  if (this->expr.is_ok) {
+    XyValuesContext xy_ctx = xy_values(0, 0, ctx);
+    ExprType type = expr_infer_type(&this->expr.ok, xy_context(&xy_ctx));
+
+    vec_Symbol xy_names = vec_Symbol_create();
+    vec_Symbol_push(&xy_names, xy_ctx.x_name);
+    vec_Symbol_push(&xy_names, xy_ctx.y_name);
+
+    this->is_scalar =
+        type.type is EXPR_VALUE_NUMBER and
+        calc_scalar_lower(&this->code, ctx, &xy_names, &this->scalar);
+    vec_Symbol_free(xy_names);
+  }
+
+  return this;
+}
+
+// =====
+// =
+// = calc_eval
+// =
+// =====
+ExprValueResult calc_eval(const CalcCompiled* this, double x, double y) {
+  assert_m(this);
+
+  if (not this->expr.is_ok)
+    return ExprValueErr(this->expr.err_pos, str_clone(&this->expr.err_text));
+
+  if (this->is_scalar) {
+    double xy[] = {x, y};
+    ExprValue val = {.type = EXPR_VALUE_NUMBER,
+                     .number = calc_scalar_run(&this->scalar, xy)};
+    return ExprValueOk(val);
+  }
+
+  XyValuesContext xy_ctx = xy_values(
+      x, y, calc_backend_get_context((CalcBackend*)&this->backend));
+  return expr_bytecode_run(&this->code, xy_context(&xy_ctx));
+}
+
+// =====
+// =
+// = calc_compiled_free
+// =
+// =====
+void calc_compiled_free(CalcCompiled* this) {
+  if (not this) return;
+
+  if (this->is_scalar) calc_scalar_free(this->scalar);
+
+  // No need to walk the expression, it is all in the arena
+  arena_free(this->arena);
+  calc_backend_free(this->backend);
+  str_free(this->text);
+  FREE(this);
+}
+
+// =====
+// =
+// = calc_calculate_expr
+// =
+// =====
+ExprValueResult calc_calculate_expr(const char* text, double x, double y) {
+  CalcCompiled* compiled = calc_compile(text);
+  ExprValueResult result = calc_eval(compiled, x, y);
+
+  // Error position points into the copy of the text, move it to the original
+  if (not result.is_ok and result.err_pos)
+    result.err_pos = text + (result.err_pos - compiled->text.string);
+
+  calc_compiled_free(compiled);
+  return result;
+}
+
+// XY CONTEXT
+
+static XyValuesContext xy_values(double x, double y, ExprContext parent) {
+  return (XyValuesContext){
+      .x = x,
+      .y = y,
+      .x_name = symbol_intern(str_slice_from_string("x")),
+      .y_name = symbol_intern(str_slice_from_string("y")),
+      .parent = parent,
+  };
+}
+
+static ExprContext xy_context(XyValuesContext* this) {
+  static const ExprContextVtable XY_CTX_VTABLE = {
+      .get_expr_type = null,
+      .get_variable_info = (void*)xy_get_variable_info,
+      .get_function_info = (void*)xy_get_function_info,
+      .get_call_type = (void*)xy_get_call_type,
+      .is_variable = (void*)xy_is_variable,
+      .is_function = (void*)xy_is_function,
+
+      .get_variable_val =
+          (ExprValueResult(*)(void*, Symbol))xy_get_variable_val,
+      .call_function =
+          (ExprValueResult(*)(void*, Symbol, ExprValue))xy_call_function,
+      .call_native = (void*)xy_call_native,
+  };
+
+  return (ExprContext){.data = this, .vtable = &XY_CTX_VTABLE};
+}
+
+static bool xy_is_xy(const XyValuesContext* this, Symbol name) {
+  return name is this->x_name or name is this->y_name;
+}
+
+static ExprValueResult xy_get_variable_val(XyValuesContext* this,
+                                           Symbol name) {
+  if (name is this->x_name) {
+    ExprValue val = {.type = EXPR_VALUE_NUMBER, .number = this->x};
+    return ExprValueOk(val);
+  } else if (name is this->y_name) {
+    ExprValue val = {.type = EXPR_VALUE_NUMBER, .number = this->y};
+    return ExprValueOk(val);
+  } else
+    return this->parent.vtable->get_variable_val(this->parent.data, name);
+}
+
+static ExprValueResult xy_call_function(XyValuesContext* this, Symbol name,
+                                        ExprValue argument) {
+  return this->parent.vtable->call_function(this->parent.data, name, argument);
+}
+
+static ExprValueResult xy_call_native(XyValuesContext* this, int index,
+                                      ExprValue argument) {
+  return this->parent.vtable->call_native(this->parent.data, index, argument);
+}
+
+// Only used for type inference: x and y are numbers, the rest is as in parent
+
+static bool xy_is_variable(XyValuesContext* this, Symbol name) {
+  return xy_is_xy(this, name) or
+         this->parent.vtable->is_variable(this->parent.data, name);
+}
+
+static bool xy_is_function(XyValuesContext* this, Symbol name) {
+  return this->parent.vtable->is_function(this->parent.data, name);
+}
+
+static ExprType xy_get_call_type(XyValuesContext* this, Symbol name,
+                                 const ExprType* args, int args_count) {
+  return this->parent.vtable->get_call_type(this->parent.data, name, args,
+                                            args_count);
+}
+
+static ExprVariableInfo xy_get_variable_info(XyValuesContext* this,
+                                             Symbol name) {
+  if (not xy_is_xy(this, name))
+    return this->parent.vtable->get_variable_info(this->parent.data, name);
+
+  return (ExprVariableInfo){
+      .is_const = false,
+      .expression = null,
+      .value = null,
+      .value_type = ExprTypeOf(EXPR_VALUE_NUMBER, -1),
+      .correct_context = xy_context(this),
+  };
+}
+
+static ExprFunctionInfo xy_get_function_info(XyValuesContext* this,
+                                             Symbol name) {
+  return this->parent.vtable->get_function_info(this->parent.data, name);
+}
@@ -0,0 +1,41 @@
+#ifndef SRC_CALCULATOR_CALC_COMPILED_H_
+#define SRC_CALCULATOR_CALC_COMPILED_H_
+
+#include "../parser/expr_bytecode.h"
+#include "../util/arena.h"
+#include "../util/better_io.h"
+#include "calc_backend.h"
+#include "calc_scalar.h"
+
+// Expression that was tokenized and parsed once. It can then be evaluated at
+// any number of (x, y) points without being parsed again.
+typedef struct CalcCompiled {
+  str_t text;  // Own copy of the text, error positions point into it
+  CalcBackend backend;
+
+  Arena arena;        // Holds `expr`, `code` and everything made while parsing
+  ExprResult expr;
+  ExprBytecode code;  // Only valid if `expr.is_ok`
+
+  // Number-only form of `code`, if `expr` is sure to be a number. Then
+  // evaluation skips `ExprValue`s altogether, see calc_scalar.h
+  bool is_scalar;
+  CalcScalarCode scalar;
+} CalcCompiled;
+
+CalcCompiled* calc_compile(const char* text);
+ExprValueResult calc_eval(const CalcCompiled* this, double x, double y);
+
+// Evaluates at `n` points (xs[i], ys[i]) into `out[i]`, same as `calc_eval`,
+// except that native functions of number-only code run as SIMD kernels over
+// all the points. Those are within 2 ULP of `calc_eval`, see native_simd.h.
+// Lanes where result is an error or not a number get NAN in `out` and false
+// in `is_ok` (may be null). Returns count of such lanes.
+size_t calc_eval_batch(const CalcCompiled* this, const double* xs,
+                       const double* ys, size_t n, double* out, bool* is_ok);
+void calc_compiled_free(CalcCompiled* this);
+
+// One-shot helper: compiles, evaluates at a single point and frees
+ExprValueResult calc_calculate_expr(const char* text, double x, double y);
+
+#endif  // SRC_CALCULATOR_CALC_COMPILED_H_
@@ -0,0 +1,132 @@
+#include <math.h>
+#include <string.h>
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+#include "calc_compiled.h"
+
+// Points are evaluated in chunks, every stack slot is an array of this many
+// lanes. Small enough for the whole stack to stay in cache.
+#define BATCH_LANES 256
+
+static void batch_run(const CalcScalarCode* program, double* stack,
+                      double* temps, const double* const* args, int lanes,
+                      double* out);
+static size_t eval_batch_points(const CalcCompiled* this, const double* xs,
+                                const double* ys, size_t n, double* out,
+                                bool* is_ok);
+
+// =====
+// =
+// = calc_eval_batch
+// =
+// =====
+size_t calc_eval_batch(const CalcCompiled* this, const double* xs,
+                       const double* ys, size_t n, double* out, bool* is_ok) {
+  assert_m(this);
+  if (n is 0) return 0;
+
+  // Only number-only code runs as arrays, see calc_scalar.h. Anything else
+  // (errors, vectors, ranges, user functions, ...) goes point by point.
+  if (not this->is_scalar)
+    return eval_batch_points(this, xs, ys, n, out, is_ok);
+  const CalcScalarCode* program = &this->scalar;
+
+  double* stack =
+      (double*)MALLOC(sizeof(double) * BATCH_LANES * program->max_stack);
+  assert_alloc(stack);
+
+  double* temps = null;
+  if (program->temps_count > 0) {
+    temps =
+        (double*)MALLOC(sizeof(double) * BATCH_LANES * program->temps_count);
+    assert_alloc(temps);
+  }
+
+  for (size_t start = 0; start < n; start += BATCH_LANES) {
+    int lanes = n - start < BATCH_LANES ? (int)(n - start) : BATCH_LANES;
+    const double* args[] = {xs + start, ys + start};  // Same order as lowered
+    batch_run(program, stack, temps, args, lanes, out + start);
+  }
+
+  FREE(temps);
+  FREE(stack);
+
+  // None of the array operations can fail
+  if (is_ok)
+    for (size_t i = 0; i < n; i++) is_ok[i] = true;
+  return 0;
+}
+
+static void batch_run(const CalcScalarCode* program, double* stack,
+                      double* temps, const double* const* args, int lanes,
+                      double* out) {
+  int top = 0;
+
+  for (int i = 0; i < program->length; i++) {
+    const CalcScalarInstr* instr = &program->code[i];
+    double* slot = &stack[top * BATCH_LANES];
+
+    switch (instr->type) {
+      case CALC_SCALAR_CONST:
+        for (int lane = 0; lane < lanes; lane++) slot[lane] = instr->number;
+        top++;
+        break;
+
+      case CALC_SCALAR_ARG:
+        memcpy(slot, args[instr->arg], sizeof(double) * lanes);
+        top++;
+        break;
+
+      case CALC_SCALAR_UNARY:
+        slot -= BATCH_LANES;
+        instr->unary_batch(slot, slot, lanes);
+        break;
+
+      case CALC_SCALAR_BINARY:
+        top--;
+        slot -= 2 * BATCH_LANES;
+        instr->binary(slot, slot + BATCH_LANES, slot, lanes);
+        break;
+
+      case CALC_SCALAR_STORE:
+        memcpy(&temps[instr->temp * BATCH_LANES], slot - BATCH_LANES,
+               sizeof(double) * lanes);
+        break;
+
+      case CALC_SCALAR_LOAD:
+        memcpy(slot, &temps[instr->temp * BATCH_LANES],
+               sizeof(double) * lanes);
+        top++;
+        break;
+
+      default:
+        panic("Unknown batch instruction %d", instr->type);
+    }
+  }
+
+  assert_m(top is 1);
+  memcpy(out, stack, sizeof(double) * lanes);
+}
+
+static size_t eval_batch_points(const CalcCompiled* this, const double* xs,
+                                const double* ys, size_t n, double* out,
+                                bool* is_ok) {
+  size_t failed_count = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    ExprValueResult res = calc_eval(this, xs[i], ys[i]);
+    bool is_number = res.is_ok and res.ok.type is EXPR_VALUE_NUMBER;
+
+    out[i] = is_number ? res.ok.number : NAN;
+    if (is_ok) is_ok[i] = is_number;
+    if (not is_number) failed_count++;
+
+    if (res.is_ok)
+      expr_value_free(res.ok);
+    else
+      str_free(res.err_text);
+  }
+
+  return failed_count;
+}
@@ -13,13 +13,12 @@ void calc_expr_free(CalcExpr this) {
   expr_free(this.expression);
 
   if (this.type is CALC_EXPR_VARIABLE) {
-    str_free(this.variable_name);
+    // Name is interned
 
   } else if (this.type is CALC_EXPR_PLOT) {
     // nothing
   } else if (this.type is CALC_EXPR_FUNCTION) {
-    str_free(this.function.name);
-    vec_str_t_free(this.function.args);
+    vec_Symbol_free(this.function.args);
 
   } else if (this.type is CALC_EXPR_ACTION) {
     // nothinh
@@ -35,12 +34,12 @@ CalcExpr calc_expr_clone(const CalcExpr* source) {
   };
 
   if (source->type is CALC_EXPR_VARIABLE) {
-    result.variable_name = str_clone(&source->variable_name);
+    result.variable_name = source->variable_name;
   } else if (source->type is CALC_EXPR_PLOT) {
-    result.function.name = str_clone(&source->function.name);
-    result.function.args = vec_str_t_clone(&source->function.args);
-  } else if (source->type is CALC_EXPR_FUNCTION) {
     // nothing
+  } else if (source->type is CALC_EXPR_FUNCTION) {
+    result.function.name = source->function.name;
+    result.function.args = vec_Symbol_clone(&source->function.args);
   } else if (source->type is CALC_EXPR_ACTION) {
     // nothinh
   } else {
@@ -67,13 +66,13 @@ void calc_expr_print(const CalcExpr* this, OutStream stream) {
   x_sprintf(stream, "CalcExpr.%s", calc_expr_type_text(this->type));
 
   if (this->type is CALC_EXPR_VARIABLE) {
-    x_sprintf(stream, "[%s]", this->variable_name.string);
+    x_sprintf(stream, "[%s]", symbol_name(this->variable_name));
   } else if (this->type is CALC_EXPR_FUNCTION) {
-    x_sprintf(stream, "[%s](", this->function.name.string);
+    x_sprintf(stream, "[%s](", symbol_name(this->function.name));
 
     for (int i = 0; i < this->function.args.length; i++) {
       if (i > 0) outstream_puts(", ", stream);
-      outstream_puts(this->function.args.data[i].string, stream);
+      outstream_puts(symbol_name(this->function.args.data[i]), stream);
     }
     outstream_puts(")", stream);
   }
@@ -13,11 +13,11 @@ typedef struct CalcExpr {
   Expr expression;
   int type;
   union {
-    str_t variable_name;
+    Symbol variable_name;
 
     struct {
-      str_t name;
-      vec_str_t args;
+      Symbol name;
+      vec_Symbol args;
     } function;
 
     // plot - nothing
@@ -47,7 +47,6 @@ const char* calc_expr_type_text(int type);
 void calc_expr_print(const CalcExpr* this, OutStream stream);
 
 CalcExprResult calc_expr_parse(ExprContext ctx, const char* text);
-CalcExprResult calc_expr_parse_tt(ExprContext ctx, TokenTree tree);
 
 #define VECTOR_H CalcExpr
 #include "../util/vector.h"
@@ -7,14 +7,24 @@
 #include "calc_expr.h"
 #include "func_const_ctx.h"
 
-static bool is_action(TokenTree* tree);
-static bool is_variable(ExprContext ctx, TokenTree* tree);
-static bool is_function(ExprContext ctx, TokenTree* tree);
+// Statements are told apart by their heads, `name =` or `name(a, b) =`, and
+// the rest (or the whole text for plots) is parsed by `expr_parse_string`.
+// Head only counts if its `=` would be the operator of the whole statement,
+// the way it was when statements were token trees split by operators.
 
-static CalcExprResult parse_action(ExprContext ctx, TokenTree tree);
-static CalcExprResult parse_variable(ExprContext ctx, TokenTree tree);
-static CalcExprResult parse_function(ExprContext ctx, TokenTree tree);
-static CalcExprResult parse_plot(ExprContext ctx, TokenTree tree);
+static bool is_action(const char* text);
+static const char* variable_body(ExprContext ctx, const char* text,
+                                 Symbol* name);
+static const char* function_body(ExprContext ctx, const char* text,
+                                 Symbol* name, vec_Symbol* args);
+
+static CalcExprResult parse_variable(ExprContext ctx, Symbol name,
+                                     const char* body);
+static CalcExprResult parse_function(ExprContext ctx, Symbol name,
+                                     vec_Symbol args, const char* body);
+static CalcExprResult parse_plot(ExprContext ctx, const char* text);
+
+static void resolve_arg_slots(Expr* expr, const vec_Symbol* args);
 
 #define ASCII_MAX 127
 bool vec_char_contains(vec_char* this, char item);
@@ -25,28 +35,24 @@ CalcExprResult calc_expr_parse(ExprContext ctx, const char* text) {
   if (strlen(forbidden.string) > 0) return CalcExprErr(null, forbidden);
   str_free(forbidden);
 
-  TtContext tt_ctx = {
-      .data = ctx.data,
-      .is_function = ctx.vtable->is_function,
-  };
-  TokenTreeResult res = token_tree_parse(text, tt_ctx);
-  // debugln("Got token tree: %$token_tree", res.ok);
+  if (is_action(text))
+    return CalcExprErr(null,
+                       str_literal("Actions are not supported yet! TODO"));
 
-  if (not res.is_ok) return CalcExprErr(res.err.text_pos, res.err.text);
-  return calc_expr_parse_tt(ctx, res.ok);
-}
+  Symbol name;
+  vec_Symbol args = vec_Symbol_create();
+  const char* body = null;
 
-CalcExprResult calc_expr_parse_tt(ExprContext ctx, TokenTree tree) {
   CalcExprResult result;
-
-  if (is_action(&tree))
-    result = parse_action(ctx, tree);
-  else if (is_variable(ctx, &tree))
-    result = parse_variable(ctx, tree);
-  else if (is_function(ctx, &tree))
-    result = parse_function(ctx, tree);
-  else
-    result = parse_plot(ctx, tree);
+  if ((body = variable_body(ctx, text, &name))) {
+    vec_Symbol_free(args);
+    result = parse_variable(ctx, name, body);
+  } else if ((body = function_body(ctx, text, &name, &args))) {
+    result = parse_function(ctx, name, args, body);
+  } else {
+    vec_Symbol_free(args);
+    result = parse_plot(ctx, text);
+  }
 
   return result;
 }
@@ -79,24 +85,18 @@ bool vec_char_contains(vec_char* this, char item) {
 
 static bool is_action_operator(StrSlice op_text);
 
-static bool is_action(TokenTree* tree) {
-  if (tree->is_token) {
-    return tree->token.type is TOKEN_OPERATOR and
-           is_action_operator(tree->token.data.operator_text);
-  } else {
-    bool result = false;
-
-    for (int i = 0; i < tree->tree.vec.length and not result; i++)
-      result = is_action(&tree->tree.vec.data[i]);
+// Action operator anywhere, even in brackets
+static bool is_action(const char* text) {
+  bool result = false;
 
-    return result;
+  TokenResult next = tk_next_token(text);
+  while (next.has_token and not result) {
+    result = next.token.type is TOKEN_OPERATOR and
+             is_action_operator(next.token.data.operator_text);
+    next = tk_next_token(next.next_token_pos);
   }
-}
 
-static CalcExprResult parse_action(ExprContext ctx, TokenTree tree) {
-  unused(ctx);
-  unused(tree);
-  return CalcExprErr(null, str_literal("Actions are not supported yet! TODO"));
+  return result;
 }
 
 static bool is_action_operator(StrSlice op_text) {
@@ -108,129 +108,156 @@ static bool is_action_operator(StrSlice op_text) {
 
 // =====
 
-// VARIABLE
-static bool is_unknown_ident(ExprContext ctx, StrSlice text);
-static bool is_eq_operator(StrSlice op_text);
-static bool is_eq_tt(TokenTree* tree);
-
-static bool is_variable(ExprContext ctx, TokenTree* tree) {
-  // 1. Unknown ident
-  // 2. Equality sign
-  // ... rest garbage
-  if (tree->is_token or tree->tree.vec.length != 3) return false;
+// HEADS
+static bool is_unknown_ident(ExprContext ctx, const TokenResult* token);
+static bool is_token(const TokenResult* token, int type, char bracket);
+static TokenResult skip_empty_brackets(TokenResult token);
+static const char* definition_body(TokenResult eq_sign);
+
+// Unknown ident and an equality sign. Empty brackets are skipped, as they are
+// everywhere, so `k() = 1` is a variable too.
+static const char* variable_body(ExprContext ctx, const char* text,
+                                 Symbol* name) {
+  TokenResult name_token = tk_next_token(text);
+  if (not is_unknown_ident(ctx, &name_token)) return null;
+
+  *name = symbol_intern(name_token.token.data.ident_text);
+  return definition_body(
+      skip_empty_brackets(tk_next_token(name_token.next_token_pos)));
+}
 
-  Token* var_name = token_tree_get_only_token(&tree->tree.vec.data[0]);
-  if (not var_name or var_name->type is_not TOKEN_IDENT) return false;
+// Unknown ident, idents list in brackets (a trailing comma is fine) and an
+// equality sign
+static const char* function_body(ExprContext ctx, const char* text,
+                                 Symbol* name, vec_Symbol* args) {
+  TokenResult name_token = tk_next_token(text);
+  if (not is_unknown_ident(ctx, &name_token)) return null;
+
+  TokenResult token = tk_next_token(name_token.next_token_pos);
+  if (not is_token(&token, TOKEN_BRACKET, '\0')) return null;
+
+  char opening = token.token.data.bracket_symbol;
+  char closing = opening is '('   ? ')'
+                 : opening is '[' ? ']'
+                 : opening is '{' ? '}'
+                                  : '\0';
+  if (closing is '\0') return null;
+
+  bool is_arg_next = true;
+  token = tk_next_token(token.next_token_pos);
+  while (not is_token(&token, TOKEN_BRACKET, closing)) {
+    if (is_arg_next and is_token(&token, TOKEN_IDENT, '\0'))
+      vec_Symbol_push(args, symbol_intern(token.token.data.ident_text));
+    else if (is_arg_next or not is_token(&token, TOKEN_COMMA, '\0'))
+      return null;
+
+    is_arg_next = not is_arg_next;
+    token = tk_next_token(token.next_token_pos);
+  }
+  if (args->length is 0) return null;
 
-  return is_unknown_ident(ctx, var_name->data.ident_text) and
-         is_eq_tt(&tree->tree.vec.data[1]);
+  *name = symbol_intern(name_token.token.data.ident_text);
+  return definition_body(tk_next_token(token.next_token_pos));
 }
 
-static CalcExprResult parse_variable(ExprContext ctx, TokenTree tree) {
-  assert_m(not tree.is_token and tree.tree.vec.length >= 3);
-
-  // Name
-  str_t var_name;
-  {
-    TokenTree first = vec_TokenTree_extract_order(&tree.tree.vec, 0);
-    Token* var_name_token = token_tree_get_only_token(&first);
-    assert_m(var_name_token and var_name_token->type is TOKEN_IDENT);
-    var_name = str_slice_to_owned(var_name_token->data.ident_text);
-    token_tree_free(first);
+// Body after the sign, if it has no commas (except for a trailing one) and no
+// operators of the same or lower priority outside of brackets. Such body
+// would be just one operand of the statement.
+static const char* definition_body(TokenResult eq_sign) {
+  if (not is_token(&eq_sign, TOKEN_OPERATOR, '\0')) return null;
+
+  StrSlice sign = eq_sign.token.data.operator_text;
+  if (not str_slice_eq_ccp(sign, "=") and not str_slice_eq_ccp(sign, "=="))
+    return null;
+
+  int priority = expr_get_operator_priority(sign);
+  int depth = 0;  // Of brackets
+  bool is_empty = true;
+
+  TokenResult token = tk_next_token(eq_sign.next_token_pos);
+  for (; token.has_token; token = tk_next_token(token.next_token_pos)) {
+    int type = token.token.type;
+
+    if (type is TOKEN_BRACKET) {
+      char bracket = token.token.data.bracket_symbol;
+      bool is_opening = bracket is '(' or bracket is '[' or bracket is '{';
+      depth += is_opening ? 1 : -1;
+      if (depth < 0) return null;
+
+    } else {
+      is_empty = false;
+      if (depth > 0) continue;
+
+      if (type is TOKEN_COMMA and tk_next_token(token.next_token_pos).has_token)
+        return null;
+      if (type is TOKEN_OPERATOR and
+          expr_get_operator_priority(token.token.data.operator_text) <=
+              priority)
+        return null;
+    }
   }
 
-  // =
-  {
-    TokenTree second = vec_TokenTree_extract_order(&tree.tree.vec, 0);
-    Token* eq_token = token_tree_get_only_token(&second);
-    assert_m(eq_token and eq_token->type is TOKEN_OPERATOR and
-             is_eq_operator(eq_token->data.operator_text))
-        token_tree_free(second);
+  return is_empty ? null : eq_sign.next_token_pos;
+}
+
+static bool is_unknown_ident(ExprContext ctx, const TokenResult* token) {
+  if (not is_token(token, TOKEN_IDENT, '\0')) return false;
+
+  StrSlice text = token->token.data.ident_text;
+  Symbol name = symbol_intern(text);
+  return not str_slice_eq_ccp(text, "x") and not str_slice_eq_ccp(text, "y") and
+         not ctx.vtable->is_function(ctx.data, name) and
+         not ctx.vtable->is_variable(ctx.data, name);
+}
+
+static TokenResult skip_empty_brackets(TokenResult token) {
+  while (is_token(&token, TOKEN_BRACKET, '\0')) {
+    char opening = token.token.data.bracket_symbol;
+    TokenResult next = tk_next_token(token.next_token_pos);
+
+    bool is_empty = (opening is '(' and is_token(&next, TOKEN_BRACKET, ')')) or
+                    (opening is '[' and is_token(&next, TOKEN_BRACKET, ']')) or
+                    (opening is '{' and is_token(&next, TOKEN_BRACKET, '}'));
+    if (not is_empty) break;
+
+    token = tk_next_token(next.next_token_pos);
   }
+  return token;
+}
+
+// Bracket has to be this one, unless it is '\0'
+static bool is_token(const TokenResult* token, int type, char bracket) {
+  if (not token->has_token or token->token.type is_not type) return false;
 
-  // Right side
-  ExprResult expr_res = expr_parse_token_tree(tree, ctx);
+  return type is_not TOKEN_BRACKET or bracket is '\0' or
+         token->token.data.bracket_symbol is bracket;
+}
+
+// =====
+
+// VARIABLE
+
+static CalcExprResult parse_variable(ExprContext ctx, Symbol name,
+                                     const char* body) {
+  ExprResult expr_res = expr_parse_string(body, ctx);
   CalcExprResult result;
   if (expr_res.is_ok) {
     CalcExpr to_add = {
         .type = CALC_EXPR_VARIABLE,
         .expression = expr_res.ok,
-        .variable_name = var_name,
+        .variable_name = name,
     };
     result = CalcExprOk(to_add);
   } else {
-    str_free(var_name);
     result = CalcExprErr(expr_res.err_pos, expr_res.err_text);
   }
   return result;
 }
 
-static bool is_eq_tt(TokenTree* tree) {
-  Token* eq_sign = token_tree_get_only_token(tree);
-  if (not eq_sign or eq_sign->type is_not TOKEN_OPERATOR) return false;
-  if (not is_eq_operator(eq_sign->data.operator_text)) return false;
-
-  return true;
-}
-
-static bool is_unknown_ident(ExprContext ctx, StrSlice text) {
-  return not str_slice_eq_ccp(text, "x") and not str_slice_eq_ccp(text, "y") and
-         not ctx.vtable->is_function(ctx.data, text) and
-         not ctx.vtable->is_variable(ctx.data, text);
-}
-
-static bool is_eq_operator(StrSlice op_text) {
-  return str_slice_eq_ccp(op_text, "=") or str_slice_eq_ccp(op_text, "==");
-}
-
 // ===== FUNCTION
 
-static bool is_function_definition(ExprContext ctx, TokenTree* tree);
-
-static bool is_function(ExprContext ctx, TokenTree* tree) {
-  // Unknown ident + idents list in brackets
-  // Equality sign
-  // ...Rest garbage
-  if (not tree or tree->is_token or tree->tree.vec.length != 3) return false;
-
-  return is_function_definition(ctx, &tree->tree.vec.data[0]) and
-         is_eq_tt(&tree->tree.vec.data[1]);
-}
-
-static CalcExprResult parse_function(ExprContext ctx,
-                                     TokenTree tree) {  // freeed
-  // name, list of args and an expr
-  assert_m(not tree.is_token and tree.tree.vec.length is 3);
-
-  TokenTree right_part =
-      vec_TokenTree_popget(&tree.tree.vec);  // passed ownership
-  vec_TokenTree_popfree(&tree.tree.vec);     // Eq sign
-
-  TokenTree left_part = vec_TokenTree_popget(&tree.tree.vec);  // freeed
-  token_tree_free(tree);
-  left_part = token_tree_unwrap_wrappers(left_part);
-  assert_m(not left_part.is_token and left_part.tree.vec.length is 2);
-
-  TokenTree args_tt = vec_TokenTree_popget(&left_part.tree.vec);  // freeed
-  TokenTree name_tt = vec_TokenTree_popget(&left_part.tree.vec);  // freeed
-  token_tree_free(left_part);
-
-  str_t fn_name =
-      str_slice_to_owned(token_tree_get_only_token(&name_tt)->data.ident_text);
-  token_tree_free(name_tt);
-  vec_str_t args = vec_str_t_create();
-
-  assert_m(not args_tt.is_token);
-  for (int i = 0; i < args_tt.tree.vec.length; i++) {
-    TokenTree* item = &args_tt.tree.vec.data[i];
-    if (token_tree_ttype(item) is TOKEN_COMMA) continue;
-    assert_m(token_tree_ttype_skip(item) is TOKEN_IDENT);
-    vec_str_t_push(
-        &args,
-        str_slice_to_owned(token_tree_get_only_token(item)->data.ident_text));
-  }
-  token_tree_free(args_tt);
-
+static CalcExprResult parse_function(ExprContext ctx, Symbol name,
+                                     vec_Symbol args, const char* body) {
   FuncConstCtx local_ctx = {
       .parent = ctx,
       .used_args = &args,
@@ -238,68 +265,48 @@ static CalcExprResult parse_function(ExprContext ctx,
   };
 
   ExprResult expr_res =
-      expr_parse_token_tree(right_part, func_const_ctx_context(&local_ctx));
+      expr_parse_string(body, func_const_ctx_context(&local_ctx));
   if (expr_res.is_ok) {
+    resolve_arg_slots(&expr_res.ok, &args);
     CalcExpr to_add = {.type = CALC_EXPR_FUNCTION,
                        .expression = expr_res.ok,
                        .function = {
                            .args = args,
-                           .name = fn_name,
+                           .name = name,
                        }};
     return CalcExprOk(to_add);
   } else {
-    str_free(fn_name);
-    vec_str_t_free(args);
+    vec_Symbol_free(args);
     return CalcExprErr(expr_res.err_pos, expr_res.err_text);
   }
 }
 
-static bool is_function_definition(ExprContext ctx, TokenTree* tree) {
-  if (not tree->is_token and tree->tree.vec.length is 1)
-    return is_function_definition(ctx, &tree->tree.vec.data[0]);
+// Arguments are then found by index, without looking up their names on every
+// call. Same as with names, the first of repeated arguments wins.
+static void resolve_arg_slots(Expr* expr, const vec_Symbol* args) {
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = expr});
 
-  if (tree->is_token)
-    return false;  // Single token is not enough to be a function definition
+  while (stack.length > 0) {
+    Expr* node = (Expr*)vec_ExprStep_popget(&stack).expr;
 
-  vec_TokenTree* subtrees = &tree->tree.vec;
-
-  bool is_function_pre =
-      subtrees->length is 2 and                                // f(x)
-      token_tree_ttype(&subtrees->data[0]) is TOKEN_IDENT and  // Name is ident
-      is_unknown_ident(ctx, subtrees->data[0].token.data.ident_text);
-
-  if (not is_function_pre) return false;
-
-  if (subtrees->data[1].is_token) {
-    // if (not is_unknown_ident(ctx, subtrees->data[1].token.data.ident_text))
-    // return false;
-    return false;
-  } else {
-    vec_TokenTree* args = &subtrees->data[1].tree.vec;
-    int tokens_in_a_row = 0;
-    for (int i = 0; i < args->length; i++) {
-      int type = token_tree_ttype_skip(&args->data[i]);
-      if (type is TOKEN_COMMA) {
-        if (tokens_in_a_row is 0)
-          return false;
-        else
-          tokens_in_a_row = 0;
-      } else if (type != TOKEN_IDENT)
-        return false;
-      else if (tokens_in_a_row is 1)
-        return false;
-      else
-        tokens_in_a_row++;
+    if (node->type is EXPR_VARIABLE) {
+      for (int i = 0; i < args->length and node->variable.arg_slot is 0; i++)
+        if (node->variable.name is args->data[i])
+          node->variable.arg_slot = i + 1;
     }
+
+    for (int i = 0; expr_child(node, i); i++)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = expr_child(node, i)});
   }
 
-  return true;
+  vec_ExprStep_free(stack);
 }
 
 // PLOT EXPR
 
-static CalcExprResult parse_plot(ExprContext ctx, TokenTree tree) {
-  ExprResult expr_res = expr_parse_token_tree(tree, ctx);
+static CalcExprResult parse_plot(ExprContext ctx, const char* text) {
+  ExprResult expr_res = expr_parse_string(text, ctx);
 
   if (expr_res.is_ok) {
     CalcExpr to_add = {
@@ -310,4 +317,4 @@ static CalcExprResult parse_plot(ExprContext ctx, TokenTree tree) {
   } else {
     return CalcExprErr(expr_res.err_pos, expr_res.err_text);
   }
-}
\ No newline at end of file
+}
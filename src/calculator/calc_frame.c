@@ -0,0 +1,138 @@
+#include "calc_frame.h"
+
+#include "../util/prettify_c.h"
+#include "native_functions.h"
+
+static int frame_find_arg(const CalcFrame* this, Symbol name);
+
+// Parsing
+static bool frame_is_variable(CalcFrame* this, Symbol var_name);
+static bool frame_is_function(CalcFrame* this, Symbol fun_name);
+static int frame_find_native(CalcFrame* this, Symbol fun_name);
+
+// Computation
+static ExprValueResult frame_get_variable_val(CalcFrame* this, Symbol);
+static ExprValueResult frame_get_argument_val(CalcFrame* this, int index);
+static ExprValueResult frame_call_function(CalcFrame* this, Symbol,
+                                           ExprValue);
+static ExprValueResult frame_call_native(CalcFrame* this, int index,
+                                         ExprValue argument);
+
+// Anasysis and compilation
+static bool frame_is_expr_const(CalcFrame* this, const Expr* expr);
+static ExprType frame_get_expr_type(CalcFrame* this, const Expr* expr);
+static ExprType frame_get_argument_type(CalcFrame* this, int index);
+static ExprType frame_get_call_type(CalcFrame* this, Symbol fun_name,
+                                    const ExprType* args, int args_count);
+
+static ExprVariableInfo frame_get_variable_info(CalcFrame* this,
+                                                Symbol var_name);
+static ExprFunctionInfo frame_get_function_info(CalcFrame* this,
+                                                Symbol fun_name);
+
+ExprContext calc_frame_context(CalcFrame* this) {
+  static const ExprContextVtable table = {
+      .is_variable = (void*)frame_is_variable,
+      .is_function = (void*)frame_is_function,
+      .find_native = (void*)frame_find_native,
+      .get_variable_val = (void*)frame_get_variable_val,
+      .get_argument_val = (void*)frame_get_argument_val,
+      .call_function = (void*)frame_call_function,
+      .call_native = (void*)frame_call_native,
+      .is_expr_const = (void*)frame_is_expr_const,
+      .get_expr_type = (void*)frame_get_expr_type,
+      .get_argument_type = (void*)frame_get_argument_type,
+      .get_call_type = (void*)frame_get_call_type,
+      .get_variable_info = (void*)frame_get_variable_info,
+      .get_function_info = (void*)frame_get_function_info,
+  };
+
+  return (ExprContext){.data = this, .vtable = &table};
+}
+
+// Only for expressions without resolved slots
+static int frame_find_arg(const CalcFrame* this, Symbol name) {
+  for (int i = 0; i < this->args_names->length; i++)
+    if (name is this->args_names->data[i]) return i;
+  return -1;
+}
+
+// Parsing
+static bool frame_is_variable(CalcFrame* this, Symbol var_name) {
+  if (frame_find_arg(this, var_name) >= 0) return true;
+
+  ExprContext ctx = calc_backend_get_context(this->backend);
+  return ctx.vtable->is_variable(ctx.data, var_name);
+}
+static bool frame_is_function(CalcFrame* this, Symbol fun_name) {
+  if (frame_find_arg(this, fun_name) >= 0) return false;
+
+  ExprContext ctx = calc_backend_get_context(this->backend);
+  return ctx.vtable->is_function(ctx.data, fun_name);
+}
+static int frame_find_native(CalcFrame* this, Symbol fun_name) {
+  if (frame_find_arg(this, fun_name) >= 0) return -1;
+
+  return calculator_find_native(symbol_slice(fun_name));
+}
+
+// Computation
+static ExprValueResult frame_get_variable_val(CalcFrame* this,
+                                              Symbol var_name) {
+  int index = frame_find_arg(this, var_name);
+  if (index >= 0) return frame_get_argument_val(this, index);
+
+  ExprContext ctx = calc_backend_get_context(this->backend);
+  return ctx.vtable->get_variable_val(ctx.data, var_name);
+}
+static ExprValueResult frame_get_argument_val(CalcFrame* this, int index) {
+  assert_m(index >= 0 and index < this->args_names->length);
+
+  if (index < this->args_count)
+    return ExprValueOk(expr_value_clone(&this->args[index]));
+  else
+    return ExprValueOk((ExprValue){.type = EXPR_VALUE_NONE});
+}
+static ExprValueResult frame_call_function(CalcFrame* this, Symbol fun_name,
+                                           ExprValue argument) {
+  return calc_backend_call_function(this->backend, fun_name, argument);
+}
+static ExprValueResult frame_call_native(CalcFrame* this, int index,
+                                         ExprValue argument) {
+  unused(this);
+  return calculator_call_native(index, argument);
+}
+
+// Anasysis and compilation
+static bool frame_is_expr_const(CalcFrame* this, const Expr* expr) {
+  return calc_backend_is_expr_const(this->backend, expr);
+}
+static ExprType frame_get_expr_type(CalcFrame* this, const Expr* expr) {
+  return expr_infer_type(expr, calc_frame_context(this));
+}
+static ExprType frame_get_argument_type(CalcFrame* this, int index) {
+  assert_m(index >= 0 and index < this->args_names->length);
+
+  if (index >= this->args_count)
+    return ExprTypeOf(EXPR_VALUE_NONE, -1);
+  else if (this->args)
+    return expr_type_of_value(&this->args[index]);
+  else
+    return this->args_types[index];
+}
+static ExprType frame_get_call_type(CalcFrame* this, Symbol fun_name,
+                                    const ExprType* args, int args_count) {
+  return calc_backend_call_type(this->backend, fun_name, args, args_count,
+                                this->depth);
+}
+
+static ExprVariableInfo frame_get_variable_info(CalcFrame* this,
+                                                Symbol var_name) {
+  ExprContext ctx = calc_backend_get_context(this->backend);
+  return ctx.vtable->get_variable_info(ctx.data, var_name);
+}
+static ExprFunctionInfo frame_get_function_info(CalcFrame* this,
+                                                Symbol fun_name) {
+  ExprContext ctx = calc_backend_get_context(this->backend);
+  return ctx.vtable->get_function_info(ctx.data, fun_name);
+}
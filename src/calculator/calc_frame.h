@@ -0,0 +1,24 @@
+#ifndef SRC_CALCULATOR_CALC_FRAME_H_
+#define SRC_CALCULATOR_CALC_FRAME_H_
+
+#include "../parser/expr.h"
+#include "calc_backend.h"
+
+// Context of one user function call. Arguments are only borrowed, and the
+// body finds them by `ExprVariable.arg_slot`. Every other name is looked up
+// in the backend.
+// Inferring types of a call uses the same frame, with types of arguments
+// instead of their values.
+typedef struct CalcFrame {
+  CalcBackend* backend;
+  const vec_Symbol* args_names;
+  const ExprValue* args;
+  int args_count;  // Missing arguments have no value
+
+  const ExprType* args_types;  // Only while inferring types
+  int depth;                   // See `calc_backend_call_type`
+} CalcFrame;
+
+ExprContext calc_frame_context(CalcFrame* this);
+
+#endif  // SRC_CALCULATOR_CALC_FRAME_H_
@@ -0,0 +1,177 @@
+#include "calc_scalar.h"
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+
+static bool lower_instr(const ExprInstr* instr, ExprContext ctx,
+                        const vec_Symbol* args_names, CalcScalarInstr* into);
+static int find_arg(const vec_Symbol* args_names, Symbol name);
+
+// =====
+// =
+// = calc_scalar_lower
+// =
+// =====
+bool calc_scalar_lower(const ExprBytecode* code, ExprContext ctx,
+                       const vec_Symbol* args_names, CalcScalarCode* into) {
+  assert_m(code and args_names and into);
+  int length = code->code.length;
+
+  CalcScalarInstr* program =
+      (CalcScalarInstr*)MALLOC(sizeof(CalcScalarInstr) * (length + 1));
+  assert_alloc(program);
+
+  for (int i = 0; i < length; i++) {
+    if (not lower_instr(&code->code.data[i], ctx, args_names, &program[i])) {
+      FREE(program);
+      return false;
+    }
+  }
+
+  *into = (CalcScalarCode){
+      .code = program,
+      .length = length,
+      .max_stack = code->max_stack,
+      .temps_count = code->temps_count,
+      .args_count = args_names->length,
+  };
+  return true;
+}
+
+static bool lower_instr(const ExprInstr* instr, ExprContext ctx,
+                        const vec_Symbol* args_names, CalcScalarInstr* into) {
+  switch (instr->type) {
+    case EXPR_OP_NUMBER:
+      *into = (CalcScalarInstr){.type = CALC_SCALAR_CONST,
+                                .number = instr->number};
+      return true;
+
+    case EXPR_OP_VARIABLE: {
+      int arg = find_arg(args_names, instr->name);
+      if (arg >= 0) {
+        *into = (CalcScalarInstr){.type = CALC_SCALAR_ARG, .arg = arg};
+        return true;
+      }
+
+      ExprValueResult res = ctx.vtable->get_variable_val(ctx.data, instr->name);
+      bool is_number = res.is_ok and res.ok.type is EXPR_VALUE_NUMBER;
+
+      if (is_number)
+        *into = (CalcScalarInstr){.type = CALC_SCALAR_CONST,
+                                  .number = res.ok.number};
+
+      if (res.is_ok)
+        expr_value_free(res.ok);
+      else
+        str_free(res.err_text);
+
+      return is_number;
+    }
+
+    case EXPR_OP_CALL: {
+      // Natives take precedence over user functions, same as in backend
+      StrSlice name = symbol_slice(instr->name);
+      NativeScalarFnPtr fn = calculator_get_native_scalar_function(name);
+      if (not fn) return false;
+      *into = (CalcScalarInstr){
+          .type = CALC_SCALAR_UNARY,
+          .unary = fn,
+          .unary_batch = calculator_get_native_batch_function(name),
+      };
+      return true;
+    }
+
+    case EXPR_OP_BINARY_OP: {
+      OperatorBatchFn fn = expr_get_operator_batch_fn(instr->operator);
+      if (not fn) return false;
+      *into = (CalcScalarInstr){.type = CALC_SCALAR_BINARY, .binary = fn};
+      return true;
+    }
+
+    case EXPR_OP_STORE:
+      *into = (CalcScalarInstr){.type = CALC_SCALAR_STORE,
+                                .temp = instr->temp};
+      return true;
+
+    case EXPR_OP_LOAD:
+      *into = (CalcScalarInstr){.type = CALC_SCALAR_LOAD, .temp = instr->temp};
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Same as in `CalcFrame`: first argument with the name wins
+static int find_arg(const vec_Symbol* args_names, Symbol name) {
+  for (int i = 0; i < args_names->length; i++)
+    if (name is args_names->data[i]) return i;
+  return -1;
+}
+
+void calc_scalar_free(CalcScalarCode this) { FREE(this.code); }
+
+// =====
+// =
+// = calc_scalar_run
+// =
+// =====
+double calc_scalar_run(const CalcScalarCode* this, const double* args) {
+  double local_stack[32];
+  double local_temps[8];
+  double* stack = local_stack;
+  double* temps = local_temps;
+
+  if (this->max_stack > (int)LEN(local_stack)) {
+    stack = (double*)MALLOC(sizeof(double) * this->max_stack);
+    assert_alloc(stack);
+  }
+  if (this->temps_count > (int)LEN(local_temps)) {
+    temps = (double*)MALLOC(sizeof(double) * this->temps_count);
+    assert_alloc(temps);
+  }
+
+  // Natives are libm for a single number, the same as in the generic
+  // evaluation, so results are the same bit for bit
+  int top = 0;
+  for (int i = 0; i < this->length; i++) {
+    const CalcScalarInstr* instr = &this->code[i];
+
+    switch (instr->type) {
+      case CALC_SCALAR_CONST:
+        stack[top++] = instr->number;
+        break;
+
+      case CALC_SCALAR_ARG:
+        stack[top++] = args[instr->arg];
+        break;
+
+      case CALC_SCALAR_UNARY:
+        stack[top - 1] = instr->unary(stack[top - 1]);
+        break;
+
+      case CALC_SCALAR_BINARY:
+        top--;
+        instr->binary(&stack[top - 1], &stack[top], &stack[top - 1], 1);
+        break;
+
+      case CALC_SCALAR_STORE:
+        temps[instr->temp] = stack[top - 1];
+        break;
+
+      case CALC_SCALAR_LOAD:
+        stack[top++] = temps[instr->temp];
+        break;
+
+      default:
+        panic("Unknown scalar instruction %d", instr->type);
+    }
+  }
+
+  assert_m(top is 1);
+  double result = stack[0];
+
+  if (stack != local_stack) FREE(stack);
+  if (temps != local_temps) FREE(temps);
+  return result;
+}
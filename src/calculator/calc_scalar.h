@@ -0,0 +1,57 @@
+#ifndef SRC_CALCULATOR_CALC_SCALAR_H_
+#define SRC_CALCULATOR_CALC_SCALAR_H_
+
+#include <stdbool.h>
+
+#include "../parser/expr.h"
+#include "../parser/expr_bytecode.h"
+#include "native_functions.h"
+
+// Number-only form of bytecode: every value is a plain double, with no
+// `ExprValue` tags and no type checks. Only numbers, arguments, arithmetic and
+// unary natives have this form. None of them can fail (bad math just gives
+// NaN or infinity, same as in the bytecode), so there are no errors to report
+// and results are exactly the same numbers.
+// Vectors, ranges, indexing and natives like `join` or `slice` have no such
+// form, so code with them is never lowered.
+
+#define CALC_SCALAR_CONST 1   // push `number`
+#define CALC_SCALAR_ARG 2     // push argument `arg`
+#define CALC_SCALAR_UNARY 4   // apply `unary` (or `unary_batch`) to the top
+#define CALC_SCALAR_BINARY 5  // pop rhs, apply `binary` to lhs
+#define CALC_SCALAR_STORE 6   // copy top value into temporary `temp`
+#define CALC_SCALAR_LOAD 7    // push temporary `temp`
+
+typedef struct CalcScalarInstr {
+  int type;
+  union {
+    double number;
+    struct {
+      NativeScalarFnPtr unary;  // Single number, libm
+      NativeBatchFnPtr unary_batch;
+    };
+    OperatorBatchFn binary;
+    int temp;
+    int arg;
+  };
+} CalcScalarInstr;
+
+typedef struct CalcScalarCode {
+  CalcScalarInstr* code;
+  int length;
+  int max_stack;
+  int temps_count;
+  int args_count;
+} CalcScalarCode;
+
+// Returns false if some instruction has no number-only form. Variables named
+// in `args_names` become arguments, in that order. Other variables do not
+// depend on the arguments, so their values are taken from `ctx` right away.
+bool calc_scalar_lower(const ExprBytecode* code, ExprContext ctx,
+                       const vec_Symbol* args_names, CalcScalarCode* into);
+void calc_scalar_free(CalcScalarCode this);
+
+// `args` has `args_count` numbers
+double calc_scalar_run(const CalcScalarCode* this, const double* args);
+
+#endif  // SRC_CALCULATOR_CALC_SCALAR_H_
@@ -9,16 +9,15 @@
 #include "../util/vector.h"  // vec_CalcValue
 
 void calc_value_free(CalcValue this) {
-  str_free(this.name);
   expr_value_free(this.value);
 }
 
 CalcValue calc_value_clone(const CalcValue* this) {
-  return (CalcValue){.name = str_clone(&this->name),
+  return (CalcValue){.name = this->name,
                      .value = expr_value_clone(&this->value)};
 }
 
 void calc_value_print(const CalcValue* this, OutStream stream) {
-  x_sprintf(stream, "CalcValue(%s = %$expr_value)", this->name.string,
+  x_sprintf(stream, "CalcValue(%s = %$expr_value)", symbol_name(this->name),
             this->value);
 }
\ No newline at end of file
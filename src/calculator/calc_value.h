@@ -4,9 +4,10 @@
 #include "../parser/expr_value.h"
 #include "../util/better_io.h"
 #include "../util/better_string.h"
+#include "../util/symbol.h"
 
 typedef struct CalcValue {
-  str_t name;
+  Symbol name;
   ExprValue value;
 } CalcValue;
 
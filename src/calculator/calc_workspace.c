@@ -0,0 +1,403 @@
+#include "calc_workspace.h"
+
+#include "../parser/tokenizer.h"
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+
+#define VECTOR_C CalcWorkspaceRow
+#define VECTOR_ITEM_DESTRUCTOR calc_workspace_row_free
+#include "../util/vector.h"
+
+#define VECTOR_C vec_int
+#define VECTOR_ITEM_DESTRUCTOR vec_int_free
+#include "../util/vector.h"
+
+static bool is_blank(const char* text);
+static Symbol definition_candidate(const char* text);
+static vec_Symbol text_idents(const char* text);
+static int expr_position(const CalcWorkspace* this, int row_index);
+static void row_parse(CalcWorkspace* this, CalcWorkspaceRow* row,
+                      int position);
+static void row_set_names(CalcWorkspaceRow* row, const CalcExpr* expr);
+static void link_row(CalcWorkspace* this, const CalcWorkspaceRow* row);
+static void unlink_row(CalcWorkspace* this, const CalcWorkspaceRow* row);
+static void mark_dependents(CalcWorkspace* this);
+static void push_row_names(vec_Symbol* names, const CalcWorkspaceRow* row);
+static bool* find_forward_exprs(const CalcWorkspace* this);
+static void set_visible_count(CalcWorkspace* this, int count,
+                              const bool* is_forward);
+
+// =====
+// =
+// = BASICS
+// =
+// =====
+CalcWorkspace calc_workspace_create() {
+  return (CalcWorkspace){
+      .backend = calc_backend_create(),
+      .rows = vec_CalcWorkspaceRow_create(),
+      .removed_names = vec_Symbol_create(),
+      .users = vec_vec_int_create(),
+      .last_row_id = 0,
+  };
+}
+
+void calc_workspace_free(CalcWorkspace this) {
+  calc_backend_free(this.backend);
+  vec_CalcWorkspaceRow_free(this.rows);
+  vec_Symbol_free(this.removed_names);
+  vec_vec_int_free(this.users);
+}
+
+void calc_workspace_row_free(CalcWorkspaceRow this) {
+  str_free(this.text);
+  str_free(this.message);
+  vec_Symbol_free(this.names);
+}
+
+void calc_workspace_insert_row(CalcWorkspace* this, int index,
+                               const char* text) {
+  assert_m(index >= 0 and index <= this->rows.length);
+
+  CalcWorkspaceRow row = {
+      .text = str_owned("%s", text),
+      .message = str_literal(""),
+      .needs_update = true,
+      .expr_index = -1,
+      .id = ++this->last_row_id,
+      .defined_name = SYMBOL_NONE,
+      .names = vec_Symbol_create(),
+  };
+  vec_CalcWorkspaceRow_insert(&this->rows, row, index);
+}
+
+// Rows using its name are only found on the next recompute, their results
+// stay until then
+void calc_workspace_remove_row(CalcWorkspace* this, int index) {
+  assert_m(index >= 0 and index < this->rows.length);
+
+  CalcWorkspaceRow* row = &this->rows.data[index];
+  if (row->defined_name is_not SYMBOL_NONE)
+    vec_Symbol_push(&this->removed_names, row->defined_name);
+  if (row->expr_index >= 0)
+    calc_backend_remove_expr(&this->backend, expr_position(this, index));
+
+  unlink_row(this, row);
+  vec_CalcWorkspaceRow_delete_order(&this->rows, index);
+}
+
+void calc_workspace_set_row(CalcWorkspace* this, int index, const char* text) {
+  assert_m(index >= 0 and index < this->rows.length);
+  CalcWorkspaceRow* row = &this->rows.data[index];
+
+  if (strcmp(row->text.string, text) is 0) return;
+
+  str_free(row->text);
+  row->text = str_owned("%s", text);
+  row->needs_update = true;
+}
+
+// Rows above may have changed, so it is counted again
+static int expr_position(const CalcWorkspace* this, int row_index) {
+  int result = 0;
+  for (int i = 0; i < row_index; i++)
+    if (this->rows.data[i].expr_index >= 0) result++;
+
+  return result;
+}
+
+// =====
+// =
+// = calc_workspace_recompute
+// =
+// =====
+int calc_workspace_recompute(CalcWorkspace* this, CalcWorkspaceRowFn on_row,
+                             void* data) {
+  // 1. Rows which may mean something else now
+  mark_dependents(this);
+
+  // 2. Parse top-down, so that a row only sees the expressions above it.
+  // Parsing just looks names up, so nothing is cached while the rest of the
+  // backend is hidden.
+  int position = 0;  // Count of expressions above the row
+  for (int i = 0; i < this->rows.length; i++) {
+    CalcWorkspaceRow* row = &this->rows.data[i];
+
+    if (row->needs_update) {
+      unlink_row(this, row);
+      if (row->expr_index >= 0)
+        calc_backend_remove_expr(&this->backend, position);
+
+      row_parse(this, row, position);
+      link_row(this, row);
+    }
+
+    if (row->expr_index >= 0) row->expr_index = position++;
+  }
+
+  // 3. Calculate, again with only the rows above known. Most expressions only
+  // use names defined above them, so what they cached stays the same whatever
+  // is hidden. Forward ones have to calculate it again.
+  bool* is_forward = find_forward_exprs(this);
+  int recomputed_count = 0;
+  position = 0;
+  for (int i = 0; i < this->rows.length; i++) {
+    CalcWorkspaceRow* row = &this->rows.data[i];
+    if (row->expr_index >= 0) position++;
+    if (not row->needs_update) continue;
+
+    row->needs_update = false;
+    if (row->expr_index >= 0) {
+      // Expression is not added yet when `calc_backend_add_expr` says this
+      set_visible_count(this, row->expr_index, is_forward);
+      str_free(row->message);
+      row->message = calc_backend_expr_message(
+          &this->backend, &this->backend.expressions.data[row->expr_index]);
+    }
+
+    recomputed_count++;
+    set_visible_count(this, position, is_forward);
+    if (on_row) on_row(data, i, row, &this->backend);
+  }
+
+  this->backend.visible_count = -1;
+  FREE(is_forward);
+  return recomputed_count;
+}
+
+// Expression goes to `position` in the backend, if the text is parsed
+static void row_parse(CalcWorkspace* this, CalcWorkspaceRow* row,
+                      int position) {
+  str_free(row->message);
+  vec_Symbol_free(row->names);
+
+  row->message = str_literal("");
+  row->expr_index = -1;
+  row->defined_name = SYMBOL_NONE;
+  row->names = vec_Symbol_create();
+
+  if (is_blank(row->text.string)) return;
+
+  ExprContext ctx = calc_backend_get_context(&this->backend);
+  this->backend.visible_count = position;
+  CalcExprResult res = calc_expr_parse(ctx, row->text.string);
+  this->backend.visible_count = -1;
+
+  if (not res.is_ok) {
+    row->message = calc_backend_parse_error_message(res);
+    // Not parsed, so any name in the text may matter
+    row->names = text_idents(row->text.string);
+    return;
+  }
+
+  calc_backend_insert_expr(&this->backend, position, res.ok);
+  row->expr_index = position;
+  row_set_names(row, &this->backend.expressions.data[position]);
+}
+
+static void row_set_names(CalcWorkspaceRow* row, const CalcExpr* expr) {
+  vec_str_t variables = expr_get_used_variables(&expr->expression);
+  vec_str_t functions = expr_get_used_functions(&expr->expression);
+
+  for (int i = 0; i < variables.length; i++)
+    vec_Symbol_push(&row->names,
+                    symbol_intern(str_slice_from_str_t(&variables.data[i])));
+  for (int i = 0; i < functions.length; i++)
+    vec_Symbol_push(&row->names,
+                    symbol_intern(str_slice_from_str_t(&functions.data[i])));
+
+  vec_str_t_free(variables);
+  vec_str_t_free(functions);
+
+  if (expr->type is CALC_EXPR_VARIABLE) {
+    row->defined_name = expr->variable_name;
+
+  } else if (expr->type is CALC_EXPR_FUNCTION) {
+    row->defined_name = expr->function.name;
+
+    // Whether arguments names are known also affects parsing
+    for (int i = 0; i < expr->function.args.length; i++)
+      vec_Symbol_push(&row->names, expr->function.args.data[i]);
+  }
+
+  // Being already defined or not changes the meaning of a definition
+  if (row->defined_name is_not SYMBOL_NONE)
+    vec_Symbol_push(&row->names, row->defined_name);
+}
+
+// =====
+// =
+// = DEPENDENCIES
+// =
+// =====
+static void link_row(CalcWorkspace* this, const CalcWorkspaceRow* row) {
+  for (int i = 0; i < row->names.length; i++) {
+    Symbol name = row->names.data[i];
+    while (this->users.length <= name)
+      vec_vec_int_push(&this->users, vec_int_create());
+
+    vec_int_push(&this->users.data[name], row->id);
+  }
+}
+
+static void unlink_row(CalcWorkspace* this, const CalcWorkspaceRow* row) {
+  for (int i = 0; i < row->names.length; i++) {
+    Symbol name = row->names.data[i];
+    if (name >= this->users.length) continue;
+
+    vec_int* ids = &this->users.data[name];
+    for (int j = ids->length - 1; j >= 0; j--)
+      if (ids->data[j] is row->id) vec_int_delete_fast(ids, j);
+  }
+}
+
+// Names which may mean something else now are those of removed rows, and
+// those changed rows defined or may define now. Every row using such a name
+// has to be updated, and so do the rows using the names it defines.
+static void mark_dependents(CalcWorkspace* this) {
+  int* positions = (int*)MALLOC(sizeof(int) * (this->last_row_id + 1));
+  assert_alloc(positions);
+  for (int i = 0; i <= this->last_row_id; i++) positions[i] = -1;
+  for (int i = 0; i < this->rows.length; i++)
+    positions[this->rows.data[i].id] = i;
+
+  vec_Symbol queue = this->removed_names;
+  this->removed_names = vec_Symbol_create();
+
+  for (int i = 0; i < this->rows.length; i++)
+    if (this->rows.data[i].needs_update)
+      push_row_names(&queue, &this->rows.data[i]);
+
+  SymbolMap is_done = symbol_map_create();
+  while (queue.length > 0) {
+    Symbol name = vec_Symbol_popget(&queue);
+    if (not symbol_map_insert(&is_done, name, 1)) continue;
+    if (name >= this->users.length) continue;
+
+    const vec_int* ids = &this->users.data[name];
+    for (int i = 0; i < ids->length; i++) {
+      assert_m(positions[ids->data[i]] >= 0);
+      CalcWorkspaceRow* row = &this->rows.data[positions[ids->data[i]]];
+
+      if (not row->needs_update) {
+        row->needs_update = true;
+        push_row_names(&queue, row);
+      }
+    }
+  }
+
+  symbol_map_free(is_done);
+  vec_Symbol_free(queue);
+  FREE(positions);
+}
+
+// Expression is forward if it uses a name first defined below it, or an
+// expression which is forward itself. What it caches then depends on how much
+// of the backend is visible.
+static bool* find_forward_exprs(const CalcWorkspace* this) {
+  const CalcBackend* backend = &this->backend;
+  int length = backend->expressions.length;
+  bool* result = (bool*)MALLOC(sizeof(bool) * (length + 1));
+  assert_alloc(result);
+
+  for (int i = 0; i < this->rows.length; i++) {
+    const CalcWorkspaceRow* row = &this->rows.data[i];
+    int index = row->expr_index;
+    if (index < 0) continue;
+
+    result[index] = false;
+    for (int j = 0; j < row->names.length and not result[index]; j++) {
+      int definitions[] = {
+          symbol_map_get(&backend->variables_index, row->names.data[j]),
+          symbol_map_get(&backend->functions_index, row->names.data[j]),
+      };
+
+      for (int k = 0; k < (int)LEN(definitions); k++)
+        if (definitions[k] > index or
+            (definitions[k] >= 0 and definitions[k] < index and
+             result[definitions[k]]))
+          result[index] = true;
+    }
+  }
+
+  return result;
+}
+
+static void set_visible_count(CalcWorkspace* this, int count,
+                              const bool* is_forward) {
+  CalcBackend* backend = &this->backend;
+  if (backend->visible_count is count) return;
+
+  for (int i = 0; i < backend->expressions.length; i++)
+    if (is_forward[i]) calc_backend_reset_expr_memo(backend, i);
+  backend->visible_count = count;
+}
+
+static void push_row_names(vec_Symbol* names, const CalcWorkspaceRow* row) {
+  if (row->defined_name is_not SYMBOL_NONE)
+    vec_Symbol_push(names, row->defined_name);
+
+  // Text may have changed, so it can define a new name now
+  Symbol candidate = definition_candidate(row->text.string);
+  if (candidate is_not SYMBOL_NONE) vec_Symbol_push(names, candidate);
+}
+
+// =====
+// =
+// = TEXT HELPERS
+// =
+// =====
+static bool is_blank(const char* text) {
+  for (int i = 0; text[i] != '\0'; i++)
+    if (text[i] is_not ' ') return false;
+
+  return true;
+}
+
+static bool is_tokenizable(const char* text) {
+  for (int i = 0; text[i] != '\0'; i++)
+    if (not tk_is_symbol_allowed(text[i])) return false;
+
+  return true;
+}
+
+// Both variable and function definitions start with their name, and have an
+// equality sign somewhere after
+static Symbol definition_candidate(const char* text) {
+  if (not is_tokenizable(text)) return SYMBOL_NONE;
+
+  TokenResult first = tk_next_token(text);
+  if (not first.has_token or first.token.type is_not TOKEN_IDENT)
+    return SYMBOL_NONE;
+
+  for (const char* pos = first.next_token_pos; pos;) {
+    TokenResult res = tk_next_token(pos);
+    if (not res.has_token) break;
+
+    if (res.token.type is TOKEN_OPERATOR and
+        (str_slice_eq_ccp(res.token.data.operator_text, "=") or
+         str_slice_eq_ccp(res.token.data.operator_text, "==")))
+      return symbol_intern(first.token.data.ident_text);
+
+    pos = res.next_token_pos;
+  }
+
+  return SYMBOL_NONE;
+}
+
+static vec_Symbol text_idents(const char* text) {
+  vec_Symbol result = vec_Symbol_create();
+  if (not is_tokenizable(text)) return result;
+
+  for (const char* pos = text; pos;) {
+    TokenResult res = tk_next_token(pos);
+    if (not res.has_token) break;
+
+    if (res.token.type is TOKEN_IDENT)
+      vec_Symbol_push(&result, symbol_intern(res.token.data.ident_text));
+
+    pos = res.next_token_pos;
+  }
+
+  return result;
+}
@@ -0,0 +1,65 @@
+#ifndef SRC_CALCULATOR_CALC_WORKSPACE_H_
+#define SRC_CALCULATOR_CALC_WORKSPACE_H_
+
+#include "../util/better_string.h"
+#include "../util/common_vecs.h"
+#include "calc_backend.h"
+
+// List of text rows, where every row is parsed and calculated in the context
+// of all the rows above it, same as when adding them one by one to a fresh
+// `CalcBackend`.
+// Backend is kept between updates, and so are the results it cached: after an
+// edit only the changed rows, and rows that use names those define, are
+// parsed and calculated again. Rows using a name are found by
+// `CalcWorkspace.users`, without going over the whole list.
+
+typedef struct CalcWorkspaceRow {
+  str_t text;
+  str_t message;      // Same as `calc_backend_add_expr` gives
+  bool needs_update;  // Text changed since the last recompute
+  // In `CalcWorkspace.backend`, -1 if the row has none. Rows above may get
+  // or lose theirs before the next recompute, so only then it is exact.
+  int expr_index;
+  int id;  // Stays the same while the row exists
+
+  Symbol defined_name;  // Of variable or function, SYMBOL_NONE if none
+  vec_Symbol names;     // Every name this row's result may depend on
+} CalcWorkspaceRow;
+
+void calc_workspace_row_free(CalcWorkspaceRow this);
+
+#define VECTOR_H CalcWorkspaceRow
+#include "../util/vector.h"
+
+#define VECTOR_H vec_int
+#include "../util/vector.h"
+
+typedef struct CalcWorkspace {
+  CalcBackend backend;  // Expressions of the rows, in the same order
+  vec_CalcWorkspaceRow rows;
+  vec_Symbol removed_names;  // Names defined by rows removed since recompute
+
+  vec_vec_int users;  // By symbol: ids of rows with it in their `names`
+  int last_row_id;
+} CalcWorkspace;
+
+// Called for every recalculated row, `prefix` only finds this row and the
+// rows above it
+typedef void (*CalcWorkspaceRowFn)(void* data, int row_index,
+                                   const CalcWorkspaceRow* row,
+                                   CalcBackend* prefix);
+
+CalcWorkspace calc_workspace_create();
+void calc_workspace_free(CalcWorkspace this);
+
+void calc_workspace_insert_row(CalcWorkspace* this, int index,
+                               const char* text);
+void calc_workspace_remove_row(CalcWorkspace* this, int index);
+// Does not mark the row for update if text is the same
+void calc_workspace_set_row(CalcWorkspace* this, int index, const char* text);
+
+// Returns count of recalculated rows
+int calc_workspace_recompute(CalcWorkspace* this, CalcWorkspaceRowFn on_row,
+                             void* data);
+
+#endif  // SRC_CALCULATOR_CALC_WORKSPACE_H_
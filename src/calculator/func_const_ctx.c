@@ -3,34 +3,42 @@
 #include "../util/allocator.h"
 #include "native_functions.h"
 
-static bool fctx_has_value(const FuncConstCtx* this, StrSlice name);
+static bool fctx_has_value(const FuncConstCtx* this, Symbol name);
 
 // Parsing
-static bool fctx_is_variable(FuncConstCtx* this, StrSlice var_name);
-static bool fctx_is_function(FuncConstCtx* this, StrSlice fun_name);
+static bool fctx_is_variable(FuncConstCtx* this, Symbol var_name);
+static bool fctx_is_function(FuncConstCtx* this, Symbol fun_name);
+static int fctx_find_native(FuncConstCtx* this, Symbol fun_name);
 
 // Computation
-static ExprValueResult fctx_get_variable_val(FuncConstCtx* this, StrSlice);
-static ExprValueResult fctx_call_function(FuncConstCtx* this, StrSlice,
-                                          vec_ExprValue*);
+static ExprValueResult fctx_get_variable_val(FuncConstCtx* this, Symbol);
+static ExprValueResult fctx_call_function(FuncConstCtx* this, Symbol,
+                                          ExprValue);
+static ExprValueResult fctx_call_native(FuncConstCtx* this, int index,
+                                        ExprValue argument);
 
 // Anasysis and compilation
 static bool fctx_is_expr_const(FuncConstCtx* this, const Expr* expr);
-static int fctx_get_expr_type(FuncConstCtx* this, const Expr* expr);
+static ExprType fctx_get_expr_type(FuncConstCtx* this, const Expr* expr);
+static ExprType fctx_get_call_type(FuncConstCtx* this, Symbol fun_name,
+                                   const ExprType* args, int args_count);
 
 static ExprVariableInfo fctx_get_variable_info(FuncConstCtx* this,
-                                               StrSlice var_name);
+                                               Symbol var_name);
 static ExprFunctionInfo fctx_get_function_info(FuncConstCtx* this,
-                                               StrSlice fun_name);
+                                               Symbol fun_name);
 
 ExprContext func_const_ctx_context(FuncConstCtx* this) {
   static const ExprContextVtable table = {
       .is_variable = (void*)fctx_is_variable,
       .is_function = (void*)fctx_is_function,
+      .find_native = (void*)fctx_find_native,
       .get_variable_val = (void*)fctx_get_variable_val,
       .call_function = (void*)fctx_call_function,
+      .call_native = (void*)fctx_call_native,
       .is_expr_const = (void*)fctx_is_expr_const,
       .get_expr_type = (void*)fctx_get_expr_type,
+      .get_call_type = (void*)fctx_get_call_type,
       .get_variable_info = (void*)fctx_get_variable_info,
       .get_function_info = (void*)fctx_get_function_info,
   };
@@ -38,43 +46,56 @@ ExprContext func_const_ctx_context(FuncConstCtx* this) {
   return (ExprContext){.data = this, .vtable = &table};
 }
 
-static bool fctx_has_value(const FuncConstCtx* this, StrSlice name) {
+static bool fctx_has_value(const FuncConstCtx* this, Symbol name) {
   for (int i = 0; i < this->used_args->length; i++)
-    if (str_slice_eq_ccp(name, this->used_args->data[i].string)) return true;
+    if (name is this->used_args->data[i]) return true;
   return false;
 }
 
 // Parsing
-static bool fctx_is_variable(FuncConstCtx* this, StrSlice var_name) {
+static bool fctx_is_variable(FuncConstCtx* this, Symbol var_name) {
   if (fctx_has_value(this, var_name)) return true;
 
   return this->parent.vtable->is_variable(this->parent.data, var_name);
 }
-static bool fctx_is_function(FuncConstCtx* this, StrSlice fun_name) {
+static bool fctx_is_function(FuncConstCtx* this, Symbol fun_name) {
   if (fctx_has_value(this, fun_name)) return false;
 
   return this->parent.vtable->is_function(this->parent.data, fun_name);
 }
+static int fctx_find_native(FuncConstCtx* this, Symbol fun_name) {
+  if (fctx_has_value(this, fun_name) or not this->parent.vtable->find_native)
+    return -1;
+
+  return this->parent.vtable->find_native(this->parent.data, fun_name);
+}
 
 // Computation
 static ExprValueResult fctx_get_variable_val(FuncConstCtx* this,
-                                             StrSlice var_name) {
+                                             Symbol var_name) {
   if (fctx_has_value(this, var_name))
     panic(
-        "FuncConstCtx cannot give a value for name-only function arg '%$slice'",
-        var_name);
+        "FuncConstCtx cannot give a value for name-only function arg '%s'",
+        symbol_name(var_name));
 
   return this->parent.vtable->get_variable_val(this->parent.data, var_name);
 }
-static ExprValueResult fctx_call_function(FuncConstCtx* this, StrSlice fun_name,
-                                          vec_ExprValue* used_args) {
-  if (fctx_has_value(this, fun_name))
-    return ExprValueErr(null, str_owned("'%$slice' is not a function, but a "
+static ExprValueResult fctx_call_function(FuncConstCtx* this, Symbol fun_name,
+                                          ExprValue argument) {
+  if (fctx_has_value(this, fun_name)) {
+    expr_value_free(argument);
+    return ExprValueErr(null, str_owned("'%s' is not a function, but a "
                                         "parent function argument instead",
-                                        fun_name));
+                                        symbol_name(fun_name)));
+  }
 
   return this->parent.vtable->call_function(this->parent.data, fun_name,
-                                            used_args);
+                                            argument);
+}
+// Only called for slots from `fctx_find_native`, so parent has it too
+static ExprValueResult fctx_call_native(FuncConstCtx* this, int index,
+                                        ExprValue argument) {
+  return this->parent.vtable->call_native(this->parent.data, index, argument);
 }
 
 // Anasysis and compilation
@@ -84,52 +105,65 @@ static bool fctx_is_expr_const(FuncConstCtx* this, const Expr* expr) {
   return pure_fctx_is_expr_const(this, expr);
 }
 
+// Every variable and function in the tree has to be const
 static bool pure_fctx_is_expr_const(FuncConstCtx* this, const Expr* expr) {
-  if (expr->type is EXPR_NUMBER) {
-    return true;
-  } else if (expr->type is EXPR_VARIABLE) {
-    if (fctx_has_value(this, str_slice_from_str_t(&expr->variable.name))) {
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = expr});
+
+  bool result = true;
+  while (result and stack.length > 0) {
+    const Expr* node = vec_ExprStep_popget(&stack).expr;
+    result = func_const_ctx_is_node_const(this, node);
+
+    const Expr* child;
+    for (int i = 0; result and (child = expr_child(node, i)); i++)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+  }
+
+  vec_ExprStep_free(stack);
+  return result;
+}
+
+bool func_const_ctx_is_node_const(FuncConstCtx* this, const Expr* node) {
+  if (node->type is EXPR_VARIABLE) {
+    if (fctx_has_value(this, node->variable.name))
       return this->are_const;
-    } else {
-      return this->parent.vtable->is_expr_const(this->parent.data, expr);
-    }
-  } else if (expr->type is EXPR_FUNCTION) {
-    if (fctx_has_value(this, str_slice_from_str_t(&expr->function.name)))
+    else
+      return this->parent.vtable->is_expr_const(this->parent.data, node);
+
+  } else if (node->type is EXPR_FUNCTION) {
+    Symbol name = node->function.name;
+    if (fctx_has_value(this, name))
       return false;
-    else {
-      StrSlice name = str_slice_from_str_t(&expr->function.name);
-      bool is_arg_const =
-          pure_fctx_is_expr_const(this, expr->function.argument);
-      if (calculator_get_native_function(name))
-        return is_arg_const;
-      else
-        return fctx_get_function_info(this, name).is_const and is_arg_const;
-    }
-  } else if (expr->type is EXPR_VECTOR) {
-    for (int i = 0; i < expr->vector.arguments.length; i++)
-      if (not pure_fctx_is_expr_const(this, &expr->vector.arguments.data[i]))
-        return false;
+    else if (calculator_find_native(symbol_slice(name)) >= 0)
+      return true;
+    else
+      return fctx_get_function_info(this, name).is_const;
 
-    return true;
-  } else if (expr->type is EXPR_BINARY_OP) {
-    return pure_fctx_is_expr_const(this, expr->binary_operator.lhs) and
-           pure_fctx_is_expr_const(this, expr->binary_operator.rhs);
   } else {
-    panic("Unknown Expr type: %d", expr->type);
+    return true;
   }
 }
 
-static int fctx_get_expr_type(FuncConstCtx* this, const Expr* expr) {
-  return this->parent.vtable->get_expr_type(this->parent.data, expr);
+static ExprType fctx_get_expr_type(FuncConstCtx* this, const Expr* expr) {
+  return expr_infer_type(expr, func_const_ctx_context(this));
+}
+static ExprType fctx_get_call_type(FuncConstCtx* this, Symbol fun_name,
+                                   const ExprType* args, int args_count) {
+  if (fctx_has_value(this, fun_name) or not this->parent.vtable->get_call_type)
+    return ExprTypeUnknown();
+
+  return this->parent.vtable->get_call_type(this->parent.data, fun_name, args,
+                                            args_count);
 }
 
 static ExprVariableInfo fctx_get_variable_info(FuncConstCtx* this,
-                                               StrSlice var_name) {
-  debugln("fctx: someone asks for variable '%$slice'", var_name);
+                                               Symbol var_name) {
+  debugln("fctx: someone asks for variable '%s'", symbol_name(var_name));
   if (fctx_has_value(this, var_name)) {
     return (ExprVariableInfo){
         .is_const = this->are_const,
-        .value_type = VALUE_TYPE_UNKNOWN,
+        .value_type = ExprTypeUnknown(),
         .value = null,
         .expression = null,  // We dont know arguments values at "compile"-time
         .correct_context = func_const_ctx_context(this),
@@ -139,10 +173,10 @@ static ExprVariableInfo fctx_get_variable_info(FuncConstCtx* this,
   }
 }
 static ExprFunctionInfo fctx_get_function_info(FuncConstCtx* this,
-                                               StrSlice fun_name) {
+                                               Symbol fun_name) {
   if (fctx_has_value(this, fun_name))
-    panic(
-        "'%$slice' is not a function, but a parent function argument instead");
+    panic("'%s' is not a function, but a parent function argument instead",
+          symbol_name(fun_name));
 
   assert_m(this->parent.vtable->get_function_info);
   return this->parent.vtable->get_function_info(this->parent.data, fun_name);
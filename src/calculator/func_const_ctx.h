@@ -6,10 +6,13 @@
 
 typedef struct FuncConstCtx {
   ExprContext parent;
-  vec_str_t* used_args;
+  const vec_Symbol* used_args;
   bool are_const;
 } FuncConstCtx;
 
 ExprContext func_const_ctx_context(FuncConstCtx* this);
+// Only the node itself, children are not looked at. Whole tree is const if
+// every node in it is.
+bool func_const_ctx_is_node_const(FuncConstCtx* this, const Expr* node);
 
 #endif  // SRC_CALCULATOR_FUNC_CONST_CTX_H_
\ No newline at end of file
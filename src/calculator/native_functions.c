@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include "../util/allocator.h"
+#include "native_simd.h"
 
 static ExprValueResult calculator_func_cos(vec_ExprValue args);
 static ExprValueResult calculator_func_sin(vec_ExprValue args);
@@ -19,27 +20,6 @@ static ExprValueResult calculator_func_slice(vec_ExprValue args);
 static ExprValueResult calculator_func_min(vec_ExprValue args);
 static ExprValueResult calculator_func_max(vec_ExprValue args);
 
-#define FUNCTIONS                                                         \
-  {                                                                       \
-    calculator_func_cos, calculator_func_sin, calculator_func_tan,        \
-        calculator_func_acos, calculator_func_asin, calculator_func_atan, \
-        calculator_func_sqrt, calculator_func_ln, calculator_func_log,    \
-        calculator_func_join, calculator_func_slice, calculator_func_min, \
-        calculator_func_max,                                              \
-  }
-
-NativeFnPtr calculator_get_native_function(StrSlice name) {
-  const char* const names[] = NATIVE_FUNCTION_NAMES;
-  NativeFnPtr const functions[] = FUNCTIONS;
-
-  assert_m(LEN(names) == LEN(functions));
-  for (int i = 0; i < (int)LEN(names); i++) {
-    if (str_slice_eq_ccp(name, names[i])) return functions[i];
-  }
-
-  return null;
-}
-
 static double basic_cos(double a) { return cos(a); }
 static double basic_sin(double a) { return sin(a); }
 static double basic_tan(double a) { return tan(a); }
@@ -50,86 +30,263 @@ static double basic_sqrt(double a) { return sqrt(a); }
 static double basic_ln(double a) { return log(a); }
 static double basic_log(double a) { return log(a) / log(10.0); }
 
-static vec_ExprValue template_unary_function_base(vec_ExprValue args,
-                                                  double (*fn)(double)) {
-  assert_m(fn);
+typedef struct NativeEntry {
+  const char* name;
+  NativeFnPtr fn;
+  // Both are null if there is no such form
+  NativeScalarFnPtr scalar_fn;
+  NativeBatchFnPtr batch_fn;
+} NativeEntry;
+
+// Perfect hash of native names: no two of them have the same one. Every name
+// has at least two characters, and these two with the length are enough.
+// Clashing entries would be a compilation warning (overriding initializer).
+#define NATIVE_HASH(first, second, length) \
+  (((first) + 15 * (second) + (length)) & 31)
+#define NATIVE(name_, first, second, fn_, scalar_fn_, batch_fn_) \
+  [NATIVE_HASH(first, second, sizeof(name_) - 1)] = {             \
+      .name = (name_),                                            \
+      .fn = (fn_),                                                \
+      .scalar_fn = (scalar_fn_),                                  \
+      .batch_fn = (batch_fn_)}
+
+static const NativeEntry NATIVES[32] = {
+    NATIVE("cos", 'c', 'o', calculator_func_cos, basic_cos, native_simd_cos),
+    NATIVE("sin", 's', 'i', calculator_func_sin, basic_sin, native_simd_sin),
+    NATIVE("tan", 't', 'a', calculator_func_tan, basic_tan, native_simd_tan),
+    NATIVE("acos", 'a', 'c', calculator_func_acos, basic_acos,
+           native_simd_acos),
+    NATIVE("asin", 'a', 's', calculator_func_asin, basic_asin,
+           native_simd_asin),
+    NATIVE("atan", 'a', 't', calculator_func_atan, basic_atan,
+           native_simd_atan),
+    NATIVE("sqrt", 's', 'q', calculator_func_sqrt, basic_sqrt,
+           native_simd_sqrt),
+    NATIVE("ln", 'l', 'n', calculator_func_ln, basic_ln, native_simd_ln),
+    NATIVE("log", 'l', 'o', calculator_func_log, basic_log, native_simd_log),
+    NATIVE("join", 'j', 'o', calculator_func_join, null, null),
+    NATIVE("slice", 's', 'l', calculator_func_slice, null, null),
+    NATIVE("min", 'm', 'i', calculator_func_min, null, null),
+    NATIVE("max", 'm', 'a', calculator_func_max, null, null),
+};
+
+int calculator_find_native(StrSlice name) {
+  if (name.length < 2) return -1;
+
+  int index = NATIVE_HASH((unsigned char)name.start[0],
+                          (unsigned char)name.start[1], name.length);
+  const char* native_name = NATIVES[index].name;
+  return native_name and str_slice_eq_ccp(name, native_name) ? index : -1;
+}
+
+ExprValueResult calculator_call_native(int index, ExprValue argument) {
+  assert_m(index >= 0 and index < (int)LEN(NATIVES) and NATIVES[index].fn);
+
+  // Natives give the same result for a range and for its numbers as separate
+  // arguments, so it is not expanded (unless there are less than two, then
+  // result is not a vector)
+  vec_ExprValue args;
+  if (argument.type is EXPR_VALUE_RANGE and argument.range->length >= 2) {
+    args = vec_ExprValue_create();
+    vec_ExprValue_push(&args, argument);
+  } else {
+    args = expr_value_to_args(argument);
+  }
+  return NATIVES[index].fn(args);
+}
+
+NativeFnPtr calculator_get_native_function(StrSlice name) {
+  int index = calculator_find_native(name);
+  return index >= 0 ? NATIVES[index].fn : null;
+}
+
+NativeScalarFnPtr calculator_get_native_scalar_function(StrSlice name) {
+  int index = calculator_find_native(name);
+  return index >= 0 ? NATIVES[index].scalar_fn : null;
+}
+
+NativeBatchFnPtr calculator_get_native_batch_function(StrSlice name) {
+  int index = calculator_find_native(name);
+  return index >= 0 ? NATIVES[index].batch_fn : null;
+}
+
+// Unary functions keep the shape of their argument, or pack several into a
+// vector. Min and max give a number if there is any, and None otherwise.
+ExprType calculator_get_native_type(StrSlice name, const ExprType* args,
+                                    int args_count) {
+  if (calculator_get_native_batch_function(name)) {
+    if (args_count is 0) return ExprTypeOf(EXPR_VALUE_NONE, -1);
+    if (args_count is 1) return args[0];
+    return ExprTypeOf(EXPR_VALUE_VEC, args_count);
+  }
+
+  if (str_slice_eq_ccp(name, "min") or str_slice_eq_ccp(name, "max")) {
+    bool are_all_none = true;
+    for (int i = 0; i < args_count; i++) {
+      if (args[i].type is EXPR_VALUE_NUMBER)
+        return ExprTypeOf(EXPR_VALUE_NUMBER, -1);
+      if (args[i].type is_not EXPR_VALUE_NONE) are_all_none = false;
+    }
+
+    return are_all_none ? ExprTypeOf(EXPR_VALUE_NONE, -1) : ExprTypeUnknown();
+  }
+
+  return ExprTypeUnknown();
+}
+
+// Single numbers go to libm, so they are exact to the last bit, as without
+// the kernels. Kernels are within 2 ULP of it (see native_simd.h) and only
+// pay off over arrays.
+typedef struct NativeUnaryFn {
+  NativeScalarFnPtr one;
+  NativeBatchFnPtr many;
+} NativeUnaryFn;
+
+static void apply_unary(NativeUnaryFn fn, double* numbers, int count) {
+  if (count is 1)
+    numbers[0] = fn.one(numbers[0]);
+  else if (count > 1)
+    fn.many(numbers, numbers, count);
+}
 
-  for (int arg = 0; arg < args.length; arg++) {
-    ExprValue* item = &args.data[arg];
+// Changes `args` in place. On a range error they are left part done, but
+// still valid values.
+static ExprValueResult template_unary_function_base(vec_ExprValue* args,
+                                                    NativeUnaryFn fn) {
+  assert_m(fn.one and fn.many);
+  ExprValueResult result = {.is_ok = true};
+
+  // Numbers of this level are gathered into a flat array, so the kernel gets
+  // them all at once
+  double local_numbers[16];
+  double* numbers = local_numbers;
+  if (args->length > (int)LEN(local_numbers)) {
+    numbers = (double*)MALLOC(sizeof(double) * args->length);
+    assert_alloc(numbers);
+  }
+
+  int count = 0;
+  for (int arg = 0; arg < args->length and result.is_ok; arg++) {
+    ExprValue* item = &args->data[arg];
 
     if (item->type is EXPR_VALUE_NONE) {
       // nothing to do
     } else if (item->type is EXPR_VALUE_NUMBER) {
-      item->number = fn(item->number);
+      numbers[count++] = item->number;
+    } else if (item->type is EXPR_VALUE_ARRAY or
+               item->type is EXPR_VALUE_RANGE) {
+      result = expr_value_check_expand(item);
+      if (result.is_ok) {
+        *item = expr_value_expand(*item).ok;
+        expr_value_make_unique(item);
+        apply_unary(fn, item->array->data, item->array->length);
+      }
     } else if (item->type is EXPR_VALUE_VEC) {
-      item->vec = template_unary_function_base(item->vec, fn);
+      expr_value_make_unique(item);
+      result = template_unary_function_base(&item->vec->items, fn);
     } else {
       panic("Unknown ExprValue type");
     }
   }
 
-  return args;
+  if (result.is_ok) {
+    apply_unary(fn, numbers, count);
+
+    count = 0;
+    for (int arg = 0; arg < args->length; arg++)
+      if (args->data[arg].type is EXPR_VALUE_NUMBER)
+        args->data[arg].number = numbers[count++];
+  }
+
+  if (numbers != local_numbers) FREE(numbers);
+  return result;
 }
 
 static ExprValueResult template_unary_function(vec_ExprValue args,
-                                               double (*fn)(double)) {
-  vec_ExprValue values = template_unary_function_base(args, fn);
-  ExprValue result;
-  if (values.length is 0) {
-    result = (ExprValue){.type = EXPR_VALUE_NONE};
-    vec_ExprValue_free(values);
-  } else if (values.length is 1) {
-    result = vec_ExprValue_popget(&values);
-    vec_ExprValue_free(values);
+                                               NativeUnaryFn fn) {
+  ExprValueResult result = {.is_ok = true};
+  if (args.length is 0) {
+    result.ok = (ExprValue){.type = EXPR_VALUE_NONE};
+    vec_ExprValue_free(args);
+  } else if (args.length is 1) {
+    result = template_unary_function_base(&args, fn);
+    if (result.is_ok) result.ok = vec_ExprValue_popget(&args);
+    vec_ExprValue_free(args);
   } else {
-    result = (ExprValue){.type = EXPR_VALUE_VEC, .vec = values};
+    // Usually all the arguments are numbers, then kernel runs right over the
+    // packed result
+    ExprValue packed = expr_value_pack(args);
+    if (packed.type is EXPR_VALUE_ARRAY)
+      apply_unary(fn, packed.array->data, packed.array->length);
+    else
+      result = template_unary_function_base(&packed.vec->items, fn);
+
+    if (result.is_ok)
+      result.ok = packed;
+    else
+      expr_value_free(packed);
   }
 
-  return (ExprValueResult){
-      .is_ok = true,
-      .ok = result,
-  };
+  return result;
 }
 
 ExprValueResult calculator_func_cos(vec_ExprValue args) {
-  return template_unary_function(args, basic_cos);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_cos, native_simd_cos});
 }
 ExprValueResult calculator_func_sin(vec_ExprValue args) {
-  return template_unary_function(args, basic_sin);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_sin, native_simd_sin});
 }
 ExprValueResult calculator_func_tan(vec_ExprValue args) {
-  return template_unary_function(args, basic_tan);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_tan, native_simd_tan});
 }
 ExprValueResult calculator_func_acos(vec_ExprValue args) {
-  return template_unary_function(args, basic_acos);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_acos, native_simd_acos});
 }
 ExprValueResult calculator_func_asin(vec_ExprValue args) {
-  return template_unary_function(args, basic_asin);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_asin, native_simd_asin});
 }
 ExprValueResult calculator_func_atan(vec_ExprValue args) {
-  return template_unary_function(args, basic_atan);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_atan, native_simd_atan});
 }
 ExprValueResult calculator_func_sqrt(vec_ExprValue args) {
-  return template_unary_function(args, basic_sqrt);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_sqrt, native_simd_sqrt});
 }
 ExprValueResult calculator_func_ln(vec_ExprValue args) {
-  return template_unary_function(args, basic_ln);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_ln, native_simd_ln});
 }
 ExprValueResult calculator_func_log(vec_ExprValue args) {
-  return template_unary_function(args, basic_log);
+  return template_unary_function(args,
+                                 (NativeUnaryFn){basic_log, native_simd_log});
 }
 
 ExprValueResult calculator_func_join(vec_ExprValue args) {
+  for (int i = 0; i < args.length; i++) {
+    ExprValueResult check = expr_value_check_expand(&args.data[i]);
+    if (not check.is_ok) {
+      vec_ExprValue_free(args);
+      return check;
+    }
+  }
+
   vec_ExprValue values = vec_ExprValue_create();
 
   for (int i = 0; i < args.length; i++) {
     ExprValue arg = args.data[i];
-    if (arg.type is EXPR_VALUE_VEC) {
-      for (int j = 0; j < arg.vec.length; j++) {
-        vec_ExprValue_push(&values, arg.vec.data[j]);
+    if (expr_value_is_vector(&arg)) {
+      vec_ExprValue items = expr_value_unpack(arg);
+      for (int j = 0; j < items.length; j++) {
+        vec_ExprValue_push(&values, items.data[j]);
       }
-      arg.vec.length = 0;
-      expr_value_free(arg);
+      items.length = 0;
+      vec_ExprValue_free(items);
     } else {
       vec_ExprValue_push(&values, arg);
     }
@@ -137,8 +294,7 @@ ExprValueResult calculator_func_join(vec_ExprValue args) {
   args.length = 0;  // All elements extracted
   vec_ExprValue_free(args);
 
-  return (ExprValueResult){.is_ok = true,
-                           .ok = {.type = EXPR_VALUE_VEC, .vec = values}};
+  return (ExprValueResult){.is_ok = true, .ok = expr_value_pack(values)};
 }
 
 #define Err(text) \
@@ -158,9 +314,10 @@ static long long check_num_integer(double number, ExprValueResult* res) {
   return result;
 }
 
-static ExprValueResult slice_base(vec_ExprValue indices, vec_ExprValue* data);
+static ExprValueResult slice_base(vec_ExprValue indices,
+                                  const ExprValue* data);
 static ExprValueResult slice_process_index(ExprValue index,
-                                           vec_ExprValue* data) {
+                                           const ExprValue* data) {
   ExprValueResult result = {.is_ok = true};
   if (index.type is EXPR_VALUE_NONE) {
     // none index -> none data
@@ -168,19 +325,25 @@ static ExprValueResult slice_process_index(ExprValue index,
   } else if (index.type is EXPR_VALUE_NUMBER) {
     long long number = check_num_integer(index.number, &result);
 
+    int length = expr_value_vector_length(data);
+
     if (result.is_ok) {
-      if (number >= 0 and number < (long long)data->length) {
-        result.ok = expr_value_clone(&data->data[number]);
+      if (number >= 0 and number < (long long)length) {
+        ExprValue item = expr_value_vector_item(data, (int)number);
+        result.ok = expr_value_clone(&item);
       } else {
         result =
             Err(str_owned("Index %lld is out of bounds for vector of size %d",
-                          number, data->length));
+                          number, length));
       }
     }
-  } else if (index.type is EXPR_VALUE_VEC) {
-    result = slice_base(index.vec, data);
-    index.type = EXPR_VALUE_NONE;
-    // no need to free
+  } else if (expr_value_is_vector(&index)) {
+    result = expr_value_check_expand(&index);
+    if (result.is_ok) {
+      result = slice_base(expr_value_unpack(index), data);
+      index.type = EXPR_VALUE_NONE;
+      // no need to free
+    }
   } else {
     panic("Unknown ExprValue type");
   }
@@ -189,7 +352,8 @@ static ExprValueResult slice_process_index(ExprValue index,
   return result;
 }
 
-static ExprValueResult slice_base(vec_ExprValue indices, vec_ExprValue* data) {
+static ExprValueResult slice_base(vec_ExprValue indices,
+                                  const ExprValue* data) {
   ExprValueResult res = {.is_ok = true};
   for (int i = 0; i < indices.length and res.is_ok; i++) {
     res = slice_process_index(indices.data[i], data);
@@ -201,7 +365,7 @@ static ExprValueResult slice_base(vec_ExprValue indices, vec_ExprValue* data) {
   }
 
   if (res.is_ok)
-    res.ok = (ExprValue){.type = EXPR_VALUE_VEC, .vec = indices};
+    res.ok = expr_value_pack(indices);
   else
     vec_ExprValue_free(indices);
 
@@ -213,18 +377,23 @@ ExprValueResult calculator_func_slice(vec_ExprValue args) {
   if (args.length != 2) {
     result = Err(str_literal(
         "Function 'slice' requires two args - data vector and indices vector"));
-  } else if (args.data[0].type != EXPR_VALUE_VEC) {
+  } else if (not expr_value_is_vector(&args.data[0])) {
     result =
         Err(str_literal("Function 'slice': first argument is not a vector"));
-  } else if (args.data[1].type != EXPR_VALUE_VEC) {
+  } else if (not expr_value_is_vector(&args.data[1])) {
     result =
         Err(str_literal("Function 'slice': second argument is not a vector"));
   } else {
-    vec_ExprValue indices = vec_ExprValue_popget(&args).vec;
-    vec_ExprValue data = vec_ExprValue_popget(&args).vec;
-    vec_ExprValue_free(args);
-    result = slice_base(indices, &data);
-    vec_ExprValue_free(data);
+    // Data is only read by index, so even ranges are not expanded. Indices
+    // are spread, so they are checked.
+    result = expr_value_check_expand(&args.data[1]);
+    if (result.is_ok) {
+      vec_ExprValue indices = expr_value_unpack(vec_ExprValue_popget(&args));
+      ExprValue data = vec_ExprValue_popget(&args);
+      vec_ExprValue_free(args);
+      result = slice_base(indices, &data);
+      expr_value_free(data);
+    }
   }
   return result;
 }
@@ -249,8 +418,20 @@ ExprValueResult calculator_func_min(vec_ExprValue args) {
       // skip
     } else if (arg.type is EXPR_VALUE_NUMBER) {
       push_min_value(arg.number, &min, &has_value);
+    } else if (arg.type is EXPR_VALUE_ARRAY) {
+      for (int j = 0; j < arg.array->length; j++)
+        push_min_value(arg.array->data[j], &min, &has_value);
+    } else if (arg.type is EXPR_VALUE_RANGE) {
+      // Range is monotonic, so its ends are enough
+      int length = arg.range->length;
+      if (length > 0) {
+        push_min_value(expr_value_vector_item(&arg, 0).number, &min,
+                       &has_value);
+        push_min_value(expr_value_vector_item(&arg, length - 1).number, &min,
+                       &has_value);
+      }
     } else if (arg.type is EXPR_VALUE_VEC) {
-      ExprValueResult res = calculator_func_min(arg.vec);
+      ExprValueResult res = calculator_func_min(arg.vec->items);
       assert_m(res.is_ok);
       ExprValue value = res.ok;
       if (value.type is EXPR_VALUE_NUMBER) {
@@ -291,8 +472,20 @@ ExprValueResult calculator_func_max(vec_ExprValue args) {
       // skip
     } else if (arg.type is EXPR_VALUE_NUMBER) {
       push_max_value(arg.number, &max, &has_value);
+    } else if (arg.type is EXPR_VALUE_ARRAY) {
+      for (int j = 0; j < arg.array->length; j++)
+        push_max_value(arg.array->data[j], &max, &has_value);
+    } else if (arg.type is EXPR_VALUE_RANGE) {
+      // Range is monotonic, so its ends are enough
+      int length = arg.range->length;
+      if (length > 0) {
+        push_max_value(expr_value_vector_item(&arg, 0).number, &max,
+                       &has_value);
+        push_max_value(expr_value_vector_item(&arg, length - 1).number, &max,
+                       &has_value);
+      }
     } else if (arg.type is EXPR_VALUE_VEC) {
-      ExprValueResult res = calculator_func_max(arg.vec);
+      ExprValueResult res = calculator_func_max(arg.vec->items);
       assert_m(res.is_ok);
       ExprValue value = res.ok;
       if (value.type is EXPR_VALUE_NUMBER) {
@@ -1,17 +1,36 @@
 #ifndef SRC_CALCULATOR_NATIVE_FUNCTIONS_H_
 #define SRC_CALCULATOR_NATIVE_FUNCTIONS_H_
 
+#include "../parser/expr.h"
 #include "../parser/expr_value.h"
 
-#define NATIVE_FUNCTION_NAMES                                                 \
-  {                                                                           \
-    "cos", "sin", "tan", "acos", "asin", "atan", "sqrt", "ln", "log", "join", \
-        "slice", "min", "max",                                                \
-  }
+// Natives are: cos, sin, tan, acos, asin, atan, sqrt, ln, log, join, slice,
+// min and max
 
 typedef ExprValueResult (*NativeFnPtr)(vec_ExprValue);
 
+// Index of the native function, or -1 if there is no such. Names are found by
+// a perfect hash, so it takes a single string comparison.
+int calculator_find_native(StrSlice name);
+// Takes ownership of the argument. Vector argument is spread into function
+// arguments, see `expr_value_to_args`.
+ExprValueResult calculator_call_native(int index, ExprValue argument);
+
 NativeFnPtr calculator_get_native_function(StrSlice name);
+// Result type for arguments of these types, see `expr_infer_type`
+ExprType calculator_get_native_type(StrSlice name, const ExprType* args,
+                                    int args_count);
+
+// Number-only forms of unary functions (cos ... log).
+// For a single number it is libm, exact to the last bit. Over arrays,
+// out[i] = fn(args[i]), it is the SIMD kernels from native_simd.h, which are
+// within 2 ULP of libm. `out` may be the same array as `args`. Native
+// functions use kernels only for vectors of two numbers or more.
+typedef double (*NativeScalarFnPtr)(double arg);
+typedef void (*NativeBatchFnPtr)(const double* args, double* out, int n);
+// Both return null if the function has no such form
+NativeScalarFnPtr calculator_get_native_scalar_function(StrSlice name);
+NativeBatchFnPtr calculator_get_native_batch_function(StrSlice name);
 /*
 ExprValueResult calculator_func_cos(vec_ExprValue args);
 ExprValueResult calculator_func_sin(vec_ExprValue args);
@@ -0,0 +1,223 @@
+#include "native_simd.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../util/prettify_c.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NATIVE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define NATIVE_SIMD_BACKEND(backend_name, suffix)                       \
+  {                                                                     \
+    .name = backend_name, .sin = sin_##suffix, .cos = cos_##suffix,     \
+    .tan = tan_##suffix, .atan = atan_##suffix, .asin = asin_##suffix,  \
+    .acos = acos_##suffix, .sqrt = sqrt_##suffix, .ln = ln_##suffix,    \
+    .log = log_##suffix,                                                \
+  }
+
+// =====
+// =
+// = SCALAR
+// =
+// =====
+// Plain libm, it is faster than the polynomials one lane at a time
+static double scalar_log10(double a) { return log(a) / log(10.0); }
+
+#define SCALAR_KERNEL(name, libm_fn)                                     \
+  static void name##_scalar(const double* in, double* out, int n) {      \
+    for (int i = 0; i < n; i++) out[i] = libm_fn(in[i]);                 \
+  }
+
+SCALAR_KERNEL(sin, sin)
+SCALAR_KERNEL(cos, cos)
+SCALAR_KERNEL(tan, tan)
+SCALAR_KERNEL(atan, atan)
+SCALAR_KERNEL(asin, asin)
+SCALAR_KERNEL(acos, acos)
+SCALAR_KERNEL(sqrt, sqrt)
+SCALAR_KERNEL(ln, log)
+SCALAR_KERNEL(log, scalar_log10)
+
+#ifdef NATIVE_SIMD_X86
+// =====
+// =
+// = SSE2
+// =
+// =====
+__attribute__((target("sse2"))) static __m128d sse2_frexp(__m128d x,
+                                                          __m128d* exponent) {
+  __m128i bits = _mm_castpd_si128(x);
+
+  // Exponent bits are put into the mantissa of 2^52, which makes it exact
+  __m128i biased = _mm_or_si128(_mm_srli_epi64(bits, 52),
+                                _mm_set1_epi64x(0x4330000000000000ll));
+  *exponent = _mm_sub_pd(_mm_castsi128_pd(biased),
+                         _mm_set1_pd(4503599627370496.0 + 1022.0));
+
+  __m128i mantissa =
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+                   _mm_set1_epi64x(0x3FE0000000000000ll));
+  return _mm_castsi128_pd(mantissa);
+}
+
+#define SIMD_SUFFIX sse2
+#define SIMD_ATTR __attribute__((target("sse2")))
+#define SIMD_WIDTH 2
+#define V __m128d
+#define M __m128d
+#define V_SET1(c) _mm_set1_pd(c)
+#define V_LOAD(ptr) _mm_loadu_pd(ptr)
+#define V_STORE(ptr, a) _mm_storeu_pd(ptr, a)
+#define V_ADD(a, b) _mm_add_pd(a, b)
+#define V_SUB(a, b) _mm_sub_pd(a, b)
+#define V_MUL(a, b) _mm_mul_pd(a, b)
+#define V_DIV(a, b) _mm_div_pd(a, b)
+#define V_SQRT(a) _mm_sqrt_pd(a)
+#define V_ABS(a) _mm_andnot_pd(_mm_set1_pd(-0.0), a)
+#define V_NEG(a) _mm_xor_pd(a, _mm_set1_pd(-0.0))
+#define V_XORSIGN(a, b) _mm_xor_pd(a, _mm_and_pd(b, _mm_set1_pd(-0.0)))
+#define V_TRUNC(a) _mm_cvtepi32_pd(_mm_cvttpd_epi32(a))
+#define V_FREXP(x, exponent) sse2_frexp(x, exponent)
+#define V_SELECT(mask, a, b) \
+  _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b))
+#define M_LT(a, b) _mm_cmplt_pd(a, b)
+#define M_LE(a, b) _mm_cmple_pd(a, b)
+#define M_GT(a, b) _mm_cmpgt_pd(a, b)
+#define M_GE(a, b) _mm_cmpge_pd(a, b)
+#define M_EQ(a, b) _mm_cmpeq_pd(a, b)
+#define M_AND(a, b) _mm_and_pd(a, b)
+#define M_XOR(a, b) _mm_xor_pd(a, b)
+#define M_BITS(mask) _mm_movemask_pd(mask)
+#include "native_simd_kernels.h"
+
+// =====
+// =
+// = AVX2
+// =
+// =====
+__attribute__((target("avx2"))) static __m256d avx2_frexp(__m256d x,
+                                                          __m256d* exponent) {
+  __m256i bits = _mm256_castpd_si256(x);
+
+  __m256i biased = _mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                   _mm256_set1_epi64x(0x4330000000000000ll));
+  *exponent = _mm256_sub_pd(_mm256_castsi256_pd(biased),
+                            _mm256_set1_pd(4503599627370496.0 + 1022.0));
+
+  __m256i mantissa = _mm256_or_si256(
+      _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+      _mm256_set1_epi64x(0x3FE0000000000000ll));
+  return _mm256_castsi256_pd(mantissa);
+}
+
+#define SIMD_SUFFIX avx2
+#define SIMD_ATTR __attribute__((target("avx2")))
+#define SIMD_WIDTH 4
+#define V __m256d
+#define M __m256d
+#define V_SET1(c) _mm256_set1_pd(c)
+#define V_LOAD(ptr) _mm256_loadu_pd(ptr)
+#define V_STORE(ptr, a) _mm256_storeu_pd(ptr, a)
+#define V_ADD(a, b) _mm256_add_pd(a, b)
+#define V_SUB(a, b) _mm256_sub_pd(a, b)
+#define V_MUL(a, b) _mm256_mul_pd(a, b)
+#define V_DIV(a, b) _mm256_div_pd(a, b)
+#define V_SQRT(a) _mm256_sqrt_pd(a)
+#define V_ABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define V_NEG(a) _mm256_xor_pd(a, _mm256_set1_pd(-0.0))
+#define V_XORSIGN(a, b) \
+  _mm256_xor_pd(a, _mm256_and_pd(b, _mm256_set1_pd(-0.0)))
+#define V_TRUNC(a) _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(a))
+#define V_FREXP(x, exponent) avx2_frexp(x, exponent)
+#define V_SELECT(mask, a, b) _mm256_blendv_pd(b, a, mask)
+#define M_LT(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define M_LE(a, b) _mm256_cmp_pd(a, b, _CMP_LE_OQ)
+#define M_GT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define M_GE(a, b) _mm256_cmp_pd(a, b, _CMP_GE_OQ)
+#define M_EQ(a, b) _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define M_AND(a, b) _mm256_and_pd(a, b)
+#define M_XOR(a, b) _mm256_xor_pd(a, b)
+#define M_BITS(mask) _mm256_movemask_pd(mask)
+#include "native_simd_kernels.h"
+#endif  // NATIVE_SIMD_X86
+
+// =====
+// =
+// = DISPATCH
+// =
+// =====
+// Best first
+static const NativeSimdBackend native_simd_backends[] = {
+#ifdef NATIVE_SIMD_X86
+    NATIVE_SIMD_BACKEND("avx2", avx2),
+    NATIVE_SIMD_BACKEND("sse2", sse2),
+#endif
+    NATIVE_SIMD_BACKEND("scalar", scalar),
+};
+
+static bool native_simd_is_supported(const NativeSimdBackend* backend) {
+#ifdef NATIVE_SIMD_X86
+  __builtin_cpu_init();
+  if (strcmp(backend->name, "avx2") is 0)
+    return __builtin_cpu_supports("avx2");
+  if (strcmp(backend->name, "sse2") is 0)
+    return __builtin_cpu_supports("sse2");
+#endif
+  return strcmp(backend->name, "scalar") is 0;
+}
+
+static const NativeSimdBackend* native_simd_backend() {
+  static const NativeSimdBackend* backend = null;
+  if (backend) return backend;
+
+  for (int i = 0; not backend; i++)
+    if (native_simd_is_supported(&native_simd_backends[i]))
+      backend = &native_simd_backends[i];
+
+  return backend;
+}
+
+const NativeSimdBackend* native_simd_backend_find(const char* name) {
+  for (int i = 0; i < (int)LEN(native_simd_backends); i++) {
+    const NativeSimdBackend* backend = &native_simd_backends[i];
+    if (strcmp(backend->name, name) is 0)
+      return native_simd_is_supported(backend) ? backend : null;
+  }
+  return null;
+}
+
+const char* native_simd_backend_name() { return native_simd_backend()->name; }
+
+void native_simd_sin(const double* in, double* out, int n) {
+  native_simd_backend()->sin(in, out, n);
+}
+void native_simd_cos(const double* in, double* out, int n) {
+  native_simd_backend()->cos(in, out, n);
+}
+void native_simd_tan(const double* in, double* out, int n) {
+  native_simd_backend()->tan(in, out, n);
+}
+void native_simd_atan(const double* in, double* out, int n) {
+  native_simd_backend()->atan(in, out, n);
+}
+void native_simd_asin(const double* in, double* out, int n) {
+  native_simd_backend()->asin(in, out, n);
+}
+void native_simd_acos(const double* in, double* out, int n) {
+  native_simd_backend()->acos(in, out, n);
+}
+void native_simd_sqrt(const double* in, double* out, int n) {
+  native_simd_backend()->sqrt(in, out, n);
+}
+void native_simd_ln(const double* in, double* out, int n) {
+  native_simd_backend()->ln(in, out, n);
+}
+void native_simd_log(const double* in, double* out, int n) {
+  native_simd_backend()->log(in, out, n);
+}
@@ -0,0 +1,45 @@
+#ifndef SRC_CALCULATOR_NATIVE_SIMD_H_
+#define SRC_CALCULATOR_NATIVE_SIMD_H_
+
+// Native math functions over contiguous arrays: out[i] = fn(in[i]). `out` may
+// be the same array as `in`.
+// Backend is picked once at runtime: AVX2 or SSE2 on x86, libm elsewhere.
+// AVX2 and SSE2 do exactly the same operations, so results do not depend on
+// the CPU, nor on position of the element in the array.
+//
+// Accuracy of AVX2/SSE2 against glibc libm, in units in the last place (ULP):
+//   sqrt - exact (same instruction)
+//   sin, cos, tan - <= 2 ULP for |x| <= 1.07e9
+//   atan, asin, acos, ln - <= 1 ULP
+//   log (base 10) - <= 2 ULP
+// Arguments outside of those ranges, zeros, infinities, NaNs and domain errors
+// are passed to libm as is. Checked by tests/test_native_simd.c, for every
+// backend the CPU can run.
+// Callers use these for arrays only: a single number goes to libm, so plain
+// evaluation is as exact as before (see native_functions.h).
+
+typedef void (*NativeSimdFn)(const double* in, double* out, int n);
+
+void native_simd_sin(const double* in, double* out, int n);
+void native_simd_cos(const double* in, double* out, int n);
+void native_simd_tan(const double* in, double* out, int n);
+void native_simd_atan(const double* in, double* out, int n);
+void native_simd_asin(const double* in, double* out, int n);
+void native_simd_acos(const double* in, double* out, int n);
+void native_simd_sqrt(const double* in, double* out, int n);
+void native_simd_ln(const double* in, double* out, int n);
+void native_simd_log(const double* in, double* out, int n);
+
+// "avx2", "sse2" or "scalar"
+const char* native_simd_backend_name();
+
+typedef struct NativeSimdBackend {
+  const char* name;
+  NativeSimdFn sin, cos, tan, atan, asin, acos, sqrt, ln, log;
+} NativeSimdBackend;
+
+// Kernels of a backend by its name, or null if this CPU cannot run them.
+// Functions above use the picked one, this is for tests to check the others.
+const NativeSimdBackend* native_simd_backend_find(const char* name);
+
+#endif  // SRC_CALCULATOR_NATIVE_SIMD_H_
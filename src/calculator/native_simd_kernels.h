@@ -0,0 +1,393 @@
+// Template of native math kernels for one SIMD backend. Included by
+// native_simd.c once per backend, so it has no include guard.
+//
+// Input macros:
+//   SIMD_SUFFIX - suffix of generated function names
+//   SIMD_ATTR - attributes of every generated function (target ISA)
+//   SIMD_WIDTH - lanes in a vector
+//   V, M - vector and mask types
+//   V_SET1, V_LOAD, V_STORE, V_ADD, V_SUB, V_MUL, V_DIV, V_SQRT, V_ABS,
+//   V_NEG, V_XORSIGN(a, b) - `a` with sign flipped where `b` is negative,
+//   V_TRUNC - truncation, only valid for |x| < 2^31,
+//   V_FREXP(x, V* exponent) - mantissa in [0.5, 1) and exponent of positive
+//   normal numbers,
+//   V_SELECT(mask, a, b), M_LT, M_LE, M_GT, M_GE, M_EQ, M_AND, M_XOR,
+//   M_BITS - mask as an int, bit per lane
+//
+// Algorithms and coefficients are from Cephes Math Library (S. L. Moshier).
+// Lanes out of the domain where the polynomial is accurate (huge arguments,
+// zeros, infinities, NaNs, ...) are recomputed with libm.
+
+#include "../util/prettify_c.h"
+
+#define SIMD_NAME(name) CONCAT(CONCAT(name, _), SIMD_SUFFIX)
+
+#ifndef NATIVE_SIMD_CONSTANTS
+#define NATIVE_SIMD_CONSTANTS
+
+#define SIMD_FOPI 1.27323954473516268615  // 4/pi
+#define SIMD_DP1 7.85398125648498535156E-1
+#define SIMD_DP2 3.77489470793079817668E-8
+#define SIMD_DP3 2.69515142907905952645E-15
+#define SIMD_TRIG_LOSSTH 1.073741824e9
+
+#define SIMD_PI 3.14159265358979323846
+#define SIMD_PIO2 1.57079632679489661923
+#define SIMD_PIO4 7.85398163397448309616E-1
+#define SIMD_MOREBITS 6.123233995736765886130E-17
+#define SIMD_T3P8 2.41421356237309504880  // tan(3 * pi / 8)
+#define SIMD_SQRTH 0.70710678118654752440
+#define SIMD_LN10 2.30258509299404568402
+
+static const double SIMD_SINCOF[] = {
+    1.58962301576546568060E-10, -2.50507477628578072866E-8,
+    2.75573136213857245213E-6,  -1.98412698295895385996E-4,
+    8.33333333332211858878E-3,  -1.66666666666666307295E-1,
+};
+static const double SIMD_COSCOF[] = {
+    -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+    -2.75573141792967388112E-7,  2.48015872888517045348E-5,
+    -1.38888888888730564116E-3,  4.16666666666665929218E-2,
+};
+static const double SIMD_TANP[] = {
+    -1.30936939181383777646E4,
+    1.15351664838587416140E6,
+    -1.79565251976484877988E7,
+};
+static const double SIMD_TANQ[] = {
+    1.36812963470692954678E4,
+    -1.32089234440210967447E6,
+    2.50083801823357915839E7,
+    -5.38695755929454629881E7,
+};
+static const double SIMD_LOGP[] = {
+    1.01875663804580931796E-4, 4.97494994976747001425E-1,
+    4.70579119878881725854E0,  1.44989225341610930846E1,
+    1.79368678507819816313E1,  7.70838733755885391666E0,
+};
+static const double SIMD_LOGQ[] = {
+    1.12873587189167450590E1, 4.52279145837532221105E1,
+    8.29875266912776603211E1, 7.11544750618563894466E1,
+    2.31251620126765340583E1,
+};
+static const double SIMD_ATANP[] = {
+    -8.750608600031904122785E-1, -1.615753718733365076637E1,
+    -7.500855792314704667340E1,  -1.228866684490136173410E2,
+    -6.485021904942025371773E1,
+};
+static const double SIMD_ATANQ[] = {
+    2.485846490142306297962E1, 1.650270098316988542046E2,
+    4.328810604912902668951E2, 4.853903996359136964868E2,
+    1.945506571482613964425E2,
+};
+static const double SIMD_ASINP[] = {
+    4.253011369004428248960E-3, -6.019598008014123785661E-1,
+    5.444622390564711410273E0,  -1.626247967210700244449E1,
+    1.956261983317594739197E1,  -8.198089802484824371615E0,
+};
+static const double SIMD_ASINQ[] = {
+    -1.474091372988853791896E1, 7.049610280856842141659E1,
+    -1.471791292232726029859E2, 1.395105614657485689735E2,
+    -4.918853881490881290097E1,
+};
+static const double SIMD_ASINR[] = {
+    2.967721961301243206100E-3, -5.634242780008963776856E-1,
+    6.968710824104713396794E0,  -2.556901049652824852289E1,
+    2.853665548261061424989E1,
+};
+static const double SIMD_ASINS[] = {
+    -2.194779531642920639778E1, 1.470656354026814941758E2,
+    -3.838770957603691357202E2, 3.424398657913078477438E2,
+};
+
+static double simd_libm_log10(double a) { return log(a) / log(10.0); }
+
+#endif  // NATIVE_SIMD_CONSTANTS
+
+// =====
+// =
+// = POLYNOMIALS
+// =
+// =====
+// coef[0] * x^n + ... + coef[n]
+static inline SIMD_ATTR V SIMD_NAME(polevl)(V x, const double* coef, int n) {
+  V result = V_SET1(coef[0]);
+  for (int i = 1; i <= n; i++)
+    result = V_ADD(V_MUL(result, x), V_SET1(coef[i]));
+  return result;
+}
+
+// x^n + coef[0] * x^(n-1) + ... + coef[n-1]
+static inline SIMD_ATTR V SIMD_NAME(p1evl)(V x, const double* coef, int n) {
+  V result = V_ADD(x, V_SET1(coef[0]));
+  for (int i = 1; i < n; i++)
+    result = V_ADD(V_MUL(result, x), V_SET1(coef[i]));
+  return result;
+}
+
+// =====
+// =
+// = TRIGONOMETRY
+// =
+// =====
+// Reduces |x| to z in [-pi/4, pi/4], and returns even octant `j`:
+// |x| = z + j * pi/4
+static inline SIMD_ATTR V SIMD_NAME(trig_reduce)(V ax, V* j) {
+  V octant = V_TRUNC(V_MUL(ax, V_SET1(SIMD_FOPI)));
+  V is_odd =
+      V_SUB(octant, V_MUL(V_SET1(2.0), V_TRUNC(V_MUL(octant, V_SET1(0.5)))));
+  octant = V_ADD(octant, is_odd);
+
+  *j = octant;
+  V z = V_SUB(ax, V_MUL(octant, V_SET1(SIMD_DP1)));
+  z = V_SUB(z, V_MUL(octant, V_SET1(SIMD_DP2)));
+  return V_SUB(z, V_MUL(octant, V_SET1(SIMD_DP3)));
+}
+
+// sin(z + j * pi/4), where j is even
+static inline SIMD_ATTR V SIMD_NAME(sin_octant)(V z, V j) {
+  V q = V_SUB(j, V_MUL(V_SET1(8.0), V_TRUNC(V_MUL(j, V_SET1(0.125)))));
+  M is_negative = M_GE(q, V_SET1(4.0));
+  q = V_SELECT(is_negative, V_SUB(q, V_SET1(4.0)), q);
+
+  V zz = V_MUL(z, z);
+  V sin_z = V_ADD(
+      z, V_MUL(V_MUL(z, zz), SIMD_NAME(polevl)(zz, SIMD_SINCOF, 5)));
+  V cos_z = V_ADD(V_SUB(V_SET1(1.0), V_MUL(zz, V_SET1(0.5))),
+                  V_MUL(V_MUL(zz, zz), SIMD_NAME(polevl)(zz, SIMD_COSCOF, 5)));
+
+  V result = V_SELECT(M_EQ(q, V_SET1(2.0)), cos_z, sin_z);
+  return V_SELECT(is_negative, V_NEG(result), result);
+}
+
+static inline SIMD_ATTR V SIMD_NAME(sin_v)(V x) {
+  V j;
+  V z = SIMD_NAME(trig_reduce)(V_ABS(x), &j);
+  return V_XORSIGN(SIMD_NAME(sin_octant)(z, j), x);
+}
+
+static inline SIMD_ATTR V SIMD_NAME(cos_v)(V x) {
+  // cos(x) = sin(|x| + pi/2)
+  V j;
+  V z = SIMD_NAME(trig_reduce)(V_ABS(x), &j);
+  return SIMD_NAME(sin_octant)(z, V_ADD(j, V_SET1(2.0)));
+}
+
+static inline SIMD_ATTR V SIMD_NAME(tan_v)(V x) {
+  V j;
+  V z = SIMD_NAME(trig_reduce)(V_ABS(x), &j);
+
+  V zz = V_MUL(z, z);
+  V ratio = V_DIV(V_MUL(zz, SIMD_NAME(polevl)(zz, SIMD_TANP, 2)),
+                  SIMD_NAME(p1evl)(zz, SIMD_TANQ, 4));
+  V result = V_ADD(z, V_MUL(z, ratio));
+
+  // Odd quadrant: tan(z + pi/2) = -1 / tan(z)
+  V quadrant = V_SUB(j, V_MUL(V_SET1(4.0), V_TRUNC(V_MUL(j, V_SET1(0.25)))));
+  result = V_SELECT(M_EQ(quadrant, V_SET1(2.0)),
+                    V_NEG(V_DIV(V_SET1(1.0), result)), result);
+
+  return V_XORSIGN(result, x);
+}
+
+static inline SIMD_ATTR M SIMD_NAME(trig_fast)(V x) {
+  return M_LE(V_ABS(x), V_SET1(SIMD_TRIG_LOSSTH));
+}
+
+// =====
+// =
+// = INVERSE TRIGONOMETRY
+// =
+// =====
+static inline SIMD_ATTR V SIMD_NAME(atan_v)(V x) {
+  V ax = V_ABS(x);
+  M is_big = M_GT(ax, V_SET1(SIMD_T3P8));
+  M is_mid = M_AND(M_GT(ax, V_SET1(0.66)), M_LE(ax, V_SET1(SIMD_T3P8)));
+
+  V reduced = V_SELECT(
+      is_big, V_NEG(V_DIV(V_SET1(1.0), ax)),
+      V_SELECT(is_mid,
+               V_DIV(V_SUB(ax, V_SET1(1.0)), V_ADD(ax, V_SET1(1.0))), ax));
+  V base = V_SELECT(is_big, V_SET1(SIMD_PIO2),
+                    V_SELECT(is_mid, V_SET1(SIMD_PIO4), V_SET1(0.0)));
+  V morebits =
+      V_SELECT(is_big, V_SET1(SIMD_MOREBITS),
+               V_SELECT(is_mid, V_SET1(0.5 * SIMD_MOREBITS), V_SET1(0.0)));
+
+  V z = V_MUL(reduced, reduced);
+  z = V_DIV(V_MUL(z, SIMD_NAME(polevl)(z, SIMD_ATANP, 4)),
+            SIMD_NAME(p1evl)(z, SIMD_ATANQ, 5));
+  z = V_ADD(V_MUL(reduced, z), reduced);
+  z = V_ADD(z, morebits);
+
+  return V_XORSIGN(V_ADD(base, z), x);
+}
+
+static inline SIMD_ATTR M SIMD_NAME(atan_fast)(V x) {
+  return M_LE(V_ABS(x), V_SET1(DBL_MAX));
+}
+
+// asin of |x|, for |x| <= 1
+static inline SIMD_ATTR V SIMD_NAME(asin_abs)(V a) {
+  // Near 1: asin(a) = pi/2 - 2 * asin(sqrt((1 - a) / 2))
+  V zz = V_SUB(V_SET1(1.0), a);
+  V p = V_DIV(V_MUL(zz, SIMD_NAME(polevl)(zz, SIMD_ASINR, 4)),
+              SIMD_NAME(p1evl)(zz, SIMD_ASINS, 4));
+  zz = V_SQRT(V_ADD(zz, zz));
+  V near_one = V_SUB(V_SET1(SIMD_PIO4), zz);
+  zz = V_SUB(V_MUL(zz, p), V_SET1(SIMD_MOREBITS));
+  near_one = V_ADD(V_SUB(near_one, zz), V_SET1(SIMD_PIO4));
+
+  V aa = V_MUL(a, a);
+  V z = V_DIV(V_MUL(aa, SIMD_NAME(polevl)(aa, SIMD_ASINP, 5)),
+              SIMD_NAME(p1evl)(aa, SIMD_ASINQ, 5));
+  V near_zero = V_ADD(V_MUL(a, z), a);
+
+  return V_SELECT(M_GT(a, V_SET1(0.625)), near_one, near_zero);
+}
+
+static inline SIMD_ATTR V SIMD_NAME(asin_v)(V x) {
+  return V_XORSIGN(SIMD_NAME(asin_abs)(V_ABS(x)), x);
+}
+
+static inline SIMD_ATTR V SIMD_NAME(acos_v)(V x) {
+  M is_low = M_LT(x, V_SET1(-0.5));
+  M is_high = M_GT(x, V_SET1(0.5));
+
+  V half_low = V_SQRT(V_MUL(V_SET1(0.5), V_ADD(V_SET1(1.0), x)));
+  V half_high = V_SQRT(V_MUL(V_SET1(0.5), V_SUB(V_SET1(1.0), x)));
+  V arg = V_SELECT(is_low, half_low, V_SELECT(is_high, half_high, x));
+  V s = SIMD_NAME(asin_v)(arg);
+
+  V low = V_SUB(V_SET1(SIMD_PI), V_MUL(V_SET1(2.0), s));
+  V high = V_MUL(V_SET1(2.0), s);
+  V middle = V_SUB(V_SET1(SIMD_PIO4), s);
+  middle = V_ADD(V_ADD(middle, V_SET1(SIMD_MOREBITS)), V_SET1(SIMD_PIO4));
+
+  return V_SELECT(is_low, low, V_SELECT(is_high, high, middle));
+}
+
+static inline SIMD_ATTR M SIMD_NAME(asin_fast)(V x) {
+  return M_LE(V_ABS(x), V_SET1(1.0));
+}
+
+// =====
+// =
+// = LOGARITHMS, SQRT
+// =
+// =====
+static inline SIMD_ATTR V SIMD_NAME(ln_v)(V x) {
+  V e;
+  V m = V_FREXP(x, &e);
+
+  // m in [sqrt(1/2), sqrt(2)), x = 1 + m
+  M is_small = M_LT(m, V_SET1(SIMD_SQRTH));
+  e = V_SELECT(is_small, V_SUB(e, V_SET1(1.0)), e);
+  m = V_SELECT(is_small, V_SUB(V_ADD(m, m), V_SET1(1.0)),
+               V_SUB(m, V_SET1(1.0)));
+
+  V z = V_MUL(m, m);
+  V y = V_DIV(V_MUL(z, SIMD_NAME(polevl)(m, SIMD_LOGP, 5)),
+              SIMD_NAME(p1evl)(m, SIMD_LOGQ, 5));
+  y = V_MUL(m, y);
+  y = V_SUB(y, V_MUL(e, V_SET1(2.121944400546905827679e-4)));
+  y = V_SUB(y, V_MUL(z, V_SET1(0.5)));
+
+  V result = V_ADD(m, y);
+  return V_ADD(result, V_MUL(e, V_SET1(0.693359375)));
+}
+
+static inline SIMD_ATTR V SIMD_NAME(log_v)(V x) {
+  return V_DIV(SIMD_NAME(ln_v)(x), V_SET1(SIMD_LN10));
+}
+
+// Positive, normal and finite
+static inline SIMD_ATTR M SIMD_NAME(ln_fast)(V x) {
+  return M_AND(M_GE(x, V_SET1(DBL_MIN)), M_LE(x, V_SET1(DBL_MAX)));
+}
+
+static inline SIMD_ATTR V SIMD_NAME(sqrt_v)(V x) { return V_SQRT(x); }
+
+static inline SIMD_ATTR M SIMD_NAME(sqrt_fast)(V x) {
+  return M_GE(x, V_SET1(0.0));
+}
+
+// =====
+// =
+// = KERNELS
+// =
+// =====
+// Tail is padded to a full vector, so every element goes through exactly the
+// same operations regardless of its position and of `n`
+#define SIMD_KERNEL(name, fast, libm_fn)                                     \
+  static SIMD_ATTR void SIMD_NAME(name)(const double* in, double* out,      \
+                                        int n) {                            \
+    double padded[SIMD_WIDTH];                                              \
+    double result[SIMD_WIDTH];                                              \
+                                                                            \
+    for (int i = 0; i < n; i += SIMD_WIDTH) {                               \
+      int count = n - i < SIMD_WIDTH ? n - i : SIMD_WIDTH;                  \
+      const double* source = &in[i];                                        \
+                                                                            \
+      if (count < SIMD_WIDTH) {                                             \
+        for (int k = 0; k < SIMD_WIDTH; k++)                                \
+          padded[k] = k < count ? in[i + k] : 0.5;                          \
+        source = padded;                                                    \
+      }                                                                     \
+                                                                            \
+      V x = V_LOAD(source);                                                 \
+      V value = SIMD_NAME(name##_v)(x);                                     \
+      int fast_lanes = M_BITS(SIMD_NAME(fast)(x));                          \
+                                                                            \
+      if (count is SIMD_WIDTH and fast_lanes is (1 << SIMD_WIDTH) - 1) {    \
+        V_STORE(&out[i], value);                                            \
+        continue;                                                           \
+      }                                                                     \
+                                                                            \
+      V_STORE(result, value);                                               \
+      for (int k = 0; k < count; k++)                                      \
+        out[i + k] =                                                        \
+            (fast_lanes >> k) & 1 ? result[k] : libm_fn(source[k]);         \
+    }                                                                       \
+  }
+
+SIMD_KERNEL(sin, trig_fast, sin)
+SIMD_KERNEL(cos, trig_fast, cos)
+SIMD_KERNEL(tan, trig_fast, tan)
+SIMD_KERNEL(atan, atan_fast, atan)
+SIMD_KERNEL(asin, asin_fast, asin)
+SIMD_KERNEL(acos, asin_fast, acos)
+SIMD_KERNEL(sqrt, sqrt_fast, sqrt)
+SIMD_KERNEL(ln, ln_fast, log)
+SIMD_KERNEL(log, ln_fast, simd_libm_log10)
+
+#undef SIMD_KERNEL
+#undef SIMD_NAME
+
+#undef SIMD_SUFFIX
+#undef SIMD_ATTR
+#undef SIMD_WIDTH
+#undef V
+#undef M
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_ABS
+#undef V_NEG
+#undef V_XORSIGN
+#undef V_TRUNC
+#undef V_FREXP
+#undef V_SELECT
+#undef M_LT
+#undef M_LE
+#undef M_GT
+#undef M_GE
+#undef M_EQ
+#undef M_AND
+#undef M_XOR
+#undef M_BITS
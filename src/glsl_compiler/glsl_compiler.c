@@ -1,72 +1,393 @@
 #include "glsl_compiler.h"
 
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 
 #include "../calculator/func_const_ctx.h"
+#include "../parser/expr_cse.h"
 #include "../util/allocator.h"
-
-static StrResult function_to_glsl(ExprContext ctx, GlslContext* glsl,
-                                  const Expr* expr, const vec_str_t* used_args);
-static StrResult operator_to_glsl(ExprContext ctx, GlslContext* glsl,
-                                  const Expr* expr, const vec_str_t* used_args);
-static StrResult variable_to_glsl(ExprContext ctx, GlslContext* glsl,
-                                  const Expr* expr, const vec_str_t* used_args);
-
-static str_t non_const_types_err_msg(ExprValue value, const Expr* expr);
+#include "../util/common_vecs.h"
+
+typedef struct GlslLocals {
+  ExprCse cse;
+  int* class_temps;  // Local of every CSE class, -1 until declared
+  int count;
+  StringStream declarations;
+} GlslLocals;
+
+// How code of a node is put together from code of its operands
+#define GLSL_FORM_CLASSIC 1     // (a + b)
+#define GLSL_FORM_COMPARSION 2  // ((a < b) ? 1.0 : 0.0)
+#define GLSL_FORM_MOD 3         // mod(a, b)
+#define GLSL_FORM_POW 4         // pow(a, b) or (1.0*a*a)
+#define GLSL_FORM_EQUALITY 5    // Sides go into functions of their own
+#define GLSL_FORM_NATIVE 6      // sin(a)
+#define GLSL_FORM_FUNCTION 7    // func_f(pos, step, a, b)
+
+// Node whose operands are being compiled
+typedef struct GlslFrame {
+  const Expr* expr;
+  int form;
+  int end;          // Index of the node after the subtree
+  int operands;     // Started so far
+  size_t start;     // Of the code of the node
+  size_t middle;    // Of the code of the second operand
+  int class_index;  // CSE class to declare when the node is done, or -1
+} GlslFrame;
+
+#define VECTOR_H GlslFrame
+#include "../util/vector.h"
+#define VECTOR_C GlslFrame
+#include "../util/vector.h"
+
+// One tree being compiled. Its code is written into a single stream, so the
+// time is linear in the size of the tree, however deep it is.
+typedef struct GlslWalk {
+  FuncConstCtx fctx;
+  ExprContext ctx;  // Of `fctx`
+  GlslContext* glsl;
+  const vec_Symbol* used_args;
+
+  GlslLocals* locals;
+  int equalities;  // Sides being compiled, which cannot use the locals
+
+  vec_ExprStep nodes;
+  vec_char is_const;  // Of every node
+  vec_GlslFrame frames;
+  StringStream code;
+  str_t error;
+} GlslWalk;
+
+static StrResult compile_tree(ExprContext ctx, GlslContext* glsl,
+                              const Expr* expr, const vec_Symbol* used_args);
+static Expr simplify_for_glsl(ExprContext ctx, const Expr* expr,
+                              const vec_Symbol* used_args);
 
 StrResult glsl_compile_expression(ExprContext ctx, GlslContext* glsl,
                                   const Expr* expr,
-                                  const vec_str_t* used_args) {
+                                  const vec_Symbol* used_args) {
   assert_m(expr);
-  // debugln("Compiling '%$expr'", *expr);
+  Expr simplified = simplify_for_glsl(ctx, expr, used_args);
+
+  // Single expression has nowhere to put locals
+  GlslLocals* prev_locals = glsl->locals;
+  glsl->locals = null;
+  StrResult result = compile_tree(ctx, glsl, &simplified, used_args);
+  glsl->locals = prev_locals;
+
+  expr_free(simplified);
+  return result;
+}
+
+StrResult glsl_compile_body(ExprContext ctx, GlslContext* glsl,
+                            const Expr* expr, const vec_Symbol* used_args) {
+  assert_m(expr);
+  Expr simplified = simplify_for_glsl(ctx, expr, used_args);
+
+  GlslLocals locals = {
+      .cse = expr_cse_create(&simplified),
+      .count = 0,
+      .declarations = string_stream_create(),
+  };
+  int classes_count = locals.cse.classes_length;
+  locals.class_temps = (int*)MALLOC(sizeof(int) * (classes_count + 1));
+  assert_alloc(locals.class_temps);
+  for (int i = 0; i < classes_count; i++) locals.class_temps[i] = -1;
+
+  // Bodies of called functions are compiled in the middle of this one
+  GlslLocals* prev_locals = glsl->locals;
+  glsl->locals = &locals;
+  StrResult code = compile_tree(ctx, glsl, &simplified, used_args);
+  glsl->locals = prev_locals;
+
+  StrResult result;
+  if (code.is_ok) {
+    OutStream os = string_stream_stream(&locals.declarations);
+    x_sprintf(os, "return %s;", code.data.string);
+    str_free(code.data);
+    result = StrOk(string_stream_to_str_t(locals.declarations));
+  } else {
+    string_stream_free(locals.declarations);
+    result = code;
+  }
+
+  FREE(locals.class_temps);
+  expr_cse_free(locals.cse);
+  expr_free(simplified);
+  return result;
+}
+
+static Expr simplify_for_glsl(ExprContext ctx, const Expr* expr,
+                              const vec_Symbol* used_args) {
   FuncConstCtx fctx = {
       .parent = ctx,
-      .used_args = (vec_str_t*)used_args,
+      .used_args = used_args,
       .are_const = false,
   };
-  ExprContext local_ctx = func_const_ctx_context(&fctx);
-  if (local_ctx.vtable->is_expr_const(local_ctx.data, expr)) {
-    // Calculate and insert as-is
-    ExprValueResult res = expr_calculate(expr, local_ctx);
-    if (not res.is_ok) return StrErr(res.err_text);
-    ExprValue value = res.ok;
-
-    if (value.type != EXPR_VALUE_NUMBER) {
-      return StrErr(non_const_types_err_msg(value, expr));
-    } else {
-      str_t result = isnan(value.number) ? str_literal("nan")
-                                         : str_owned("%.10lf", value.number);
-      expr_value_free(value);
-      return StrOk(result);
+  return expr_simplify(expr_clone(expr), func_const_ctx_context(&fctx));
+}
+
+// =====
+// =
+// = compile_tree
+// =
+// =====
+static void list_nodes(GlslWalk* this, const Expr* root);
+static bool start_node(GlslWalk* this, int* index);
+static bool finish_node(GlslWalk* this);
+
+// Tree of an already simplified expression. Nodes are started before their
+// operands (see `expr_operand`) and finished after them, and code of each one
+// is written around code of its operands. Const subtrees are calculated
+// instead. Repeated ones are declared as locals at their first use, and
+// referenced by name after.
+static StrResult compile_tree(ExprContext ctx, GlslContext* glsl,
+                              const Expr* expr, const vec_Symbol* used_args) {
+  assert_m(expr);
+  GlslWalk walk = {
+      .fctx = {.parent = ctx,
+               .used_args = used_args,
+               .are_const = false},
+      .glsl = glsl,
+      .used_args = used_args,
+      .locals = glsl->locals,
+      .equalities = 0,
+      .frames = vec_GlslFrame_create(),
+      .code = string_stream_create(),
+  };
+  walk.ctx = func_const_ctx_context(&walk.fctx);
+  list_nodes(&walk, expr);
+
+  bool is_ok = true;
+  int index = 0;
+  while (is_ok and (index < walk.nodes.length or walk.frames.length > 0)) {
+    int count = walk.frames.length;
+    if (count > 0 and walk.frames.data[count - 1].end <= index)
+      is_ok = finish_node(&walk);
+    else
+      is_ok = start_node(&walk, &index);
+  }
+
+  vec_ExprStep_free(walk.nodes);
+  vec_char_free(walk.is_const);
+  vec_GlslFrame_free(walk.frames);
+
+  if (is_ok) return StrOk(string_stream_to_str_t(walk.code));
+
+  string_stream_free(walk.code);
+  return StrErr(walk.error);
+}
+
+// Nodes before their operands, left to right, so every subtree is a range of
+// them. `step` of a node is the index after its subtree. Going backwards,
+// operands come before their node, that is how constness is found.
+static void list_nodes(GlslWalk* this, const Expr* root) {
+  this->nodes = vec_ExprStep_create();
+  this->is_const = vec_char_create();
+
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = root});
+
+  while (stack.length > 0) {
+    const Expr* node = vec_ExprStep_popget(&stack).expr;
+    vec_ExprStep_push(&this->nodes, (ExprStep){.expr = node});
+    vec_char_push(&this->is_const, false);
+
+    int count = 0;
+    while (expr_operand(node, count)) count++;
+    for (int i = count - 1; i >= 0; i--)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = expr_operand(node, i)});
+  }
+  vec_ExprStep_free(stack);
+
+  for (int i = this->nodes.length - 1; i >= 0; i--) {
+    const Expr* node = this->nodes.data[i].expr;
+    bool is_const = func_const_ctx_is_node_const(&this->fctx, node);
+
+    int next = i + 1;
+    for (int k = 0; expr_operand(node, k); k++) {
+      is_const = is_const and this->is_const.data[next];
+      next = this->nodes.data[next].step;
     }
+
+    this->nodes.data[i].step = next;
+    this->is_const.data[i] = is_const;
+  }
+}
+
+static bool fail(GlslWalk* this, str_t error) {
+  this->error = error;
+  return false;
+}
+
+// =====
+// =
+// = NODES
+// =
+// =====
+static void put_separator(GlslWalk* this);
+static void declare_local(GlslWalk* this, int class_index, size_t start);
+static bool put_const(GlslWalk* this, const Expr* node);
+static bool put_variable(GlslWalk* this, const Expr* node);
+static bool start_function(GlslWalk* this, GlslFrame* frame);
+static bool start_operator(GlslWalk* this, GlslFrame* frame);
+
+// Whole subtree is written here, unless the node waits for its operands
+static bool start_node(GlslWalk* this, int* index) {
+  const Expr* node = this->nodes.data[*index].expr;
+  bool is_const = this->is_const.data[*index];
+  int end = this->nodes.data[*index].step;
+
+  put_separator(this);
+  size_t start = this->code.length;
+  OutStream os = string_stream_stream(&this->code);
+
+  int class_index = -1;
+  if (this->locals and this->equalities is 0)
+    class_index = expr_cse_find(&this->locals->cse, node);
+
+  if (class_index >= 0 and this->locals->class_temps[class_index] >= 0) {
+    x_sprintf(os, "t%d", this->locals->class_temps[class_index]);
+    *index = end;
+    return true;
+  }
+
+  bool is_ok = true;
+  if (is_const) {
+    is_ok = put_const(this, node);
+
+  } else if (node->type is EXPR_VARIABLE) {
+    is_ok = put_variable(this, node);
+
+  } else if (node->type is EXPR_VECTOR) {
+    is_ok = fail(
+        this, str_owned("Vectors cannon be used in plot expressions. And "
+                        "'%$expr' is a vector.",
+                        *node));
+
   } else {
-    // Convert to GLSL expression
-    if (expr->type is EXPR_VECTOR) {
-      return StrErr(
-          str_owned("Vectors cannon be used in plot expressions. And '%$expr' "
-                    "is a vector.",
-                    *expr));
-    } else {
-      switch (expr->type) {
-        case EXPR_NUMBER:
-          return StrOk(isnan(expr->number.value)
-                           ? str_literal("nan")
-                           : str_owned("%lf", expr->number.value));
-        case EXPR_VARIABLE:
-          return variable_to_glsl(local_ctx, glsl, expr, used_args);
-        case EXPR_FUNCTION:
-          return function_to_glsl(local_ctx, glsl, expr, used_args);
-        case EXPR_BINARY_OP:
-          return operator_to_glsl(local_ctx, glsl, expr, used_args);
-        default:
-          panic("Invalid expr type");
-      }
+    GlslFrame frame = {
+        .expr = node,
+        .end = end,
+        .operands = 0,
+        .start = start,
+        .middle = start,
+        .class_index = class_index,
+    };
+    is_ok = node->type is EXPR_FUNCTION ? start_function(this, &frame)
+                                        : start_operator(this, &frame);
+    if (is_ok) {
+      vec_GlslFrame_push(&this->frames, frame);
+      (*index)++;
     }
+    return is_ok;
   }
+
+  if (is_ok) declare_local(this, class_index, start);
+  *index = end;
+  return is_ok;
+}
+
+// Between operands of the node on top
+static void put_separator(GlslWalk* this) {
+  if (this->frames.length is 0) return;
+  GlslFrame* parent = &this->frames.data[this->frames.length - 1];
+  OutStream os = string_stream_stream(&this->code);
+  int operand = parent->operands++;
+
+  if (parent->form is GLSL_FORM_FUNCTION) {
+    x_sprintf(os, ", ");
+  } else if (operand is 1) {
+    if (parent->form is GLSL_FORM_CLASSIC or
+        parent->form is GLSL_FORM_COMPARSION)
+      x_sprintf(os, " %s ", symbol_name(parent->expr->binary_operator.name));
+    else if (parent->form is GLSL_FORM_MOD or parent->form is GLSL_FORM_POW)
+      x_sprintf(os, ", ");
+  }
+
+  if (operand is 1) parent->middle = this->code.length;
+}
+
+// Code of the node since `start` becomes the value of a new local
+static void declare_local(GlslWalk* this, int class_index, size_t start) {
+  if (class_index < 0) return;
+  GlslLocals* locals = this->locals;
+  int* temp = &locals->class_temps[class_index];
+  *temp = locals->count++;
+
+  OutStream os = string_stream_stream(&locals->declarations);
+  x_sprintf(os, "float t%d = ", *temp);
+  outstream_put_slice(&this->code.buffer[start], this->code.length - start,
+                      os);
+  x_sprintf(os, ";\n");
+
+  string_stream_truncate(&this->code, start);
+  x_sprintf(string_stream_stream(&this->code), "t%d", *temp);
 }
 
-// HELPERS
+static str_t non_const_types_err_msg(ExprValue value, const Expr* expr);
+
+// Calculate and insert as-is
+static bool put_const(GlslWalk* this, const Expr* node) {
+  ExprValueResult res = expr_calculate(node, this->ctx);
+  if (not res.is_ok) return fail(this, res.err_text);
+
+  ExprValue value = res.ok;
+  if (value.type != EXPR_VALUE_NUMBER)
+    return fail(this, non_const_types_err_msg(value, node));
+
+  OutStream os = string_stream_stream(&this->code);
+  if (isnan(value.number))
+    x_sprintf(os, "nan");
+  else
+    x_sprintf(os, "%.10lf", value.number);
+  expr_value_free(value);
+  return true;
+}
+
+static StrResult variable_to_glsl(ExprContext ctx, GlslContext* glsl,
+                                  const Expr* expr,
+                                  const vec_Symbol* used_args);
+
+static bool put_variable(GlslWalk* this, const Expr* node) {
+  StrResult code =
+      variable_to_glsl(this->ctx, this->glsl, node, this->used_args);
+  if (not code.is_ok) return fail(this, code.data);
+
+  x_sprintf(string_stream_stream(&this->code), "%s", code.data.string);
+  str_free(code.data);
+  return true;
+}
+
+static bool finish_function(GlslWalk* this, const GlslFrame* frame);
+static bool finish_native(GlslWalk* this, const GlslFrame* frame);
+static void finish_pow(GlslWalk* this, const GlslFrame* frame);
+static void finish_equality(GlslWalk* this, const GlslFrame* frame);
+
+static bool finish_node(GlslWalk* this) {
+  GlslFrame frame = vec_GlslFrame_popget(&this->frames);
+  OutStream os = string_stream_stream(&this->code);
+
+  bool is_ok = true;
+  if (frame.form is GLSL_FORM_CLASSIC or frame.form is GLSL_FORM_MOD)
+    x_sprintf(os, ")");
+  else if (frame.form is GLSL_FORM_COMPARSION)
+    x_sprintf(os, ") ? 1.0 : 0.0)");
+  else if (frame.form is GLSL_FORM_POW)
+    finish_pow(this, &frame);
+  else if (frame.form is GLSL_FORM_EQUALITY)
+    finish_equality(this, &frame);
+  else if (frame.form is GLSL_FORM_NATIVE)
+    is_ok = finish_native(this, &frame);
+  else if (frame.form is GLSL_FORM_FUNCTION)
+    is_ok = finish_function(this, &frame);
+  else
+    panic("Unknown GLSL form %d", frame.form);
+
+  if (is_ok) declare_local(this, frame.class_index, frame.start);
+  return is_ok;
+}
 
 // =====
 // VARIABLE TO GLSL
@@ -80,27 +401,26 @@ static StrResult variable_to_glsl_turn_to_fn(GlslContext* glsl,
 
 static StrResult variable_to_glsl(ExprContext ctx, GlslContext* glsl,
                                   const Expr* expr,
-                                  const vec_str_t* used_args) {
-  const char* var_name = expr->variable.name.string;
+                                  const vec_Symbol* used_args) {
+  Symbol name = expr->variable.name;
+  const char* var_name = symbol_name(name);
   // debugln("Glsl var '%s'", var_name);
-  StrSlice var_name_slice = str_slice_from_str_t(&expr->variable.name);
 
   StrResult result;
 
   bool contains = false;
   for (int i = 0; i < used_args->length and not contains; i++)
-    if (strcmp(used_args->data[i].string, var_name) is 0) contains = true;
+    if (used_args->data[i] is name) contains = true;
 
   if (contains) {
     result = StrOk(str_owned("arg_%s", var_name));
-  } else if (ctx.vtable->is_variable(ctx.data, var_name_slice)) {
+  } else if (ctx.vtable->is_variable(ctx.data, name)) {
     debugln("Is actually variable (vtable is %p)", ctx.vtable);
     assert_m(ctx.vtable->get_variable_info);
     debug_push();
 
     debugln("Fn is %p", ctx.vtable->get_variable_info);
-    ExprVariableInfo info =
-        ctx.vtable->get_variable_info(ctx.data, var_name_slice);
+    ExprVariableInfo info = ctx.vtable->get_variable_info(ctx.data, name);
 
     debug_pop();
     debugln("Got info");
@@ -163,22 +483,21 @@ static StrResult variable_to_glsl_turn_to_fn(GlslContext* glsl,
     result = StrOk(str_owned("%s(pos, step)", glsl_var_fn_name.string));
     str_free(glsl_var_fn_name);
   } else {
-    vec_str_t args = vec_str_t_create();
-    StrResult code = glsl_compile_expression(info.correct_context, glsl,
-                                             info.expression, &args);
+    vec_Symbol args = vec_Symbol_create();
+    StrResult code =
+        glsl_compile_body(info.correct_context, glsl, info.expression, &args);
 
     if (code.is_ok) {
       result = StrOk(str_owned("%s(pos, step)", glsl_var_fn_name.string));
       GlslFunction fn = {
           .name = glsl_var_fn_name,
           .args = args,
-          .code = str_owned("return %s;", code.data.string),
+          .code = code.data,
       };
-      str_free(code.data);
       glsl_context_add_function(glsl, fn);
     } else {
       str_free(glsl_var_fn_name);
-      vec_str_t_free(args);
+      vec_Symbol_free(args);
       result = code;
     }
   }
@@ -192,123 +511,93 @@ static StrResult variable_to_glsl_turn_to_fn(GlslContext* glsl,
 // =====
 // FUNCTION TO GLSL
 // =====
-static int get_func_args_count(ExprContext ctx, const char* fn_name);
+static int get_func_args_count(ExprContext ctx, Symbol fn_name);
 static bool is_func_glsl_native(const char* fn_name);
-static str_t call_native_function(const char* native_fn, const char* argument);
 
 static StrResult ftgl_check_correctness(ExprContext this, GlslContext* glsl,
                                         const Expr* expr,
-                                        const vec_str_t* used_args);
+                                        const vec_Symbol* used_args);
 
 static StrResult compile_function_to_glsl(ExprContext ctx, GlslContext* glsl,
                                           const Expr* function);
-static StrResult glsl_compile_fn_args_values(ExprContext ctx, GlslContext* glsl,
-                                             const Expr* fn_argument,
-                                             const vec_str_t* used_args);
 
-static StrResult function_to_glsl(ExprContext ctx, GlslContext* glsl,
-                                  const Expr* expr,
-                                  const vec_str_t* used_args) {
+static bool start_function(GlslWalk* this, GlslFrame* frame) {
+  const Expr* expr = frame->expr;
   assert_m(expr->type is EXPR_FUNCTION);
-  StrResult result = ftgl_check_correctness(ctx, glsl, expr, used_args);
-  if (not result.is_ok)
-    return result;
-  else
-    str_free(result.data);
-
-  StrResult argument = glsl_compile_fn_args_values(
-      ctx, glsl, expr->function.argument, used_args);
-
-  if (not argument.is_ok) {
-    result = argument;
+  StrResult result =
+      ftgl_check_correctness(this->ctx, this->glsl, expr, this->used_args);
+  if (not result.is_ok) return fail(this, result.data);
+  str_free(result.data);
+
+  OutStream os = string_stream_stream(&this->code);
+  const char* fn_name = symbol_name(expr->function.name);
+
+  if (is_func_glsl_native(fn_name)) {
+    frame->form = GLSL_FORM_NATIVE;
+    bool is_log = strcmp(fn_name, "ln") is 0 or strcmp(fn_name, "log") is 0;
+    x_sprintf(os, "%s(", is_log ? "log" : fn_name);
   } else {
-    if (is_func_glsl_native(expr->function.name.string)) {
-      result = StrOk(
-          call_native_function(expr->function.name.string,
-                               argument.data.string + 2));  // +2 to skip comma
-    } else {
-      str_t shader_func_name = str_owned("func_%s", expr->function.name.string);
-
-      if (not glsl_context_get_function(glsl, shader_func_name.string))
-        result = compile_function_to_glsl(ctx, glsl, expr);
-
-      if (result.is_ok) {
-        str_free(result.data);
-        str_t tmp = str_owned("%s(pos, step%s)", shader_func_name.string,
-                              argument.data.string);
-        result = StrOk(tmp);
-      }
-      str_free(shader_func_name);
-    }
-    str_free(argument.data);
+    frame->form = GLSL_FORM_FUNCTION;
+    x_sprintf(os, "func_%s(pos, step", fn_name);
   }
-
-  return result;
+  return true;
 }
 
-static StrResult glsl_compile_fn_args_values(ExprContext ctx, GlslContext* glsl,
-                                             const Expr* fn_argument,
-                                             const vec_str_t* used_args) {
-  StringStream stream = string_stream_create();
-  OutStream os = string_stream_stream(&stream);
-
-  StrResult result = StrOk(str_literal(""));
-  if (fn_argument->type is EXPR_VECTOR) {
-    const vec_Expr* args_expr = &fn_argument->vector.arguments;
-
-    for (int i = 0; i < args_expr->length and result.is_ok; i++) {
-      StrResult local_res =
-          glsl_compile_expression(ctx, glsl, &args_expr->data[i], used_args);
-      if (not local_res.is_ok) {
-        result = local_res;
-      } else {
-        x_sprintf(os, ", %s", local_res.data.string);
-        str_free(local_res.data);
-      }
-    }
-  } else {
-    StrResult local_res =
-        glsl_compile_expression(ctx, glsl, fn_argument, used_args);
-    if (not local_res.is_ok)
-      result = local_res;
-    else {
-      x_sprintf(os, ", %s", local_res.data.string);
-      str_free(local_res.data);
-    }
-  }
+#define E "2.71828182846"
+static bool finish_native(GlslWalk* this, const GlslFrame* frame) {
+  const char* fn_name = symbol_name(frame->expr->function.name);
+  OutStream os = string_stream_stream(&this->code);
+
+  if (strcmp(fn_name, "ln") is 0)
+    x_sprintf(os, ")/log(" E ")");
+  else if (strcmp(fn_name, "log") is 0)
+    x_sprintf(os, ")/log(10.0)");
+  else
+    x_sprintf(os, ")");
+  return true;
+}
 
-  if (result.is_ok) {
-    str_free(result.data);
-    result = StrOk(string_stream_to_str_t(stream));
-  } else {
-    string_stream_free(stream);
+// Called function is compiled after its arguments
+static bool finish_function(GlslWalk* this, const GlslFrame* frame) {
+  const Expr* expr = frame->expr;
+  str_t shader_func_name =
+      str_owned("func_%s", symbol_name(expr->function.name));
+
+  bool is_ok = true;
+  if (not glsl_context_get_function(this->glsl, shader_func_name.string)) {
+    StrResult result = compile_function_to_glsl(this->ctx, this->glsl, expr);
+    if (result.is_ok)
+      str_free(result.data);
+    else
+      is_ok = fail(this, result.data);
   }
+  str_free(shader_func_name);
 
-  return result;
+  if (is_ok) x_sprintf(string_stream_stream(&this->code), ")");
+  return is_ok;
 }
 
 static StrResult compile_function_to_glsl(ExprContext ctx, GlslContext* glsl,
                                           const Expr* expr) {
-  ExprFunctionInfo info = ctx.vtable->get_function_info(
-      ctx.data, str_slice_from_str_t(&expr->function.name));
+  const char* fn_name = symbol_name(expr->function.name);
+  ExprFunctionInfo info =
+      ctx.vtable->get_function_info(ctx.data, expr->function.name);
 
   StrResult result;
   if (not info.expression) {
-    result = StrErr(
-        str_owned("Function '%s' not found", expr->function.name.string));
+    result = StrErr(str_owned("Function '%s' not found", fn_name));
   } else {
-    StrResult code = glsl_compile_expression(info.correct_context, glsl,
-                                             info.expression, info.args_names);
+    StrResult code = glsl_compile_body(info.correct_context, glsl,
+                                       info.expression, info.args_names);
     if (not code.is_ok) {
       result = StrErr(code.data);
     } else {
       GlslFunction func = {
-          .args = vec_str_t_clone(info.args_names),
-          .code = str_owned("return %s;", code.data.string),
-          .name = str_owned("func_%s", expr->function.name.string)};
+          .args = vec_Symbol_clone(info.args_names),
+          .code = code.data,
+          .name = str_owned("func_%s", fn_name)};
 
       glsl_context_add_function(glsl, func);
-      str_free(code.data);
 
       result = StrOk(str_literal("-"));
     }
@@ -319,14 +608,14 @@ static StrResult compile_function_to_glsl(ExprContext ctx, GlslContext* glsl,
 
 static StrResult ftgl_check_correctness(ExprContext ctx, GlslContext* glsl,
                                         const Expr* expr,
-                                        const vec_str_t* used_args) {
+                                        const vec_Symbol* used_args) {
   unused(glsl);
   unused(used_args);
   assert_m(expr->type is EXPR_FUNCTION);
-  int required_args = get_func_args_count(ctx, expr->function.name.string);
+  const char* fn_name = symbol_name(expr->function.name);
+  int required_args = get_func_args_count(ctx, expr->function.name);
   if (required_args < 0)
-    return StrErr(
-        str_owned("Function '%s' cannot be found", expr->function.name.string));
+    return StrErr(str_owned("Function '%s' cannot be found", fn_name));
 
   int fn_args_count;
   if (expr->function.argument->type != EXPR_VECTOR) {
@@ -338,16 +627,15 @@ static StrResult ftgl_check_correctness(ExprContext ctx, GlslContext* glsl,
   if (fn_args_count != required_args)
     return StrErr(str_owned(
         "Function '%s' accepts %d arguments, but %d args were provided.",
-        expr->function.name.string, required_args, fn_args_count));
+        fn_name, required_args, fn_args_count));
 
   return StrOk(str_literal("Ok"));
 }
 
-static int get_func_args_count(ExprContext ctx, const char* fn_name) {
-  if (is_func_glsl_native(fn_name)) return 1;
+static int get_func_args_count(ExprContext ctx, Symbol fn_name) {
+  if (is_func_glsl_native(symbol_name(fn_name))) return 1;
 
-  ExprFunctionInfo info =
-      ctx.vtable->get_function_info(ctx.data, str_slice_from_string(fn_name));
+  ExprFunctionInfo info = ctx.vtable->get_function_info(ctx.data, fn_name);
   if (info.args_names) {
     return info.args_names->length;
   } else {
@@ -362,16 +650,6 @@ static bool is_func_glsl_native(const char* fn_name) {
 
   return false;
 }
-
-#define E "2.71828182846"
-static str_t call_native_function(const char* native_fn, const char* argument) {
-  if (strcmp(native_fn, "ln") is 0)
-    return str_owned("log(%s)/log(" E ")", argument);
-  else if (strcmp(native_fn, "log") is 0)
-    return str_owned("log(%s)/log(10.0)", argument);
-  else
-    return str_owned("%s(%s)", native_fn, argument);
-}
 // =====
 // FUNCTION TO GLSL END
 // =====
@@ -396,95 +674,67 @@ static str_t non_const_types_err_msg(ExprValue value, const Expr* expr) {
 // + - * / ^ > < >= <= == = !=
 #define cmp(a, b) strcmp((a), (b)) is 0
 
-#define TemplateOperator(fn_name, ...)                                    \
-  static StrResult fn_name##_operator(ExprContext ctx, GlslContext* glsl, \
-                                      const Expr* expr,                   \
-                                      const vec_str_t* used_args) {       \
-    assert_m(expr->type is EXPR_BINARY_OP);                               \
-                                                                          \
-    StrResult left_r = glsl_compile_expression(                           \
-        ctx, glsl, expr->binary_operator.lhs, used_args);                 \
-    if (not left_r.is_ok) return left_r;                                  \
-                                                                          \
-    StrResult right_r = glsl_compile_expression(                          \
-        ctx, glsl, expr->binary_operator.rhs, used_args);                 \
-    if (not right_r.is_ok) {                                              \
-      str_result_free(left_r);                                            \
-      return right_r;                                                     \
-    }                                                                     \
-    const char* left = left_r.data.string;                                \
-    const char* right = right_r.data.string;                              \
-    const char* name = expr->binary_operator.name.string;                 \
-    unused(name);                                                         \
-    unused(left);                                                         \
-    unused(right);                                                        \
-    str_t result = str_owned(__VA_ARGS__);                                \
-                                                                          \
-    str_result_free(left_r);                                              \
-    str_result_free(right_r);                                             \
-    return StrOk(result);                                                 \
-  }
-
-TemplateOperator(classic, "(%s %s %s)", left, name, right)
-TemplateOperator(comparsion, "((%s %s %s) ? 1.0 : 0.0)", left, name, right)
-TemplateOperator(mod, "mod(%s, %s)", left, right)
-
-static StrResult equality_operator(ExprContext this, GlslContext* glsl,
-                                   const Expr* expr,
-                                   const vec_str_t* used_args);
-static StrResult powf_operator(ExprContext ctx, GlslContext* glsl,
-                               const Expr* expr, const vec_str_t* used_args);
-
-static StrResult operator_to_glsl(ExprContext this, GlslContext* glsl,
-                                  const Expr* expr,
-                                  const vec_str_t* used_args) {
+static bool start_operator(GlslWalk* this, GlslFrame* frame) {
+  const Expr* expr = frame->expr;
   assert_m(expr->type is EXPR_BINARY_OP);
 
-  const char* op_name = expr->binary_operator.name.string;
+  const char* op_name = symbol_name(expr->binary_operator.name);
+  OutStream os = string_stream_stream(&this->code);
 
   if (cmp(op_name, "+") or cmp(op_name, "-") or cmp(op_name, "*") or
       cmp(op_name, "/")) {
-    return classic_operator(this, glsl, expr, used_args);
+    frame->form = GLSL_FORM_CLASSIC;
+    x_sprintf(os, "(");
   } else if (cmp(op_name, "^")) {
-    return powf_operator(this, glsl, expr, used_args);
+    frame->form = GLSL_FORM_POW;
+    x_sprintf(os, "pow(");
   } else if (cmp(op_name, "<") or cmp(op_name, ">") or cmp(op_name, "<=") or
              cmp(op_name, ">=")) {
-    return comparsion_operator(this, glsl, expr, used_args);
+    frame->form = GLSL_FORM_COMPARSION;
+    x_sprintf(os, "((");
   } else if (cmp(op_name, "==") or cmp(op_name, "!=") or cmp(op_name, "=")) {
-    return equality_operator(this, glsl, expr, used_args);
+    // Sides go into a function of their own, so they cannot use locals of
+    // the current body
+    frame->form = GLSL_FORM_EQUALITY;
+    this->equalities++;
   } else if (cmp(op_name, "%") or cmp(op_name, "mod")) {
-    return mod_operator(this, glsl, expr, used_args);
+    frame->form = GLSL_FORM_MOD;
+    x_sprintf(os, "mod(");
   } else {
-    return StrErr(
-        str_owned("Operator '%s' cannot used in plot-expression", op_name));
+    return fail(this, str_owned(
+                          "Operator '%s' cannot used in plot-expression",
+                          op_name));
   }
+  return true;
 }
 
 static int get_int(const char* text);
 
-static StrResult powf_operator(ExprContext ctx, GlslContext* glsl,
-                               const Expr* expr, const vec_str_t* used_args) {
-  assert_m(expr->type is EXPR_BINARY_OP);
-
-  StrResult left_r =
-      glsl_compile_expression(ctx, glsl, expr->binary_operator.lhs, used_args);
-  if (not left_r.is_ok) return left_r;
-
-  StrResult right_r =
-      glsl_compile_expression(ctx, glsl, expr->binary_operator.rhs, used_args);
-  if (not right_r.is_ok) {
-    str_result_free(left_r);
-    return right_r;
+// Small integer powers of short operands are written out as multiplications
+static void finish_pow(GlslWalk* this, const GlslFrame* frame) {
+  OutStream os = string_stream_stream(&this->code);
+  const char* buffer = this->code.buffer;
+
+  size_t left_start = frame->start + strlen("pow(");
+  size_t left_length = frame->middle - strlen(", ") - left_start;
+  size_t right_length = this->code.length - frame->middle;
+
+  // Such integers are always short
+  int int_val = INT_MAX;
+  char right[32];
+  if (right_length < sizeof(right)) {
+    memcpy(right, &buffer[frame->middle], right_length);
+    right[right_length] = '\0';
+    int_val = get_int(right);
   }
-  const char* left = left_r.data.string;
-  const char* right = right_r.data.string;
-  str_t result;
 
-  int int_val = get_int(right);
   if (int_val != INT_MAX and int_val >= -32 and int_val <= 32 and
-      strlen(left) < 16) {
-    StringStream stream = string_stream_create();
-    OutStream os = string_stream_stream(&stream);
+      left_length < 16) {
+    char left[16];
+    memcpy(left, &buffer[left_start], left_length);
+    left[left_length] = '\0';
+
+    string_stream_truncate(&this->code, frame->start);
     x_sprintf(os, "(1.0");
 
     for (int i = 1; i <= int_val; i++) x_sprintf(os, "*%s", left);
@@ -492,13 +742,9 @@ static StrResult powf_operator(ExprContext ctx, GlslContext* glsl,
     for (int i = -1; i >= int_val; i--) x_sprintf(os, "/%s", left);
 
     x_sprintf(os, ")");
-    result = string_stream_to_str_t(stream);
-  } else
-    result = str_owned("pow(%s, %s)", left, right);
-
-  str_result_free(left_r);
-  str_result_free(right_r);
-  return StrOk(result);
+  } else {
+    x_sprintf(os, ")");
+  }
 }
 
 static int get_int(const char* text) {
@@ -537,10 +783,11 @@ static str_t eq_function_text(const char* fn_name, const char* used_args_text,
   return res;
 }
 
-static StrResult equality_operator(ExprContext ctx, GlslContext* glsl,
-                                   const Expr* expr,
-                                   const vec_str_t* used_args) {
-  const char* op_name = expr->binary_operator.name.string;
+// Difference of the sides becomes a function, and another one checks if it
+// changes sign around the point
+static void finish_equality(GlslWalk* this, const GlslFrame* frame) {
+  this->equalities--;
+  const char* op_name = symbol_name(frame->expr->binary_operator.name);
   bool eq_or_neq;
   if (cmp(op_name, "==") or cmp(op_name, "="))
     eq_or_neq = true;
@@ -549,41 +796,41 @@ static StrResult equality_operator(ExprContext ctx, GlslContext* glsl,
   else
     panic("Invalid eq operator");
 
-  StrResult left_r =
-      glsl_compile_expression(ctx, glsl, expr->binary_operator.lhs, used_args);
-  if (not left_r.is_ok) return left_r;
-
-  StrResult right_r =
-      glsl_compile_expression(ctx, glsl, expr->binary_operator.rhs, used_args);
-  if (not right_r.is_ok) {
-    str_result_free(left_r);
-    return right_r;
-  }
+  const char* buffer = this->code.buffer;
+  StringStream difference = string_stream_create();
+  OutStream diff_os = string_stream_stream(&difference);
+  x_sprintf(diff_os, "return (");
+  outstream_put_slice(&buffer[frame->start], frame->middle - frame->start,
+                      diff_os);
+  x_sprintf(diff_os, ") - (");
+  outstream_put_slice(&buffer[frame->middle],
+                      this->code.length - frame->middle, diff_os);
+  x_sprintf(diff_os, ");");
+  string_stream_truncate(&this->code, frame->start);
+
+  GlslContext* glsl = this->glsl;
+  const vec_Symbol* used_args = this->used_args;
 
   str_t expr_function_name = glsl_context_get_unique_fn_name(glsl);
   GlslFunction fn = {
       .name = str_clone(&expr_function_name),
-      .args = vec_str_t_clone(used_args),
-      .code = str_owned("return (%s) - (%s);", left_r.data.string,
-                        right_r.data.string),
+      .args = vec_Symbol_clone(used_args),
+      .code = string_stream_to_str_t(difference),
   };
-  str_result_free(left_r);
-  str_result_free(right_r);
   glsl_context_add_function(glsl, fn);
 
   str_t args_text = glsl_args_vals_to_string(used_args);
   str_t expr_change_fn_name = glsl_context_get_unique_fn_name(glsl);
   GlslFunction fn2 = {.name = str_clone(&expr_change_fn_name),
-                      .args = vec_str_t_clone(used_args),
+                      .args = vec_Symbol_clone(used_args),
                       .code = eq_function_text(expr_function_name.string,
                                                args_text.string, eq_or_neq)};
   glsl_context_add_function(glsl, fn2);
   str_free(expr_function_name);
 
-  str_t result = str_owned("%s(pos, step%s)", expr_change_fn_name.string,
-                           args_text.string);
+  x_sprintf(string_stream_stream(&this->code), "%s(pos, step%s)",
+            expr_change_fn_name.string, args_text.string);
 
   str_free(expr_change_fn_name);
   str_free(args_text);
-  return StrOk(result);
 }
@@ -10,6 +10,11 @@
 #include "glsl_function.h"
 
 StrResult glsl_compile_expression(ExprContext calc, GlslContext* glsl,
-                                  const Expr* expr, const vec_str_t* used_args);
+                                  const Expr* expr,
+                                  const vec_Symbol* used_args);
+// Whole function body: repeated subexpressions are computed once into
+// `float tN = ...;` locals, followed by `return ...;`
+StrResult glsl_compile_body(ExprContext calc, GlslContext* glsl,
+                            const Expr* expr, const vec_Symbol* used_args);
 
 #endif  // SRC_CALCULATOR_GLSL_RENDERER_H_
\ No newline at end of file
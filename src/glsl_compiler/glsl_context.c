@@ -7,6 +7,7 @@
 GlslContext glsl_context_create() {
   return (GlslContext){
       .functions = vec_GlslFunction_create(),
+      .locals = null,
   };
 }
 
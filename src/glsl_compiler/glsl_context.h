@@ -5,6 +5,7 @@
 
 typedef struct GlslContext {
   vec_GlslFunction functions;
+  struct GlslLocals* locals;  // Temporaries of the body being compiled, if any
 } GlslContext;
 
 GlslContext glsl_context_create();
@@ -10,12 +10,12 @@
 void glsl_function_free(GlslFunction this) {
   str_free(this.name);
   str_free(this.code);
-  vec_str_t_free(this.args);
+  vec_Symbol_free(this.args);
 }
 
 GlslFunction glsl_function_clone(const GlslFunction* this) {
   GlslFunction clone = {
-      .args = vec_str_t_clone(&this->args),
+      .args = vec_Symbol_clone(&this->args),
       .code = str_clone(&this->code),
       .name = str_clone(&this->name),
   };
@@ -28,24 +28,24 @@ void glsl_function_print(const GlslFunction* this, OutStream out) {
   x_sprintf(out, "){\n%s\n}", this->code.string);
 }
 
-void glsl_print_args(const vec_str_t* used_args, OutStream out) {
+void glsl_print_args(const vec_Symbol* used_args, OutStream out) {
   for (int i = 0; i < used_args->length; i++)
-    x_sprintf(out, ", float arg_%s", used_args->data[i].string);
+    x_sprintf(out, ", float arg_%s", symbol_name(used_args->data[i]));
 }
 
-str_t glsl_args_to_string(const vec_str_t* used_args) {
+str_t glsl_args_to_string(const vec_Symbol* used_args) {
   StringStream stream = string_stream_create();
   OutStream os = string_stream_stream(&stream);
   glsl_print_args(used_args, os);
   return string_stream_to_str_t(stream);
 }
 
-void glsl_print_args_vals(const vec_str_t* used_args, OutStream out) {
+void glsl_print_args_vals(const vec_Symbol* used_args, OutStream out) {
   for (int i = 0; i < used_args->length; i++)
-    x_sprintf(out, ", arg_%s", used_args->data[i].string);
+    x_sprintf(out, ", arg_%s", symbol_name(used_args->data[i]));
 }
 
-str_t glsl_args_vals_to_string(const vec_str_t* used_args) {
+str_t glsl_args_vals_to_string(const vec_Symbol* used_args) {
   StringStream stream = string_stream_create();
   OutStream os = string_stream_stream(&stream);
   glsl_print_args_vals(used_args, os);
@@ -11,6 +11,7 @@
 #include "app.h"
 #include "util/allocator.h"
 #include "util/prettify_c.h"
+#include "util/symbol.h"
 
 #define MAX_VERTEX_BUFFER 512 * 1024
 #define MAX_ELEMENT_BUFFER 128 * 1024
@@ -90,6 +91,7 @@ int main() {
   glfwTerminate();
 
   debugln("Done. Stopping the program");
+  symbols_free();
   my_allocator_dump_short();
   return 0;
 }
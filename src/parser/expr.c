@@ -2,6 +2,7 @@
 #include "expr.h"
 
 #include "../util/allocator.h"
+#include "../util/common_vecs.h"
 
 #define VECTOR_C Expr
 #define VECTOR_ITEM_DESTRUCTOR expr_free
@@ -13,6 +14,12 @@
 #define VECTOR_ITEM_CLONE vec_Expr_clone
 #include "../util/vector.h"
 
+#define VECTOR_C ExprStep
+#include "../util/vector.h"
+
+#define VECTOR_C ExprType
+#include "../util/vector.h"
+
 // FUNCTIONS
 
 // -- Basic functionality
@@ -23,32 +30,45 @@
 // =
 // =====
 void expr_free(Expr this) {
-  if (this.type is EXPR_NUMBER) {
-    // Number does not OWN any resources to free
-  } else if (this.type is EXPR_VARIABLE) {
-    str_free(this.variable.name);
-
-  } else if (this.type is EXPR_FUNCTION) {
-    str_free(this.function.name);
-    if (this.function.argument) {
-      expr_free(*this.function.argument);
-      FREE(this.function.argument);
+  vec_Expr rest = vec_Expr_create();  // Children are moved here to be freed
+
+  while (true) {
+    if (this.type is EXPR_NUMBER) {
+      // Number does not OWN any resources to free
+    } else if (this.type is EXPR_VARIABLE) {
+      // Names are interned, nodes do not own them
+
+    } else if (this.type is EXPR_FUNCTION) {
+      if (this.function.argument) {
+        vec_Expr_push(&rest, *this.function.argument);
+        FREE(this.function.argument);
+      }
+
+    } else if (this.type is EXPR_VECTOR) {
+      vec_Expr* items = &this.vector.arguments;
+      for (int i = 0; i < items->length; i++)
+        vec_Expr_push(&rest, items->data[i]);
+
+      items->length = 0;  // Moved
+      vec_Expr_free(*items);
+
+    } else if (this.type is EXPR_BINARY_OP) {
+      Expr* lhs = this.binary_operator.lhs;
+      Expr* rhs = this.binary_operator.rhs;
+      if (lhs) vec_Expr_push(&rest, *lhs);
+      if (rhs) vec_Expr_push(&rest, *rhs);
+      FREE(lhs);
+      FREE(rhs);
+
+    } else {
+      panic("Invalid expr type");
     }
 
-  } else if (this.type is EXPR_VECTOR) {
-    vec_Expr_free(this.vector.arguments);
-
-  } else if (this.type is EXPR_BINARY_OP) {
-    str_free(this.binary_operator.name);
-
-    if (this.binary_operator.lhs) expr_free(*this.binary_operator.lhs);
-    if (this.binary_operator.rhs) expr_free(*this.binary_operator.rhs);
-    FREE(this.binary_operator.lhs);
-    FREE(this.binary_operator.rhs);
-
-  } else {
-    panic("Invalid expr type");
+    if (rest.length is 0) break;
+    this = vec_Expr_popget(&rest);
   }
+
+  vec_Expr_free(rest);
 }
 
 // =====
@@ -56,54 +76,81 @@ void expr_free(Expr this) {
 // = expr_print
 // =
 // =====
-static void expr_print_binary_op(const Expr* this, OutStream out);
+static bool expr_print_step(const Expr* this, int step, OutStream out,
+                            const Expr** child);
+
 void expr_print(const Expr* this, OutStream out) {
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
+
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* child;
+
+    if (expr_print_step(top->expr, top->step++, out, &child))
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+    else
+      vec_ExprStep_popfree(&stack);
+  }
+
+  vec_ExprStep_free(stack);
+}
+
+// Prints what goes before child number `step` and gives that child (which is
+// null in unfinished trees), or prints the end and returns false
+static bool expr_print_step(const Expr* this, int step, OutStream out,
+                            const Expr** child) {
   if (this is null) {
     x_sprintf(out, "<nullptr>");
-    return;
+
   } else if (this->type is EXPR_NUMBER) {
     x_sprintf(out, "%.1lf", this->number.value);
 
   } else if (this->type is EXPR_VARIABLE) {
-    x_sprintf(out, "%s", this->variable.name.string);
+    x_sprintf(out, "%s", symbol_name(this->variable.name));
+
   } else if (this->type is EXPR_FUNCTION) {
-    x_sprintf(out, "<%s> ", this->function.name.string);
-    expr_print(this->function.argument, out);
+    if (step is 0) {
+      x_sprintf(out, "<%s> ", symbol_name(this->function.name));
+      *child = this->function.argument;
+      return true;
+    }
 
   } else if (this->type is EXPR_VECTOR) {
-    outstream_putc('[', out);
-    for (int i = 0; i < this->vector.arguments.length; i++) {
-      if (i > 0) x_sprintf(out, ", ");
-      expr_print(&this->vector.arguments.data[i], out);
+    if (step is 0) outstream_putc('[', out);
+    if (step < this->vector.arguments.length) {
+      if (step > 0) x_sprintf(out, ", ");
+      *child = &this->vector.arguments.data[step];
+      return true;
     }
     outstream_putc(']', out);
 
   } else if (this->type is EXPR_BINARY_OP) {
-    expr_print_binary_op(this, out);
-
-  } else {
-    panic("Invalid expr type");
-  }
-}
-
-static void expr_print_binary_op(const Expr* this, OutStream out) {
-  assert_m(this->type is EXPR_BINARY_OP);
+    // Indexing is `(a[b])`, other operators are `(a + b)`
+    const char* name = symbol_name(this->binary_operator.name);
+    bool is_index = strcmp(name, "[]") is 0;
+
+    if (step is 0) {
+      outstream_putc('(', out);
+      *child = this->binary_operator.lhs;
+      return true;
+    } else if (step is 1) {
+      if (is_index)
+        outstream_putc('[', out);
+      else
+        x_sprintf(out, " %s ", name);
+      *child = this->binary_operator.rhs;
+      return true;
+    }
 
-  outstream_putc('(', out);
-  expr_print(this->binary_operator.lhs, out);
+    if (is_index) outstream_putc(']', out);
+    outstream_putc(')', out);
 
-  if (strcmp(this->binary_operator.name.string, "[]") is 0) {
-    // Indexing[operator]
-    outstream_putc('[', out);
-    expr_print(this->binary_operator.rhs, out);
-    outstream_putc(']', out);
   } else {
-    // Regular + operator
-    x_sprintf(out, " %s ", this->binary_operator.name.string);
-    expr_print(this->binary_operator.rhs, out);
+    panic("Invalid expr type");
   }
 
-  outstream_putc(')', out);
+  return false;
 }
 
 // =====
@@ -111,45 +158,134 @@ static void expr_print_binary_op(const Expr* this, OutStream out) {
 // = expr_clone
 // =
 // =====
+static Expr expr_clone_node(const Expr* this, vec_Expr* done);
+
+// Children are cloned first, and wait on `done` for their parent
 Expr expr_clone(const Expr* this) {
   assert_m(this);
 
-  Expr result;
-  if (this->type is EXPR_NUMBER) {
-    result = *this;
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_Expr done = vec_Expr_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
 
-  } else if (this->type is EXPR_VARIABLE) {
-    result = (Expr){
-        .type = EXPR_VARIABLE,
-        .variable.name = str_clone(&this->variable.name),
-    };
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* child = expr_child(top->expr, top->step++);
+
+    if (child) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+    } else {
+      Expr node = expr_clone_node(top->expr, &done);
+      vec_Expr_push(&done, node);
+      vec_ExprStep_popfree(&stack);
+    }
+  }
+
+  Expr result = vec_Expr_popget(&done);
+  vec_ExprStep_free(stack);
+  vec_Expr_free(done);
+  return result;
+}
+
+// Clones of the children are the last ones in `done`, and are taken from there
+static Expr expr_clone_node(const Expr* this, vec_Expr* done) {
+  if (this->type is EXPR_NUMBER or this->type is EXPR_VARIABLE) {
+    return *this;
 
   } else if (this->type is EXPR_FUNCTION) {
-    result = (Expr){.type = EXPR_FUNCTION,
-                    .function = {.argument = expr_move_to_heap(
-                                     expr_clone(this->function.argument)),
-                                 .name = str_clone(&this->function.name)}};
+    assert_m(this->function.argument);
+    return (Expr){
+        .type = EXPR_FUNCTION,
+        .function = {.argument = expr_move_to_heap(vec_Expr_popget(done)),
+                     .name = this->function.name,
+                     .native_slot = this->function.native_slot}};
 
   } else if (this->type is EXPR_VECTOR) {
-    result = (Expr){
-        .type = EXPR_VECTOR,
-        .vector.arguments = vec_Expr_clone(&this->vector.arguments),
-    };
+    int count = this->vector.arguments.length;
+    vec_Expr items = vec_Expr_with_capacity(count);
+    for (int i = done->length - count; i < done->length; i++)
+      vec_Expr_push(&items, done->data[i]);
+    done->length -= count;  // Moved
+
+    return (Expr){.type = EXPR_VECTOR, .vector.arguments = items};
 
   } else if (this->type is EXPR_BINARY_OP) {
-    result = (Expr){
-        .type = EXPR_BINARY_OP,
-        .binary_operator = {
-            .name = str_clone(&this->binary_operator.name),
-            .lhs = expr_move_to_heap(expr_clone(this->binary_operator.lhs)),
-            .rhs = expr_move_to_heap(expr_clone(this->binary_operator.rhs)),
-        }};
+    assert_m(this->binary_operator.lhs and this->binary_operator.rhs);
+    Expr* rhs = expr_move_to_heap(vec_Expr_popget(done));
+    Expr* lhs = expr_move_to_heap(vec_Expr_popget(done));
+
+    return (Expr){.type = EXPR_BINARY_OP,
+                  .binary_operator = {
+                      .name = this->binary_operator.name,
+                      .fn = this->binary_operator.fn,
+                      .lhs = lhs,
+                      .rhs = rhs,
+                  }};
 
   } else {
     panic("Invalid expr type");
   }
+}
 
-  return result;
+// =====
+// =
+// = expr_equal
+// =
+// =====
+static bool nodes_equal(const Expr* a, const Expr* b);
+
+// Pairs of nodes wait on the stack as two entries in a row
+bool expr_equal(const Expr* a, const Expr* b) {
+  assert_m(a and b);
+
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = a});
+  vec_ExprStep_push(&stack, (ExprStep){.expr = b});
+
+  bool is_equal = true;
+  while (is_equal and stack.length > 0) {
+    const Expr* b_node = vec_ExprStep_popget(&stack).expr;
+    const Expr* a_node = vec_ExprStep_popget(&stack).expr;
+    is_equal = nodes_equal(a_node, b_node);
+
+    // Equal nodes have the same number of children
+    const Expr* child;
+    for (int i = 0; is_equal and (child = expr_child(a_node, i)); i++) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+      vec_ExprStep_push(&stack, (ExprStep){.expr = expr_child(b_node, i)});
+    }
+  }
+
+  vec_ExprStep_free(stack);
+  return is_equal;
+}
+
+// Children are not compared here
+static bool nodes_equal(const Expr* a, const Expr* b) {
+  if (a->type is_not b->type) return false;
+
+  if (a->type is EXPR_NUMBER) {
+    // Bitwise, so that -0 and 0 are different (and NaN is equal to itself)
+    return memcmp(&a->number.value, &b->number.value, sizeof(double)) is 0;
+
+  } else if (a->type is EXPR_VARIABLE) {
+    return a->variable.arg_slot is b->variable.arg_slot and
+           a->variable.name is b->variable.name;
+
+  } else if (a->type is EXPR_FUNCTION) {
+    return a->function.native_slot is b->function.native_slot and
+           a->function.name is b->function.name;
+
+  } else if (a->type is EXPR_VECTOR) {
+    return a->vector.arguments.length is b->vector.arguments.length;
+
+  } else if (a->type is EXPR_BINARY_OP) {
+    return a->binary_operator.fn is b->binary_operator.fn and
+           a->binary_operator.name is b->binary_operator.name;
+
+  } else {
+    panic("Invalid expr type");
+  }
 }
 
 // =====
@@ -164,6 +300,46 @@ Expr* expr_move_to_heap(Expr value) {
   return ptr;
 }
 
+// =====
+// =
+// = expr_child
+// =
+// =====
+const Expr* expr_child(const Expr* this, int index) {
+  assert_m(this);
+
+  if (this->type is EXPR_FUNCTION) {
+    return index is 0 ? this->function.argument : null;
+
+  } else if (this->type is EXPR_VECTOR) {
+    const vec_Expr* items = &this->vector.arguments;
+    return index < items->length ? &items->data[index] : null;
+
+  } else if (this->type is EXPR_BINARY_OP) {
+    if (index is 0) return this->binary_operator.lhs;
+    if (index is 1) return this->binary_operator.rhs;
+    return null;
+
+  } else {
+    return null;
+  }
+}
+
+// =====
+// =
+// = expr_operand
+// =
+// =====
+const Expr* expr_operand(const Expr* this, int index) {
+  assert_m(this);
+
+  if (this->type is EXPR_FUNCTION and this->function.argument and
+      this->function.argument->type is EXPR_VECTOR)
+    return expr_child(this->function.argument, index);
+  else
+    return expr_child(this, index);
+}
+
 // =====
 // =
 // = expr_type_text
@@ -184,64 +360,60 @@ const char* expr_type_text(int type) {
     panic("Unknown Expr type");
 }
 
-/*
+// =====
+// =
+// = expr_get_used_variables, expr_get_used_functions
+// =
+// =====
+static vec_str_t get_used_names(const Expr* this, int type);
 
 vec_str_t expr_get_used_variables(const Expr* this) {
-  vec_str_t result = vec_str_t_create();
-
-  if (this->type is EXPR_FUNCTION or this->type is EXPR_NUMBER) {
-    // nothing
-  } else if (this->type is EXPR_VARIABLE) {
-    vec_str_t_push(&result, str_clone(&this->variable.name));
-
-  } else if (this->type is EXPR_VECTOR) {
-    for (int el = 0; el < this->vector.arguments.length; el++) {
-      vec_str_t variables =
-          expr_get_used_variables(&this->vector.arguments.data[el]);
-      vstrt_push_unique(&result, variables);
-    }
-
-  } else if (this->type is EXPR_BINARY_OP) {
-    vstrt_push_unique(&result,
-                      expr_get_used_variables(this->binary_operator.lhs));
-    vstrt_push_unique(&result,
-                      expr_get_used_variables(this->binary_operator.rhs));
-
-  } else {
-    panic("Unknown expr type");
-  }
-
-  return result;
+  return get_used_names(this, EXPR_VARIABLE);
 }
 
 vec_str_t expr_get_used_functions(const Expr* this) {
+  return get_used_names(this, EXPR_FUNCTION);
+}
+
+// Names of nodes of this type. Nodes are walked before their children, left
+// to right, which is the order of the text. Names are borrowed from the
+// symbols table.
+static vec_str_t get_used_names(const Expr* this, int type) {
+  assert_m(this);
   vec_str_t result = vec_str_t_create();
+  vec_char is_added = vec_char_create();  // By symbol
 
-  if (this->type is EXPR_VARIABLE or this->type is EXPR_NUMBER) {
-    // nothing
-  } else if (this->type is EXPR_FUNCTION) {
-    vec_str_t_push(&result, str_clone(&this->function.name));
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
 
-  } else if (this->type is EXPR_VECTOR) {
-    for (int el = 0; el < this->vector.arguments.length; el++) {
-      vec_str_t variables =
-          expr_get_used_functions(&this->vector.arguments.data[el]);
-      vstrt_push_unique(&result, variables);
-    }
+  while (stack.length > 0) {
+    const Expr* node = vec_ExprStep_popget(&stack).expr;
 
-  } else if (this->type is EXPR_BINARY_OP) {
-    vstrt_push_unique(&result,
-                      expr_get_used_functions(this->binary_operator.lhs));
-    vstrt_push_unique(&result,
-                      expr_get_used_functions(this->binary_operator.rhs));
+    if (node->type is type) {
+      Symbol name = type is EXPR_VARIABLE ? node->variable.name
+                                          : node->function.name;
+      while (is_added.length <= name) vec_char_push(&is_added, false);
 
-  } else {
-    panic("Unknown expr type");
+      if (not is_added.data[name]) {
+        is_added.data[name] = true;
+        vec_str_t_push(&result, str_literal(symbol_name(name)));
+      }
+    }
+
+    // Reversed, so that the first child is on top
+    int count = 0;
+    while (expr_child(node, count)) count++;
+    for (int i = count - 1; i >= 0; i--)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = expr_child(node, i)});
   }
 
+  vec_ExprStep_free(stack);
+  vec_char_free(is_added);
   return result;
 }
 
+/*
+
 void expr_iter_variables(const Expr* this,
                          void (*callback)(void* cb_data, const str_t* var_name),
                          void* cb_data) {
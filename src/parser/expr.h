@@ -3,7 +3,9 @@
 
 #include "../util/better_io.h"
 #include "../util/better_string.h"
+#include "../util/symbol.h"
 #include "expr_value.h"
+#include "operators_fns.h"
 #include "token_tree.h"
 
 typedef struct Expr Expr;
@@ -26,13 +28,17 @@ typedef struct ExprNumber {
   double value;
 } ExprNumber;
 
+// Names are interned, so nodes do not own them and compare them as numbers
+
 typedef struct ExprVariable {
-  str_t name;
+  Symbol name;
+  int arg_slot;  // Index + 1 of the function argument it names, 0 if none
 } ExprVariable;
 
 typedef struct ExprFunction {
-  str_t name;
+  Symbol name;
   Expr* argument;
+  int native_slot;  // Index + 1 of the native function it names, 0 if none
 } ExprFunction;
 
 typedef struct ExprVector {
@@ -40,7 +46,8 @@ typedef struct ExprVector {
 } ExprVector;
 
 typedef struct ExprBinaryOp {
-  str_t name;
+  Symbol name;
+  OperatorFn fn;  // Resolved from `name` by the parser
   Expr* lhs;
   Expr* rhs;
 } ExprBinaryOp;
@@ -69,6 +76,18 @@ typedef struct ExprResult {
   };
 } ExprResult;
 
+// Entry of an explicit stack, for passes that walk trees in a loop instead of
+// recursion, so that deep trees do not overflow the C stack. `step` is up to
+// the pass, usually it is the child to walk next.
+typedef struct ExprStep {
+  const Expr* expr;
+  int step;
+} ExprStep;
+
+// ===== vec_ExprStep
+#define VECTOR_H ExprStep
+#include "../util/vector.h"
+
 typedef struct VecExprResult {
   bool is_ok;
 
@@ -85,25 +104,56 @@ typedef struct VecExprResult {
 
 #define VALUE_TYPE_UNKNOWN -1
 
+// Static type of an expression: what its value is if calculation succeeds.
+// `type` is one of EXPR_VALUE_NUMBER, EXPR_VALUE_NONE, EXPR_VALUE_VEC (for
+// every kind of vector) or VALUE_TYPE_UNKNOWN.
+typedef struct ExprType {
+  int type;
+  int length;  // Of a vector, -1 if not known
+} ExprType;
+
+#define ExprTypeOf(type_, length_) \
+  (ExprType) { .type = (type_), .length = (length_) }
+#define ExprTypeUnknown() ExprTypeOf(VALUE_TYPE_UNKNOWN, -1)
+
+// ===== vec_ExprType
+#define VECTOR_H ExprType
+#include "../util/vector.h"
+
 typedef struct ExprFunctionInfo ExprFunctionInfo;
 
 typedef struct ExprVariableInfo ExprVariableInfo;
 
+// Names are interned (see `symbol_intern`), so contexts look them up by id
 typedef struct ExprContextVtable {
   // Parsing
-  bool (*is_variable)(void* this, StrSlice var_name);
-  bool (*is_function)(void* this, StrSlice fun_name);
+  bool (*is_variable)(void* this, Symbol var_name);
+  bool (*is_function)(void* this, Symbol fun_name);
+  // Optional. Index of native function with this name, -1 if there is none.
+  // Natives are then called by index, without looking up their names.
+  int (*find_native)(void* this, Symbol fun_name);
 
   // Computation
-  ExprValueResult (*get_variable_val)(void*, StrSlice);
-  ExprValueResult (*call_function)(void*, StrSlice, vec_ExprValue*);
+  ExprValueResult (*get_variable_val)(void*, Symbol);
+  // Optional. Value of function argument, `index` is `arg_slot` - 1.
+  ExprValueResult (*get_argument_val)(void*, int index);
+  // Takes ownership of the argument value. Vector argument is spread into
+  // function arguments, see `expr_value_to_args`.
+  ExprValueResult (*call_function)(void*, Symbol, ExprValue argument);
+  // Optional. Same for natives, `index` is `native_slot` - 1.
+  ExprValueResult (*call_native)(void*, int index, ExprValue argument);
 
   // Anasysis and compilation
   bool (*is_expr_const)(void* this, const Expr* expr);
-  int (*get_expr_type)(void* this, const Expr* expr);
-
-  ExprVariableInfo (*get_variable_info)(void* this, StrSlice var_name);
-  ExprFunctionInfo (*get_function_info)(void* this, StrSlice fun_name);
+  ExprType (*get_expr_type)(void* this, const Expr* expr);
+  // Optional. Type of function argument, `index` is `arg_slot` - 1.
+  ExprType (*get_argument_type)(void* this, int index);
+  // Optional. Result type of a call with these (already spread) arguments.
+  ExprType (*get_call_type)(void* this, Symbol fun_name, const ExprType* args,
+                            int args_count);
+
+  ExprVariableInfo (*get_variable_info)(void* this, Symbol var_name);
+  ExprFunctionInfo (*get_function_info)(void* this, Symbol fun_name);
 } ExprContextVtable;
 
 typedef struct ExprContext {
@@ -113,9 +163,9 @@ typedef struct ExprContext {
 
 typedef struct ExprFunctionInfo {
   bool is_const;
-  const vec_str_t* args_names;
+  const vec_Symbol* args_names;
   const Expr* expression;
-  int value_type;
+  ExprType value_type;  // Whatever the arguments are
   ExprContext correct_context;
 } ExprFunctionInfo;
 
@@ -123,33 +173,63 @@ typedef struct ExprVariableInfo {
   bool is_const;
   const Expr* expression;
   const ExprValue* value;
-  int value_type;
+  ExprType value_type;
   ExprContext correct_context;
 } ExprVariableInfo;
 
 // FUNCTIONS
 
 // -- Basic functionality
+// Passes over trees walk them in a loop, so chains like `1 + 2 + 3 ...` can
+// be as long as they want. Only brackets and calls are limited, by
+// `PARSE_MAX_NESTING`.
 void expr_free(Expr this);
 void expr_print(const Expr* this, OutStream out);
 Expr expr_clone(const Expr* this);
+// Structural equality, numbers are compared bitwise
+bool expr_equal(const Expr* a, const Expr* b);
 Expr* expr_move_to_heap(Expr value);
+// Argument of a function, items of a vector, or operands of an operator, in
+// that order. Null after the last one (and for parts that are not parsed yet).
+const Expr* expr_child(const Expr* this, int index);
+// Same, except that a call with a vector written in place gives the items of
+// the vector: those are the arguments of the call
+const Expr* expr_operand(const Expr* this, int index);
 const char* expr_type_text(int type);
 
 // -- Parsing
+// Goes over the tokens once, with no token tree. Trees are the same as from
+// `expr_parse_token_tree`, the older parser, which tests check it against.
 ExprResult expr_parse_string(const char* text, ExprContext ctx);
 ExprResult expr_parse_token_tree(TokenTree tree, ExprContext ctx);
 ExprResult expr_parse_tokens(vec_TokenTree tokens, char bracket,
                              ExprContext ctx);
 
 // -- Computation
+// Walks the tree in a loop as well
 ExprValueResult expr_calculate(const Expr* this, ExprContext ctx);
 
-/*
-Maybe later:
+// -- Optimization
+// Folds const subtrees into numbers, drops operations that never change a
+// value (like `x * 1`) and merges nested unary signs. Simplified expression
+// gives exactly the same values and errors. Takes ownership.
+Expr expr_simplify(Expr this, ExprContext ctx);
+
+// -- Analysis
+// Types of leaves come from the context: variables from their info, arguments
+// and calls from the optional vtable entries. Undefined names are unknown.
+ExprType expr_infer_type(const Expr* this, ExprContext ctx);
+// Type of one node from types of its operands (see `expr_operand`), for
+// passes which already go over the tree children first
+ExprType expr_infer_node_type(const Expr* this, const ExprType* operands,
+                              ExprContext ctx);
+ExprType expr_type_of_value(const ExprValue* value);
+// Unique names, in order of first appearance
 vec_str_t expr_get_used_variables(const Expr* this);
 vec_str_t expr_get_used_functions(const Expr* this);
 
+/*
+Maybe later:
 void expr_iter_variables(const Expr* this,
                          void (*callback)(void* cb_data, const str_t* var_name),
                          void* cb_data);
@@ -0,0 +1,291 @@
+#include "expr_bytecode.h"
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+#include "expr_cse.h"
+
+#define VECTOR_C ExprInstr
+#include "../util/vector.h"
+
+// =====
+// =
+// = expr_bytecode_compile
+// =
+// =====
+typedef struct BytecodeBuilder {
+  ExprBytecode* result;
+  int depth;
+
+  ExprCse cse;
+  int* class_temps;  // Temporary of every CSE class, -1 until stored
+} BytecodeBuilder;
+
+static void builder_push(BytecodeBuilder* this, ExprInstr instr, int pops,
+                         int pushes);
+static void compile_expr(BytecodeBuilder* this, const Expr* expr);
+static void compile_node(BytecodeBuilder* this, const Expr* expr);
+
+ExprBytecode expr_bytecode_compile(const Expr* expr) {
+  assert_m(expr);
+
+  ExprBytecode result = {
+      .code = vec_ExprInstr_create(),
+      .max_stack = 0,
+      .temps_count = 0,
+  };
+  BytecodeBuilder builder = {
+      .result = &result,
+      .depth = 0,
+      .cse = expr_cse_create(expr),
+  };
+
+  int classes_count = builder.cse.classes_length;
+  builder.class_temps = (int*)MALLOC(sizeof(int) * (classes_count + 1));
+  assert_alloc(builder.class_temps);
+  for (int i = 0; i < classes_count; i++) builder.class_temps[i] = -1;
+
+  compile_expr(&builder, expr);
+  assert_m(builder.depth is 1);
+
+  FREE(builder.class_temps);
+  expr_cse_free(builder.cse);
+  return result;
+}
+
+static void compile_store(BytecodeBuilder* this, const Expr* expr);
+
+// Children are compiled before their parent. Repeated subtrees are stored
+// into a temporary the first time, and after that loaded from it, with no
+// children compiled.
+static void compile_expr(BytecodeBuilder* this, const Expr* expr) {
+  assert_m(expr);
+
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = expr});
+
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+
+    if (top->step is 0) {
+      int class_index = expr_cse_find(&this->cse, top->expr);
+      int temp = class_index >= 0 ? this->class_temps[class_index] : -1;
+
+      if (temp >= 0) {
+        ExprInstr instr = {.type = EXPR_OP_LOAD, .temp = temp};
+        builder_push(this, instr, 0, 1);
+        vec_ExprStep_popfree(&stack);
+        continue;
+      }
+    }
+
+    const Expr* child = expr_child(top->expr, top->step++);
+    if (child) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+    } else {
+      compile_node(this, top->expr);
+      compile_store(this, top->expr);
+      vec_ExprStep_popfree(&stack);
+    }
+  }
+
+  vec_ExprStep_free(stack);
+}
+
+// First occurrence of a repeated subtree, which has just been compiled
+static void compile_store(BytecodeBuilder* this, const Expr* expr) {
+  int class_index = expr_cse_find(&this->cse, expr);
+  if (class_index < 0) return;
+
+  int* temp = &this->class_temps[class_index];
+  assert_m(*temp < 0);
+  *temp = this->result->temps_count++;
+
+  ExprInstr instr = {.type = EXPR_OP_STORE, .temp = *temp};
+  builder_push(this, instr, 0, 0);
+}
+
+// Only the instruction of the node, its children are already compiled
+static void compile_node(BytecodeBuilder* this, const Expr* expr) {
+  if (expr->type is EXPR_NUMBER) {
+    ExprInstr instr = {.type = EXPR_OP_NUMBER, .number = expr->number.value};
+    builder_push(this, instr, 0, 1);
+
+  } else if (expr->type is EXPR_VARIABLE) {
+    ExprInstr instr = {.type = EXPR_OP_VARIABLE, .name = expr->variable.name};
+    builder_push(this, instr, 0, 1);
+
+  } else if (expr->type is EXPR_FUNCTION) {
+    ExprInstr instr = {.type = EXPR_OP_CALL,
+                       .name = expr->function.name,
+                       .native_slot = expr->function.native_slot};
+    builder_push(this, instr, 1, 1);
+
+  } else if (expr->type is EXPR_VECTOR) {
+    int count = expr->vector.arguments.length;
+    ExprInstr instr = {.type = EXPR_OP_VECTOR, .count = count};
+    builder_push(this, instr, count, 1);
+
+  } else if (expr->type is EXPR_BINARY_OP) {
+    assert_m(expr->binary_operator.fn);
+
+    ExprInstr instr = {.type = EXPR_OP_BINARY_OP,
+                       .operator= expr->binary_operator.fn};
+    builder_push(this, instr, 2, 1);
+
+  } else {
+    panic("Invalid expr type");
+  }
+}
+
+static void builder_push(BytecodeBuilder* this, ExprInstr instr, int pops,
+                         int pushes) {
+  vec_ExprInstr_push(&this->result->code, instr);
+
+  this->depth -= pops;
+  assert_m(this->depth >= 0);
+  this->depth += pushes;
+
+  if (this->depth > this->result->max_stack)
+    this->result->max_stack = this->depth;
+}
+
+// =====
+// =
+// = expr_bytecode_free
+// =
+// =====
+void expr_bytecode_free(ExprBytecode this) { vec_ExprInstr_free(this.code); }
+
+// =====
+// =
+// = expr_bytecode_print
+// =
+// =====
+void expr_bytecode_print(const ExprBytecode* this, OutStream out) {
+  assert_m(this);
+
+  for (int i = 0; i < this->code.length; i++) {
+    const ExprInstr* instr = &this->code.data[i];
+    x_sprintf(out, "%3d: ", i);
+
+    if (instr->type is EXPR_OP_NUMBER) {
+      x_sprintf(out, "number %lf\n", instr->number);
+    } else if (instr->type is EXPR_OP_VARIABLE) {
+      x_sprintf(out, "variable %s\n", symbol_name(instr->name));
+    } else if (instr->type is EXPR_OP_CALL) {
+      x_sprintf(out, "call %s\n", symbol_name(instr->name));
+    } else if (instr->type is EXPR_OP_VECTOR) {
+      x_sprintf(out, "vector %d\n", instr->count);
+    } else if (instr->type is EXPR_OP_BINARY_OP) {
+      x_sprintf(out, "operator %p\n", (void*)instr->operator);
+    } else if (instr->type is EXPR_OP_STORE) {
+      x_sprintf(out, "store t%d\n", instr->temp);
+    } else if (instr->type is EXPR_OP_LOAD) {
+      x_sprintf(out, "load t%d\n", instr->temp);
+    } else {
+      panic("Invalid instruction type");
+    }
+  }
+}
+
+// =====
+// =
+// = expr_bytecode_run
+// =
+// =====
+ExprValueResult expr_bytecode_run(const ExprBytecode* this, ExprContext ctx) {
+  assert_m(this);
+  assert_m(ctx.vtable and ctx.vtable->get_variable_val and
+           ctx.vtable->call_function);
+
+  // Most expressions are shallow, so avoid allocating the stack
+  ExprValue local_stack[32];
+  ExprValue* stack = local_stack;
+  if (this->max_stack > (int)LEN(local_stack)) {
+    stack = (ExprValue*)MALLOC(sizeof(ExprValue) * this->max_stack);
+    assert_alloc(stack);
+  }
+
+  ExprValue local_temps[8];
+  ExprValue* temps = local_temps;
+  if (this->temps_count > (int)LEN(local_temps)) {
+    temps = (ExprValue*)MALLOC(sizeof(ExprValue) * this->temps_count);
+    assert_alloc(temps);
+  }
+
+  int top = 0;
+  int stored_count = 0;
+  ExprValueResult res = {.is_ok = true};
+
+  const ExprInstr* code = this->code.data;
+  for (int ip = 0; ip < this->code.length and res.is_ok; ip++) {
+    const ExprInstr* instr = &code[ip];
+
+    switch (instr->type) {
+      case EXPR_OP_NUMBER:
+        stack[top++] = (ExprValue){.type = EXPR_VALUE_NUMBER,
+                                   .number = instr->number};
+        break;
+
+      case EXPR_OP_VARIABLE:
+        res = ctx.vtable->get_variable_val(ctx.data, instr->name);
+        if (res.is_ok) stack[top++] = res.ok;
+        break;
+
+      case EXPR_OP_CALL: {
+        if (instr->native_slot > 0 and ctx.vtable->call_native)
+          res = ctx.vtable->call_native(ctx.data, instr->native_slot - 1,
+                                        stack[--top]);
+        else
+          res = ctx.vtable->call_function(ctx.data, instr->name, stack[--top]);
+        if (res.is_ok) stack[top++] = res.ok;
+        break;
+      }
+
+      case EXPR_OP_VECTOR: {
+        top -= instr->count;
+
+        // Values are moved from the stack, not cloned
+        vec_ExprValue values = vec_ExprValue_with_capacity(instr->count);
+        if (instr->count > 0)
+          memcpy(values.data, &stack[top], sizeof(ExprValue) * instr->count);
+        values.length = instr->count;
+
+        stack[top++] = expr_value_pack(values);
+        break;
+      }
+
+      case EXPR_OP_BINARY_OP:
+        top -= 2;
+        res = instr->operator(stack[top], stack[top + 1]);
+        if (res.is_ok) stack[top++] = res.ok;
+        break;
+
+      case EXPR_OP_STORE:
+        assert_m(instr->temp is stored_count);
+        temps[stored_count++] = expr_value_clone(&stack[top - 1]);
+        break;
+
+      case EXPR_OP_LOAD:
+        stack[top++] = expr_value_clone(&temps[instr->temp]);
+        break;
+
+      default:
+        panic("Invalid instruction type");
+    }
+  }
+
+  if (res.is_ok) {
+    assert_m(top is 1);
+    res.ok = stack[0];
+  } else {
+    // Values consumed by the failed instruction are already freed by it
+    for (int i = 0; i < top; i++) expr_value_free(stack[i]);
+  }
+
+  for (int i = 0; i < stored_count; i++) expr_value_free(temps[i]);
+
+  if (stack != local_stack) FREE(stack);
+  if (temps != local_temps) FREE(temps);
+  return res;
+}
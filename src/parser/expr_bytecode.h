@@ -0,0 +1,51 @@
+#ifndef SRC_PARSER_EXPR_BYTECODE_H_
+#define SRC_PARSER_EXPR_BYTECODE_H_
+
+#include "../util/better_string.h"
+#include "expr.h"
+#include "operators_fns.h"
+
+// Flat postfix form of an `Expr`. Values are evaluated in the same order as
+// `expr_calculate` does, so results and errors are identical.
+// Repeated subexpressions (see `ExprCse`) are computed once: the first
+// occurrence is stored into a temporary, and the others load it.
+
+#define EXPR_OP_NUMBER 1     // push number
+#define EXPR_OP_VARIABLE 2   // push ctx value of variable `name`
+#define EXPR_OP_CALL 3       // pop argument, push ctx call of `name`
+#define EXPR_OP_VECTOR 5     // pop `count` values, push vector of them
+#define EXPR_OP_BINARY_OP 7  // pop rhs and lhs, push `operator(lhs, rhs)`
+#define EXPR_OP_STORE 8      // copy top value into temporary `temp`
+#define EXPR_OP_LOAD 9       // push copy of temporary `temp`
+
+typedef struct ExprInstr {
+  int type;
+  union {
+    double number;
+    struct {
+      Symbol name;
+      int native_slot;  // Only for calls, see `ExprFunction`
+    };
+    int count;
+    int temp;  // Temporaries are stored in order: 0, 1, 2...
+    OperatorFn operator;
+  };
+} ExprInstr;
+
+// ===== vec_ExprInstr
+#define VECTOR_H ExprInstr
+#include "../util/vector.h"
+
+typedef struct ExprBytecode {
+  vec_ExprInstr code;
+  int max_stack;
+  int temps_count;
+} ExprBytecode;
+
+ExprBytecode expr_bytecode_compile(const Expr* expr);
+void expr_bytecode_free(ExprBytecode this);
+void expr_bytecode_print(const ExprBytecode* this, OutStream out);
+
+ExprValueResult expr_bytecode_run(const ExprBytecode* this, ExprContext ctx);
+
+#endif  // SRC_PARSER_EXPR_BYTECODE_H_
@@ -16,115 +16,85 @@
     .is_ok = true, .ok.type = EXPR_VALUE_NUMBER, .ok.number = (num) \
   }
 
-static ExprValueResult expr_calculate_function(const ExprFunction* this,
-                                               ExprContext ctx);
-static ExprValueResult expr_calculate_vector(const ExprVector* this,
-                                             ExprContext ctx);
-static ExprValueResult expr_calculate_binary_op(const ExprBinaryOp* this,
-                                                ExprContext ctx);
+static ExprValueResult calculate_node(const Expr* this, ExprContext ctx,
+                                      vec_ExprValue* values);
 
+// Children are calculated first, left to right, and their values wait on
+// `values` for their parent. Calculation stops at the first error.
 ExprValueResult expr_calculate(const Expr* this, ExprContext ctx) {
   assert_m(this);
   assert_m(ctx.vtable and ctx.vtable->get_variable_val and
            ctx.vtable->call_function);
 
-  if (this->type is EXPR_NUMBER) {
-    return OkNum(this->number.value);
-
-  } else if (this->type is EXPR_VARIABLE) {
-    return ctx.vtable->get_variable_val(
-        ctx.data, str_slice_from_str_t(&this->variable.name));
-
-  } else if (this->type is EXPR_FUNCTION) {
-    return expr_calculate_function(&this->function, ctx);
-
-  } else if (this->type is EXPR_VECTOR) {
-    return expr_calculate_vector(&this->vector, ctx);
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprValue values = vec_ExprValue_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
 
-  } else if (this->type is EXPR_BINARY_OP) {
-    return expr_calculate_binary_op(&this->binary_operator, ctx);
+  ExprValueResult res = {.is_ok = true};
+  while (res.is_ok and stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* child = expr_child(top->expr, top->step++);
 
-  } else {
-    panic("Invalid expr type");
+    if (child) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+    } else {
+      res = calculate_node(top->expr, ctx, &values);
+      if (res.is_ok) vec_ExprValue_push(&values, res.ok);
+      vec_ExprStep_popfree(&stack);
+    }
   }
+
+  if (res.is_ok) res.ok = vec_ExprValue_popget(&values);
+  vec_ExprValue_free(values);  // Not empty only after errors
+  vec_ExprStep_free(stack);
+  return res;
 }
 
-static ExprValueResult expr_calculate_function(const ExprFunction* this,
-                                               ExprContext ctx) {
-  assert_m(this);
-  // FUNCTION
-  StrSlice function_name = str_slice_from_str_t(&this->name);
-  ExprValueResult res = expr_calculate(this->argument, ctx);
-  if (not res.is_ok) return res;
+// Values of the children are the last ones in `values`, and are taken from
+// there
+static ExprValueResult calculate_node(const Expr* this, ExprContext ctx,
+                                      vec_ExprValue* values) {
+  if (this->type is EXPR_NUMBER) {
+    return OkNum(this->number.value);
 
-  vec_ExprValue args;
+  } else if (this->type is EXPR_VARIABLE) {
+    if (this->variable.arg_slot > 0 and ctx.vtable->get_argument_val)
+      return ctx.vtable->get_argument_val(ctx.data,
+                                          this->variable.arg_slot - 1);
 
-  if (res.ok.type is EXPR_VALUE_NUMBER) {
-    args = vec_ExprValue_create();
-    vec_ExprValue_push(&args, res.ok);
+    return ctx.vtable->get_variable_val(ctx.data, this->variable.name);
 
-  } else if (res.ok.type is EXPR_VALUE_VEC) {
-    args = res.ok.vec;
+  } else if (this->type is EXPR_FUNCTION) {
+    // FUNCTION
+    assert_m(this->function.argument);
+    ExprValue argument = vec_ExprValue_popget(values);
 
-  } else if (res.ok.type is EXPR_VALUE_NONE) {
-    args = vec_ExprValue_create();
+    if (this->function.native_slot > 0 and ctx.vtable->call_native)
+      return ctx.vtable->call_native(ctx.data, this->function.native_slot - 1,
+                                     argument);
 
-  } else {
-    panic("Unknown ExprValue type");
-  }
+    return ctx.vtable->call_function(ctx.data, this->function.name, argument);
 
-  ExprValueResult call_res =
-      ctx.vtable->call_function(ctx.data, function_name, &args);
-  vec_ExprValue_free(args);
-  return call_res;
-}
+  } else if (this->type is EXPR_VECTOR) {
+    // VECTOR
+    int count = this->vector.arguments.length;
+    vec_ExprValue args = vec_ExprValue_with_capacity(count);
+    for (int i = values->length - count; i < values->length; i++)
+      vec_ExprValue_push(&args, values->data[i]);
+    values->length -= count;  // Moved
 
-static ExprValueResult expr_calculate_vector(const ExprVector* this,
-                                             ExprContext ctx) {
-  assert_m(this);
-  // VECTOR
-  const vec_Expr* args_expr = &this->arguments;
-  vec_ExprValue args = vec_ExprValue_create();
+    return (ExprValueResult){.is_ok = true, .ok = expr_value_pack(args)};
 
-  ExprValueResult res = {.is_ok = true};
-  for (int i = 0; i < args_expr->length and res.is_ok; i++) {
-    res = expr_calculate(&args_expr->data[i], ctx);
+  } else if (this->type is EXPR_BINARY_OP) {
+    // BINARY OPERATOR
+    assert_m(this->binary_operator.lhs and this->binary_operator.rhs);
+    assert_m(this->binary_operator.fn);
+    ExprValue b = vec_ExprValue_popget(values);
+    ExprValue a = vec_ExprValue_popget(values);
 
-    if (res.is_ok) vec_ExprValue_push(&args, res.ok);
-  }
+    return this->binary_operator.fn(a, b);
 
-  if (res.is_ok) {
-    res = (ExprValueResult){.is_ok = true,
-                            .ok = (ExprValue){
-                                .type = EXPR_VALUE_VEC,
-                                .vec = args,
-                            }};
   } else {
-    vec_ExprValue_free(args);
-  }
-
-  return res;
-}
-
-static ExprValueResult expr_calculate_binary_op(const ExprBinaryOp* this,
-                                                ExprContext ctx) {
-  assert_m(this);
-  // BINARY OPERATOR
-  ExprValueResult res = expr_calculate(this->lhs, ctx);
-  if (res.is_ok) {
-    ExprValue a = res.ok;
-
-    res = expr_calculate(this->rhs, ctx);
-    if (res.is_ok) {
-      ExprValue b = res.ok;
-      OperatorFn operator= expr_get_operator_fn(this->name.string);
-      assert_m(operator);
-
-      res = operator(a, b);
-    } else {
-      expr_value_free(a);
-    }
+    panic("Invalid expr type");
   }
-
-  return res;
 }
@@ -0,0 +1,242 @@
+#include "expr_cse.h"
+
+#include <string.h>
+
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+
+#define CSE_MIN_CAPACITY 16
+
+#define VECTOR_H uint32_t
+#include "../util/vector.h"
+#define VECTOR_C uint32_t
+#include "../util/vector.h"
+
+static bool is_candidate(const Expr* node);
+static void cse_hash(ExprCse* this, const Expr* root);
+static void cse_count(ExprCse* this, const Expr* root);
+
+static ExprCseNode* nodes_find(const ExprCse* this, const Expr* node);
+static void nodes_grow(ExprCse* this);
+static int classes_find_or_add(ExprCse* this, const Expr* node,
+                               uint32_t hash);
+
+// =====
+// =
+// = BASICS
+// =
+// =====
+ExprCse expr_cse_create(const Expr* root) {
+  assert_m(root);
+  ExprCse result = {
+      .nodes = null,
+      .nodes_capacity = 0,
+      .nodes_length = 0,
+      .classes = null,
+      .classes_length = 0,
+      .classes_index = null,
+  };
+
+  // 1. Hash of every candidate, children first
+  cse_hash(&result, root);
+  if (result.nodes_length is 0) return result;
+
+  // 2. Group them, in calculation order
+  result.classes =
+      (ExprCseClass*)MALLOC(sizeof(ExprCseClass) * result.nodes_length);
+  result.classes_index = (int*)MALLOC(sizeof(int) * result.nodes_capacity);
+  assert_alloc(result.classes);
+  assert_alloc(result.classes_index);
+  for (int i = 0; i < result.nodes_capacity; i++) result.classes_index[i] = -1;
+
+  cse_count(&result, root);
+  return result;
+}
+
+void expr_cse_free(ExprCse this) {
+  FREE(this.nodes);
+  FREE(this.classes);
+  FREE(this.classes_index);
+}
+
+int expr_cse_find(const ExprCse* this, const Expr* node) {
+  if (this->nodes_length is 0 or not is_candidate(node)) return -1;
+
+  ExprCseNode* entry = nodes_find(this, node);
+  if (not entry->node or entry->class_index < 0) return -1;
+
+  int class_index = entry->class_index;
+  return this->classes[class_index].uses > 0 ? class_index : -1;
+}
+
+// Numbers and variables are as cheap to get as a temporary
+static bool is_candidate(const Expr* node) {
+  return node->type is EXPR_FUNCTION or node->type is EXPR_BINARY_OP;
+}
+
+// =====
+// =
+// = PASSES
+// =
+// =====
+static uint32_t hash_mix(uint32_t hash, uint32_t value) {
+  return (hash ^ value) * 16777619u;
+}
+
+static uint32_t hash_node(ExprCse* this, const Expr* node,
+                          const uint32_t* children);
+
+// Equal subtrees have equal hashes. Hashes of children wait on `done` for
+// their parent.
+static void cse_hash(ExprCse* this, const Expr* root) {
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_uint32_t done = vec_uint32_t_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = root});
+
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* child = expr_child(top->expr, top->step++);
+
+    if (child) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = child});
+    } else {
+      done.length -= top->step - 1;
+      uint32_t hash = hash_node(this, top->expr, &done.data[done.length]);
+      vec_uint32_t_push(&done, hash);
+      vec_ExprStep_popfree(&stack);
+    }
+  }
+
+  vec_ExprStep_free(stack);
+  vec_uint32_t_free(done);
+}
+
+// Candidates are remembered with their hash
+static uint32_t hash_node(ExprCse* this, const Expr* node,
+                          const uint32_t* children) {
+  uint32_t hash = hash_mix(2166136261u, (uint32_t)node->type);
+
+  if (node->type is EXPR_NUMBER) {
+    unsigned char bytes[sizeof(double)];
+    memcpy(bytes, &node->number.value, sizeof(double));
+    for (int i = 0; i < (int)sizeof(double); i++)
+      hash = hash_mix(hash, bytes[i]);
+
+  } else if (node->type is EXPR_VARIABLE) {
+    hash = hash_mix(hash, (uint32_t)node->variable.name);
+    hash = hash_mix(hash, (uint32_t)node->variable.arg_slot);
+
+  } else if (node->type is EXPR_FUNCTION) {
+    hash = hash_mix(hash, (uint32_t)node->function.name);
+    hash = hash_mix(hash, children[0]);
+
+  } else if (node->type is EXPR_VECTOR) {
+    for (int i = 0; i < node->vector.arguments.length; i++)
+      hash = hash_mix(hash, children[i]);
+
+  } else if (node->type is EXPR_BINARY_OP) {
+    hash = hash_mix(hash, (uint32_t)node->binary_operator.name);
+    hash = hash_mix(hash, children[0]);
+    hash = hash_mix(hash, children[1]);
+
+  } else {
+    panic("Invalid expr type");
+  }
+
+  if (is_candidate(node)) {
+    // Keep load factor under 1/2, so probe sequences stay short
+    if ((this->nodes_length + 1) * 2 > this->nodes_capacity) nodes_grow(this);
+
+    *nodes_find(this, node) =
+        (ExprCseNode){.node = node, .hash = hash, .class_index = -1};
+    this->nodes_length++;
+  }
+
+  return hash;
+}
+
+// Nodes are counted before their children, in order of calculation. Repeated
+// occurrence is not calculated again, so its children are skipped.
+static void cse_count(ExprCse* this, const Expr* root) {
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = root});
+
+  while (stack.length > 0) {
+    const Expr* node = vec_ExprStep_popget(&stack).expr;
+
+    if (is_candidate(node)) {
+      ExprCseNode* entry = nodes_find(this, node);
+      entry->class_index = classes_find_or_add(this, node, entry->hash);
+
+      ExprCseClass* cse_class = &this->classes[entry->class_index];
+      if (cse_class->first is_not node) {
+        cse_class->uses++;
+        continue;
+      }
+    }
+
+    // Reversed, so that the first child is on top
+    int count = 0;
+    while (expr_child(node, count)) count++;
+    for (int i = count - 1; i >= 0; i--)
+      vec_ExprStep_push(&stack, (ExprStep){.expr = expr_child(node, i)});
+  }
+
+  vec_ExprStep_free(stack);
+}
+
+// =====
+// =
+// = TABLES
+// =
+// =====
+static ExprCseNode* nodes_find(const ExprCse* this, const Expr* node) {
+  uint32_t mask = (uint32_t)this->nodes_capacity - 1;
+  uint32_t start = (uint32_t)((uintptr_t)node >> 4) * 2654435761u;
+
+  for (uint32_t i = start & mask;; i = (i + 1) & mask) {
+    ExprCseNode* entry = &this->nodes[i];
+    if (entry->node is null or entry->node is node) return entry;
+  }
+}
+
+static void nodes_grow(ExprCse* this) {
+  ExprCse grown = {
+      .nodes_capacity = this->nodes_capacity > 0 ? this->nodes_capacity * 2
+                                                 : CSE_MIN_CAPACITY,
+      .nodes_length = this->nodes_length,
+  };
+  grown.nodes =
+      (ExprCseNode*)MALLOC(sizeof(ExprCseNode) * grown.nodes_capacity);
+  assert_alloc(grown.nodes);
+  memset(grown.nodes, 0, sizeof(ExprCseNode) * grown.nodes_capacity);
+
+  for (int i = 0; i < this->nodes_capacity; i++)
+    if (this->nodes[i].node)
+      *nodes_find(&grown, this->nodes[i].node) = this->nodes[i];
+
+  FREE(this->nodes);
+  this->nodes = grown.nodes;
+  this->nodes_capacity = grown.nodes_capacity;
+}
+
+static int classes_find_or_add(ExprCse* this, const Expr* node,
+                               uint32_t hash) {
+  uint32_t mask = (uint32_t)this->nodes_capacity - 1;
+
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    int index = this->classes_index[i];
+
+    if (index < 0) {
+      index = this->classes_length++;
+      this->classes[index] =
+          (ExprCseClass){.first = node, .hash = hash, .uses = 0};
+      this->classes_index[i] = index;
+      return index;
+    }
+
+    const ExprCseClass* cse_class = &this->classes[index];
+    if (cse_class->hash is hash and expr_equal(cse_class->first, node))
+      return index;
+  }
+}
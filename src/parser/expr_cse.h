@@ -0,0 +1,44 @@
+#ifndef SRC_PARSER_EXPR_CSE_H_
+#define SRC_PARSER_EXPR_CSE_H_
+
+#include <stdint.h>
+
+#include "expr.h"
+
+// Common subexpressions: function calls and operators which appear more than
+// once in an expression. Each group of equal subtrees is a class, which code
+// generators compute once into a temporary.
+// Occurrences are found in the order of calculation, and subtrees inside a
+// repeated occurrence are not counted: that one is not computed anyway.
+// Only borrows the expression, which must not change while this is alive.
+
+typedef struct ExprCseNode {
+  const Expr* node;  // null if the slot is empty
+  uint32_t hash;
+  int class_index;  // -1 if not reached by calculation order
+} ExprCseNode;
+
+typedef struct ExprCseClass {
+  const Expr* first;
+  uint32_t hash;
+  int uses;  // Occurrences after the first one
+} ExprCseClass;
+
+typedef struct ExprCse {
+  ExprCseNode* nodes;  // Open addressing by node pointer
+  int nodes_capacity;  // Always 0 or a power of two
+  int nodes_length;
+
+  ExprCseClass* classes;  // At most one per node
+  int classes_length;
+  int* classes_index;  // Open addressing by hash, `nodes_capacity` slots
+} ExprCse;
+
+ExprCse expr_cse_create(const Expr* root);
+void expr_cse_free(ExprCse this);
+
+// Returns index of the class if the subtree appears more than once,
+// otherwise -1
+int expr_cse_find(const ExprCse* this, const Expr* node);
+
+#endif  // SRC_PARSER_EXPR_CSE_H_
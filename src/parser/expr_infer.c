@@ -0,0 +1,188 @@
+#include "../util/allocator.h"
+#include "../util/prettify_c.h"
+#include "expr.h"
+#include "operators_fns.h"
+
+// -- Analysis
+
+#define Type(type, length) ExprTypeOf(type, length)
+#define Unknown() ExprTypeUnknown()
+
+// =====
+// =
+// = expr_infer_type
+// =
+// =====
+static ExprType infer_variable(const ExprVariable* this, ExprContext ctx);
+static ExprType infer_function(const Expr* this, const ExprType* operands,
+                               ExprContext ctx);
+static ExprType infer_binary_op(const ExprBinaryOp* this, ExprType lhs,
+                                ExprType rhs);
+
+static bool is_alg_operator(OperatorFn fn);
+static bool is_comparsion_operator(OperatorFn fn);
+static bool is_assign_operator(OperatorFn fn);
+static bool is_vector(ExprType type);
+
+// Types of operands wait on `done` for their parent. Items of a vector are
+// not needed for its type, so they are only walked when they are arguments.
+ExprType expr_infer_type(const Expr* this, ExprContext ctx) {
+  assert_m(this and ctx.vtable);
+
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprType done = vec_ExprType_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
+
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* operand = top->expr->type is EXPR_VECTOR
+                              ? null
+                              : expr_operand(top->expr, top->step++);
+
+    if (operand) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = operand});
+    } else {
+      int count = top->expr->type is EXPR_VECTOR ? 0 : top->step - 1;
+      done.length -= count;
+      ExprType type =
+          expr_infer_node_type(top->expr, &done.data[done.length], ctx);
+      vec_ExprType_push(&done, type);
+      vec_ExprStep_popfree(&stack);
+    }
+  }
+
+  ExprType result = vec_ExprType_popget(&done);
+  vec_ExprStep_free(stack);
+  vec_ExprType_free(done);
+  return result;
+}
+
+ExprType expr_infer_node_type(const Expr* this, const ExprType* operands,
+                              ExprContext ctx) {
+  assert_m(this and ctx.vtable);
+
+  if (this->type is EXPR_NUMBER) {
+    return Type(EXPR_VALUE_NUMBER, -1);
+
+  } else if (this->type is EXPR_VARIABLE) {
+    return infer_variable(&this->variable, ctx);
+
+  } else if (this->type is EXPR_FUNCTION) {
+    return infer_function(this, operands, ctx);
+
+  } else if (this->type is EXPR_VECTOR) {
+    return Type(EXPR_VALUE_VEC, this->vector.arguments.length);
+
+  } else if (this->type is EXPR_BINARY_OP) {
+    return infer_binary_op(&this->binary_operator, operands[0], operands[1]);
+
+  } else {
+    panic("Invalid expr type");
+  }
+}
+
+ExprType expr_type_of_value(const ExprValue* value) {
+  if (expr_value_is_vector(value))
+    return Type(EXPR_VALUE_VEC, expr_value_vector_length(value));
+  else
+    return Type(value->type, -1);
+}
+
+static ExprType infer_variable(const ExprVariable* this, ExprContext ctx) {
+  if (this->arg_slot > 0 and ctx.vtable->get_argument_type)
+    return ctx.vtable->get_argument_type(ctx.data, this->arg_slot - 1);
+
+  Symbol name = this->name;
+  bool is_variable = ctx.vtable->is_variable and
+                     ctx.vtable->is_variable(ctx.data, name);
+
+  if (is_variable and ctx.vtable->get_variable_info)
+    return ctx.vtable->get_variable_info(ctx.data, name).value_type;
+
+  return Unknown();
+}
+
+// Argument is spread the same way `expr_value_to_args` does it. Only vectors
+// written in place have known items, and those are the operands.
+static ExprType infer_function(const Expr* this, const ExprType* operands,
+                               ExprContext ctx) {
+  if (not ctx.vtable->get_call_type) return Unknown();
+
+  Symbol name = this->function.name;
+  const Expr* argument = this->function.argument;
+
+  if (argument->type is EXPR_VECTOR)
+    return ctx.vtable->get_call_type(ctx.data, name, operands,
+                                     argument->vector.arguments.length);
+
+  ExprType arg = operands[0];
+  if (arg.type is EXPR_VALUE_NUMBER)
+    return ctx.vtable->get_call_type(ctx.data, name, &arg, 1);
+  else if (arg.type is EXPR_VALUE_NONE)
+    return ctx.vtable->get_call_type(ctx.data, name, null, 0);
+  else
+    return Unknown();
+}
+
+static ExprType infer_binary_op(const ExprBinaryOp* this, ExprType lhs,
+                                ExprType rhs) {
+  OperatorFn fn = this->fn;
+
+  if (is_assign_operator(fn)) return rhs;
+
+  if (fn is expr_operator_eq or fn is expr_operator_neq)
+    return Type(EXPR_VALUE_NUMBER, -1);
+
+  bool is_known = lhs.type is_not VALUE_TYPE_UNKNOWN and
+                  rhs.type is_not VALUE_TYPE_UNKNOWN;
+  if (not is_known) return Unknown();
+
+  if (is_comparsion_operator(fn)) {
+    // Vectors are compared item by item, unless their lengths differ
+    if (not is_vector(lhs) or not is_vector(rhs))
+      return Type(EXPR_VALUE_NUMBER, -1);
+    if (lhs.length < 0 or rhs.length < 0) return Unknown();
+
+    return lhs.length is rhs.length ? lhs : Type(EXPR_VALUE_NUMBER, -1);
+  }
+
+  if (is_alg_operator(fn)) {
+    // Anything with None is an error, so it has no type
+    if (lhs.type is EXPR_VALUE_NONE or rhs.type is EXPR_VALUE_NONE)
+      return Unknown();
+
+    if (not is_vector(lhs) and not is_vector(rhs))
+      return Type(EXPR_VALUE_NUMBER, -1);
+    if (not is_vector(rhs)) return lhs;
+    if (not is_vector(lhs)) return rhs;
+
+    // Two vectors only go together if their lengths are the same
+    return lhs.length >= 0 ? lhs : rhs;
+  }
+
+  if (fn is expr_operator_range or fn is expr_operator_range_included)
+    return Type(EXPR_VALUE_VEC, -1);
+
+  return Unknown();
+}
+
+static bool is_alg_operator(OperatorFn fn) {
+  return fn is expr_operator_add or fn is expr_operator_sub or
+         fn is expr_operator_mul or fn is expr_operator_div or
+         fn is expr_operator_mod or fn is expr_operator_pow;
+}
+
+static bool is_comparsion_operator(OperatorFn fn) {
+  return fn is expr_operator_lt or fn is expr_operator_gt or
+         fn is expr_operator_lte or fn is expr_operator_gte;
+}
+
+// They all just give the right side
+static bool is_assign_operator(OperatorFn fn) {
+  return fn is expr_operator_assign or fn is expr_operator_add_assign or
+         fn is expr_operator_sub_assign or fn is expr_operator_mul_assign or
+         fn is expr_operator_div_assign or fn is expr_operator_mod_assign or
+         fn is expr_operator_pow_assign;
+}
+
+static bool is_vector(ExprType type) { return type.type is EXPR_VALUE_VEC; }
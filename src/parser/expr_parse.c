@@ -4,36 +4,12 @@
 
 // -- Parsing
 
-// =====
-// =
-// = expr_parse_string
-// =
-// =====
-ExprResult expr_parse_string(const char* text, ExprContext ctx) {
-  assert_m(text);
-  assert_m(ctx.vtable and ctx.vtable->is_function and ctx.vtable->is_variable);
-
-  TtContext token_tree_ctx = {
-      .data = ctx.data,
-      .is_function = ctx.vtable->is_function,
-  };
-  TokenTreeResult res = token_tree_parse(text, token_tree_ctx);
-
-  if (not res.is_ok)
-    return (ExprResult){
-        .is_ok = false,
-        .err_text = res.err.text,
-        .err_pos = res.err.text_pos,
-    };
-
-  return expr_parse_token_tree(res.ok, ctx);
-}
-
 // =====
 // =
 // = expr_parse_token_tree
 // =
 // =====
+// Nesting is limited by `token_tree_parse` already
 ExprResult expr_parse_token_tree(TokenTree tree, ExprContext ctx) {
   vec_TokenTree tokens_vec;
 
@@ -66,9 +42,10 @@ ExprResult expr_parse_token_tree(TokenTree tree, ExprContext ctx) {
   }
 
 static ExprResult parser_parse_item(TokenTree item, ExprContext ctx,
-                                    vec_vec_Expr* result);
+                                    vec_vec_Expr* result, int* open_places);
 static ExprResult parser_map_vecvec_to_vec(vec_vec_Expr total_exprs,
-                                           vec_Expr* collect_into);
+                                           vec_Expr* collect_into,
+                                           bool has_open_places);
 static ExprResult map_vec_to_expr(vec_Expr expressions, char bracket);
 
 ExprResult expr_parse_tokens(vec_TokenTree tokens, char bracket,
@@ -78,15 +55,16 @@ ExprResult expr_parse_tokens(vec_TokenTree tokens, char bracket,
   // Mapping vec of TokenTrees to vec of Exprs and operators one-after-another
   vec_vec_Expr total_exprs = vec_vec_Expr_create();
   vec_vec_Expr_push(&total_exprs, vec_Expr_create());
+  int open_places = 0;
 
-  foreach_extract(TokenTree item, tokens, result.is_ok, {  //
-    result = parser_parse_item(item, ctx, &total_exprs);   //
-  });                                                      //
+  foreach_extract(TokenTree item, tokens, result.is_ok, {               //
+    result = parser_parse_item(item, ctx, &total_exprs, &open_places);  //
+  });                                                                   //
   vec_TokenTree_free(tokens);
 
   if (result.is_ok) {
     vec_Expr values = vec_Expr_create();
-    result = parser_map_vecvec_to_vec(total_exprs, &values);
+    result = parser_map_vecvec_to_vec(total_exprs, &values, open_places > 0);
 
     if (result.is_ok) result = map_vec_to_expr(values, bracket);
   } else {
@@ -97,9 +75,13 @@ ExprResult expr_parse_tokens(vec_TokenTree tokens, char bracket,
 }
 
 // EXPR_PARSE_TOKENS HELPERS
-static ExprResult check_for_errors(Expr* this);
+static ExprResult check_for_errors(const Expr* this);
+// Subtrees are checked when they are parsed, so only the places made at this
+// level can be empty. If none are left, checking everything again is skipped:
+// with deep nesting that made parsing quadratic.
 static ExprResult parser_map_vecvec_to_vec(vec_vec_Expr total_exprs,
-                                           vec_Expr* collect_into) {
+                                           vec_Expr* collect_into,
+                                           bool has_open_places) {
   ExprResult result = {.is_ok = true};
 
   // debugln("Parsing vecvec to vec start");
@@ -115,16 +97,17 @@ static ExprResult parser_map_vecvec_to_vec(vec_vec_Expr total_exprs,
 
     } else if (exprs->length > 1) {
       // Multiple
-      debugln("Multiple unrelated expressions right next to each other:");
-      for (int i = 0; i < exprs->length; i++)
-        debugln("\t\tExpression %d: '%$expr'", i + 1, exprs->data[i]);
+      // debugln("Multiple unrelated expressions right next to each other:");
+      // for (int i = 0; i < exprs->length; i++)
+      //   debugln("\t\tExpression %d: '%$expr'", i + 1, exprs->data[i]);
 
       result = ExprErr(str_literal(
           "Multiple unrelated expressions right next to each other"));
 
     } else {
       // Just right - single
-      ExprResult check = check_for_errors(&exprs->data[0]);
+      ExprResult check =
+          has_open_places ? check_for_errors(&exprs->data[0]) : OkExprResult;
       if (not check.is_ok) {
         result = check;
         break;
@@ -161,45 +144,56 @@ static ExprResult map_vec_to_expr(vec_Expr values, char bracket) {
 }
 
 // EXPR_PARSE_TOKENS HELPERS HELPERS
-static ExprResult check_for_errors(Expr* this) {
+static ExprResult check_node(const Expr* this, vec_ExprStep* stack);
+
+// Nodes are checked before their children, left to right
+static ExprResult check_for_errors(const Expr* this) {
   assert_m(this);
 
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = this});
+
   ExprResult result = OkExprResult;
+  while (result.is_ok and stack.length > 0)
+    result = check_node(vec_ExprStep_popget(&stack).expr, &stack);
+
+  vec_ExprStep_free(stack);
+  return result;
+}
+
+// Pushes children in reverse, so that the first one is checked next
+static ExprResult check_node(const Expr* this, vec_ExprStep* stack) {
   if (this->type is EXPR_NUMBER or this->type is EXPR_VARIABLE) {
     // These types just hold the data, no room for errors
-    result = OkExprResult;
 
   } else if (this->type is EXPR_VECTOR) {
-    // Vector - recursively
-    for (int i = 0; i < this->vector.arguments.length and result.is_ok; i++)
-      result = check_for_errors(&this->vector.arguments.data[i]);
+    for (int i = this->vector.arguments.length - 1; i >= 0; i--)
+      vec_ExprStep_push(stack,
+                        (ExprStep){.expr = &this->vector.arguments.data[i]});
 
   } else if (this->type is EXPR_FUNCTION) {
-    // Function - recursively
     if (this->function.argument is null)
-      result = ExprErr(str_literal("Function with no arguments"));
-    else
-      result = check_for_errors(this->function.argument);
+      return ExprErr(str_literal("Function with no arguments"));
+
+    vec_ExprStep_push(stack, (ExprStep){.expr = this->function.argument});
 
   } else if (this->type is EXPR_BINARY_OP) {
-    // Recursively
-    const char* name = this->binary_operator.name.string;
+    const char* name = symbol_name(this->binary_operator.name);
 
-    if (this->binary_operator.lhs is null) {
-      result = ExprErr(str_owned("Incomplete operator '%s' to the left", name));
-    } else if (this->binary_operator.rhs is null) {
-      result =
-          ExprErr(str_owned("Incomplete operator '%s' to the right", name));
-    } else {
-      result = check_for_errors(this->binary_operator.lhs);
-      if (result.is_ok) {
-        result = check_for_errors(this->binary_operator.rhs);
-        if (result.is_ok) result = OkExprResult;
-      }
-    }
-  } else
+    if (this->binary_operator.lhs is null)
+      return ExprErr(str_owned("Incomplete operator '%s' to the left", name));
+    if (this->binary_operator.rhs is null)
+      return ExprErr(
+          str_owned("Incomplete operator '%s' to the right", name));
+
+    vec_ExprStep_push(stack, (ExprStep){.expr = this->binary_operator.rhs});
+    vec_ExprStep_push(stack, (ExprStep){.expr = this->binary_operator.lhs});
+
+  } else {
     panic("Invalid expr type");
-  return result;
+  }
+
+  return OkExprResult;
 }
 
 // PARSER_PARSE_ITEM
@@ -255,9 +249,12 @@ static ExprResult expr_parse_push_token_tree(vec_Expr* current_pos,
   (int)LEN(res); i++) debugc("%c", res[i] ? 'T' : 'F'); debugc("]\n");
   debugln("Is unary: %b | Prev: %p", res[4], prev);
 */
+// `open_places` counts function arguments and right operands that are not
+// filled yet. A value either fills one of them, or becomes a new item.
 static ExprResult parser_parse_item(TokenTree item, ExprContext ctx,
-                                    vec_vec_Expr* result) {
+                                    vec_vec_Expr* result, int* open_places) {
   vec_Expr* current_pos = &result->data[result->length - 1];
+  int length = current_pos->length;
 
   Expr* prev = current_pos->length >= 1
                    ? &current_pos->data[current_pos->length - 1]
@@ -267,30 +264,36 @@ static ExprResult parser_parse_item(TokenTree item, ExprContext ctx,
     item.tree.bracket = '[';
   }
 
+  // Indexing, implicit operators and commas leave no places open
   ExprResult current_result;
-  if (parser_is_function(&item, ctx))
+  if (parser_is_function(&item, ctx)) {
     current_result = parser_collect_function(item, ctx, current_pos);
+    *open_places += current_pos->length - length;  // Unless it is pushed deeper
 
-  else if (parser_is_indexing(&item, prev))
+  } else if (parser_is_indexing(&item, prev)) {
     current_result = parser_collect_indexing(item, ctx, current_pos);
 
-  else if (parser_is_implicit_subtraction(&item, prev))
+  } else if (parser_is_implicit_subtraction(&item, prev)) {
     current_result = parser_collect_implicit_sub(item, ctx, current_pos);
 
-  else if (parser_is_implicit_multiplication(&item, prev))
+  } else if (parser_is_implicit_multiplication(&item, prev)) {
     current_result = parser_collect_implicit_mul(item, ctx, current_pos);
 
-  else if (parser_is_unary_operator(&item, prev))
+  } else if (parser_is_unary_operator(&item, prev)) {
     current_result = parser_collect_unary_operator(item, ctx, current_pos);
+    (*open_places)++;
 
-  else if (parser_is_operator(&item, prev))
+  } else if (parser_is_operator(&item, prev)) {
     current_result = parser_collect_operator(item, ctx, current_pos);
+    (*open_places)++;
 
-  else if (parser_is_comma(&item, prev))
+  } else if (parser_is_comma(&item, prev)) {
     current_result = parser_collect_comma(result);
 
-  else
+  } else {
     current_result = expr_parse_push_token_tree(current_pos, ctx, item);
+    *open_places -= 1 - (current_pos->length - length);  // If pushed deeper
+  }
 
   return current_result;
 }
@@ -364,7 +367,8 @@ static ExprResult expr_parse_push_token_tree(vec_Expr* current_pos,
 }
 
 static ExprResult expr_parse_single_ident(Token ident, ExprContext ctx) {
-  bool is_function = ctx.vtable->is_function(ctx.data, ident.data.ident_text);
+  bool is_function =
+      ctx.vtable->is_function(ctx.data, symbol_intern(ident.data.ident_text));
   ExprResult result = {.is_ok = true};
 
   if (is_function) {
@@ -375,7 +379,7 @@ static ExprResult expr_parse_single_ident(Token ident, ExprContext ctx) {
     };
   } else {
     result.ok.type = EXPR_VARIABLE;
-    result.ok.variable.name = str_slice_to_owned(ident.data.ident_text);
+    result.ok.variable.name = symbol_intern(ident.data.ident_text);
   }
 
   return result;
@@ -450,7 +454,7 @@ static ExprResult expr_push_operator(vec_Expr* current_pos, Expr value,
       return (ExprResult){
           .is_ok = false,
           .err_text = str_owned("Incomplete operator '%s' (to the left)",
-                                value.binary_operator.name.string),
+                                symbol_name(value.binary_operator.name)),
           .err_pos = err_pos,
       };
     } else {
@@ -472,18 +476,24 @@ static ExprResult expr_push_operator(vec_Expr* current_pos, Expr value,
 // ===== FUNCTION ()
 static bool parser_is_function(TokenTree* item, ExprContext ctx) {
   return token_tree_ttype(item) is TOKEN_IDENT and
-         ctx.vtable->is_function(ctx.data, item->token.data.ident_text);
+         ctx.vtable->is_function(ctx.data,
+                                 symbol_intern(item->token.data.ident_text));
 }
 
 static ExprResult parser_collect_function(TokenTree item, ExprContext ctx,
                                           vec_Expr* current_pos) {
-  unused(ctx);
   // It is a function and we need to combine it with the very next token
   // Like 'x sin x' or 'sin'
+  Symbol name = symbol_intern(item.token.data.ident_text);
+  int native = ctx.vtable->find_native
+                   ? ctx.vtable->find_native(ctx.data, name)
+                   : -1;
+
   Expr expr = (Expr){.type = EXPR_FUNCTION,
                      .function = {
-                         .name = str_slice_to_owned(item.token.data.ident_text),
+                         .name = name,
                          .argument = null,  // This pointer will be filled later
+                         .native_slot = native + 1,
                      }};
   expr_push_to_left(current_pos, expr);
 
@@ -515,7 +525,8 @@ static ExprResult parser_collect_indexing(TokenTree item, ExprContext ctx,
           {
               .lhs = null,
               .rhs = null,  // This pointer will be filled later
-              .name = str_owned("[]"),
+              .name = symbol_intern(str_slice_from_string("[]")),
+              .fn = expr_operator_index,
           },
   };
 
@@ -556,7 +567,8 @@ static ExprResult parser_collect_implicit_mul(TokenTree item, ExprContext ctx,
           {
               .lhs = null,
               .rhs = null,
-              .name = str_owned("*"),
+              .name = symbol_intern(str_slice_from_string("*")),
+              .fn = expr_operator_mul,
           },
   };
 
@@ -588,7 +600,8 @@ static ExprResult parser_collect_implicit_sub(TokenTree item, ExprContext ctx,
                   .type = EXPR_NUMBER,
                   .number.value = -item.token.data.number_number,
               }),
-              .name = str_owned("-"),
+              .name = symbol_intern(str_slice_from_string("-")),
+              .fn = expr_operator_sub,
           },
   };
 
@@ -622,7 +635,8 @@ static ExprResult parser_collect_unary_operator(TokenTree item, ExprContext ctx,
                   .number.value = 0.0,
               }),
               .rhs = null,  // This pointer will be filled later
-              .name = str_slice_to_owned(item.token.data.operator_text),
+              .name = symbol_intern(item.token.data.operator_text),
+              .fn = expr_get_operator_fn_slice(item.token.data.operator_text),
           },
   };
   expr_push_operator(current_pos, operator, item.token.start_pos);
@@ -658,7 +672,8 @@ static ExprResult parser_collect_operator(TokenTree item, ExprContext ctx,
           {
               .lhs = null,
               .rhs = null,  // This pointer will be filled later
-              .name = str_slice_to_owned(item.token.data.operator_text),
+              .name = symbol_intern(item.token.data.operator_text),
+              .fn = expr_get_operator_fn_slice(item.token.data.operator_text),
           },
   };
 
@@ -0,0 +1,563 @@
+#include "../util/allocator.h"
+#include "expr.h"
+#include "tokenizer.h"
+
+// -- Parsing
+
+// Single pass over the tokens, straight into `Expr`, without a token tree.
+// Gives the same trees as `token_tree_parse` + `expr_parse_token_tree`, quirks
+// included:
+//  - All operators are left associative, with priorities of
+//    `expr_get_operator_priority`. Sign is only unary before anything else of
+//    its priority: `-a + b` and `a = -b` are fine, `a * -b` is not.
+//  - Minus right before a number is a part of the number, and such number
+//    right after a value is subtracted: `1 - 2^10` is `(1 - 2)^10`.
+//  - Values next to each other are multiplied, unless it is a plain number
+//    after a variable or a function call (`x 2`).
+//  - `[...]` after a value is indexing.
+//  - Function takes the very next item as its argument: `sin x`, `sin (x)`.
+//    Function after a value (`2 sin x`) is only allowed when the whole text
+//    (or the whole argument of such function) is one run of values. That is
+//    where the token tree grouped functions with their arguments.
+//  - Empty brackets are skipped and unclosed brackets are closed at the end.
+// The only difference is brackets with nothing but other empty brackets and
+// commas inside, like `(())` or `(,)`. They are always an error here, while
+// token tree dropped some of them depending on where they were.
+// Errors have the same texts, but of several errors in a text another one may
+// be found first.
+// Brackets and calls are parsed recursively, so they can only be nested
+// `PARSE_MAX_NESTING` deep. Operators of the same priority are chained in a
+// loop, so sums and such can be of any length.
+
+typedef struct Parser {
+  ExprContext ctx;
+  TokenResult current;
+  int nesting;  // Of brackets and calls being parsed
+} Parser;
+
+static ExprResult parse_content(Parser* p, char closing, bool is_top,
+                                bool* is_empty, bool* needs_top);
+static ExprResult parse_expr(Parser* p, int min_priority, bool is_top,
+                             bool* is_empty, bool* needs_top);
+static ExprResult parse_values(Parser* p, bool may_group, bool* is_empty,
+                               bool* needs_top);
+static ExprResult parse_bracket(Parser* p, Token opening, bool is_top,
+                                bool* is_empty, bool* needs_top);
+static ExprResult parse_call(Parser* p, Token name, bool may_group,
+                             bool* needs_top);
+
+static void advance(Parser* p);
+static bool is_bracket(const Parser* p, bool is_opening);
+static bool is_operator(const Parser* p);
+static bool is_comma(const Parser* p);
+static bool is_values_end(const Parser* p);
+static bool is_function(ExprContext ctx, Token token);
+static char closing_bracket(char opening);
+
+static Expr binary_op(StrSlice name, OperatorFn fn, Expr lhs, Expr rhs);
+static Expr number(double value);
+static Expr variable(Token ident);
+static ExprResult error_at(const char* pos, const char* text);
+static ExprResult error_empty(const char* pos, int items_count);
+
+#define ExprOk(expr) \
+  (ExprResult) { .is_ok = true, .ok = (expr) }
+
+#define MULTIPLE_EXPRS "Multiple unrelated expressions right next to each other"
+#define TOO_DEEP "Expression is nested too deep"
+
+// =====
+// =
+// = expr_parse_string
+// =
+// =====
+ExprResult expr_parse_string(const char* text, ExprContext ctx) {
+  assert_m(text);
+  assert_m(ctx.vtable and ctx.vtable->is_function and ctx.vtable->is_variable);
+
+  Parser parser = {.ctx = ctx, .current = tk_next_token(text)};
+
+  // Text as a whole works the same as a bracket that is never closed
+  bool is_empty, needs_top;
+  ExprResult result =
+      parse_content(&parser, '\0', true, &is_empty, &needs_top);
+
+  if (result.is_ok and is_empty) result = error_empty(null, 1);
+
+  return result;
+}
+
+// =====
+// =
+// = parse_content
+// =
+// =====
+static ExprResult parse_items(Parser* p, bool is_top, vec_Expr* items,
+                              bool* needs_top);
+static ExprResult close_bracket(Parser* p, char closing);
+static ExprResult error_empty_item(const Parser* p, TokenResult item_start,
+                                   int items_before);
+
+// Comma separated items up to the `closing` bracket. Items make a vector, a
+// single item is the value itself. `is_empty` is set if there are no tokens
+// at all, and the value is a placeholder then.
+static ExprResult parse_content(Parser* p, char closing, bool is_top,
+                                bool* is_empty, bool* needs_top) {
+  *is_empty = is_bracket(p, false) or not p->current.has_token;
+  *needs_top = false;
+
+  vec_Expr items = vec_Expr_create();
+  ExprResult result = {.is_ok = true};
+
+  if (not *is_empty) result = parse_items(p, is_top, &items, needs_top);
+  if (result.is_ok) result = close_bracket(p, closing);
+
+  if (not result.is_ok) {
+    vec_Expr_free(items);
+    return result;
+  }
+
+  if (items.length is 0) {
+    result = ExprOk(number(0.0));
+    vec_Expr_free(items);
+  } else if (items.length is 1) {
+    result = ExprOk(vec_Expr_popget(&items));
+    vec_Expr_free(items);
+  } else {
+    result = ExprOk(((Expr){.type = EXPR_VECTOR, .vector.arguments = items}));
+  }
+  return result;
+}
+
+// Trailing comma is ignored
+static ExprResult parse_items(Parser* p, bool is_top, vec_Expr* items,
+                              bool* needs_top) {
+  while (true) {
+    // Only the first item can be the whole text, if there is no comma after
+    TokenResult item_start = p->current;
+    bool is_empty, item_top;
+    ExprResult item =
+        parse_expr(p, 0, is_top and items->length is 0, &is_empty, &item_top);
+
+    if (not item.is_ok) return item;
+    if (is_empty) return error_empty_item(p, item_start, items->length);
+
+    vec_Expr_push(items, item.ok);
+    if (item_top) *needs_top = true;
+
+    if (not is_comma(p)) break;
+    advance(p);
+    if (is_bracket(p, false) or not p->current.has_token) break;
+  }
+
+  if (items->length > 1 and *needs_top) return error_at(null, MULTIPLE_EXPRS);
+  return (ExprResult){.is_ok = true};
+}
+
+static bool is_opening_chain(const Parser* p, TokenResult from);
+static int count_items(TokenResult from, int items_before);
+
+// Token tree counted the items of the bracket where one had nothing at all,
+// or was only `((...))` it dropped. Other empty brackets were a text of
+// their own.
+static ExprResult error_empty_item(const Parser* p, TokenResult item_start,
+                                   int items_before) {
+  int count = 1;
+  if (is_opening_chain(p, item_start))
+    count = count_items(item_start, items_before);
+  return error_empty(item_start.token.start_pos, count);
+}
+
+// Tokens from `from` up to the current one are `(`, `{` and then closings
+static bool is_opening_chain(const Parser* p, TokenResult from) {
+  bool is_closing = false;
+
+  for (TokenResult it = from; it.has_token;
+       it = tk_next_token(it.next_token_pos)) {
+    if (p->current.has_token and
+        it.token.start_pos is p->current.token.start_pos)
+      break;
+
+    char c = it.token.data.bracket_symbol;
+    if (it.token.type is_not TOKEN_BRACKET or c is '[') return false;
+    if (c is '(' or c is '{') {
+      if (is_closing) return false;
+    } else {
+      is_closing = true;
+    }
+  }
+  return true;
+}
+
+// Of the bracket being parsed from `from` on, as the token tree split it by
+// commas: trailing comma does not start an item. Only for error texts, so
+// looks ahead.
+static int count_items(TokenResult from, int items_before) {
+  int commas = items_before, depth = 0;
+  bool has_tail = false;
+
+  for (TokenResult it = from; it.has_token;
+       it = tk_next_token(it.next_token_pos)) {
+    if (it.token.type is TOKEN_BRACKET) {
+      char c = it.token.data.bracket_symbol;
+      bool is_open = c is '(' or c is '[' or c is '{';
+      if (not is_open and depth is 0) break;
+      depth += is_open ? 1 : -1;
+    }
+
+    bool is_item_end = depth is 0 and it.token.type is TOKEN_COMMA;
+    if (is_item_end) commas++;
+    has_tail = not is_item_end;
+  }
+
+  int count = commas + (has_tail ? 1 : 0);
+  return count > 0 ? count : 1;
+}
+
+// Brackets that are not closed till the end of text are fine
+static ExprResult close_bracket(Parser* p, char closing) {
+  if (is_bracket(p, false)) {
+    const char* pos = p->current.token.start_pos;
+    if (closing is '\0')
+      return error_at(pos, "Unexpected closing bracket");
+    if (p->current.token.data.bracket_symbol is_not closing)
+      return error_at(pos, "Closing bracket does not match");
+    advance(p);
+  }
+  return (ExprResult){.is_ok = true};
+}
+
+// =====
+// =
+// = parse_expr
+// =
+// =====
+
+// Precedence climbing over operators of `min_priority` and higher.
+// `is_empty` is set if there are no values up to the next operator of lower
+// priority, comma or closing bracket.
+static ExprResult parse_expr(Parser* p, int min_priority, bool is_top,
+                             bool* is_empty, bool* needs_top) {
+  ExprResult lhs = parse_values(p, is_top, is_empty, needs_top);
+  if (not lhs.is_ok) return lhs;
+
+  bool has_operators = false;
+  while (is_operator(p)) {
+    Token op = p->current.token;
+    StrSlice op_text = op.data.operator_text;
+    int priority = expr_get_operator_priority(op_text);
+    assert_m(priority >= 0);
+    if (priority < min_priority) break;
+
+    advance(p);
+    has_operators = true;
+
+    if (*is_empty) {
+      bool is_sign = str_slice_eq_ccp(op_text, "+") or
+                     str_slice_eq_ccp(op_text, "-");
+      if (not is_sign) return error_at(op.start_pos, "Incomplete operator");
+
+      *is_empty = false;  // Unary sign is `0 + x` or `0 - x`
+    }
+
+    bool rhs_empty, rhs_top;
+    ExprResult rhs = parse_expr(p, priority + 1, false, &rhs_empty, &rhs_top);
+    if (rhs.is_ok and rhs_empty)
+      rhs = (ExprResult){
+          .is_ok = false,
+          .err_text = str_owned("Incomplete operator '%$slice' to the right",
+                                op_text),
+          .err_pos = op.start_pos,
+      };
+
+    if (not rhs.is_ok) {
+      expr_free(lhs.ok);
+      return rhs;
+    }
+
+    lhs.ok = binary_op(op_text, expr_get_operator_fn_slice(op_text), lhs.ok,
+                       rhs.ok);
+  }
+
+  // Operators split values apart, so they are not the whole text
+  if (has_operators and *needs_top) {
+    expr_free(lhs.ok);
+    return error_at(null, MULTIPLE_EXPRS);
+  }
+  return lhs;
+}
+
+// =====
+// =
+// = parse_values
+// =
+// =====
+
+// Run of values with no operators between them: numbers, names, calls and
+// brackets, put together left to right by implicit multiplication,
+// subtraction and indexing. `may_group` is set if the run can be the whole
+// text, and then `needs_top` is set if the value relies on that.
+static ExprResult parse_values(Parser* p, bool may_group, bool* is_empty,
+                               bool* needs_top) {
+  Expr acc = number(0.0);
+  bool has_acc = false;
+  int count = 0;
+  *needs_top = false;
+
+  bool first_needs_top = false;  // First bracket relies on being alone
+  ExprResult result = {.is_ok = true};
+
+  while (result.is_ok and not is_values_end(p)) {
+    Token token = p->current.token;
+    advance(p);
+
+    Expr value;
+    bool is_tree = token.type is_not TOKEN_NUMBER;
+    bool is_index = false;
+    bool is_call = false;
+
+    if (token.type is TOKEN_BRACKET) {
+      char bracket = token.data.bracket_symbol;
+      bool is_first_tree = may_group and count is 0 and bracket is_not '[';
+      bool value_empty, value_top;
+      result =
+          parse_bracket(p, token, is_first_tree, &value_empty, &value_top);
+      if (not result.is_ok) break;
+      if (value_empty) continue;  // Empty brackets are skipped
+
+      value = result.ok;
+      is_index = bracket is '[';
+      if (value_top) first_needs_top = true;
+
+    } else if (is_function(p->ctx, token)) {
+      bool call_top = false;
+      result = parse_call(p, token, may_group, &call_top);
+      if (not result.is_ok) break;
+
+      value = result.ok;
+      is_call = true;
+      if (call_top or has_acc) *needs_top = true;
+
+    } else if (token.type is TOKEN_IDENT) {
+      value = variable(token);
+    } else {
+      value = number(token.data.number_number);
+    }
+    count++;
+
+    bool is_subtraction =
+        token.type is TOKEN_NUMBER and token.data.number_number < 0;
+    bool is_multipliable =
+        is_tree or
+        not(acc.type is EXPR_VARIABLE or acc.type is EXPR_FUNCTION);
+
+    if (not has_acc) {
+      acc = value;
+      has_acc = true;
+    } else if (is_call and not may_group) {
+      expr_free(value);
+      result = error_at(token.start_pos, MULTIPLE_EXPRS);
+    } else if (is_index) {
+      acc = binary_op(str_slice_from_string("[]"), expr_operator_index, acc,
+                      value);
+    } else if (is_subtraction) {
+      value.number.value = -value.number.value;
+      acc = binary_op(str_slice_from_string("-"), expr_operator_sub, acc,
+                      value);
+    } else if (is_multipliable) {
+      acc = binary_op(str_slice_from_string("*"), expr_operator_mul, acc,
+                      value);
+    } else {
+      expr_free(value);
+      result = error_at(token.start_pos, MULTIPLE_EXPRS);
+    }
+  }
+
+  // The first bracket was taken as the whole text, but it is not alone
+  if (result.is_ok and first_needs_top and count > 1)
+    result = error_at(null, MULTIPLE_EXPRS);
+
+  if (not result.is_ok) {
+    expr_free(acc);
+    return result;
+  }
+
+  if (first_needs_top) *needs_top = true;
+  *is_empty = not has_acc;
+  return ExprOk(acc);
+}
+
+static ExprResult parse_bracket(Parser* p, Token opening, bool is_top,
+                                bool* is_empty, bool* needs_top) {
+  if (p->nesting is PARSE_MAX_NESTING)
+    return error_at(opening.start_pos, TOO_DEEP);
+
+  p->nesting++;
+  ExprResult result =
+      parse_content(p, closing_bracket(opening.data.bracket_symbol), is_top,
+                    is_empty, needs_top);
+  p->nesting--;
+  return result;
+}
+
+static ExprResult parse_argument(Parser* p, Token name, bool may_group,
+                                 bool* needs_top);
+
+static ExprResult parse_call(Parser* p, Token name, bool may_group,
+                             bool* needs_top) {
+  if (p->nesting is PARSE_MAX_NESTING)
+    return error_at(name.start_pos, TOO_DEEP);
+
+  p->nesting++;
+  ExprResult argument = parse_argument(p, name, may_group, needs_top);
+  p->nesting--;
+  if (not argument.is_ok) return argument;
+
+  ExprContext ctx = p->ctx;
+  Symbol name_symbol = symbol_intern(name.data.ident_text);
+  int native = ctx.vtable->find_native
+                   ? ctx.vtable->find_native(ctx.data, name_symbol)
+                   : -1;
+
+  return ExprOk(((Expr){.type = EXPR_FUNCTION,
+                        .function = {
+                            .name = name_symbol,
+                            .argument = expr_move_to_heap(argument.ok),
+                            .native_slot = native + 1,
+                        }}));
+}
+
+// Function takes the very next item as its argument. In a run of values that
+// can be the whole text, bracket argument can be the whole text as well.
+static ExprResult parse_argument(Parser* p, Token name, bool may_group,
+                                 bool* needs_top) {
+  ExprContext ctx = p->ctx;
+  ExprResult argument = {.is_ok = false};
+  bool has_argument = false;
+
+  while (not has_argument) {
+    // Negative number is subtracted from the call, that has no argument yet
+    bool is_negative = p->current.has_token and
+                       p->current.token.type is TOKEN_NUMBER and
+                       p->current.token.data.number_number < 0;
+    if (is_values_end(p) or is_negative)
+      return error_at(name.start_pos, "Function with no arguments");
+
+    Token token = p->current.token;
+    advance(p);
+
+    if (token.type is TOKEN_BRACKET) {
+      bool is_empty, arg_top;
+      argument = parse_bracket(p, token, may_group, &is_empty, &arg_top);
+      if (not argument.is_ok) return argument;
+
+      has_argument = not is_empty;  // Empty brackets are skipped
+      if (arg_top) *needs_top = true;
+
+    } else if (is_function(ctx, token)) {
+      argument = parse_call(p, token, may_group, needs_top);
+      if (not argument.is_ok) return argument;
+      has_argument = true;
+
+    } else if (token.type is TOKEN_IDENT) {
+      argument = ExprOk(variable(token));
+      has_argument = true;
+
+    } else {
+      argument = ExprOk(number(token.data.number_number));
+      has_argument = true;
+    }
+  }
+
+  return argument;
+}
+
+// =====
+// =
+// = Helpers
+// =
+// =====
+static void advance(Parser* p) {
+  assert_m(p->current.has_token);
+  p->current = tk_next_token(p->current.next_token_pos);
+}
+
+static bool is_bracket(const Parser* p, bool is_opening) {
+  if (not p->current.has_token or p->current.token.type is_not TOKEN_BRACKET)
+    return false;
+
+  char c = p->current.token.data.bracket_symbol;
+  bool is_open = c is '(' or c is '[' or c is '{';
+  return is_open is is_opening;
+}
+
+static bool is_operator(const Parser* p) {
+  return p->current.has_token and p->current.token.type is TOKEN_OPERATOR;
+}
+
+static bool is_comma(const Parser* p) {
+  return p->current.has_token and p->current.token.type is TOKEN_COMMA;
+}
+
+static bool is_values_end(const Parser* p) {
+  return not p->current.has_token or is_operator(p) or is_comma(p) or
+         is_bracket(p, false);
+}
+
+static bool is_function(ExprContext ctx, Token token) {
+  if (token.type is_not TOKEN_IDENT) return false;
+
+  Symbol name = symbol_intern(token.data.ident_text);
+  return ctx.vtable->is_function(ctx.data, name);
+}
+
+static char closing_bracket(char opening) {
+  switch (opening) {
+    case '(':
+      return ')';
+    case '[':
+      return ']';
+    case '{':
+      return '}';
+    default:
+      panic("Unknown bracket: '%c'", opening);
+  }
+}
+
+static Expr binary_op(StrSlice name, OperatorFn fn, Expr lhs, Expr rhs) {
+  return (Expr){
+      .type = EXPR_BINARY_OP,
+      .binary_operator =
+          {
+              .name = symbol_intern(name),
+              .fn = fn,
+              .lhs = expr_move_to_heap(lhs),
+              .rhs = expr_move_to_heap(rhs),
+          },
+  };
+}
+
+static Expr number(double value) {
+  return (Expr){.type = EXPR_NUMBER, .number.value = value};
+}
+
+static Expr variable(Token ident) {
+  return (Expr){.type = EXPR_VARIABLE,
+                .variable.name = symbol_intern(ident.data.ident_text)};
+}
+
+static ExprResult error_at(const char* pos, const char* text) {
+  return (ExprResult){
+      .is_ok = false, .err_text = str_literal(text), .err_pos = pos};
+}
+
+// Same text as the token tree parser gives
+static ExprResult error_empty(const char* pos, int items_count) {
+  return (ExprResult){
+      .is_ok = false,
+      .err_text = str_owned("Empty expressions are not allowed (1) (there "
+                            "are %d exprs in total)",
+                            items_count),
+      .err_pos = pos,
+  };
+}
@@ -0,0 +1,198 @@
+#include <math.h>
+
+#include "../util/allocator.h"
+#include "../util/common_vecs.h"
+#include "expr.h"
+#include "operators_fns.h"
+
+// -- Optimization
+
+// =====
+// =
+// = expr_simplify
+// =
+// =====
+static void simplify_node(Expr* this, int count, const ExprType* types,
+                          const char* consts, ExprContext ctx, ExprType* type,
+                          bool* is_const);
+static Expr simplify_binary_op(Expr this, ExprContext ctx);
+static Expr take_operand(Expr this, bool is_lhs);
+
+static bool is_call_const(const Expr* this, ExprContext ctx);
+static bool is_number(const Expr* this, double value);
+static bool is_sign_op(const Expr* this);
+static bool is_never_none(const Expr* this, ExprContext ctx);
+
+// Operands (see `expr_operand`) are simplified first, and their types and
+// constness wait on `types` and `consts` for their parent. So every node is
+// looked at once, and the tree is changed in place, it is owned here.
+Expr expr_simplify(Expr this, ExprContext ctx) {
+  assert_m(ctx.vtable and ctx.vtable->is_expr_const);
+
+  vec_ExprStep stack = vec_ExprStep_create();
+  vec_ExprType types = vec_ExprType_create();
+  vec_char consts = vec_char_create();
+  vec_ExprStep_push(&stack, (ExprStep){.expr = &this});
+
+  while (stack.length > 0) {
+    ExprStep* top = &stack.data[stack.length - 1];
+    const Expr* operand = expr_operand(top->expr, top->step++);
+
+    if (operand) {
+      vec_ExprStep_push(&stack, (ExprStep){.expr = operand});
+    } else {
+      int count = top->step - 1;
+      types.length -= count;
+      consts.length -= count;
+
+      ExprType type;
+      bool is_const;
+      simplify_node((Expr*)top->expr, count, &types.data[types.length],
+                    &consts.data[consts.length], ctx, &type, &is_const);
+
+      vec_ExprType_push(&types, type);
+      vec_char_push(&consts, is_const);
+      vec_ExprStep_popfree(&stack);
+    }
+  }
+
+  vec_ExprStep_free(stack);
+  vec_ExprType_free(types);
+  vec_char_free(consts);
+  return this;
+}
+
+// Only number results are folded. Errors are left to happen at calculation,
+// the same way as without simplification.
+// Subtrees of other types (vectors, ranges, None) are not calculated at all,
+// they would be thrown away anyway. And every number subtree is folded before
+// its parent, so calculation at the parent does not go down again.
+// Type and constness of a node stay the same after it is simplified.
+static void simplify_node(Expr* this, int count, const ExprType* types,
+                          const char* consts, ExprContext ctx, ExprType* type,
+                          bool* is_const) {
+  bool are_operands_const = true;
+  for (int i = 0; i < count; i++)
+    are_operands_const = are_operands_const and consts[i];
+
+  if (this->type is EXPR_VARIABLE)
+    *is_const = ctx.vtable->is_expr_const(ctx.data, this);
+  else if (this->type is EXPR_FUNCTION)
+    *is_const = are_operands_const and is_call_const(this, ctx);
+  else
+    *is_const = are_operands_const;
+
+  *type = expr_infer_node_type(this, types, ctx);
+
+  if (*is_const and type->type is EXPR_VALUE_NUMBER and
+      this->type is_not EXPR_NUMBER) {
+    ExprValueResult res = expr_calculate(this, ctx);
+
+    if (not res.is_ok) {
+      str_free(res.err_text);
+    } else if (res.ok.type is_not EXPR_VALUE_NUMBER) {
+      expr_value_free(res.ok);
+    } else {
+      expr_free(*this);
+      *this = (Expr){.type = EXPR_NUMBER, .number.value = res.ok.number};
+    }
+  }
+
+  *this = simplify_binary_op(*this, ctx);
+}
+
+// Identities have to keep every value bit for bit, NaN, infinities and the
+// sign of zero included. So `x + 0` (-0 + 0 is 0) and `0 * x` (0 * inf is
+// NaN) are never dropped, but `x + -0` and `x - 0` are.
+// Operand has to be something that is never None: `None * 1` is an error,
+// and it must not turn into plain None.
+static Expr simplify_binary_op(Expr this, ExprContext ctx) {
+  if (this.type is_not EXPR_BINARY_OP) return this;
+
+  OperatorFn fn = this.binary_operator.fn;
+  const Expr* lhs = this.binary_operator.lhs;
+  const Expr* rhs = this.binary_operator.rhs;
+
+  bool is_lhs_safe = is_never_none(lhs, ctx);
+  bool is_rhs_safe = is_never_none(rhs, ctx);
+
+  if (fn is expr_operator_mul) {
+    if (is_number(rhs, 1.0) and is_lhs_safe) return take_operand(this, true);
+    if (is_number(lhs, 1.0) and is_rhs_safe) return take_operand(this, false);
+
+  } else if (fn is expr_operator_div or fn is expr_operator_pow) {
+    if (is_number(rhs, 1.0) and is_lhs_safe) return take_operand(this, true);
+
+  } else if (fn is expr_operator_add) {
+    if (is_number(rhs, -0.0) and is_lhs_safe) return take_operand(this, true);
+    if (is_number(lhs, -0.0) and is_rhs_safe) return take_operand(this, false);
+
+  } else if (fn is expr_operator_sub) {
+    if (is_number(rhs, 0.0) and is_lhs_safe) return take_operand(this, true);
+  }
+
+  // Nested unary signs: `0 - (0 - x)` is the same as `0 + x` for any x
+  // (both give +0 for zeros), and so on for other sign pairs
+  if (is_sign_op(&this) and is_sign_op(rhs) and
+      is_never_none(rhs->binary_operator.rhs, ctx)) {
+    bool is_negative = (fn is expr_operator_sub) !=
+                       (rhs->binary_operator.fn is expr_operator_sub);
+    Expr inner = take_operand(this, false);
+
+    inner.binary_operator.name =
+        symbol_intern(str_slice_from_string(is_negative ? "-" : "+"));
+    inner.binary_operator.fn =
+        is_negative ? expr_operator_sub : expr_operator_add;
+    return inner;
+  }
+
+  return this;
+}
+
+// Operands are already known to be const, so the context is only asked about
+// the function itself, with a number in place of the argument
+static bool is_call_const(const Expr* this, ExprContext ctx) {
+  Expr argument = {.type = EXPR_NUMBER, .number.value = 0.0};
+  Expr call = *this;
+  call.function.argument = &argument;
+  return ctx.vtable->is_expr_const(ctx.data, &call);
+}
+
+// Frees the operator and the other operand
+static Expr take_operand(Expr this, bool is_lhs) {
+  Expr** kept = is_lhs ? &this.binary_operator.lhs : &this.binary_operator.rhs;
+
+  Expr result = **kept;
+  FREE(*kept);
+  *kept = null;
+
+  expr_free(this);
+  return result;
+}
+
+// Bitwise, so -0 is not 0
+static bool is_number(const Expr* this, double value) {
+  return this->type is EXPR_NUMBER and this->number.value == value and
+         signbit(this->number.value) == signbit(value);
+}
+
+// Unary sign is parsed as `0 + x` or `0 - x`
+static bool is_sign_op(const Expr* this) {
+  return this->type is EXPR_BINARY_OP and
+         (this->binary_operator.fn is expr_operator_add or
+          this->binary_operator.fn is expr_operator_sub) and
+         is_number(this->binary_operator.lhs, 0.0);
+}
+
+// Operators give numbers, vectors or errors, but never None. The only other
+// sure thing are the plot coordinates (when they are not a function argument).
+static bool is_never_none(const Expr* this, ExprContext ctx) {
+  if (this->type is EXPR_NUMBER or this->type is EXPR_BINARY_OP) return true;
+  if (this->type is_not EXPR_VARIABLE or this->variable.arg_slot > 0)
+    return false;
+
+  StrSlice name = symbol_slice(this->variable.name);
+  return (str_slice_eq_ccp(name, "x") or str_slice_eq_ccp(name, "y")) and
+         not(ctx.vtable->is_variable and
+             ctx.vtable->is_variable(ctx.data, this->variable.name));
+}
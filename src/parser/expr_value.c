@@ -1,6 +1,8 @@
 
 #include "expr_value.h"
 
+#include <math.h>
+
 #include "../util/allocator.h"
 
 #define VECTOR_C ExprValue
@@ -17,7 +19,15 @@ void expr_value_free(ExprValue this) {
   if (this.type is EXPR_VALUE_NUMBER) {
     // nothing
   } else if (this.type is EXPR_VALUE_VEC) {
-    vec_ExprValue_free(this.vec);
+    if (--this.vec->ref_count > 0) return;
+    vec_ExprValue_free(this.vec->items);
+    FREE(this.vec);
+  } else if (this.type is EXPR_VALUE_ARRAY) {
+    if (--this.array->ref_count > 0) return;
+    FREE(this.array);
+  } else if (this.type is EXPR_VALUE_RANGE) {
+    if (--this.range->ref_count > 0) return;
+    FREE(this.range);
   } else if (this.type is EXPR_VALUE_NONE) {
     // nothing
   } else {
@@ -31,13 +41,16 @@ void expr_value_free(ExprValue this) {
 // =
 // =====
 ExprValue expr_value_clone(const ExprValue* source) {
-  ExprValue res;
-  res.type = source->type;
+  ExprValue res = *source;
 
   if (res.type is EXPR_VALUE_NUMBER) {
-    res.number = source->number;
+    // nothing
   } else if (res.type is EXPR_VALUE_VEC) {
-    res.vec = vec_ExprValue_create_copy(source->vec.data, source->vec.length);
+    res.vec->ref_count++;
+  } else if (res.type is EXPR_VALUE_ARRAY) {
+    res.array->ref_count++;
+  } else if (res.type is EXPR_VALUE_RANGE) {
+    res.range->ref_count++;
   } else if (res.type is EXPR_VALUE_NONE) {
     // do nothing
   } else {
@@ -58,10 +71,36 @@ void expr_value_print(const ExprValue* this, OutStream stream) {
 
   } else if (this->type is EXPR_VALUE_VEC) {
     outstream_putc('[', stream);
-    for (int i = 0; i < this->vec.length; i++) {
+    for (int i = 0; i < this->vec->items.length; i++) {
+      if (i > 0) outstream_puts(", ", stream);
+
+      expr_value_print(&this->vec->items.data[i], stream);
+    }
+    outstream_putc(']', stream);
+
+  } else if (this->type is EXPR_VALUE_ARRAY) {
+    outstream_putc('[', stream);
+    for (int i = 0; i < this->array->length; i++) {
+      if (i > 0) outstream_puts(", ", stream);
+
+      x_sprintf(stream, "%.2lf", this->array->data[i]);
+    }
+    outstream_putc(']', stream);
+
+  } else if (this->type is EXPR_VALUE_RANGE) {
+    // Ranges too long to expand are too long to print, only the ends are shown
+    int length = this->range->length;
+    bool is_cut = length > EXPR_VALUE_MAX_EXPANDED;
+
+    outstream_putc('[', stream);
+    for (int i = 0; i < length; i++) {
       if (i > 0) outstream_puts(", ", stream);
+      if (is_cut and i is 3) {
+        outstream_puts("..., ", stream);
+        i = length - 1;
+      }
 
-      expr_value_print(&this->vec.data[i], stream);
+      x_sprintf(stream, "%.2lf", expr_value_vector_item(this, i).number);
     }
     outstream_putc(']', stream);
 
@@ -85,8 +124,202 @@ const char* expr_value_type_text(int type) {
     case EXPR_VALUE_NUMBER:
       return "Number";
     case EXPR_VALUE_VEC:
+    case EXPR_VALUE_ARRAY:
+    case EXPR_VALUE_RANGE:
       return "Vec";
     default:
       panic("Unknown ExprValue type");
   }
 }
+
+// =====
+// =
+// = ARRAYS
+// =
+// =====
+bool expr_value_is_vector(const ExprValue* this) {
+  return this->type is EXPR_VALUE_VEC or this->type is EXPR_VALUE_ARRAY or
+         this->type is EXPR_VALUE_RANGE;
+}
+
+int expr_value_vector_length(const ExprValue* this) {
+  if (this->type is EXPR_VALUE_VEC) return this->vec->items.length;
+  if (this->type is EXPR_VALUE_ARRAY) return this->array->length;
+  if (this->type is EXPR_VALUE_RANGE) return this->range->length;
+  panic("Value is not a vector");
+}
+
+ExprValue expr_value_vector_item(const ExprValue* this, int index) {
+  assert_m(index >= 0 and index < expr_value_vector_length(this));
+
+  if (this->type is EXPR_VALUE_VEC) return this->vec->items.data[index];
+
+  double number = this->type is EXPR_VALUE_ARRAY
+                      ? this->array->data[index]
+                      : this->range->start + index * this->range->step;
+  return (ExprValue){.type = EXPR_VALUE_NUMBER, .number = number};
+}
+
+bool expr_value_is_shared(const ExprValue* this) {
+  if (this->type is EXPR_VALUE_VEC) return this->vec->ref_count > 1;
+  if (this->type is EXPR_VALUE_ARRAY) return this->array->ref_count > 1;
+  return false;
+}
+
+void expr_value_make_unique(ExprValue* this) {
+  if (not expr_value_is_shared(this)) return;
+
+  ExprValue copy;
+  if (this->type is EXPR_VALUE_VEC) {
+    copy = expr_value_vec(vec_ExprValue_clone(&this->vec->items));
+  } else {
+    copy = expr_value_array(this->array->length);
+    memcpy(copy.array->data, this->array->data,
+           sizeof(double) * this->array->length);
+  }
+
+  expr_value_free(*this);
+  *this = copy;
+}
+
+ExprValue expr_value_array(int length) {
+  assert_m(length >= 0);
+
+  ExprValueArray* array =
+      (ExprValueArray*)MALLOC(sizeof(ExprValueArray) + sizeof(double) * length);
+  assert_alloc(array);
+  array->ref_count = 1;
+  array->length = length;
+
+  return (ExprValue){.type = EXPR_VALUE_ARRAY, .array = array};
+}
+
+ExprValue expr_value_vec(vec_ExprValue items) {
+  ExprValueVec* vec = (ExprValueVec*)MALLOC(sizeof(ExprValueVec));
+  assert_alloc(vec);
+  vec->ref_count = 1;
+  vec->items = items;
+
+  return (ExprValue){.type = EXPR_VALUE_VEC, .vec = vec};
+}
+
+ExprValue expr_value_pack(vec_ExprValue values) {
+  for (int i = 0; i < values.length; i++)
+    if (values.data[i].type is_not EXPR_VALUE_NUMBER)
+      return expr_value_vec(values);
+
+  ExprValue res = expr_value_array(values.length);
+  for (int i = 0; i < values.length; i++)
+    res.array->data[i] = values.data[i].number;
+
+  vec_ExprValue_free(values);
+  return res;
+}
+
+vec_ExprValue expr_value_unpack(ExprValue vector) {
+  vec_ExprValue values;
+
+  if (vector.type is EXPR_VALUE_VEC) {
+    if (expr_value_is_shared(&vector)) {
+      values = vec_ExprValue_clone(&vector.vec->items);
+      expr_value_free(vector);
+    } else {
+      values = vector.vec->items;
+      FREE(vector.vec);
+    }
+    return values;
+  }
+
+  assert_m(vector.type is_not EXPR_VALUE_RANGE or
+           vector.range->length <= EXPR_VALUE_MAX_EXPANDED);
+  int length = expr_value_vector_length(&vector);
+  values = vec_ExprValue_with_capacity(length);
+  for (int i = 0; i < length; i++)
+    values.data[i] = expr_value_vector_item(&vector, i);
+  values.length = length;
+
+  expr_value_free(vector);
+  return values;
+}
+
+vec_ExprValue expr_value_to_args(ExprValue argument) {
+  vec_ExprValue args;
+
+  if (argument.type is EXPR_VALUE_NUMBER) {
+    args = vec_ExprValue_create();
+    vec_ExprValue_push(&args, argument);
+
+  } else if (expr_value_is_vector(&argument)) {
+    args = expr_value_unpack(argument);
+
+  } else if (argument.type is EXPR_VALUE_NONE) {
+    args = vec_ExprValue_create();
+
+  } else {
+    panic("Unknown ExprValue type");
+  }
+
+  return args;
+}
+
+// =====
+// =
+// = RANGES
+// =
+// =====
+
+// Doubles hold all integers up to 2^53. With both `start` and `i * step` under
+// 2^52, their sum is exact too.
+#define EXACT_LIMIT 4503599627370496.0  // 2^52
+
+static bool is_exact_integer(double number) {
+  return fabs(number) <= EXACT_LIMIT and floor(number) == number;
+}
+
+bool expr_value_range_is_exact(double start, double step, int length) {
+  return length >= 0 and is_exact_integer(start) and
+         is_exact_integer(step) and fabs(step) * length <= EXACT_LIMIT;
+}
+
+ExprValue expr_value_range(double start, double step, int length) {
+  assert_m(expr_value_range_is_exact(start, step, length));
+
+  ExprValueRange* range = (ExprValueRange*)MALLOC(sizeof(ExprValueRange));
+  assert_alloc(range);
+  *range = (ExprValueRange){
+      .ref_count = 1,
+      .length = length,
+      .start = start,
+      .step = step,
+  };
+
+  return (ExprValue){.type = EXPR_VALUE_RANGE, .range = range};
+}
+
+ExprValueResult expr_value_check_expand(const ExprValue* this) {
+  if (this->type is EXPR_VALUE_RANGE and
+      this->range->length > EXPR_VALUE_MAX_EXPANDED)
+    return ExprValueErr(
+        null, str_owned("Range error: %d numbers are too many for this (at "
+                        "most %d are allowed)",
+                        this->range->length, EXPR_VALUE_MAX_EXPANDED));
+
+  return ExprValueOk((ExprValue){.type = EXPR_VALUE_NONE});
+}
+
+ExprValueResult expr_value_expand(ExprValue this) {
+  if (this.type is_not EXPR_VALUE_RANGE) return ExprValueOk(this);
+
+  ExprValueResult check = expr_value_check_expand(&this);
+  if (not check.is_ok) {
+    expr_value_free(this);
+    return check;
+  }
+
+  ExprValue res = expr_value_array(this.range->length);
+  for (int i = 0; i < this.range->length; i++)
+    res.array->data[i] = this.range->start + i * this.range->step;
+
+  expr_value_free(this);
+  return ExprValueOk(res);
+}
@@ -10,22 +10,89 @@ typedef struct ExprValue ExprValue;
 #define VECTOR_H ExprValue
 #include "../util/vector.h"
 
+// Vector payloads are reference-counted: cloning a value shares its payload,
+// so vectors are never copied when passed around. Shared payload must not be
+// changed, call `expr_value_make_unique` before writing to it.
+
+typedef struct ExprValueVec {
+  int ref_count;
+  vec_ExprValue items;
+} ExprValueVec;
+
+// Packed vector of numbers. Means exactly the same as a `vec` of numbers, but
+// is stored contiguously, so operators and functions can run tight loops over
+// it.
+typedef struct ExprValueArray {
+  int ref_count;
+  int length;
+  double data[];
+} ExprValueArray;
+
+// Lazy vector of numbers `start + i * step`, which takes constant memory
+// whatever its length. Ranges are never changed, and hold only integers small
+// enough for all the math on them to be exact (see
+// `expr_value_range_is_exact`), so they give the same results as an array of
+// the same numbers.
+typedef struct ExprValueRange {
+  int ref_count;
+  int length;
+  double start;
+  double step;
+} ExprValueRange;
+
 #define EXPR_VALUE_NUMBER 0
 #define EXPR_VALUE_VEC 1
+#define EXPR_VALUE_ARRAY 2
 #define EXPR_VALUE_NONE 3
+#define EXPR_VALUE_RANGE 4
 struct ExprValue {
   int type;
   union {
     double number;
-    vec_ExprValue vec;
+    ExprValueVec* vec;  // Only for data which is not all numbers
+    ExprValueArray* array;
+    ExprValueRange* range;
   };
 };
 
 void expr_value_free(ExprValue this);
+// Shares vector payload
 ExprValue expr_value_clone(const ExprValue* source);
 void expr_value_print(const ExprValue* this, OutStream stream);
 const char* expr_value_type_text(int type);
 
+// All the vector types
+bool expr_value_is_vector(const ExprValue* this);
+int expr_value_vector_length(const ExprValue* this);
+// Borrowed: items of a `vec` are returned as is and must not be freed
+ExprValue expr_value_vector_item(const ExprValue* this, int index);
+
+bool expr_value_is_shared(const ExprValue* this);
+// Copies vector payload if it is shared with other values. Only one level is
+// copied: items of a `vec` stay shared. Ranges are returned as is, since they
+// cannot be written to anyway.
+void expr_value_make_unique(ExprValue* this);
+
+// Uninitialized array of `length` numbers
+ExprValue expr_value_array(int length);
+// Takes ownership
+ExprValue expr_value_vec(vec_ExprValue items);
+// Takes ownership. Returns an array if all the values are numbers, and a `vec`
+// of them otherwise.
+ExprValue expr_value_pack(vec_ExprValue values);
+// Takes ownership. Array and range are spread into a `vec` of numbers, `vec`
+// is returned as is. Ranges have to pass `expr_value_check_expand`.
+vec_ExprValue expr_value_unpack(ExprValue vector);
+// Takes ownership. Arguments of a function call with this argument value:
+// vector is spread into them, none gives no arguments. Ranges have to pass
+// `expr_value_check_expand`.
+vec_ExprValue expr_value_to_args(ExprValue argument);
+
+// All the numbers are integers with `start + i * step` exact in doubles
+bool expr_value_range_is_exact(double start, double step, int length);
+// Range has to be exact
+ExprValue expr_value_range(double start, double step, int length);
+
 typedef struct ExprValueResult {
   bool is_ok;
 
@@ -43,4 +110,16 @@ typedef struct ExprValueResult {
 #define ExprValueErr(pos, text) \
   (ExprValueResult) { .is_ok = false, .err_pos = (pos), .err_text = (text) }
 
+// Ranges longer than this stay lazy: expanding one into an array or spreading
+// it into values is a range error instead of gigabytes of memory
+#define EXPR_VALUE_MAX_EXPANDED 10000000
+
+// Range error if `this` is a range too long to expand or spread, Ok (with
+// nothing in it) otherwise
+ExprValueResult expr_value_check_expand(const ExprValue* this);
+// Takes ownership. Range is turned into an array of the same numbers, other
+// values are returned as is. Range too long to expand is freed and gives a
+// range error.
+ExprValueResult expr_value_expand(ExprValue this);
+
 #endif  // SRC_PARSER_EXPR_VALUE_H_
\ No newline at end of file
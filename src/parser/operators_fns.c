@@ -1,5 +1,6 @@
 #include "operators_fns.h"
 
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 
@@ -52,6 +53,25 @@ OperatorFn expr_get_operator_fn(const char* name) {
       (StrSlice){.start = name, .length = strlen(name)});
 }
 
+int expr_get_operator_priority(StrSlice name) {
+  // Each row is operators of equal priority, the lowest first
+  static const char* const rows[OPERATOR_PRIORITIES][8] = {
+      {"=", ":=", "+=", "-=", "*=", "/=", "%=", "^="},
+      {"==", "!=", "<=", ">=", "<", ">"},
+      {"+", "-"},
+      {"/", "%", "mod"},
+      {"*"},
+      {"..", "..="},
+      {"^"},
+  };
+
+  for (int row = 0; row < OPERATOR_PRIORITIES; row++)
+    for (int i = 0; i < (int)LEN(rows[row]) and rows[row][i]; i++)
+      if (str_slice_eq_ccp(name, rows[row][i])) return row;
+
+  return -1;
+}
+
 #define Err(...)                                                        \
   (ExprValueResult) {                                                   \
     .is_ok = false, .err_pos = null, .err_text = str_owned(__VA_ARGS__) \
@@ -59,135 +79,407 @@ OperatorFn expr_get_operator_fn(const char* name) {
 #define Ok(val) \
   (ExprValueResult) { .is_ok = true, .ok = (val) }
 
-static ExprValueResult template_alg_operator(ExprValue* a, ExprValue* b,
-                                             double (*fn)(double, double),
-                                             const char* err_name);
+// Operator on `start` and `step` of ranges, where number is a range with zero
+// step. Returns false if result is not a range.
+typedef bool (*RangeOperatorFn)(double a_start, double a_step, double b_start,
+                                double b_step, double* start, double* step);
+
+// Every form of one arithmetic operator
+typedef struct AlgOperatorFns {
+  double (*fn)(double, double);
+  OperatorBatchFn batch;  // array op array
+  void (*batch_num)(const double* a, double b, double* out, int n);
+  void (*num_batch)(double a, const double* b, double* out, int n);
+  RangeOperatorFn range_fn;  // null if ranges are always expanded
+  const char* err_name;
+} AlgOperatorFns;
+
+static ExprValueResult template_alg_operator(const ExprValue* a,
+                                             const ExprValue* b,
+                                             const AlgOperatorFns* op);
+
+static bool range_add(double a_start, double a_step, double b_start,
+                      double b_step, double* start, double* step) {
+  *start = a_start + b_start;
+  *step = a_step + b_step;
+  return true;
+}
+
+static bool range_sub(double a_start, double a_step, double b_start,
+                      double b_step, double* start, double* step) {
+  *start = a_start - b_start;
+  *step = a_step - b_step;
+  return true;
+}
+
+static bool range_mul(double a_start, double a_step, double b_start,
+                      double b_step, double* start, double* step) {
+  // Product of two ranges is not linear
+  if (a_step != 0.0 and b_step != 0.0) return false;
+
+  *start = a_start * b_start;
+  *step = a_step * b_start + b_step * a_start;
+  return true;
+}
+
+static bool range_operand(const ExprValue* value, double* start, double* step,
+                          int* length) {
+  if (value->type is EXPR_VALUE_RANGE) {
+    *start = value->range->start;
+    *step = value->range->step;
+    *length = value->range->length;
+    return true;
+
+  } else if (value->type is EXPR_VALUE_NUMBER) {
+    *start = value->number;
+    *step = 0.0;
+    *length = -1;  // Fits any length
+    return expr_value_range_is_exact(value->number, 0.0, 0);
+  }
+
+  return false;
+}
+
+static double range_operand_at(const ExprValue* value, int index) {
+  if (value->type is EXPR_VALUE_NUMBER) return value->number;
+  return expr_value_vector_item(value, index).number;
+}
+
+// Exact range has the same numbers as computed one by one, except that zero
+// may be +0 or -0 depending on how it is computed. So zero is checked against
+// the operator itself.
+static bool is_range_zero_same(const ExprValue* a, const ExprValue* b,
+                               const AlgOperatorFns* op, double start,
+                               double step, int length) {
+  if (step == 0.0) return start != 0.0;
+  if (fmod(start, step) != 0.0) return true;
+
+  double index = -start / step;
+  if (index < 0.0 or index >= length) return true;
+
+  double lazy = start + index * step;
+  double computed = op->fn(range_operand_at(a, (int)index),
+                           range_operand_at(b, (int)index));
+  return signbit(lazy) == signbit(computed);
+}
+
+// Ranges are kept lazy if the result is an exact range too
+static bool template_alg_range_lazy(const ExprValue* a, const ExprValue* b,
+                                    const AlgOperatorFns* op,
+                                    ExprValue* result) {
+  double a_start, a_step, b_start, b_step;
+  int a_length, b_length;
+
+  if (not op->range_fn or not range_operand(a, &a_start, &a_step, &a_length) or
+      not range_operand(b, &b_start, &b_step, &b_length))
+    return false;
+  if (a_length >= 0 and b_length >= 0 and a_length != b_length) return false;
+
+  int length = a_length >= 0 ? a_length : b_length;
+  double start, step;
+  if (not op->range_fn(a_start, a_step, b_start, b_step, &start, &step) or
+      not expr_value_range_is_exact(start, step, length) or
+      not is_range_zero_same(a, b, op, start, step, length))
+    return false;
+
+  *result = expr_value_range(start, step, length);
+  return true;
+}
+
+static bool are_lengths_different(const ExprValue* a, const ExprValue* b) {
+  return expr_value_is_vector(a) and expr_value_is_vector(b) and
+         expr_value_vector_length(a) != expr_value_vector_length(b);
+}
+
+static ExprValueResult template_alg_range(const ExprValue* a,
+                                          const ExprValue* b,
+                                          const AlgOperatorFns* op) {
+  ExprValue lazy;
+  if (template_alg_range_lazy(a, b, op, &lazy)) return Ok(lazy);
+
+  // Not expanded just to report the error
+  if (are_lengths_different(a, b))
+    return Err(
+        "Elements of vectors of different lengths (%d vs %d) cannot be %s",
+        expr_value_vector_length(a), expr_value_vector_length(b),
+        op->err_name);
+
+  ExprValueResult a_expanded = expr_value_expand(expr_value_clone(a));
+  if (not a_expanded.is_ok) return a_expanded;
+  ExprValueResult b_expanded = expr_value_expand(expr_value_clone(b));
+  if (not b_expanded.is_ok) {
+    expr_value_free(a_expanded.ok);
+    return b_expanded;
+  }
+
+  ExprValueResult result =
+      template_alg_operator(&a_expanded.ok, &b_expanded.ok, op);
+  expr_value_free(a_expanded.ok);
+  expr_value_free(b_expanded.ok);
+  return result;
+}
+
+static ExprValueResult template_alg_arrarr(const ExprValue* a,
+                                           const ExprValue* b,
+                                           const AlgOperatorFns* op) {
+  assert_m(a->type is EXPR_VALUE_ARRAY and b->type is EXPR_VALUE_ARRAY);
+
+  if (a->array->length != b->array->length)
+    return Err(
+        "Elements of vectors of different lengths (%d vs %d) cannot be %s",
+        a->array->length, b->array->length, op->err_name);
+
+  ExprValue result = expr_value_array(a->array->length);
+  op->batch(a->array->data, b->array->data, result.array->data,
+            result.array->length);
+  return Ok(result);
+}
+
+static ExprValueResult template_alg_arrnum(const ExprValue* a,
+                                           const ExprValue* b,
+                                           const AlgOperatorFns* op) {
+  if (a->type is EXPR_VALUE_ARRAY) {
+    assert_m(b->type is EXPR_VALUE_NUMBER);
+    ExprValue result = expr_value_array(a->array->length);
+    op->batch_num(a->array->data, b->number, result.array->data,
+                  result.array->length);
+    return Ok(result);
+
+  } else {
+    assert_m(a->type is EXPR_VALUE_NUMBER and b->type is EXPR_VALUE_ARRAY);
+    ExprValue result = expr_value_array(b->array->length);
+    op->num_batch(a->number, b->array->data, result.array->data,
+                  result.array->length);
+    return Ok(result);
+  }
+}
 
-static ExprValueResult template_alg_vecvec(ExprValue* a, ExprValue* b,
-                                           double (*fn)(double, double),
-                                           const char* err_name) {
+static ExprValueResult template_alg_vecvec(const ExprValue* a,
+                                           const ExprValue* b,
+                                           const AlgOperatorFns* op) {
   //.
-  assert_m(a->type is EXPR_VALUE_VEC and b->type is EXPR_VALUE_VEC);
+  assert_m(expr_value_is_vector(a) and expr_value_is_vector(b));
+  int length = expr_value_vector_length(a);
 
-  if (a->vec.length != b->vec.length)
+  if (length != expr_value_vector_length(b))
     return Err(
         "Elements of vectors of different lengths (%d vs %d) cannot be %s",
-        a->vec.length, b->vec.length, err_name);
+        length, expr_value_vector_length(b), op->err_name);
 
   ExprValueResult result = {.is_ok = true};
 
-  vec_ExprValue values = vec_ExprValue_with_capacity(a->vec.length);
+  vec_ExprValue values = vec_ExprValue_with_capacity(length);
 
-  for (int i = 0; i < a->vec.length and result.is_ok; i++) {
-    result =
-        template_alg_operator(&a->vec.data[i], &b->vec.data[i], fn, err_name);
+  for (int i = 0; i < length and result.is_ok; i++) {
+    ExprValue item_a = expr_value_vector_item(a, i);
+    ExprValue item_b = expr_value_vector_item(b, i);
+    result = template_alg_operator(&item_a, &item_b, op);
 
     if (result.is_ok) vec_ExprValue_push(&values, result.ok);
   }
 
   if (result.is_ok)
-    result.ok = (ExprValue){
-        .type = EXPR_VALUE_VEC,
-        .vec = values,
-    };
+    result.ok = expr_value_pack(values);
   else
     vec_ExprValue_free(values);
 
   return result;
 }
 
-static ExprValueResult template_alg_vecnum(ExprValue* a, ExprValue* b,
-                                           double (*fn)(double, double),
-                                           const char* err_name) {
-  ExprValue* vec = a;
-  ExprValue* number = b;
+static ExprValueResult template_alg_vecnum(const ExprValue* a,
+                                           const ExprValue* b,
+                                           const AlgOperatorFns* op) {
+  const ExprValue* vec = a;
+  const ExprValue* number = b;
   bool is_inverted = false;
 
   if (vec->type is EXPR_VALUE_NUMBER) {
-    SWAP(ExprValue*, vec, number);
+    SWAP(const ExprValue*, vec, number);
     is_inverted = true;
   }
 
-  assert_m(vec->type is EXPR_VALUE_VEC and number->type is EXPR_VALUE_NUMBER);
+  assert_m(expr_value_is_vector(vec) and number->type is EXPR_VALUE_NUMBER);
+  int length = expr_value_vector_length(vec);
 
   ExprValueResult result = {.is_ok = true};
-  vec_ExprValue values = vec_ExprValue_with_capacity(vec->vec.length);
+  vec_ExprValue values = vec_ExprValue_with_capacity(length);
 
-  for (int i = 0; i < vec->vec.length and result.is_ok; i++) {
+  for (int i = 0; i < length and result.is_ok; i++) {
+    ExprValue item = expr_value_vector_item(vec, i);
     if (not is_inverted)
-      result = template_alg_operator(&vec->vec.data[i], number, fn, err_name);
+      result = template_alg_operator(&item, number, op);
     else
-      result = template_alg_operator(number, &vec->vec.data[i], fn, err_name);
+      result = template_alg_operator(number, &item, op);
 
     if (result.is_ok) vec_ExprValue_push(&values, result.ok);
   }
 
   if (result.is_ok)
-    result.ok = (ExprValue){
-        .type = EXPR_VALUE_VEC,
-        .vec = values,
-    };
+    result.ok = expr_value_pack(values);
   else
     vec_ExprValue_free(values);
 
   return result;
 }
-static ExprValueResult template_alg_operator(ExprValue* a, ExprValue* b,
-                                             double (*fn)(double, double),
-                                             const char* err_name) {
+static ExprValueResult template_alg_operator(const ExprValue* a,
+                                             const ExprValue* b,
+                                             const AlgOperatorFns* op) {
   //.
   ExprValueResult result = {.is_ok = true};
   if (a->type is EXPR_VALUE_NONE or b->type is EXPR_VALUE_NONE) {
-    result = Err("None values cannot be %s", err_name);
+    result = Err("None values cannot be %s", op->err_name);
   } else if (a->type is EXPR_VALUE_NUMBER and b->type is EXPR_VALUE_NUMBER) {
     ExprValue v = {.type = EXPR_VALUE_NUMBER,
-                   .number = fn(a->number, b->number)};
+                   .number = op->fn(a->number, b->number)};
     result = Ok(v);
+  } else if (a->type is EXPR_VALUE_RANGE or b->type is EXPR_VALUE_RANGE) {
+    result = template_alg_range(a, b, op);
+  } else if (a->type is EXPR_VALUE_ARRAY and b->type is EXPR_VALUE_ARRAY) {
+    result = template_alg_arrarr(a, b, op);
+  } else if (a->type is EXPR_VALUE_ARRAY or b->type is EXPR_VALUE_ARRAY) {
+    // Array with a number, or with a `vec` of other things
+    if (a->type is EXPR_VALUE_NUMBER or b->type is EXPR_VALUE_NUMBER)
+      result = template_alg_arrnum(a, b, op);
+    else
+      result = template_alg_vecvec(a, b, op);
   } else if (a->type is EXPR_VALUE_VEC and b->type is EXPR_VALUE_VEC) {
-    result = template_alg_vecvec(a, b, fn, err_name);
+    result = template_alg_vecvec(a, b, op);
   } else {
-    result = template_alg_vecnum(a, b, fn, err_name);
+    result = template_alg_vecnum(a, b, op);
   }
 
   return result;
 }
 
-#define AlgOperator(name, err_name, action)                         \
-  static double expr_operator_##name##_lambda(double a, double b) { \
-    return action;                                                  \
-  }                                                                 \
-  ExprValueResult expr_operator_##name(ExprValue a, ExprValue b) {  \
-    ExprValueResult res = template_alg_operator(                    \
-        &a, &b, expr_operator_##name##_lambda, err_name);           \
-    expr_value_free(a);                                             \
-    expr_value_free(b);                                             \
-    return res;                                                     \
+// Operands are owned here, so arrays nobody else uses are overwritten with the
+// result instead of allocating a new one
+static ExprValueResult expr_operator_alg(ExprValue a, ExprValue b,
+                                         const AlgOperatorFns* op) {
+  if (a.type is EXPR_VALUE_RANGE or b.type is EXPR_VALUE_RANGE) {
+    ExprValue lazy;
+    if (template_alg_range_lazy(&a, &b, op, &lazy)) {
+      expr_value_free(a);
+      expr_value_free(b);
+      return Ok(lazy);
+    }
+
+    // Arrays made of ranges are not shared, so they can hold the result
+    if (not are_lengths_different(&a, &b)) {
+      ExprValueResult check = expr_value_check_expand(&a);
+      if (check.is_ok) check = expr_value_check_expand(&b);
+      if (not check.is_ok) {
+        expr_value_free(a);
+        expr_value_free(b);
+        return check;
+      }
+
+      a = expr_value_expand(a).ok;
+      b = expr_value_expand(b).ok;
+    }
+  }
+
+  bool is_a_writable =
+      a.type is EXPR_VALUE_ARRAY and not expr_value_is_shared(&a);
+  bool is_b_writable =
+      b.type is EXPR_VALUE_ARRAY and not expr_value_is_shared(&b);
+
+  if (is_a_writable and b.type is EXPR_VALUE_NUMBER) {
+    op->batch_num(a.array->data, b.number, a.array->data, a.array->length);
+    return Ok(a);
+
+  } else if (a.type is EXPR_VALUE_NUMBER and is_b_writable) {
+    op->num_batch(a.number, b.array->data, b.array->data, b.array->length);
+    return Ok(b);
+
+  } else if (is_a_writable and b.type is EXPR_VALUE_ARRAY and
+             a.array->length is b.array->length) {
+    op->batch(a.array->data, b.array->data, a.array->data, a.array->length);
+    expr_value_free(b);
+    return Ok(a);
+  }
+
+  ExprValueResult res = template_alg_operator(&a, &b, op);
+  expr_value_free(a);
+  expr_value_free(b);
+  return res;
+}
+
+// Array forms are plain loops over the same lambda, so compiler can inline and
+// vectorize them
+#define AlgOperator(name, err_text, action, range_action)                      \
+  static double expr_operator_##name##_lambda(double a, double b) {            \
+    return action;                                                             \
+  }                                                                            \
+  static void expr_operator_##name##_batch(const double* a, const double* b,   \
+                                           double* out, int n) {               \
+    for (int i = 0; i < n; i++)                                                \
+      out[i] = expr_operator_##name##_lambda(a[i], b[i]);                      \
+  }                                                                            \
+  static void expr_operator_##name##_batch_num(const double* a, double b,      \
+                                               double* out, int n) {           \
+    for (int i = 0; i < n; i++)                                                \
+      out[i] = expr_operator_##name##_lambda(a[i], b);                         \
+  }                                                                            \
+  static void expr_operator_##name##_num_batch(double a, const double* b,      \
+                                               double* out, int n) {           \
+    for (int i = 0; i < n; i++)                                                \
+      out[i] = expr_operator_##name##_lambda(a, b[i]);                         \
+  }                                                                            \
+  static const AlgOperatorFns expr_operator_##name##_fns = {                   \
+      .fn = expr_operator_##name##_lambda,                                     \
+      .batch = expr_operator_##name##_batch,                                   \
+      .batch_num = expr_operator_##name##_batch_num,                           \
+      .num_batch = expr_operator_##name##_num_batch,                           \
+      .range_fn = range_action,                                                \
+      .err_name = err_text,                                                    \
+  };                                                                           \
+  ExprValueResult expr_operator_##name(ExprValue a, ExprValue b) {             \
+    return expr_operator_alg(a, b, &expr_operator_##name##_fns);               \
   }
 
-AlgOperator(add, "added", a + b)
-AlgOperator(sub, "subtracted", a - b)
-AlgOperator(mul, "multiply", a* b)
-AlgOperator(div, "divide", a / b)
-AlgOperator(mod, "mod-ded", fmod(a, b))
-AlgOperator(pow, "exponentiated", pow(a, b))
+AlgOperator(add, "added", a + b, range_add)
+AlgOperator(sub, "subtracted", a - b, range_sub)
+AlgOperator(mul, "multiply", a* b, range_mul)
+AlgOperator(div, "divide", a / b, null)
+AlgOperator(mod, "mod-ded", fmod(a, b), null)
+AlgOperator(pow, "exponentiated", pow(a, b), null)
+
+OperatorBatchFn expr_get_operator_batch_fn(OperatorFn fn) {
+  const OperatorFn funcs[] = {
+      expr_operator_add, expr_operator_sub, expr_operator_mul,
+      expr_operator_div, expr_operator_mod, expr_operator_pow,
+  };
+  const OperatorBatchFn batch_funcs[] = {
+      expr_operator_add_batch, expr_operator_sub_batch,
+      expr_operator_mul_batch, expr_operator_div_batch,
+      expr_operator_mod_batch, expr_operator_pow_batch,
+  };
+
+  for (int i = 0; i < (int)LEN(funcs); i++)
+    if (funcs[i] is fn) return batch_funcs[i];
+
+  return null;
+}
 
 static long long check_num_integer(double number, ExprValueResult* res);
 
 ExprValueResult expr_operator_index(ExprValue a, ExprValue b) {
   ExprValueResult result = {.is_ok = true};
 
-  if (a.type is EXPR_VALUE_VEC) {
+  if (expr_value_is_vector(&a)) {
     if (b.type is EXPR_VALUE_NUMBER) {
       long long index = check_num_integer(b.number, &result);
+      int length = expr_value_vector_length(&a);
       if (result.is_ok) {
-        if (index >= 0 and index < (long long)a.vec.length) {
+        if (index >= 0 and index < (long long)length) {
+          ExprValue item = expr_value_vector_item(&a, (int)index);
           result = (ExprValueResult){
               .is_ok = true,
-              .ok = expr_value_clone(&a.vec.data[index]),
+              .ok = expr_value_clone(&item),
           };
         } else {
           result = Err("Index %lld is out of bounds for vector of length %d",
-                       index, a.vec.length);
+                       index, length);
         }
       }
     } else {
@@ -211,7 +503,6 @@ ExprValueResult expr_operator_index(ExprValue a, ExprValue b) {
 //
 //
 // RANGES
-#define MAX_RANGE 10000
 #define Err(...)                                                        \
   (ExprValueResult) {                                                   \
     .is_ok = false, .err_pos = null, .err_text = str_owned(__VA_ARGS__) \
@@ -220,13 +511,13 @@ ExprValueResult expr_operator_index(ExprValue a, ExprValue b) {
 #define EPSILON 0.0001
 
 static long long check_num_integer(double number, ExprValueResult* res) {
-  int result = 0;
+  long long result = 0;
   if (fabs(round(number) - number) > EPSILON) {
     (*res) = Err("Range error: number %lf is not an integer (error of +-" STR(
                      EPSILON) " from integer value is allowed)",
                  number);
   } else {
-    result = (long)round(number);
+    result = (long long)round(number);
   }
   return result;
 }
@@ -242,17 +533,29 @@ static ExprValueResult expr_op_range_template(ExprValue a, ExprValue b,
         if (result.is_ok) {
           long long len = high > low ? high - low : 0;
           debugln("Len: %lld", len);
-          vec_ExprValue vec = vec_ExprValue_with_capacity(len);
-
-          for (long long i = low; inclusive ? i <= high : i < high; i++)
-            vec_ExprValue_push(&vec, (ExprValue){.type = EXPR_VALUE_NUMBER,
-                                                 .number = (double)i});
-
-          result = (ExprValueResult){.is_ok = true,
-                                     .ok = {
-                                         .type = EXPR_VALUE_VEC,
-                                         .vec = vec,
-                                     }};
+          if (inclusive and high >= low) len = high - low + 1;
+
+          if (len > INT_MAX) {
+            result = Err("Range error: %lld numbers are too many (at most %d "
+                         "are allowed)",
+                         len, INT_MAX);
+          } else if (expr_value_range_is_exact((double)low, 1.0, (int)len)) {
+            result = (ExprValueResult){
+                .is_ok = true,
+                .ok = expr_value_range((double)low, 1.0, (int)len),
+            };
+          } else if (len > EXPR_VALUE_MAX_EXPANDED) {
+            result = Err("Range error: %lld numbers this large are too many "
+                         "(at most %d are allowed)",
+                         len, EXPR_VALUE_MAX_EXPANDED);
+          } else {
+            // Too large for lazy range to be exact
+            ExprValue array = expr_value_array((int)len);
+            for (int i = 0; i < array.array->length; i++)
+              array.array->data[i] = (double)(low + i);
+
+            result = (ExprValueResult){.is_ok = true, .ok = array};
+          }
         }
       }
     } else
@@ -315,22 +618,45 @@ ExprValueResult expr_operator_pow_assign(ExprValue a, ExprValue b) {
 //
 //
 // COMPARSIONS
-static bool expr_operator_eq_ptr(ExprValue* a, ExprValue* b) {
+static bool expr_operator_eq_ptr(const ExprValue* a, const ExprValue* b) {
+  if (a->type is EXPR_VALUE_RANGE and b->type is EXPR_VALUE_RANGE) {
+    const ExprValueRange* x = a->range;
+    const ExprValueRange* y = b->range;
+    return x->length is y->length and
+           (x->length is 0 or
+            (x->start == y->start and (x->length is 1 or x->step == y->step)));
+  }
+
+  if (a->type is EXPR_VALUE_ARRAY and b->type is EXPR_VALUE_ARRAY) {
+    if (a->array->length != b->array->length) return false;
+
+    for (int i = 0; i < a->array->length; i++)
+      if (a->array->data[i] != b->array->data[i]) return false;
+
+    return true;
+  }
+
+  // Array and `vec` of the same numbers are equal
+  if (expr_value_is_vector(a) and expr_value_is_vector(b)) {
+    int length = expr_value_vector_length(a);
+    if (length != expr_value_vector_length(b)) return false;
+
+    for (int i = 0; i < length; i++) {
+      ExprValue item_a = expr_value_vector_item(a, i);
+      ExprValue item_b = expr_value_vector_item(b, i);
+      if (not expr_operator_eq_ptr(&item_a, &item_b)) return false;
+    }
+
+    return true;
+  }
+
   if (a->type != b->type) return false;
 
   if (a->type is EXPR_VALUE_NONE)
     return true;
   else if (a->type is EXPR_VALUE_NUMBER)
     return a->number == b->number;
-  else if (a->type is EXPR_VALUE_VEC) {
-    if (a->vec.length != b->vec.length) return false;
-
-    for (int i = 0; i < a->vec.length; i++)
-      if (not expr_operator_eq_ptr(&a->vec.data[i], &b->vec.data[i]))
-        return false;
-
-    return true;
-  } else {
+  else {
     panic("Unknown ExprValue type: %d", a->type);
   }
 }
@@ -359,25 +685,40 @@ ExprValueResult expr_operator_neq(ExprValue a, ExprValue b) {
 #define Number(cond) \
   (ExprValue) { .type = EXPR_VALUE_NUMBER, .number = (cond) ? 1.0 : 0.0 }
 
-ExprValue expr_comparsion_template(ExprValue* a, ExprValue* b,
+ExprValue expr_comparsion_template(const ExprValue* a, const ExprValue* b,
                                    bool (*fn)(double, double)) {
+  if (a->type is EXPR_VALUE_ARRAY and b->type is EXPR_VALUE_ARRAY) {
+    if (a->array->length != b->array->length) return Number(false);
+
+    ExprValue values = expr_value_array(a->array->length);
+    const double* a_data = a->array->data;
+    const double* b_data = b->array->data;
+    for (int i = 0; i < a->array->length; i++)
+      values.array->data[i] = fn(a_data[i], b_data[i]) ? 1.0 : 0.0;
+    return values;
+  }
+
+  if (expr_value_is_vector(a) and expr_value_is_vector(b)) {
+    int length = expr_value_vector_length(a);
+    if (length != expr_value_vector_length(b)) return Number(false);
+
+    vec_ExprValue values = vec_ExprValue_with_capacity(length);
+    for (int i = 0; i < length; i++) {
+      ExprValue item_a = expr_value_vector_item(a, i);
+      ExprValue item_b = expr_value_vector_item(b, i);
+      vec_ExprValue_push(&values,
+                         expr_comparsion_template(&item_a, &item_b, fn));
+    }
+    return expr_value_pack(values);
+  }
+
   if (a->type != b->type) return Number(false);
 
   if (a->type is EXPR_VALUE_NONE)
     return Number(fn(0.0, 0.0));
   else if (a->type is EXPR_VALUE_NUMBER)
     return Number(fn(a->number, b->number));
-  else if (a->type is EXPR_VALUE_VEC) {
-    if (a->vec.length != b->vec.length) return Number(false);
-
-    vec_ExprValue values = vec_ExprValue_with_capacity(a->vec.length);
-    for (int i = 0; i < a->vec.length; i++) {
-      ExprValue val =
-          expr_comparsion_template(&a->vec.data[i], &b->vec.data[i], fn);
-      vec_ExprValue_push(&values, val);
-    }
-    return (ExprValue){.type = EXPR_VALUE_VEC, .vec = values};
-  } else
+  else
     panic("Unknown ExprValue type: %d", a->type);
 }
 
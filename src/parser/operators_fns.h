@@ -7,6 +7,18 @@ typedef ExprValueResult (*OperatorFn)(ExprValue, ExprValue);
 OperatorFn expr_get_operator_fn(const char* name);
 OperatorFn expr_get_operator_fn_slice(StrSlice name);
 
+// Both parsers group operators by it, from 0 (assignments, the lowest) to
+// `OPERATOR_PRIORITIES - 1` (`^`). -1 if there is no such operator.
+#define OPERATOR_PRIORITIES 7
+int expr_get_operator_priority(StrSlice name);
+
+// Number-only form of an operator over arrays: out[i] = a[i] op b[i].
+// `out` may be the same array as `a` or `b`.
+typedef void (*OperatorBatchFn)(const double* a, const double* b, double* out,
+                                int n);
+// Returns null if the operator has no such form
+OperatorBatchFn expr_get_operator_batch_fn(OperatorFn fn);
+
 ExprValueResult expr_operator_add(ExprValue, ExprValue);
 ExprValueResult expr_operator_sub(ExprValue, ExprValue);
 ExprValueResult expr_operator_mul(ExprValue, ExprValue);
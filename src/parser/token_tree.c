@@ -5,6 +5,7 @@
 
 #include "../util/allocator.h"
 #include "../util/common_vecs.h"
+#include "operators_fns.h"
 
 #define VECTOR_C TokenTree
 #define VECTOR_ITEM_DESTRUCTOR token_tree_free
@@ -20,7 +21,24 @@ static char flip_bracket(char c);
 // =
 // =====
 void token_tree_free(TokenTree this) {
-  if (not this.is_token) vec_TokenTree_free(this.tree.vec);
+  vec_TokenTree rest = vec_TokenTree_create();  // Subtrees to be freed
+
+  while (true) {
+    if (not this.is_token) {
+      vec_TokenTree* items = &this.tree.vec;
+      for (int i = 0; i < items->length; i++)
+        if (not items->data[i].is_token)
+          vec_TokenTree_push(&rest, items->data[i]);
+
+      items->length = 0;  // Moved
+      vec_TokenTree_free(*items);
+    }
+
+    if (rest.length is 0) break;
+    this = vec_TokenTree_popget(&rest);
+  }
+
+  vec_TokenTree_free(rest);
 }
 
 // =====
@@ -195,27 +213,10 @@ static TokenTree simplify_vector_tree(TokenTree tree) {
 // =
 // =====
 
-// Each row represents operators of equal priority. Bottom row have more
-// priority that top.
-#define OPERATORS                                                \
-  {                                                              \
-    "=", ":=", "+=", "-=", "*=", "/=", "%=", "^=", "\0", /* - */ \
-        "==", "!=", "<=", ">=", "<", ">", "\0",          /* - */ \
-        "+", "-", "\0",                                  /* - */ \
-        "/", "%", "mod", "\0",                           /* - */ \
-        "*", "\0",                                       /* - */ \
-        "..", "..=", "\0",                               /* - */ \
-        "^", "\0",                                       /* - */ \
-  }
-
-typedef struct OpsSlice {
-  const char* const* operators;
-  int length;
-} OpsSlice;
-
+static const Token* find_too_deep(const vec_Token* tokens, TtContext ctx);
 static TokenTreeResult group_by_brackets(vec_Token tokens);
 static TokenTree group_by_commas(TokenTree tree);
-static TokenTree split_by(TokenTree tree, OpsSlice operators);
+static TokenTree split_by(TokenTree tree, int priority);
 static TokenTree group_by_functions(TokenTree tree, TtContext ctx);
 
 TokenTreeResult token_tree_parse(const char* text, TtContext ctx) {
@@ -228,22 +229,26 @@ TokenTreeResult token_tree_parse(const char* text, TtContext ctx) {
     next_token = tk_next_token(next_token.next_token_pos);
   }
 
+  const Token* too_deep = find_too_deep(&tokens, ctx);
+  if (too_deep) {
+    const char* pos = too_deep->start_pos;
+    vec_Token_free(tokens);
+    return (TokenTreeResult){
+        .is_ok = false,
+        .err.text = str_literal("Expression is nested too deep"),
+        .err.text_pos = pos,
+    };
+  }
+
   TokenTreeResult result = group_by_brackets(tokens);
   if (result.is_ok) {
     TokenTree tree = group_by_commas(result.ok);
     tree = token_tree_simplify(tree);
 
-    // Split by all operators
-    static const char* const operators[] = OPERATORS;
-
-    int ops_start = 0;
-    for (int i = 0; i < (int)LEN(operators); i++) {
-      if (operators[i][0] is '\0') {
-        tree = split_by(tree, (OpsSlice){.operators = &operators[ops_start],
-                                         .length = i - ops_start});
-        tree = token_tree_simplify(tree);
-        ops_start = i + 1;
-      }
+    // Split by all operators, from the lowest priority
+    for (int priority = 0; priority < OPERATOR_PRIORITIES; priority++) {
+      tree = split_by(tree, priority);
+      tree = token_tree_simplify(tree);
     }
 
     // TODO: GROUP BY IMPLICIT MUL
@@ -258,6 +263,45 @@ TokenTreeResult token_tree_parse(const char* text, TtContext ctx) {
   return result;
 }
 
+// Nesting is counted on the tokens, before any recursion over the tree. Call
+// is nested till the end of its argument, which is the very next item, so
+// every bracket depth has its own calls waiting for an argument.
+static const Token* find_too_deep(const vec_Token* tokens, TtContext ctx) {
+  int* calls = (int*)MALLOC(sizeof(int) * (tokens->length + 1));
+  assert_alloc(calls);
+
+  int depth = 0;  // Of brackets, `calls[depth]` are calls at this depth
+  int nesting = 0;
+  calls[0] = 0;
+
+  const Token* result = null;
+  for (int i = 0; i < tokens->length and not result; i++) {
+    const Token* token = &tokens->data[i];
+    bool is_bracket = token->type is TOKEN_BRACKET;
+    bool is_function = token->type is TOKEN_IDENT and
+                       ctx.is_function(ctx.data,
+                                       symbol_intern(token->data.ident_text));
+
+    if (is_bracket and is_opening_bracket(token->data.bracket_symbol)) {
+      calls[++depth] = 0;
+      nesting++;
+    } else if (is_function) {
+      calls[depth]++;
+      nesting++;
+    } else {
+      // Closed bracket is a whole item, so calls outside get their argument
+      if (is_bracket and depth > 0) nesting -= 1 + calls[depth--];
+      nesting -= calls[depth];
+      calls[depth] = 0;
+    }
+
+    if (nesting > PARSE_MAX_NESTING) result = token;
+  }
+
+  FREE(calls);
+  return result;
+}
+
 // Group by brackets
 #define ERR(textt)                                                       \
   (TokenTreeResult) {                                                    \
@@ -347,9 +391,9 @@ static TokenTree token_tree_bracket(char bracket) {
 
 // SPLIT BY
 
-static bool is_operator(const TokenTree* item, OpsSlice operators);
+static bool is_operator(const TokenTree* item, int priority);
 
-static TokenTree split_by(TokenTree tree, OpsSlice operators) {
+static TokenTree split_by(TokenTree tree, int priority) {
   if (tree.is_token) {
     return tree;
   } else {
@@ -361,9 +405,9 @@ static TokenTree split_by(TokenTree tree, OpsSlice operators) {
     vec_TokenTree tail = vec_TokenTree_create();
 
     for (int i = 0; i < tree.tree.vec.length; i++) {
-      TokenTree item = split_by(tree.tree.vec.data[i], operators);
+      TokenTree item = split_by(tree.tree.vec.data[i], priority);
 
-      if (is_operator(&item, operators)) {
+      if (is_operator(&item, priority)) {
         TokenTree to_push = {
             .is_token = false,
             .tree.vec = tail,
@@ -391,15 +435,10 @@ static TokenTree split_by(TokenTree tree, OpsSlice operators) {
   }
 }
 
-static bool is_operator(const TokenTree* item_ptr, OpsSlice operators) {
-  bool is_op = false;
-  if (item_ptr->is_token and item_ptr->token.type is TOKEN_OPERATOR) {
-    for (int op = 0; op < operators.length and not is_op; op++) {
-      StrSlice op_text = item_ptr->token.data.operator_text;
-      if (str_slice_eq_ccp(op_text, operators.operators[op])) is_op = true;
-    }
-  }
-  return is_op;
+static bool is_operator(const TokenTree* item_ptr, int priority) {
+  return item_ptr->is_token and item_ptr->token.type is TOKEN_OPERATOR and
+         expr_get_operator_priority(item_ptr->token.data.operator_text) is
+             priority;
 }
 
 // GROUP BY COMMAS
@@ -448,16 +487,28 @@ static TokenTree group_by_commas(TokenTree tree) {
 
 // GROUP BY FUNCTIONS
 
+static bool is_function_token(const TokenTree* item, TtContext ctx);
+
+// Items are walked from the back and put back into the same vector, from its
+// end. `next` is the first of the items already put back.
+// Groups made here are not walked again: they are grouped inside already, and
+// doing that again made chains like `sin sin sin x` quadratic.
 static TokenTree group_by_functions(TokenTree tree, TtContext ctx) {
-  if (tree.is_token) return tree;
+  if (tree.is_token or tree.tree.vec.length < 2) return tree;
+
+  TokenTree* items = tree.tree.vec.data;
+  int length = tree.tree.vec.length;
 
   // We dont need last token
-  for (int i = tree.tree.vec.length - 2; i >= 0; i--) {
-    TokenTree* item_tree = &tree.tree.vec.data[i];
+  int next = length - 1;
+  bool is_next_group = false;
 
-    if (token_tree_ttype(item_tree) is_not TOKEN_IDENT) continue;
-    if (not ctx.is_function(ctx.data, item_tree->token.data.ident_text))
+  for (int i = length - 2; i >= 0; i--) {
+    if (not is_function_token(&items[i], ctx)) {
+      items[--next] = items[i];
+      is_next_group = false;
       continue;
+    }
 
     // And then group this token and next expression together
     TokenTree group = {
@@ -465,19 +516,25 @@ static TokenTree group_by_functions(TokenTree tree, TtContext ctx) {
         .tree.vec = vec_TokenTree_create(),
         .tree.bracket = '<',
     };
-    TokenTree item_owned = vec_TokenTree_extract_order(&tree.tree.vec, i);
-    TokenTree next_owned = vec_TokenTree_extract_order(&tree.tree.vec, i);
+    if (not is_next_group) items[next] = group_by_functions(items[next], ctx);
 
-    next_owned = group_by_functions(next_owned, ctx);
-
-    vec_TokenTree_push(&group.tree.vec, item_owned);
-    vec_TokenTree_push(&group.tree.vec, next_owned);
-    vec_TokenTree_insert(&tree.tree.vec, group, i);
+    vec_TokenTree_push(&group.tree.vec, items[i]);
+    vec_TokenTree_push(&group.tree.vec, items[next]);
+    items[next] = group;
+    is_next_group = true;
   }
 
+  for (int i = next; i < length; i++) items[i - next] = items[i];
+  tree.tree.vec.length = length - next;
+
   return tree;
 }
 
+static bool is_function_token(const TokenTree* item, TtContext ctx) {
+  return token_tree_ttype(item) is TOKEN_IDENT and
+         ctx.is_function(ctx.data, symbol_intern(item->token.data.ident_text));
+}
+
 // OTHER
 
 TokenTree token_tree_unwrap_wrappers(TokenTree tree) {
@@ -4,10 +4,18 @@
 #include "../util/better_io.h"
 #include "../util/better_string.h"
 #include "../util/prettify_c.h"
+#include "../util/symbol.h"
 #include "tokenizer.h"
 
 typedef struct TokenTree TokenTree;
 
+// Most brackets and function calls nested in one another that parsing takes,
+// text nested deeper is an error. Parsers are recursive, and every level costs
+// them a lot of stack. Can be changed with -D.
+#ifndef PARSE_MAX_NESTING
+#define PARSE_MAX_NESTING 1000
+#endif
+
 // vec_TokenTree header
 #define VECTOR_H TokenTree
 #include "../util/vector.h"
@@ -38,7 +46,7 @@ typedef struct TokenTreeResult {
 
 typedef struct TtContext {
   void* data;
-  bool (*is_function)(void*, StrSlice);
+  bool (*is_function)(void*, Symbol);
 } TtContext;
 
 // =====
@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include "../util/allocator.h"
+#include "../util/parse_number.h"
 #include "../util/prettify_c.h"
 
 #define VECTOR_C Token
@@ -34,8 +35,9 @@ static TokenResult scan_comma(const char* string, TokenResult result);
 static TokenResult scan_bracket(const char* string, TokenResult result);
 static TokenResult scan_ident(const char* string, TokenResult result);
 static TokenResult scan_number(const char* string, TokenResult result);
-static double read_num_non_scientific(const char* string, int* offset);
+static double read_num_hex(const char* string, int* offset);
 static bool has_double_dot_after_digits(const char* string);
+static int number_text_length(const char* string);
 
 // >-<function itself>-<
 struct TokenResult tk_next_token(const char* string) {
@@ -201,28 +203,45 @@ static struct TokenResult scan_ident(const char* string,
   return result;
 }
 
-static double read_num_non_scientific(const char* string, int* offset) {
-  int len = 0;
-  while (string[len] != '\0' and (is_digit(string[len]) or string[len] is '.'))
-    len++;
-
-  str_t part = str_owned("%.*s", len, string);
-  double number = 42.0;
-  int success = sscanf(part.string, "%lf", &number);
-  (*offset) = len;
+// Hex numbers are rare, so they are left to `sscanf`, which reads hex floats
+static double read_num_hex(const char* string, int* offset) {
+  // `sscanf` takes `strlen` of its input, so scanning the rest of the text
+  // would make tokenizing quadratic. It gets a copy of just the number.
+  str_t part = str_owned("%.*s", number_text_length(string), string);
+  double number = 0.0;
+  int success = sscanf(part.string, "%lf%n", &number, offset);
   str_free(part);
-  assert_m(success and (*offset) > 0);
+
+  // Nothing after `0x` is a hex number, so there is just zero
+  if (not success or (*offset) is 0) {
+    number = 0.0;
+    (*offset) = 1;
+  }
   return number;
 }
 
 static bool has_double_dot_after_digits(const char* string) {
-  int len = strlen(string);
-  for (int i = 0; i < len - 2 and is_digit(string[i]); i++)
+  for (int i = 0; is_digit(string[i]); i++)
     if (string[i + 1] == '.' and string[i + 2] == '.') return true;
 
   return false;
 }
 
+// Characters `sscanf` may take for a hex number: digits, dots, letters and a
+// sign right after an exponent letter
+static int number_text_length(const char* string) {
+  int len = 0;
+  while (true) {
+    char c = string[len];
+    bool is_sign = (c is '+' or c is '-') and len > 0 and
+                   strchr("eEpP", string[len - 1]);
+
+    if (not(is_letter(c) or is_digit(c) or c is '.' or is_sign)) break;
+    len++;
+  }
+  return len;
+}
+
 static struct TokenResult scan_number(const char* string,
                                       struct TokenResult result) {
   bool is_negative = false;
@@ -233,28 +252,17 @@ static struct TokenResult scan_number(const char* string,
   }
 
   string = skip_spaces(string);
-  bool has_double_dot = has_double_dot_after_digits(string);
-
-  int offset = 0, success = 1;
-  double number = 42.0;
+  bool is_hex = string[0] is '0' and (string[1] is 'x' or string[1] is 'X');
+  int offset = 0;
+  double number = is_hex ? read_num_hex(string, &offset)
+                         : parse_double(string, &offset);
 
-  if (not has_double_dot) {
-    success = sscanf(string, "%lf%n", &number, &offset);
-
-    if (not success or offset is 0) {
-      number = read_num_non_scientific(string, &offset);
-      success = 1;
-    }
-  } else {
-    // Scan as integer, since dots are for .. or ..= operators
-    long long number_l = 0;
-    success = sscanf(string, "%lld%n", &number_l, &offset);
-    number = number_l;
-  }
-
-  if (not success or offset is 0)
+  if (offset is 0)
     panic("Failed to parse number at: %s (this SHOULD NOT HAPPEN)\n", string);
 
+  // In `1..5` the number is read as `1.`, but the dot is for `..` or `..=`
+  if (has_double_dot_after_digits(string)) offset--;
+
   result.has_token = true;
   result.token.data.number_number = number * (is_negative ? -1.0 : 1.0);
   result.next_token_pos = string + offset;
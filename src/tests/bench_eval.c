@@ -0,0 +1,77 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "../calculator/calc_compiled.h"
+#include "../util/prettify_c.h"
+#include "tests.h"
+
+// Per-point cost of evaluating an expression at many points: parsed again
+// for every point (`calc_calculate_expr`), compiled once (`calc_eval`) and
+// over arrays of points (`calc_eval_batch`)
+
+#define POINTS 100000
+#define ONE_SHOT_POINTS 5000  // Parsing every time is slow, fewer points
+
+static double point_x(int i) { return -10.0 + 20.0 * i / POINTS; }
+static double point_y(int i) { return 5.0 - 7.0 * i / POINTS; }
+
+static double take_number(ExprValueResult res) {
+  double number = NAN;
+  if (res.is_ok and res.ok.type is EXPR_VALUE_NUMBER) number = res.ok.number;
+
+  if (res.is_ok)
+    expr_value_free(res.ok);
+  else
+    str_free(res.err_text);
+  return number;
+}
+
+static void bench_expr(const char* text, double* xs, double* ys,
+                       double* out) {
+  double sum = 0.0;
+
+  double start = bench_now();
+  for (int i = 0; i < ONE_SHOT_POINTS; i++)
+    sum += take_number(calc_calculate_expr(text, xs[i], ys[i]));
+  double one_shot = (bench_now() - start) / ONE_SHOT_POINTS;
+
+  start = bench_now();
+  CalcCompiled* compiled = calc_compile(text);
+  for (int i = 0; i < POINTS; i++)
+    sum += take_number(calc_eval(compiled, xs[i], ys[i]));
+  double each = (bench_now() - start) / POINTS;
+
+  start = bench_now();
+  calc_eval_batch(compiled, xs, ys, POINTS, out, null);
+  double batch = (bench_now() - start) / POINTS;
+  calc_compiled_free(compiled);
+
+  printf("%-28s one-shot %8.0f ns/pt, compiled %6.0f ns/pt (x%.0f), "
+         "batch %5.0f ns/pt (x%.0f)   [%g]\n",
+         text, one_shot * 1e9, each * 1e9, one_shot / each, batch * 1e9,
+         one_shot / batch, sum);
+}
+
+int main() {
+  const char* const exprs[] = {
+      "x*y+1",
+      "sin(x)*cos(y)+x^2/(1+y^2)",
+      "sqrt(x^2+y^2) - 1",
+      "max(x, y) - [x, y][0]",
+  };
+
+  double* xs = (double*)malloc(sizeof(double) * POINTS);
+  double* ys = (double*)malloc(sizeof(double) * POINTS);
+  double* out = (double*)malloc(sizeof(double) * POINTS);
+  for (int i = 0; i < POINTS; i++) {
+    xs[i] = point_x(i);
+    ys[i] = point_y(i);
+  }
+
+  for (int i = 0; i < (int)LEN(exprs); i++) bench_expr(exprs[i], xs, ys, out);
+
+  free(xs);
+  free(ys);
+  free(out);
+  return 0;
+}
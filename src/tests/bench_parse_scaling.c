@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../calculator/calc_backend.h"
+#include "../util/prettify_c.h"
+#include "tests.h"
+
+// Parsing time of flat sums of growing length, as plot expressions
+// (`expr_parse_string`) and as workspace statements (`calc_backend_add_expr`).
+// Time per term should stay about the same as the sum gets longer.
+
+#define TERM_FORMAT " + %d*x"
+#define TERM_MAX_LENGTH 16
+
+// "v = 1 + 1*x + 2*x ...", the expression starts after `prefix`
+static char* sum_text(int terms, const char* prefix) {
+  char* text = (char*)malloc(strlen(prefix) + 2 +
+                             (size_t)terms * TERM_MAX_LENGTH);
+  size_t length = sprintf(text, "%s1", prefix);
+  for (int i = 1; i < terms; i++)
+    length += sprintf(&text[length], TERM_FORMAT, i % 1000);
+  return text;
+}
+
+static double bench_plot(int terms) {
+  CalcBackend backend = calc_backend_create();
+  char* text = sum_text(terms, "");
+
+  double start = bench_now();
+  ExprResult res = expr_parse_string(text, calc_backend_get_context(&backend));
+  double time = bench_now() - start;
+
+  if (res.is_ok) {
+    expr_free(res.ok);
+  } else {
+    printf("Sum of %d terms is not parsed: %s\n", terms, res.err_text.string);
+    str_free(res.err_text);
+  }
+  free(text);
+  calc_backend_free(backend);
+  return time;
+}
+
+static double bench_workspace(int terms) {
+  CalcBackend backend = calc_backend_create();
+  char* text = sum_text(terms, "v = ");
+
+  double start = bench_now();
+  str_t message = calc_backend_add_expr(&backend, text);
+  double time = bench_now() - start;
+
+  str_free(message);
+  free(text);
+  calc_backend_free(backend);
+  return time;
+}
+
+int main() {
+  const int sizes[] = {1000, 10000, 100000, 1000000};
+
+  double plot_base = 0.0;
+  double workspace_base = 0.0;
+  for (int i = 0; i < (int)LEN(sizes); i++) {
+    double plot = bench_plot(sizes[i]) / sizes[i];
+    double workspace = bench_workspace(sizes[i]) / sizes[i];
+    if (i is 0) {
+      plot_base = plot;
+      workspace_base = workspace;
+    }
+
+    printf("%8d terms: plot %6.0f ns/term (x%.2f), "
+           "workspace %6.0f ns/term (x%.2f)\n",
+           sizes[i], plot * 1e9, plot / plot_base, workspace * 1e9,
+           workspace / workspace_base);
+  }
+  return 0;
+}
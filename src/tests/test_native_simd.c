@@ -0,0 +1,278 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../calculator/calc_compiled.h"
+#include "../calculator/native_simd.h"
+#include "../util/prettify_c.h"
+#include "tests.h"
+
+// SIMD kernels against libm, within the bounds documented in native_simd.h,
+// for every backend this CPU can run. Vector backends give the same bits, at
+// any position in the array. And single numbers in the calculator are libm
+// exactly, only arrays get the kernels.
+
+#define COUNT 200000
+
+static int failures = 0;
+
+static uint64_t random_state = 88172645463325252ull;
+static uint64_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+// In [0, 1)
+static double next_unit() { return (next_random() >> 11) * 0x1.0p-53; }
+
+// Doubles ordered as integers, so that the difference is the ULP count
+static int64_t ordered(double number) {
+  int64_t bits = 0;
+  memcpy(&bits, &number, sizeof(bits));
+  return bits < 0 ? INT64_MIN - bits : bits;
+}
+
+static uint64_t ulp_distance(double a, double b) {
+  if (isnan(a) or isnan(b)) return isnan(a) and isnan(b) ? 0 : UINT64_MAX;
+  if (a == b) return 0;  // Also +0 and -0
+  int64_t x = ordered(a), y = ordered(b);
+  return x > y ? (uint64_t)x - (uint64_t)y : (uint64_t)y - (uint64_t)x;
+}
+
+static double basic_log10(double a) { return log(a) / log(10.0); }
+
+typedef struct Kernel {
+  const char* name;
+  double (*libm)(double);
+  uint64_t max_ulp;
+  double min, max;     // Range of inputs
+  bool is_log_scale;   // Else uniform
+  bool is_signed;      // Also the same range below zero
+} Kernel;
+
+// =====
+// =
+// = Kernels
+// =
+// =====
+
+static const char* const backends_names[] = {"avx2", "sse2", "scalar"};
+
+static NativeSimdFn kernel_fn(const NativeSimdBackend* backend,
+                              const char* name) {
+  const NativeSimdFn fns[] = {backend->sin,  backend->cos,  backend->tan,
+                              backend->atan, backend->asin, backend->acos,
+                              backend->sqrt, backend->ln,   backend->log};
+  const char* const names[] = {"sin",  "cos",  "tan", "atan", "asin",
+                               "acos", "sqrt", "ln",  "log"};
+
+  for (int i = 0; i < (int)LEN(names); i++)
+    if (strcmp(names[i], name) is 0) return fns[i];
+  return null;
+}
+
+static bool is_same_bits(double a, double b) {
+  return memcmp(&a, &b, sizeof(double)) is 0;
+}
+
+static void check_backend(const Kernel* kernel,
+                          const NativeSimdBackend* backend, const double* in,
+                          double* out) {
+  kernel_fn(backend, kernel->name)(in, out, COUNT);
+
+  uint64_t worst = 0;
+  for (int i = 0; i < COUNT; i++) {
+    double expected = kernel->libm(in[i]);
+    uint64_t distance = ulp_distance(out[i], expected);
+    if (distance > worst) worst = distance;
+
+    CHECK(failures, distance <= kernel->max_ulp,
+          "%s %s(%.17g) = %.17g, libm gives %.17g", backend->name,
+          kernel->name, in[i], out[i], expected);
+  }
+  printf("%-5s %-6s: worst %llu ULP (allowed %llu)\n", kernel->name,
+         backend->name, (unsigned long long)worst,
+         (unsigned long long)kernel->max_ulp);
+}
+
+// Tail of an array goes through the same operations as the full lanes
+static void check_positions(const Kernel* kernel,
+                            const NativeSimdBackend* backend, const double* in,
+                            const double* out) {
+  double* shifted = (double*)malloc(sizeof(double) * COUNT);
+  kernel_fn(backend, kernel->name)(in + 1, shifted, COUNT - 1);
+
+  for (int i = 0; i < COUNT - 1; i++)
+    CHECK(failures, is_same_bits(shifted[i], out[i + 1]),
+          "%s %s(%.17g) at %d = %a, at %d = %a", backend->name, kernel->name,
+          in[i + 1], i, shifted[i], i + 1, out[i + 1]);
+
+  free(shifted);
+}
+
+static void check_kernel(const Kernel* kernel) {
+  double* in = (double*)malloc(sizeof(double) * COUNT);
+  double* out = (double*)malloc(sizeof(double) * COUNT);
+  double* vector_out = (double*)malloc(sizeof(double) * COUNT);
+  const char* vector_name = null;
+
+  double low = kernel->min, high = kernel->max;
+  if (kernel->is_log_scale) {
+    low = log(low);
+    high = log(high);
+  }
+
+  for (int i = 0; i < COUNT; i++) {
+    double number = low + next_unit() * (high - low);
+    if (kernel->is_log_scale) number = exp(number);
+    if (kernel->is_signed and next_random() % 2) number = -number;
+    in[i] = number;
+  }
+
+  // Zeros, infinities, NaNs, domain errors, subnormals and huge arguments
+  const double edges[] = {0.0,  -0.0,   INFINITY, -INFINITY, NAN,
+                          -2.0, 1e-310, 1e300,    -1e300};
+  for (int i = 0; i < (int)LEN(edges); i++) in[i] = edges[i];
+
+  for (int i = 0; i < (int)LEN(backends_names); i++) {
+    const NativeSimdBackend* backend =
+        native_simd_backend_find(backends_names[i]);
+    if (not backend) continue;
+
+    check_backend(kernel, backend, in, out);
+    if (strcmp(backend->name, "scalar") is 0) continue;
+
+    // Vector backends do exactly the same operations
+    check_positions(kernel, backend, in, out);
+    if (not vector_name) {
+      vector_name = backend->name;
+      memcpy(vector_out, out, sizeof(double) * COUNT);
+      continue;
+    }
+
+    for (int j = 0; j < COUNT; j++)
+      CHECK(failures, is_same_bits(out[j], vector_out[j]),
+            "%s(%.17g): %s gives %a, %s gives %a", kernel->name, in[j],
+            backend->name, out[j], vector_name, vector_out[j]);
+  }
+
+  free(in);
+  free(out);
+  free(vector_out);
+}
+
+static void check_kernels() {
+  const Kernel kernels[] = {
+      {"sqrt", sqrt, 0, 1e-300, 1e300, true, false},
+      {"sin", sin, 2, -10, 10, false, false},
+      {"sin", sin, 2, 1e-300, 1.07e9, true, true},
+      {"cos", cos, 2, -10, 10, false, false},
+      {"cos", cos, 2, 1e-300, 1.07e9, true, true},
+      {"tan", tan, 2, -10, 10, false, false},
+      {"tan", tan, 2, 1e-300, 1.07e9, true, true},
+      {"atan", atan, 1, 1e-300, 1e300, true, true},
+      {"asin", asin, 1, -1, 1, false, false},
+      {"acos", acos, 1, -1, 1, false, false},
+      {"ln", log, 1, 1e-300, 1e300, true, false},
+      {"ln", log, 1, 0.5, 2, false, false},
+      {"log", basic_log10, 2, 1e-300, 1e300, true, false},
+      {"log", basic_log10, 2, 0.5, 2, false, false},
+  };
+
+  printf("picked backend: %s\n", native_simd_backend_name());
+  for (int i = 0; i < (int)LEN(kernels); i++) check_kernel(&kernels[i]);
+}
+
+// =====
+// =
+// = Calculator
+// =
+// =====
+
+static double eval_number(const CalcCompiled* compiled, double x) {
+  ExprValueResult res = calc_eval(compiled, x, 0.0);
+  double number = NAN;
+  if (res.is_ok and res.ok.type is EXPR_VALUE_NUMBER) number = res.ok.number;
+
+  if (res.is_ok)
+    expr_value_free(res.ok);
+  else
+    str_free(res.err_text);
+  return number;
+}
+
+static double with_libm(int expr, double x) {
+  switch (expr) {
+    case 0:
+      return sin(x);
+    case 1:
+      return pow(sin(x), 2) + pow(cos(x), 2);
+    case 2:
+      return sqrt(x * x + 1) + atan(x);
+    default:
+      return basic_log10(sqrt(x * x) + 1);
+  }
+}
+
+// Single numbers, through both the generic and the number-only evaluation,
+// are libm bit for bit. Batches are within kernel bounds.
+static void check_calculator() {
+  const char* const exprs[] = {
+      "sin(x)",
+      "sin(x)^2 + cos(x)^2",
+      "sqrt(x*x + 1) + atan(x)",
+      "log(sqrt(x*x) + 1)",
+  };
+
+  double xs[1000], ys[1000], out[1000];
+  for (int i = 0; i < (int)LEN(xs); i++) {
+    xs[i] = i is 0 ? 0.7 : i is 1 ? 2.0 : -50.0 + 100.0 * next_unit();
+    ys[i] = 0.0;
+  }
+
+  for (int expr = 0; expr < (int)LEN(exprs); expr++) {
+    CalcCompiled* compiled = calc_compile(exprs[expr]);
+    calc_eval_batch(compiled, xs, ys, LEN(xs), out, null);
+
+    for (int i = 0; i < (int)LEN(xs); i++) {
+      double number = eval_number(compiled, xs[i]);
+      double expected = with_libm(expr, xs[i]);
+      CHECK(failures, ulp_distance(number, expected) is 0,
+            "%s at x = %.17g: %a, libm gives %a", exprs[expr], xs[i], number,
+            expected);
+
+      // A few kernels in a row, each within its bound
+      CHECK(failures, ulp_distance(out[i], number) <= 16,
+            "batch %s at x = %.17g: %a, single gives %a", exprs[expr], xs[i],
+            out[i], number);
+    }
+    calc_compiled_free(compiled);
+  }
+
+  // Vectors of numbers are arrays too, each item is within kernel bounds
+  ExprValueResult res = calc_calculate_expr("sin([2, x, 0.7])", 2.0, 0.0);
+  CHECK(failures, res.is_ok, "sin of a vector failed");
+  if (res.is_ok) {
+    for (int i = 0; i < 3; i++) {
+      double arg = i is 2 ? 0.7 : 2.0;
+      double item = expr_value_vector_item(&res.ok, i).number;
+      CHECK(failures, ulp_distance(item, sin(arg)) <= 2,
+            "sin([2, x, 0.7])[%d] = %a, libm gives %a", i, item, sin(arg));
+    }
+    expr_value_free(res.ok);
+  } else {
+    str_free(res.err_text);
+  }
+}
+
+int main() {
+  check_kernels();
+  check_calculator();
+
+  printf("native_simd: %d failed\n", failures);
+  return failures is 0 ? 0 : 1;
+}
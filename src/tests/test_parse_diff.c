@@ -0,0 +1,349 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../calculator/calc_backend.h"
+#include "../calculator/calc_expr.h"
+#include "../parser/token_tree.h"
+#include "../util/prettify_c.h"
+#include "tests.h"
+
+// `expr_parse_string` against the token tree parser (`token_tree_parse` and
+// `expr_parse_token_tree`): either both fail, or both give equal trees. Texts
+// are written by hand, where errors must have the same text too, or put
+// together at random from tokens, garbage included. Then statement heads of
+// `calc_expr_parse`.
+
+static int failures = 0;
+static long checked = 0;
+static long parsed = 0;
+
+static void check(ExprContext ctx, const char* text, bool is_same_error) {
+  TtContext tt_ctx = {.data = ctx.data, .is_function = ctx.vtable->is_function};
+  TokenTreeResult tree = token_tree_parse(text, tt_ctx);
+
+  ExprResult expected;
+  if (tree.is_ok) {
+    expected = expr_parse_token_tree(tree.ok, ctx);
+  } else {
+    expected = (ExprResult){.is_ok = false, .err_text = tree.err.text};
+  }
+  ExprResult got = expr_parse_string(text, ctx);
+
+  checked++;
+  if (expected.is_ok) parsed++;
+  bool is_same =
+      expected.is_ok is got.is_ok and
+      (got.is_ok ? expr_equal(&expected.ok, &got.ok)
+                 : not is_same_error or strcmp(expected.err_text.string,
+                                               got.err_text.string) is 0);
+  CHECK(failures, is_same,
+        "'%s': token tree parser gives '%s', and expr_parse_string '%s'", text,
+        expected.is_ok ? "a tree" : expected.err_text.string,
+        got.is_ok ? "a different tree" : got.err_text.string);
+
+  if (expected.is_ok)
+    expr_free(expected.ok);
+  else
+    str_free(expected.err_text);
+
+  if (got.is_ok)
+    expr_free(got.ok);
+  else
+    str_free(got.err_text);
+}
+
+static uint64_t random_state = 88172645463325252ull;
+static int next_random(int count) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return (int)(random_state % (uint64_t)count);
+}
+
+#define PICK(items) items[next_random(LEN(items))]
+
+// =====
+// =
+// = Texts
+// =
+// =====
+
+static const char* const definitions[] = {
+    "c = 0.3",           "f(a) = sin(a*c)^2 + a", "g(a, b) = {a, b}",
+    "h(a) = a",          "r = 1..5",              "w = {1, 2, 3}",
+    "q(a) = g(a, a) * a"};
+
+static const char* const written[] = {
+    "x^2 + y^2 - 1",     "sin x * cos y",      "2 sin x",
+    "-x^2",              "1 - 2^10",           "x - -1",
+    "f(x) + g(1, 2)[0]", "[1, 2, 3][1]",       "1..5",
+    "x 2",               "2x",                 "sin(x)^2 + cos(x)^2",
+    "f f x",             "h(x)(y)",            "{1, {2, 3}}",
+    "r * 2 + w",         "a = x + 1",          "x == y",
+    "x < y != y >= x",   "sqrt abs x mod 3",   "len(w) / 0",
+    "(((x)))",           "((x), (y))",         "x +",
+    "* x",               "(x",                 "x)",
+    "(x]",               "sin",                "sin()",
+    "()",                "",                   "x,",
+    ",x",                "q 1 2",              "+-x",
+    "x,,y",              "(,x)",               "[1, (), 2]",
+    "[1, [], 2]",        "{x, ((y)), ,}",      "g(1, ,2)",
+};
+
+static const char* const numbers[] = {"1",   "2", "0",    "3.5", "0.5",
+                                      "10",  "7", "0.25", "4",   "-1",
+                                      "-3.5"};
+static const char* const variables[] = {"x", "y", "c", "r", "w", "a", "zz"};
+static const char* const functions[] = {"sin", "cos", "sqrt", "f", "g",
+                                        "h",   "abs", "len",  "q"};
+static const char* const operators[] = {
+    "+", "-",  "*",   "/", "^",  "%", "mod", "..", "..=",
+    "=", "==", "!=",  "<", ">", "<=", ">=", ":=", "+="};
+static const char* const brackets[][2] = {{"(", ")"}, {"[", "]"}, {"{", "}"}};
+static const char* const noise[] = {"(", ")", "[",   "]", "{", "}", ",",
+                                    "-", "+", "*",   "()", "[]", "{}",
+                                    "x", "2", "sin", "-3"};
+
+#define MAX_TOKENS 4096
+
+typedef struct Tokens {
+  const char* items[MAX_TOKENS];
+  int length;
+} Tokens;
+
+static void put(Tokens* this, const char* token) {
+  if (this->length < MAX_TOKENS) this->items[this->length++] = token;
+}
+
+static void put_expr(Tokens* this, int depth);
+
+static void put_group(Tokens* this, int depth) {
+  int kind = next_random(LEN(brackets));
+  put(this, brackets[kind][0]);
+
+  int count = next_random(4) is 0 ? 1 + next_random(3) : 1;
+  for (int i = 0; i < count; i++) {
+    if (i > 0) put(this, ",");
+    put_expr(this, depth + 1);
+  }
+  put(this, brackets[kind][1]);
+}
+
+static void put_atom(Tokens* this, int depth) {
+  int kind = next_random(20);
+
+  if (kind < 6) {
+    put(this, PICK(numbers));
+  } else if (kind < 10) {
+    put(this, PICK(variables));
+  } else if (kind < 14 and depth < 4) {
+    put(this, PICK(functions));
+    if (next_random(10) < 7)
+      put_group(this, depth + 1);
+    else
+      put_atom(this, depth + 1);
+  } else if (kind < 18 and depth < 4) {
+    put_group(this, depth + 1);
+  } else if (kind < 19) {
+    put(this, PICK(noise));
+  } else {
+    put(this, PICK(functions));
+  }
+}
+
+static void put_values(Tokens* this, int depth) {
+  put_atom(this, depth);
+  while (next_random(10) < 3 and depth < 5) put_atom(this, depth);
+}
+
+static void put_expr(Tokens* this, int depth) {
+  if (next_random(10) is 0) put(this, "-");
+
+  put_values(this, depth);
+  while (next_random(20) < 9 and depth < 5) {
+    put(this, PICK(operators));
+    put_values(this, depth + 1);
+  }
+}
+
+static void put_soup(Tokens* this) {
+  int count = 1 + next_random(12);
+  for (int i = 0; i < count; i++) {
+    int kind = next_random(4);
+    if (kind is 0) put(this, PICK(numbers));
+    if (kind is 1) put(this, PICK(variables));
+    if (kind is 2) put(this, PICK(operators));
+    if (kind is 3) put(this, PICK(noise));
+  }
+}
+
+// Token dropped or some noise put in
+static void mutate(Tokens* this) {
+  int count = 1 + next_random(3);
+  for (int i = 0; i < count and this->length > 0; i++) {
+    int index = next_random(this->length);
+
+    if (next_random(2) is 0) {
+      memmove(&this->items[index], &this->items[index + 1],
+              sizeof(const char*) * (this->length - index - 1));
+      this->length--;
+    } else if (this->length < MAX_TOKENS) {
+      memmove(&this->items[index + 1], &this->items[index],
+              sizeof(const char*) * (this->length - index));
+      this->items[index] = PICK(noise);
+      this->length++;
+    }
+  }
+}
+
+static bool is_word_char(char c) {
+  return (c >= 'a' and c <= 'z') or (c >= '0' and c <= '9') or c is '.';
+}
+
+// Spaces are random, but words stay apart. And there is never a dot right
+// after a minus, the tokenizer takes it for a number.
+static void join(const Tokens* this, char* text) {
+  size_t length = 0;
+  text[0] = '\0';
+
+  for (int i = 0; i < this->length; i++) {
+    const char* token = this->items[i];
+    if (token[0] is '.' and i > 0 and strcmp(this->items[i - 1], "-") is 0)
+      length += sprintf(&text[length], " 1");
+
+    char last = length > 0 ? text[length - 1] : ' ';
+    int spaces = next_random(3);
+    if (is_word_char(last) and is_word_char(token[0]) and spaces is 0)
+      spaces = 1;
+
+    length += sprintf(&text[length], "%.*s%s", spaces, "  ", token);
+  }
+}
+
+// Brackets with other brackets and commas inside, but nothing else, like
+// `(())` or `(,)`, closed or not. Parsers are known to treat those
+// differently.
+static bool is_hollow(const char* text) {
+  int depth = 0;
+  bool has_value[MAX_TOKENS] = {false};  // At every depth
+  bool has_inner[MAX_TOKENS] = {false};
+
+  for (const char* c = text; *c; c++) {
+    if (strchr("([{", *c)) {
+      depth++;
+      has_value[depth] = false;
+      has_inner[depth] = false;
+    } else if (strchr(")]}", *c)) {
+      if (depth is 0) return false;  // Error either way
+      if (has_inner[depth] and not has_value[depth]) return true;
+      depth--;
+      has_inner[depth] = true;
+    } else if (*c is ',') {
+      has_inner[depth] = true;
+    } else if (*c is_not ' ') {
+      for (int i = 0; i <= depth; i++) has_value[i] = true;
+    }
+  }
+
+  for (; depth > 0; depth--) {
+    if (has_inner[depth] and not has_value[depth]) return true;
+    has_inner[depth - 1] = true;
+  }
+  return false;
+}
+
+static void check_random_texts(ExprContext ctx, int count) {
+  static char text[MAX_TOKENS * 8];
+  static Tokens tokens;
+
+  for (int i = 0; i < count; i++) {
+    tokens.length = 0;
+
+    int kind = next_random(10);
+    if (kind < 6) {
+      put_expr(&tokens, 0);
+    } else if (kind < 8) {
+      put_soup(&tokens);
+    } else {
+      put_expr(&tokens, 0);
+      mutate(&tokens);
+    }
+
+    join(&tokens, text);
+    if (not is_hollow(text)) check(ctx, text, false);
+  }
+}
+
+// =====
+// =
+// = Statements
+// =
+// =====
+
+#define ERROR -1
+
+typedef struct Statement {
+  const char* text;
+  int type;  // Or ERROR
+} Statement;
+
+// Head counts only if its `=` is the operator of the whole statement
+static const Statement statements[] = {
+    {"v = 1", CALC_EXPR_VARIABLE},
+    {"v = x == 1", CALC_EXPR_VARIABLE},
+    {"v == x + 1", CALC_EXPR_VARIABLE},
+    {"v == x < 1", CALC_EXPR_PLOT},
+    {"v = u = 1", CALC_EXPR_PLOT},
+    {"v = 1, 2", CALC_EXPR_PLOT},
+    {"v = 1,", CALC_EXPR_VARIABLE},
+    {"v = (1, 2)", CALC_EXPR_VARIABLE},
+    {"v = 2 sin x", CALC_EXPR_VARIABLE},
+    {"v() = 1", CALC_EXPR_VARIABLE},
+    {"v =", ERROR},
+    {"v := 1", ERROR},
+    {"c = 1", CALC_EXPR_PLOT},
+    {"x = 1", CALC_EXPR_PLOT},
+    {"p(a, b) = a + b", CALC_EXPR_FUNCTION},
+    {"p[a] = a", CALC_EXPR_FUNCTION},
+    {"p(a,) = a", CALC_EXPR_FUNCTION},
+    {"p(sin) = sin * 2", CALC_EXPR_FUNCTION},
+    {"p(a) = (a = 1)", CALC_EXPR_FUNCTION},
+    {"p(,a) = a", ERROR},
+    {"p(a b) = a", CALC_EXPR_PLOT},
+    {"p(1) = 1", CALC_EXPR_PLOT},
+    {"f(a) = a", CALC_EXPR_PLOT},
+    {"x^2 + y^2 = 1", CALC_EXPR_PLOT},
+};
+
+static void check_statements(ExprContext ctx) {
+  for (int i = 0; i < (int)LEN(statements); i++) {
+    const Statement* statement = &statements[i];
+    CalcExprResult res = calc_expr_parse(ctx, statement->text);
+
+    int type = res.is_ok ? res.ok.type : ERROR;
+    CHECK(failures, type is statement->type, "'%s': type %d, expected %d",
+          statement->text, type, statement->type);
+
+    if (res.is_ok)
+      calc_expr_free(res.ok);
+    else
+      str_free(res.err_text);
+  }
+}
+
+int main() {
+  CalcBackend backend = calc_backend_create();
+  for (int i = 0; i < (int)LEN(definitions); i++)
+    str_free(calc_backend_add_expr(&backend, definitions[i]));
+  ExprContext ctx = calc_backend_get_context(&backend);
+
+  for (int i = 0; i < (int)LEN(written); i++) check(ctx, written[i], true);
+  check_random_texts(ctx, 200000);
+  check_statements(ctx);
+
+  calc_backend_free(backend);
+  printf("parse_diff: %ld texts (%ld parsed), %d failed\n", checked, parsed,
+         failures);
+  return failures > 0;
+}
@@ -0,0 +1,198 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util/parse_number.h"
+#include "../util/prettify_c.h"
+#include "tests.h"
+
+// `parse_double` against `strtod`: both the number and the count of
+// characters read have to be the same. Texts start with a digit or a dot and
+// are not hex, since that is all the tokenizer gives it.
+
+static int failures = 0;
+static long checked = 0;
+
+static void check(const char* text) {
+  int length = -1;
+  double number = parse_double(text, &length);
+
+  char* end = null;
+  double expected = strtod(text, &end);
+  int expected_length = (int)(end - text);
+
+  checked++;
+  CHECK(failures,
+        length is expected_length and
+            (length is 0 or memcmp(&number, &expected, sizeof(double)) is 0),
+        "'%.100s': got %.17g (%d chars), strtod gives %.17g (%d chars)", text,
+        number, length, expected, expected_length);
+}
+
+static uint64_t random_state = 88172645463325252ull;
+static uint64_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+// =====
+// =
+// = Texts
+// =
+// =====
+
+// Every text up to `max_length` characters from `alphabet`
+static void check_all_texts(const char* alphabet, char* text, int length,
+                            int max_length) {
+  if (length > 0 and (text[0] is '.' or (text[0] >= '0' and text[0] <= '9')))
+    check(text);
+  if (length is max_length) return;
+
+  for (const char* c = alphabet; *c; c++) {
+    text[length] = *c;
+    text[length + 1] = '\0';
+    check_all_texts(alphabet, text, length + 1, max_length);
+  }
+  text[length] = '\0';
+}
+
+static void check_integers_and_grid() {
+  char text[64];
+  for (long i = 0; i < (1 << 20); i++) {
+    sprintf(text, "%ld", i);
+    check(text);
+  }
+
+  for (long i = 0; i < 20000; i++) {
+    for (int exponent = -345; exponent <= 310; exponent += 37) {
+      sprintf(text, "%ld.%03lde%d", i / 1000, i % 1000, exponent);
+      check(text);
+    }
+  }
+}
+
+// Random doubles printed with 1 to 17 digits, and the exact points halfway
+// between neighbouring doubles, which are the hardest to round: as is, a bit
+// above, a bit below and cut after 20 to 40 digits
+static void check_random_doubles(int count) {
+  char text[1200];
+  char halfway[1024];
+
+  for (int i = 0; i < count; i++) {
+    uint64_t bits = next_random() & 0x7FFFFFFFFFFFFFFFull;
+    double number = 0.0;
+    memcpy(&number, &bits, sizeof(number));
+    if (not isfinite(number)) continue;
+
+    for (int digits = 1; digits <= 17; digits++) {
+      sprintf(text, "%.*e", digits - 1, number);
+      check(text);
+    }
+
+    double next = nextafter(number, INFINITY);
+    if (not isfinite(next)) continue;
+
+    // Long double has enough bits for the exact middle, and printf prints it
+    // exactly
+    long double middle =
+        (long double)number + ((long double)next - (long double)number) / 2;
+    sprintf(halfway, "%.780Le", middle);
+
+    char* exponent = strchr(halfway, 'e');
+    char exponent_text[16];
+    strcpy(exponent_text, exponent);
+    int length = (int)(exponent - halfway);
+    while (halfway[length - 1] is '0') length--;
+    halfway[length] = '\0';
+
+    sprintf(text, "%s%s", halfway, exponent_text);
+    check(text);
+    sprintf(text, "%s1%s", halfway, exponent_text);
+    check(text);
+
+    if (length > 3 and halfway[length - 1] > '0') {
+      halfway[length - 1]--;
+      sprintf(text, "%s999999999999%s", halfway, exponent_text);
+      check(text);
+      halfway[length - 1]++;
+    }
+
+    for (int cut = 20; cut < 42 and cut < length; cut += 3) {
+      sprintf(text, "%.*s%s", cut, halfway, exponent_text);
+      check(text);
+    }
+  }
+}
+
+// Up to 60 digits, with leading zeros, a dot anywhere and any exponent
+static void check_random_digits(int count) {
+  char text[256];
+
+  for (int i = 0; i < count; i++) {
+    int digits = 1 + next_random() % 60;
+    int dot = next_random() % (digits + 2);
+    int zeros = next_random() % 4 is 0 ? next_random() % 30 : 0;
+    int length = 0;
+
+    for (int j = 0; j < zeros; j++) text[length++] = '0';
+    for (int j = 0; j < digits; j++) {
+      if (j is dot) text[length++] = '.';
+      text[length++] = '0' + next_random() % 10;
+    }
+    if (next_random() % 2)
+      length += sprintf(&text[length], "e%d", (int)(next_random() % 700) - 360);
+    text[length] = '\0';
+
+    check(text);
+  }
+}
+
+static void check_edges() {
+  const char* const texts[] = {
+      "4.9406564584124654e-324",  // Smallest subnormal
+      "2.4703282292062327e-324",  // Just below a half of it
+      "2.4703282292062328e-324",
+      "2.2250738585072011e-308",  // Largest subnormal
+      "2.2250738585072014e-308",  // Smallest normal
+      "1.7976931348623157e308",   // Largest double
+      "1.7976931348623158e308",
+      "1.7976931348623159e308",   // Rounds to infinity
+      "9007199254740993",         // 2^53 + 1
+      "9007199254740992.5",
+      "9007199254740993.0000000000000000001",
+      "1e-400",
+      "1e400",
+      "0e999999999999999999999",
+      "1e-99999999999999999",
+      "1e99999999999999999999",
+      "123456789012345678901234567890e-50",
+      "00000000000000000000000000000000001",
+      "0.000000000000000000000000000000000000000000001e45",
+      "5.",
+      ".5",
+      ".e1",
+      "..",
+      "1e+",
+      "1e-x",
+      "1ex",
+      "1.5e",
+  };
+
+  for (int i = 0; i < (int)LEN(texts); i++) check(texts[i]);
+}
+
+int main() {
+  char text[16] = {0};
+  check_all_texts("059.eE+-", text, 0, 7);
+  check_integers_and_grid();
+  check_random_doubles(50000);
+  check_random_digits(300000);
+  check_edges();
+
+  printf("parse_double: %ld texts, %d failed\n", checked, failures);
+  return failures is 0 ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#ifndef SRC_TESTS_TESTS_H_
+#define SRC_TESTS_TESTS_H_
+
+#include <stdio.h>
+#include <time.h>
+
+// Tests and benchmarks are plain programs, run by `make test` and
+// `make bench`. Tests print what failed and return non-zero.
+
+// Counts the failure and prints it, but goes on, so one run shows them all
+#define CHECK(failures, cond, ...)                                  \
+  if (not(cond)) {                                                  \
+    if ((failures)++ < 20) {                                        \
+      fprintf(stderr, "%s:%d: check failed: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);                                 \
+      fprintf(stderr, "\n");                                        \
+    }                                                               \
+  }
+
+// Seconds since some fixed moment
+static inline double bench_now() {
+  struct timespec time;
+  timespec_get(&time, TIME_UTC);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#endif  // SRC_TESTS_TESTS_H_
@@ -2,7 +2,7 @@
 
 #include <float.h>
 
-#include "../calculator/calc_backend.h"
+#include "../calculator/calc_compiled.h"
 #include "../util/allocator.h"
 
 #define EDIT_FLAGS NK_EDIT_SIMPLE | NK_EDIT_SELECTABLE | NK_EDIT_CLIPBOARD
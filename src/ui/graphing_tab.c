@@ -50,6 +50,7 @@ GraphingTab* graphing_tab_create(int screen_w, int screen_h) {
       .is_dragging = false,
 
       .expressions = vec_ui_expr_create(),
+      .workspace = calc_workspace_create(),
       .icons =
           {
               load_nk_icon("assets/img/home.png"),
@@ -85,6 +86,8 @@ GraphingTab* graphing_tab_create(int screen_w, int screen_h) {
 
     debugln("Reading expression '%s'", line);
     vec_ui_expr_push(&result->expressions, ui_expr_create(line));
+    calc_workspace_insert_row(&result->workspace,
+                              result->workspace.rows.length, line);
   }
   if (exprs) fclose(exprs);
 
@@ -120,6 +123,7 @@ void graphing_tab_free(GraphingTab* this) {
   debugln("Graphing tab - freeing...");
   mesh_delete(this->square_mesh);
   vec_ui_expr_free(this->expressions);
+  calc_workspace_free(this->workspace);
 
   for (int i = 0; i < ICONS_COUNT; i++) delete_nk_icon(this->icons[i]);
 
@@ -138,20 +142,41 @@ void graphing_tab_free(GraphingTab* this) {
   debugln("Graphing tab - freeing done");
 }
 
+// Rows which were not recomputed keep drawing their shaders, so only the
+// oldest of the unused ones is deleted. There are at most half as many rows
+// as shaders, so there always is one.
+static int graphing_tab_oldest_unused_shader(GraphingTab* this) {
+  for (int i = 0; i < this->shaders_pool.length; i++) {
+    GLuint program = this->shaders_pool.data[i].shader.program;
+
+    bool is_used = false;
+    for (int j = 0; j < this->expressions.length and not is_used; j++)
+      is_used = this->expressions.data[j].plot_shader is program;
+
+    if (not is_used) return i;
+  }
+  panic("Every shader in the pool is used");
+}
+
 void graphing_tab_add_shader(GraphingTab* this, str_t name, GlProgram shader) {
   assert_m(graphing_tab_get_shader(this, name.string) is 0);
   if (this->shaders_pool.length >= GRAPHING_MAX_SHADERS) {
-    debugln("Warning: shader pool overflow, deleting oldest shader");
-    vec_NamedShader_delete_fast(&this->shaders_pool,
-                                0);  // Delete the oldest shader
+    debugln("Warning: shader pool overflow, deleting oldest unused shader");
+    vec_NamedShader_delete_order(&this->shaders_pool,
+                                 graphing_tab_oldest_unused_shader(this));
   }
-  vec_NamedShader_push(&this->shaders_pool,
-                       (NamedShader){.name = name, .shader = shader});
+  uint32_t hash = str_map_hash(str_slice_from_str_t(&name));
+  vec_NamedShader_push(
+      &this->shaders_pool,
+      (NamedShader){.name = name, .hash = hash, .shader = shader});
 }
 GLuint graphing_tab_get_shader(GraphingTab* this, const char* name) {
+  uint32_t hash = str_map_hash(str_slice_from_string(name));
+
   for (int i = 0; i < this->shaders_pool.length; i++) {
-    if (strcmp(name, this->shaders_pool.data[i].name.string) is 0)
-      return this->shaders_pool.data[i].shader.program;
+    const NamedShader* item = &this->shaders_pool.data[i];
+    if (item->hash is hash and strcmp(name, item->name.string) is 0)
+      return item->shader.program;
   }
   return 0;
 }
@@ -207,7 +232,8 @@ static void draw_exprs_ui(GraphingTab* this, struct nk_context* ctx) {
 
     nk_layout_row_push(ctx, 25);
     if (nk_button_image(ctx, this->icons[ICON_CROSS])) {
-      vec_ui_expr_delete_order(&this->expressions, i--);
+      vec_ui_expr_delete_order(&this->expressions, i);
+      calc_workspace_remove_row(&this->workspace, i--);
       graphing_tab_update_calc(this);
       continue;
     }
@@ -250,6 +276,8 @@ static void draw_exprs_ui(GraphingTab* this, struct nk_context* ctx) {
   if (this->expressions.length < (GRAPHING_MAX_SHADERS / 2) and
       nk_button_image(ctx, this->icons[ICON_PLUS])) {
     vec_ui_expr_push(&this->expressions, ui_expr_create(""));
+    calc_workspace_insert_row(&this->workspace, this->workspace.rows.length,
+                              "");
     graphing_tab_update_calc(this);
   }
 }
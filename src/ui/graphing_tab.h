@@ -5,9 +5,11 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include "../calculator/calc_workspace.h"
 #include "../nuklear_flags.h"
 #include "../util/camera.h"
 #include "../util/mesh.h"
+#include "../util/str_map.h"
 #include "framebuffer.h"
 #include "shader_loader.h"
 #include "ui_expr.h"
@@ -21,8 +23,11 @@
 
 #define GRAPHING_MAX_SHADERS 10000
 
+// Shaders are found by their whole source. Sources start with the same
+// helper functions, so the hash is compared first.
 typedef struct NamedShader {
   str_t name;
+  uint32_t hash;  // `str_map_hash` of the name
   GlProgram shader;
 } NamedShader;
 
@@ -47,6 +52,7 @@ typedef struct GraphingTab {
   PlotCamera camera;
 
   vec_ui_expr expressions;
+  CalcWorkspace workspace;  // One row per item of `expressions`
 
   struct nk_image icons[ICONS_COUNT];
 
@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "../calculator/calc_backend.h"
+#include "../calculator/calc_workspace.h"
 #include "../glsl_compiler/glsl_compiler.h"
 #include "../util/allocator.h"
 #include "graphing_tab.h"
@@ -13,110 +13,106 @@ static str_t copy_from_nk_textedit(struct nk_text_edit* textedit) {
   return str_owned("%.*s", length, text);
 }
 
-void graphing_tab_update_calc(GraphingTab* this) {
-  CalcBackend calc = calc_backend_create();
+static GLuint compile_plot_shader(GraphingTab* this, CalcBackend* prefix,
+                                  const CalcExpr* plot, str_t* error) {
+  // Own context per plot, so the shader only contains functions it needs, and
+  // does not depend on plots above it
+  GlslContext glsl = glsl_context_create();
 
-  vec_Plot_free(this->plots);
-  this->plots = vec_Plot_create();
+  ExprContext ctx = calc_backend_get_context(prefix);
+  vec_Symbol used_args = vec_Symbol_create();
+  StrResult code =
+      glsl_compile_body(ctx, &glsl, &plot->expression, &used_args);
+  vec_Symbol_free(used_args);
+
+  if (not code.is_ok) {
+    debugln("Failed to compile to GLSL cuz: %s", code.data.string);
+    glsl_context_free(glsl);
+    *error = code.data;
+    return 0;
+  }
 
-  // 1. Delete old shaders. (TODO: add shaders caching to not recompile those
-  // every time)
-  GlslContext glsl = glsl_context_create();
+  // debugln("1. Combine into full shader code");
+  StringStream string_stream = string_stream_create();
+  OutStream stream = string_stream_stream(&string_stream);
 
-  for (int i = 0; i < this->expressions.length; i++) {
-    ui_expr* item = &this->expressions.data[i];
-    bool are_only_spaces = true;
-    const char* nk_buffer = nk_str_get_const(&item->textedit.string);
-    int length = nk_str_len(&item->textedit.string);
+  outstream_puts(this->plot_exprs_base.string, stream);
+  outstream_puts("\n", stream);
+  glsl_context_print_all_functions(&glsl, stream);
 
-    for (int i = 0; i < length and are_only_spaces; i++)
-      if (nk_buffer[i] is_not ' ') are_only_spaces = false;
+  outstream_puts("\n\nfloat function(vec2 pos, vec2 step) {\n", stream);
+  outstream_puts(code.data.string, stream);
+  outstream_puts("\n}\n", stream);
 
-    if (are_only_spaces) {
-      str_free(item->descr_text);
-      item->descr_text = str_literal("");
-      continue;
-    }
+  str_free(code.data);
+  glsl_context_free(glsl);
+  str_t shader_src = string_stream_to_str_t(string_stream);
 
-    str_t buffer = copy_from_nk_textedit(&item->textedit);
+  // debugln("2. Check if already exists");
+  GLuint shader = graphing_tab_get_shader(this, shader_src.string);
+  if (shader) {
+    str_free(shader_src);
+    return shader;
+  }
 
-    // ADD ITEM
-    // debugln("Adding expr: %s", buffer.string);
-    // debug_push();
+  // debugln("3. Compile and add the shader");
+  Shader sh_compiled =
+      shader_from_source(GL_FRAGMENT_SHADER, shader_src.string);
+  GlProgram pr_compiled =
+      gl_program_from_2_shaders(&this->common_vert, &sh_compiled);
+  shader_free(sh_compiled);
 
-    int prev_length = calc.expressions.length;
-    str_t message = calc_backend_add_expr(&calc, buffer.string);
+  debugln("Compiled shader for expr: '%$expr'", plot->expression);
+  graphing_tab_add_shader(this, shader_src, pr_compiled);
+  return pr_compiled.program;
+}
 
-    // debug_pop();
-    //    debugln("Adding done (%s).", message.string);
-    str_free(buffer);
-    str_free(item->descr_text);
-    item->descr_text = message;
+static void on_row_recomputed(void* data, int row_index,
+                              const CalcWorkspaceRow* row,
+                              CalcBackend* prefix) {
+  GraphingTab* this = (GraphingTab*)data;
+  ui_expr* item = &this->expressions.data[row_index];
 
-    CalcExpr* last_expr = calc_backend_last_expr(&calc);
+  str_free(item->descr_text);
+  item->descr_text = str_clone(&row->message);
+  item->plot_shader = 0;
 
-    if (last_expr and prev_length != calc.expressions.length) {
-      // debugln("Successfully CalcExpr '%$calc_expr' of type %s",
-      // &last_expr->expression, calc_expr_type_text(last_expr->type));
+  if (row->expr_index < 0) return;
+  const CalcExpr* expr = &prefix->expressions.data[row->expr_index];
+  if (expr->type is_not CALC_EXPR_PLOT) return;
 
-      if (last_expr->type is CALC_EXPR_PLOT) {
-        debugln("Adding a plot");
-        // debugln("0. Compile to glsl");
+  debugln("Adding a plot");
+  str_t error = str_literal("");
+  item->plot_shader = compile_plot_shader(this, prefix, expr, &error);
 
-        ExprContext ctx = calc_backend_get_context(&calc);
-        vec_str_t used_args = vec_str_t_create();
-        StrResult code = glsl_compile_expression(
-            ctx, &glsl, &last_expr->expression, &used_args);
-        vec_str_t_free(used_args);
-
-        if (code.is_ok) {
-          // debugln("1. Combine into full shader code");
-          StringStream string_stream = string_stream_create();
-          OutStream stream = string_stream_stream(&string_stream);
-
-          outstream_puts(this->plot_exprs_base.string, stream);
-          outstream_puts("\n", stream);
-          glsl_context_print_all_functions(&glsl, stream);
-
-          outstream_puts("\n\nfloat function(vec2 pos, vec2 step) {\n return ",
-                         stream);
-          outstream_puts(code.data.string, stream);
-          outstream_puts(";\n}\n", stream);
-
-          str_free(code.data);
-          str_t shader_src = string_stream_to_str_t(string_stream);
-
-          // debugln("2. Check if already exists");
-          GLuint shader = graphing_tab_get_shader(this, shader_src.string);
-          if (shader) {
-            str_free(shader_src);
-          } else {
-            // debugln("3. Compile and add the shader");
-
-            Shader sh_compiled =
-                shader_from_source(GL_FRAGMENT_SHADER, shader_src.string);
-            GlProgram pr_compiled =
-                gl_program_from_2_shaders(&this->common_vert, &sh_compiled);
-            shader_free(sh_compiled);
-
-            debugln("Compiled shader for expr: '%$expr'",
-                    last_expr->expression);
-            graphing_tab_add_shader(this, shader_src, pr_compiled);
-            shader = pr_compiled.program;
-          }
-          vec_Plot_push(&this->plots,
-                        (Plot){.expr_id = i, .shader_id = shader});
-        } else {
-          debugln("Failed to compile to GLSL cuz: %s", code.data.string);
-          str_free(item->descr_text);
-          item->descr_text = code.data;
-        }
-      }
-    }
+  if (not item->plot_shader) {
+    str_free(item->descr_text);
+    item->descr_text = error;
+  } else {
+    str_free(error);
   }
+}
 
-  glsl_context_free(glsl);
-  calc_backend_free(calc);
+void graphing_tab_update_calc(GraphingTab* this) {
+  // 1. Only rows with changed text, and rows depending on them, are parsed
+  // and compiled again
+  for (int i = 0; i < this->expressions.length; i++) {
+    str_t text = copy_from_nk_textedit(&this->expressions.data[i].textedit);
+    calc_workspace_set_row(&this->workspace, i, text.string);
+    str_free(text);
+  }
+
+  calc_workspace_recompute(&this->workspace, on_row_recomputed, this);
+
+  // 2. Plots of all the rows, recomputed or not
+  vec_Plot_free(this->plots);
+  this->plots = vec_Plot_create();
+
+  for (int i = 0; i < this->expressions.length; i++) {
+    GLuint shader = this->expressions.data[i].plot_shader;
+    if (shader)
+      vec_Plot_push(&this->plots, (Plot){.expr_id = i, .shader_id = shader});
+  }
 }
 
 void ui_expr_update(GraphingTab* gt, ui_expr_t* this) {
@@ -153,10 +149,10 @@ void ui_expr_update(GraphingTab* gt, ui_expr_t* this) {
         debug_push();
 
         ExprContext ctx = calc_backend_get_context(&this->calc);
-        vec_str_t used_args = vec_str_t_create();
+        vec_Symbol used_args = vec_Symbol_create();
         StrResult res = glsl_compile_expression(
             ctx, &glsl, &last_expr->expression, &used_args);
-        vec_str_t_free(used_args);
+        vec_Symbol_free(used_args);
 
         debug_pop();
         debugln("Conversion done");
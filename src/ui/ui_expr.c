@@ -17,6 +17,7 @@ ui_expr_t ui_expr_create(const char* text) {
       .color = {.r = 0.8, .g = 0.2, .b = 0.1, .a = 1.0},
       .prev_active = false,
       .descr_text = str_literal("Faz balls"),
+      .plot_shader = 0,
   };
 
   nk_textedit_init_default(&this.textedit);
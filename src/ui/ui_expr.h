@@ -14,6 +14,7 @@ typedef struct ui_expr {
   const char* prev_buffer;
 
   str_t descr_text;
+  unsigned int plot_shader;  // 0 if the row is not a plot
 } ui_expr_t;
 ui_expr_t ui_expr_create(const char* text);
 void ui_expr_free(ui_expr_t this);
@@ -1,79 +1,203 @@
 #include "allocator.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "prettify_c.h"
 
-#undef VECTOR_MALLOC_FN
-#undef VECTOR_FREE_FN
-#undef VECTOR_REALLOC_FN
-#define VECTOR_C MemRegion
-#include "vector.h"
+static Arena* bound_arena = null;
 
-static vec_MemRegion regions = {.data = null, .capacity = 0, .length = 0};
+Arena* my_allocator_bind_arena(Arena* arena) {
+  Arena* prev = bound_arena;
+  bound_arena = arena;
+  return prev;
+}
+
+#ifdef ALLOCATOR_SYSTEM
+
+// =====
+// =
+// = SYSTEM ALLOCATOR (no tracking)
+// =
+// =====
+void* my_malloc(size_t size) {
+  if (bound_arena) return arena_alloc(bound_arena, size);
+  return malloc(size);
+}
+
+void* my_realloc(void* mem, size_t size) {
+  if (bound_arena and mem and arena_owns(bound_arena, mem))
+    return arena_realloc(bound_arena, mem, size);
+  if (not mem) return my_malloc(size);
+  return realloc(mem, size);
+}
+
+void my_free(void* mem) {
+  if (bound_arena and mem and arena_owns(bound_arena, mem)) return;
+  free(mem);
+}
+
+void my_allocator_free() {}
+
+void my_allocator_dump() {
+  debugln("Allocator tracking is disabled (ALLOCATOR_SYSTEM)");
+}
+
+void my_allocator_dump_short() { my_allocator_dump(); }
+
+#else
+
+// =====
+// =
+// = TRACKED ALLOCATOR
+// =
+// =====
+// Live regions are kept in an open addressing hash table keyed by pointer
+// (linear probing, null `ptr` is an empty slot), so lookups are O(1).
+#define REGIONS_MIN_CAPACITY 64
+
+static MemRegion* regions = null;
+static int regions_capacity = 0;  // Always 0 or a power of two
+static int regions_length = 0;
+
+static uint32_t region_slot(const void* ptr) {
+  uint64_t hash = (uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull;
+  return (uint32_t)(hash >> 32) & (uint32_t)(regions_capacity - 1);
+}
+
+// Returns the slot with `ptr`, or the empty slot where it should be put
+static MemRegion* regions_find(const void* ptr) {
+  uint32_t mask = (uint32_t)regions_capacity - 1;
+
+  for (uint32_t i = region_slot(ptr);; i = (i + 1) & mask)
+    if (regions[i].ptr is null or regions[i].ptr == ptr) return &regions[i];
+}
+
+static void regions_grow() {
+  MemRegion* old = regions;
+  int old_capacity = regions_capacity;
+
+  regions_capacity = old_capacity > 0 ? old_capacity * 2 : REGIONS_MIN_CAPACITY;
+  regions = (MemRegion*)calloc(regions_capacity, sizeof(MemRegion));
+  assert_alloc(regions);
+
+  for (int i = 0; i < old_capacity; i++)
+    if (old[i].ptr) *regions_find(old[i].ptr) = old[i];
+
+  free(old);
+}
+
+static void regions_insert(MemRegion region) {
+  // Keep load factor under 1/2
+  if ((regions_length + 1) * 2 > regions_capacity) regions_grow();
+
+  *regions_find(region.ptr) = region;
+  regions_length++;
+}
+
+// Backward shift deletion: moves later entries of the same probe sequence
+// into the hole, so no tombstones are needed
+static void regions_remove(MemRegion* slot) {
+  uint32_t mask = (uint32_t)regions_capacity - 1;
+  uint32_t hole = (uint32_t)(slot - regions);
+
+  for (uint32_t i = (hole + 1) & mask; regions[i].ptr; i = (i + 1) & mask) {
+    uint32_t home = region_slot(regions[i].ptr);
+
+    // Entry can move into the hole only if hole is between home and i
+    bool can_move = hole <= i ? (home <= hole or home > i)
+                              : (home <= hole and home > i);
+    if (can_move) {
+      regions[hole] = regions[i];
+      hole = i;
+    }
+  }
+
+  regions[hole] = (MemRegion){.ptr = null, .size = 0};
+  regions_length--;
+}
+
+static MemRegion* regions_get(const void* ptr) {
+  if (regions_length is 0) return null;
+
+  MemRegion* slot = regions_find(ptr);
+  return slot->ptr ? slot : null;
+}
 
 void my_allocator_free() {
-  for (int i = 0; i < regions.length; i++) {
+  for (int i = 0; i < regions_capacity; i++) {
+    if (regions[i].ptr is null) continue;
+
     debugln("Non freed allocation at %p for %d bytes. Freeing forcibly...",
-            regions.data[i].ptr, (int)regions.data[i].size);
-    free(regions.data[i].ptr);
+            regions[i].ptr, (int)regions[i].size);
+    free(regions[i].ptr);
   }
-  vec_MemRegion_free(regions);
-  regions = vec_MemRegion_create();
+
+  free(regions);
+  regions = null;
+  regions_capacity = 0;
+  regions_length = 0;
 }
 
 void* my_malloc(size_t size) {
+  if (bound_arena) return arena_alloc(bound_arena, size);
+
   MemRegion r = {
       .ptr = malloc(size),
       .size = size,
   };
-  vec_MemRegion_push(&regions, r);
+  if (r.ptr) regions_insert(r);
   // debugln("Alloc for %ld at %p", (long)r.size, r.ptr);
   return r.ptr;
 }
 
 void* my_realloc(void* mem, size_t size) {
+  // Heap memory stays on the heap, even while an arena is bound
+  if (bound_arena and mem and arena_owns(bound_arena, mem))
+    return arena_realloc(bound_arena, mem, size);
+
   if (mem) {
-    for (int i = 0; i < regions.length; i++) {
-      if (regions.data[i].ptr == mem) {
-        void* new_mem = realloc(mem, size);
-        // debugln("Realloc %p with %ld bytes into %p with %ld bytes",
-        // regions.data[i].ptr, (long)regions.data[i].size, new_mem,
-        // (long)size);
-        regions.data[i].ptr = new_mem;
-        regions.data[i].size = size;
-        return new_mem;
-      }
+    MemRegion* region = regions_get(mem);
+    if (not region) panic("Unknown realloc pointer: %p", mem);
+
+    void* new_mem = realloc(mem, size);
+    // debugln("Realloc %p with %ld bytes into %p with %ld bytes",
+    // region->ptr, (long)region->size, new_mem, (long)size);
+    if (new_mem is mem) {
+      region->size = size;
+    } else if (new_mem) {
+      regions_remove(region);
+      regions_insert((MemRegion){.ptr = new_mem, .size = size});
     }
-
-    panic("Unknown realloc pointer: %p", mem);
+    return new_mem;
   } else {
     return my_malloc(size);
   }
 }
+
 void my_free(void* mem) {
   if (not mem) return;
+  if (bound_arena and arena_owns(bound_arena, mem)) return;
 
-  for (int i = 0; i < regions.length; i++) {
-    if (regions.data[i].ptr == mem) {
-      // debugln("Free of %p", mem);
-      free(mem);
-      vec_MemRegion_delete_fast(&regions, i);
-      return;
-    }
+  MemRegion* region = regions_get(mem);
+  if (region) {
+    // debugln("Free of %p", mem);
+    regions_remove(region);
+  } else {
+    debugln("Unknown free pointer: %p", mem);
   }
-
-  debugln("Unknown free pointer: %p", mem);
   free(mem);
 }
 
 void my_allocator_dump() {
-  debugln("Allocator has %d active memory regions (cap %d):", regions.length,
-          regions.capacity);
+  debugln("Allocator has %d active memory regions (cap %d):", regions_length,
+          regions_capacity);
 
-  for (int i = 0; i < regions.length; i++) {
-    debugc("Ptr: %p | Size: %d\n", regions.data[i].ptr,
-           (int)regions.data[i].size);
+  for (int i = 0; i < regions_capacity; i++) {
+    if (regions[i].ptr is null) continue;
+    debugc("Ptr: %p | Size: %d\n", regions[i].ptr, (int)regions[i].size);
   }
 
   debugln("Allocator dump done");
@@ -82,9 +206,12 @@ void my_allocator_dump() {
 void my_allocator_dump_short() {
   size_t sum_size = 0;
 
-  for (int i = 0; i < regions.length; i++) sum_size += regions.data[i].size;
+  for (int i = 0; i < regions_capacity; i++)
+    if (regions[i].ptr) sum_size += regions[i].size;
 
   debugln(
       "Allocator has %d(/%d) active memory regions for the total size of %ld",
-      regions.length, regions.capacity, (long)sum_size);
-}
\ No newline at end of file
+      regions_length, regions_capacity, (long)sum_size);
+}
+
+#endif
@@ -4,14 +4,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+// By default every allocation is tracked, so leaks can be dumped. Build with
+// `make ALLOCATOR=system` (defines ALLOCATOR_SYSTEM) to skip the tracking and
+// call the system allocator directly.
+
 typedef struct MemRegion {
   void* ptr;
   size_t size;
 } MemRegion;
 
-#define VECTOR_H MemRegion
-#include "vector.h"
-
 #undef VECTOR_MALLOC_FN
 #undef VECTOR_REALLOC_FN
 #undef VECTOR_FREE_FN
@@ -20,6 +21,10 @@ void* my_malloc(size_t size);
 void* my_realloc(void* mem, size_t size);
 void my_free(void* mem);
 
+// Until unbound, all the allocations go to `arena` (null to unbind). Returns
+// the previously bound arena
+struct Arena* my_allocator_bind_arena(struct Arena* arena);
+
 void my_allocator_dump();
 void my_allocator_free();
 void my_allocator_dump_short();
@@ -0,0 +1,87 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prettify_c.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 4096
+
+// Every allocation is prefixed with its size, so it can be reallocated
+#define ARENA_HEADER ARENA_ALIGN
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char* block_data(ArenaBlock* block) {
+  return (char*)block + align_up(sizeof(ArenaBlock));
+}
+
+Arena arena_create() { return (Arena){.last = null}; }
+
+void arena_free(Arena this) {
+  while (this.last) {
+    ArenaBlock* prev = this.last->prev;
+    free(this.last);
+    this.last = prev;
+  }
+}
+
+void* arena_alloc(Arena* this, size_t size) {
+  size_t needed = ARENA_HEADER + align_up(size);
+
+  if (not this->last or this->last->used + needed > this->last->capacity) {
+    size_t capacity = this->last ? this->last->capacity * 2 : ARENA_MIN_BLOCK;
+    while (capacity < needed) capacity *= 2;
+
+    // Not MALLOC: it may be redirected into this very arena
+    ArenaBlock* block =
+        (ArenaBlock*)malloc(align_up(sizeof(ArenaBlock)) + capacity);
+    assert_alloc(block);
+
+    *block = (ArenaBlock){.prev = this->last, .capacity = capacity, .used = 0};
+    this->last = block;
+  }
+
+  char* chunk = block_data(this->last) + this->last->used;
+  *(size_t*)chunk = size;
+  this->last->used += needed;
+
+  return chunk + ARENA_HEADER;
+}
+
+void* arena_realloc(Arena* this, void* mem, size_t size) {
+  if (not mem) return arena_alloc(this, size);
+
+  size_t* old_size = (size_t*)((char*)mem - ARENA_HEADER);
+  ArenaBlock* block = this->last;
+  char* data = block_data(block);
+
+  bool is_last = (char*)mem >= data and
+                 (char*)mem + align_up(*old_size) is data + block->used;
+  if (is_last) {
+    size_t offset = (char*)mem - data;
+
+    if (offset + align_up(size) <= block->capacity) {
+      block->used = offset + align_up(size);
+      *old_size = size;
+      return mem;
+    }
+  }
+
+  void* new_mem = arena_alloc(this, size);
+  memcpy(new_mem, mem, *old_size < size ? *old_size : size);
+  return new_mem;
+}
+
+bool arena_owns(const Arena* this, const void* mem) {
+  for (ArenaBlock* block = this->last; block; block = block->prev) {
+    const char* data = block_data(block);
+    if ((const char*)mem >= data and (const char*)mem < data + block->used)
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,33 @@
+#ifndef SRC_UTIL_ARENA_H_
+#define SRC_UTIL_ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bump allocator. Allocations are never freed one by one, the whole arena is
+// released at once by `arena_free`.
+// Bind it with `my_allocator_bind_arena` to make MALLOC/REALLOC/FREE (and so
+// all the vectors, strings and expressions) allocate from it. While bound,
+// FREE of arena memory does nothing. Arena memory must not be passed to
+// FREE/REALLOC after it is unbound.
+
+typedef struct ArenaBlock {
+  struct ArenaBlock* prev;
+  size_t capacity;
+  size_t used;
+} ArenaBlock;
+
+typedef struct Arena {
+  ArenaBlock* last;  // null if nothing was allocated yet
+} Arena;
+
+Arena arena_create();
+void arena_free(Arena this);
+
+void* arena_alloc(Arena* this, size_t size);
+// `mem` has to be from this arena. Grows in place if it is the last
+// allocation, otherwise copies
+void* arena_realloc(Arena* this, void* mem, size_t size);
+bool arena_owns(const Arena* this, const void* mem);
+
+#endif  // SRC_UTIL_ARENA_H_
@@ -31,8 +31,12 @@ static const char* next_item(const char* format) {
 static const char* put_format(OutStream stream, const char* format,
                               va_list* list, int* total_written);
 
-void x_vprintf(OutStream stream, const char* format, va_list list) {
+void x_vprintf(OutStream stream, const char* format, va_list source_list) {
   const char* next = format;
+  // va_list may be an array type (SysV ABI), so work on a local copy that can
+  // be safely passed around by pointer
+  va_list list;
+  va_copy(list, source_list);
 
   int total_written = 0;
 
@@ -53,6 +57,7 @@ void x_vprintf(OutStream stream, const char* format, va_list list) {
       }
     }
   }
+  va_end(list);
 }
 
 typedef struct Specificator {
@@ -102,9 +107,19 @@ static const char* put_format(OutStream stream, const char* format,
              (FORMAT_BUF_SIZE - 1)) char format_buf[BUFFER_SIZE] = {'\0'};
     strncpy(format_buf, format, info.symbols_count + 1);
 
-    vsprintf(buffer, format_buf, *list);
-
-    if (strcmp(info.length_mod, "l") is 0) {
+    va_list list_copy;
+    va_copy(list_copy, *list);
+    vsprintf(buffer, format_buf, list_copy);
+    va_end(list_copy);
+
+    if (strchr("fFeEgGaA", info.type)) {
+      if (strcmp(info.length_mod, "L") is 0)
+        va_arg(*list, long double);
+      else
+        va_arg(*list, double);
+    } else if (info.type is 'p') {
+      va_arg(*list, void*);
+    } else if (strcmp(info.length_mod, "l") is 0) {
       va_arg(*list, long);
     } else if (strcmp(info.length_mod, "ll") is 0) {
       va_arg(*list, long long);
@@ -115,7 +130,7 @@ static const char* put_format(OutStream stream, const char* format,
     } else if (strcmp(info.length_mod, "t") is 0) {
       va_arg(*list, ptrdiff_t);
     } else if (strcmp(info.length_mod, "LL") is 0) {
-      va_arg(*list, __int64);
+      va_arg(*list, int64_t);
     } else {
       va_arg(*list, int);
     }
@@ -127,21 +142,30 @@ static const char* put_format(OutStream stream, const char* format,
   return format + 1 + (info.symbols_count is 0 ? 1 : info.symbols_count);
 }
 
+// Same as `MIN(strlen(string), max)`, but does not look further than `max`.
+// Slices often point into a long text, and `strlen` of all of it is slow.
+static int slice_strlen(const char* string, int max) {
+  if (max <= 0) return max;
+
+  const char* end = (const char*)memchr(string, '\0', max);
+  return end ? (int)(end - string) : max;
+}
+
 static void put_string_fmt(OutStream stream, Specificator info,
                            const char* format, va_list* list,
                            int* total_written) {
   unused(format);
   if (info.precision > 0) {
     char* string = va_arg(*list, char*);
+    int length = slice_strlen(string, info.precision);
 
-    outstream_put_slice(string, info.precision, stream);
-    (*total_written) +=
-        info.precision is 0 ? 0 : MIN((int)strlen(string), info.precision);
+    outstream_put_slice(string, length, stream);
+    (*total_written) += length;
   } else if (info.precision is - 1) {
     int len = va_arg(*list, int);
     char* string = va_arg(*list, char*);
     outstream_put_slice(string, len, stream);
-    (*total_written) += len is 0 ? 0 : MIN((int)strlen(string), len);
+    (*total_written) += slice_strlen(string, len);
   } else {
     char* string = va_arg(*list, char*);
     outstream_puts(string, stream);
@@ -101,4 +101,9 @@ char* string_stream_collect(StringStream tthis) {
 
 str_t string_stream_to_str_t(StringStream tthis) {
   return str_raw_owned(string_stream_collect(tthis));
-}
\ No newline at end of file
+}
+
+void string_stream_truncate(StringStream* tthis, size_t length) {
+  assert_m(length <= tthis->length);
+  tthis->length = length;
+}
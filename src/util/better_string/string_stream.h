@@ -19,5 +19,7 @@ void string_stream_print(const StringStream* tthis, OutStream out);
 OutStream string_stream_stream(StringStream* tthis);
 char* string_stream_collect(StringStream tthis);
 str_t string_stream_to_str_t(StringStream tthis);
+// Drops what was written after the first `length` characters
+void string_stream_truncate(StringStream* tthis, size_t length);
 
 #endif  // BETTER_STRING_STRING_STREAM_H_
\ No newline at end of file
@@ -14,4 +14,9 @@
 #include "../util/vector.h"
 #undef VECTOR_ITEM_TYPE
 
+#define VECTOR_IMPLEMENTATION
+#define VECTOR_ITEM_TYPE int
+#include "../util/vector.h"
+#undef VECTOR_ITEM_TYPE
+
 //.
\ No newline at end of file
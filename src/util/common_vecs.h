@@ -17,4 +17,9 @@ typedef void* void_ptr;
 #include "../util/vector.h"
 #undef VECTOR_ITEM_TYPE
 
+// vec_int header + implementation
+#define VECTOR_ITEM_TYPE int
+#include "../util/vector.h"
+#undef VECTOR_ITEM_TYPE
+
 #endif  // SRC_UTIL_COMMON_VECS_H_
\ No newline at end of file
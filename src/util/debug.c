@@ -0,0 +1,13 @@
+#include "better_io.h"
+#include "prettify_c.h"
+
+// Kept apart from other.c, so that code without the UI (tests) links without
+// GL
+
+static int tabs = 0;
+
+void debug_push() { tabs++; }
+void debug_pop() { tabs--; }
+void debug_print_tabs() {
+  for (int i = 0; i < tabs; i++) x_sprintf(DEBUG_OUT, "|   ");
+}
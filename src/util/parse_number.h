@@ -0,0 +1,14 @@
+#ifndef SRC_UTIL_PARSE_NUMBER_H_
+#define SRC_UTIL_PARSE_NUMBER_H_
+
+// Decimal text to double, rounded to nearest like `strtod`, but without a
+// copy of the text and without locale.
+// Reads `digits[.digits][(e|E)[+|-]digits]`, where either side of the dot may
+// be empty but not both. There is no sign, hex, `inf` or `nan`: the caller
+// deals with those. Exponent without digits is not a part of the number, so
+// `2e` is `2` followed by `e`, as in `strtod`.
+// Sets `length` to the number of characters read, or 0 if the text does not
+// start with a number.
+double parse_double(const char* text, int* length);
+
+#endif  // SRC_UTIL_PARSE_NUMBER_H_
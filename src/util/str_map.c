@@ -0,0 +1,93 @@
+#include "str_map.h"
+
+#include <string.h>
+
+#include "allocator.h"
+#include "prettify_c.h"
+
+#define STR_MAP_MIN_CAPACITY 8
+
+StrMap str_map_create() {
+  return (StrMap){.entries = null, .capacity = 0, .length = 0};
+}
+
+void str_map_free(StrMap this) { FREE(this.entries); }
+
+void str_map_clear(StrMap* this) {
+  if (this->entries)
+    memset(this->entries, 0, sizeof(StrMapEntry) * this->capacity);
+  this->length = 0;
+}
+
+uint32_t str_map_hash(StrSlice key) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < key.length; i++) {
+    hash ^= (unsigned char)key.start[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Returns the slot with this key, or the empty slot where it should be put
+static StrMapEntry* str_map_find(const StrMap* this, StrSlice key,
+                                 uint32_t hash) {
+  uint32_t mask = (uint32_t)this->capacity - 1;
+
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    StrMapEntry* entry = &this->entries[i];
+
+    if (entry->key is null or
+        (entry->hash is hash and entry->key_length is key.length and
+         memcmp(entry->key, key.start, key.length) is 0))
+      return entry;
+  }
+}
+
+static void str_map_grow(StrMap* this) {
+  StrMap grown = {
+      .capacity = this->capacity > 0 ? this->capacity * 2
+                                     : STR_MAP_MIN_CAPACITY,
+      .length = this->length,
+  };
+  grown.entries = (StrMapEntry*)MALLOC(sizeof(StrMapEntry) * grown.capacity);
+  assert_alloc(grown.entries);
+  memset(grown.entries, 0, sizeof(StrMapEntry) * grown.capacity);
+
+  for (int i = 0; i < this->capacity; i++) {
+    StrMapEntry* entry = &this->entries[i];
+    if (entry->key is null) continue;
+
+    StrSlice key = {.start = entry->key, .length = entry->key_length};
+    *str_map_find(&grown, key, entry->hash) = *entry;
+  }
+
+  FREE(this->entries);
+  *this = grown;
+}
+
+bool str_map_insert(StrMap* this, StrSlice key, int value) {
+  assert_m(key.start);
+
+  // Keep load factor under 1/2, so probe sequences stay short
+  if ((this->length + 1) * 2 > this->capacity) str_map_grow(this);
+
+  uint32_t hash = str_map_hash(key);
+  StrMapEntry* entry = str_map_find(this, key, hash);
+  if (entry->key) return false;
+
+  *entry = (StrMapEntry){
+      .key = key.start,
+      .key_length = key.length,
+      .hash = hash,
+      .value = value,
+  };
+  this->length++;
+  return true;
+}
+
+int str_map_get(const StrMap* this, StrSlice key) {
+  if (this->length is 0) return -1;
+
+  StrMapEntry* entry = str_map_find(this, key, str_map_hash(key));
+  return entry->key ? entry->value : -1;
+}
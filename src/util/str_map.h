@@ -0,0 +1,37 @@
+#ifndef SRC_UTIL_STR_MAP_H_
+#define SRC_UTIL_STR_MAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "better_string.h"
+
+// Hash map from string to int index. Open addressing, FNV-1a hashes.
+// Keys are borrowed: map only stores pointers, and the caller has to keep
+// strings alive (and unchanged) while they are in the map.
+
+typedef struct StrMapEntry {
+  const char* key;  // null if the slot is empty
+  int key_length;
+  uint32_t hash;
+  int value;
+} StrMapEntry;
+
+typedef struct StrMap {
+  StrMapEntry* entries;
+  int capacity;  // Always 0 or a power of two
+  int length;
+} StrMap;
+
+StrMap str_map_create();
+void str_map_free(StrMap this);
+void str_map_clear(StrMap* this);
+
+// Does nothing and returns false if the key is already present
+bool str_map_insert(StrMap* this, StrSlice key, int value);
+// Returns -1 if there is no such key
+int str_map_get(const StrMap* this, StrSlice key);
+
+uint32_t str_map_hash(StrSlice key);
+
+#endif  // SRC_UTIL_STR_MAP_H_
@@ -0,0 +1,115 @@
+#include "symbol.h"
+
+#include <string.h>
+
+#include "allocator.h"
+#include "arena.h"
+#include "prettify_c.h"
+#include "str_map.h"
+
+#define SYMBOLS_MIN_CAPACITY 64
+
+#define VECTOR_C Symbol
+#include "vector.h"
+
+// Texts are put into the arena, so they never move and the index can borrow
+// them as keys
+typedef struct SymbolTable {
+  StrMap index;     // Name to id
+  StrSlice* names;  // By id, the first one is SYMBOL_NONE
+  int length;
+  int capacity;
+  Arena texts;
+} SymbolTable;
+
+static SymbolTable table = {0};
+
+static void symbols_grow();
+
+Symbol symbol_intern(StrSlice name) {
+  assert_m(name.start);
+
+  Symbol found = symbol_find(name);
+  if (found is_not SYMBOL_NONE) return found;
+
+  // Table outlives any arena that is bound right now
+  Arena* prev_arena = my_allocator_bind_arena(null);
+
+  if (table.length >= table.capacity) symbols_grow();
+
+  char* text = (char*)arena_alloc(&table.texts, name.length + 1);
+  memcpy(text, name.start, name.length);
+  text[name.length] = '\0';
+
+  Symbol result = table.length++;
+  table.names[result] = (StrSlice){.start = text, .length = name.length};
+  str_map_insert(&table.index, table.names[result], result);
+
+  my_allocator_bind_arena(prev_arena);
+  return result;
+}
+
+Symbol symbol_find(StrSlice name) {
+  int found = str_map_get(&table.index, name);
+  return found < 0 ? SYMBOL_NONE : found;
+}
+
+const char* symbol_name(Symbol this) { return symbol_slice(this).start; }
+
+StrSlice symbol_slice(Symbol this) {
+  assert_m(this > SYMBOL_NONE and this < table.length);
+  return table.names[this];
+}
+
+void symbols_free() {
+  str_map_free(table.index);
+  FREE(table.names);
+  arena_free(table.texts);
+  table = (SymbolTable){0};
+}
+
+static void symbols_grow() {
+  int capacity = table.capacity > 0 ? table.capacity * 2 : SYMBOLS_MIN_CAPACITY;
+  table.names = (StrSlice*)REALLOC(table.names, sizeof(StrSlice) * capacity);
+  assert_alloc(table.names);
+  table.capacity = capacity;
+
+  // Id 0 is taken, so that zeroed structs have no name
+  if (table.length is 0)
+    table.names[table.length++] = (StrSlice){.start = "", .length = 0};
+}
+
+// =====
+// =
+// = SymbolMap
+// =
+// =====
+SymbolMap symbol_map_create() { return (SymbolMap){0}; }
+
+void symbol_map_free(SymbolMap this) { FREE(this.values); }
+
+bool symbol_map_insert(SymbolMap* this, Symbol key, int value) {
+  assert_m(key > SYMBOL_NONE);
+  if (symbol_map_get(this, key) >= 0) return false;
+
+  if (key >= this->capacity) {
+    int capacity = this->capacity > 0 ? this->capacity : SYMBOLS_MIN_CAPACITY;
+    while (capacity <= key) capacity *= 2;
+
+    this->values = (int*)REALLOC(this->values, sizeof(int) * capacity);
+    assert_alloc(this->values);
+    for (int i = this->capacity; i < capacity; i++) this->values[i] = -1;
+    this->capacity = capacity;
+  }
+
+  this->values[key] = value;
+  return true;
+}
+
+int symbol_map_get(const SymbolMap* this, Symbol key) {
+  return key < this->capacity ? this->values[key] : -1;
+}
+
+void symbol_map_remove(SymbolMap* this, Symbol key) {
+  if (key < this->capacity) this->values[key] = -1;
+}
@@ -0,0 +1,48 @@
+#ifndef SRC_UTIL_SYMBOL_H_
+#define SRC_UTIL_SYMBOL_H_
+
+#include "better_string.h"
+
+// Interned names. Every distinct name gets a small id once, and the same name
+// always gives the same id, so names are stored without copies and compared
+// as numbers.
+// There is one table for the whole program, because expressions move freely
+// between contexts and backends. Names stay in it until `symbols_free`: there
+// are only as many of them as were ever typed.
+
+typedef int Symbol;
+
+#define SYMBOL_NONE 0  // No name, never returned by `symbol_intern`
+
+Symbol symbol_intern(StrSlice name);
+// Does not add the name, returns SYMBOL_NONE if it was never interned
+Symbol symbol_find(StrSlice name);
+
+const char* symbol_name(Symbol this);
+StrSlice symbol_slice(Symbol this);
+
+// Releases the table, so that it is not dumped as a leak at exit. Symbols
+// made before must not be used after it.
+void symbols_free();
+
+// ===== vec_Symbol
+#define VECTOR_H Symbol
+#include "vector.h"
+
+// Symbol to int index. Symbols are small and dense, so it is just an array by
+// id, and lookups do not hash anything.
+typedef struct SymbolMap {
+  int* values;  // -1 for no value
+  int capacity;
+} SymbolMap;
+
+SymbolMap symbol_map_create();
+void symbol_map_free(SymbolMap this);
+
+// Does nothing and returns false if the key is already present
+bool symbol_map_insert(SymbolMap* this, Symbol key, int value);
+// Returns -1 if there is no such key
+int symbol_map_get(const SymbolMap* this, Symbol key);
+void symbol_map_remove(SymbolMap* this, Symbol key);
+
+#endif  // SRC_UTIL_SYMBOL_H_